@@ -0,0 +1,46 @@
+"""
+Beacon v2 decoder for the ground station
+The STM32 beacons on the radio as COMM_SendBeacon in
+stm32-firmware/Core/Src/main.c packs it:
+AA 5D <uint64 status, LE> <CRC-16>
+"""
+import struct
+
+import telemetry_schema
+
+
+SYNC = 0xAA5D
+FRAME_SIZE = 12                 # COMM_BEACON_FRAME_SIZE
+
+# (name, first bit, width) of the status word, LSB first
+FIELDS = (
+    ('system_state', 0, 3),
+    ('battery', 3, 8),          # (mV - 2500) / 8
+    ('temperature', 11, 8),     # int8, 0.5 degC (TMP117)
+    ('error_flags', 19, 8),
+    ('radiation_cps', 27, 12),  # Saturates at 4095
+    ('boot_count', 39, 8),      # Low 8 bits
+    ('uptime_min', 47, 17),
+)
+
+
+def decode(frame):
+    """One beacon frame -> dict in telemetry units, None if sync, length or CRC is wrong"""
+    if len(frame) < FRAME_SIZE or struct.unpack_from('>H', frame)[0] != SYNC:
+        return None
+    if struct.unpack_from('<H', frame, 10)[0] != telemetry_schema.crc16(frame[:10]):
+        return None
+
+    status = struct.unpack_from('<Q', frame, 2)[0]
+    raw = {name: (status >> shift) & ((1 << width) - 1) for name, shift, width in FIELDS}
+    temperature = raw['temperature'] - 256 if raw['temperature'] & 0x80 else raw['temperature']
+
+    return {
+        'system_state': raw['system_state'],
+        'battery_voltage': raw['battery'] * 8 + 2500,   # mV, to -7 mV
+        'temperature_tmp': temperature / 2.0,           # degC
+        'error_flags': raw['error_flags'],
+        'radiation_cps': raw['radiation_cps'],
+        'boot_count': raw['boot_count'],
+        'uptime': raw['uptime_min'] * 60,               # s, to -59 s
+    }
@@ -31,6 +31,10 @@ import queue
 import hashlib
 from pathlib import Path
 import warnings
+
+import telemetry_schema
+import beacon_decoder
+from history_decoder import HistoryDecoder, DumpReceiver
 warnings.filterwarnings('ignore')
 
 # ==============================================================================
@@ -457,7 +461,8 @@ class Config:
     SYNC_COMMAND = 0xAA56
     SYNC_IMAGE = 0xAA58
     SYNC_FILE = 0xAA59
-    SYNC_BEACON = 0xAA5A
+    SYNC_BEACON = 0xAA5D         # Beacon v2, see beacon_decoder.py
+    SYNC_HISTORY = 0xAA62
     
     # Commands
     CMD_PING = 0x01
@@ -474,6 +479,10 @@ class Config:
     CMD_CALIBRATE = 0x0C
     CMD_GET_LOGS = 0x0D
     CMD_CLEAR_LOGS = 0x0E
+    CMD_FILE_ACK = 0x10         # Binary, <file_id> <first_chunk> <bitmap>, for the Pi
+    CMD_GET_HISTORY = 0x11      # Binary, <first_seq> <last_seq>, for the STM32
+    CMD_DUMP_HISTORY = 0x12     # Binary, <first_seq> <last_seq> [<window>], for the STM32
+    CMD_DUMP_ACK = 0x13         # Binary, <session> <base> <bitmap>, for the STM32
     
     # Modes
     MODES = {
@@ -521,6 +530,7 @@ class Config:
     TELEMETRY_DIR = MISSION_DATA_DIR / 'telemetry'
     IMAGES_DIR = MISSION_DATA_DIR / 'images'
     LOGS_DIR = MISSION_DATA_DIR / 'logs'
+    FILES_DIR = MISSION_DATA_DIR / 'files'
 
 # ==============================================================================
 # TELEMETRY DATA CLASS
@@ -684,28 +694,38 @@ class TelemetryData:
         }
     
     def from_packet(self, data):
-        """Parse from binary packet"""
+        """Parse from binary packet (TelemetryPacket_t, see telemetry_schema.py)"""
         try:
-            if len(data) >= 41 and data[0] == 0xAA and data[1] == 0x55:
-                self.sequence = struct.unpack('<H', data[3:5])[0]
-                self.mission_time = struct.unpack('<I', data[5:9])[0] / 1000.0
+            fields = telemetry_schema.decode(data)
+            if fields is not None:
+                self.sequence = fields['sequence_number']
+                self.mission_time = fields['timestamp'] / 1000.0
                 
                 # Parse sensor data
-                self.mag_x = struct.unpack('<f', data[9:13])[0]
-                self.mag_y = struct.unpack('<f', data[13:17])[0]
-                self.mag_z = struct.unpack('<f', data[17:21])[0]
-                self.corrosion_raw = struct.unpack('<H', data[21:23])[0]
-                self.radiation_cps = struct.unpack('<I', data[23:27])[0]
-                self.temperature_bme = struct.unpack('<f', data[27:31])[0]
-                self.pressure = struct.unpack('<f', data[31:35])[0]
-                self.humidity = struct.unpack('<f', data[35:39])[0]
-                self.battery_voltage = struct.unpack('<H', data[39:41])[0] / 1000.0
+                self.mag_x = fields['mag_x']
+                self.mag_y = fields['mag_y']
+                self.mag_z = fields['mag_z']
+                self.corrosion_raw = fields['corrosion_raw']
+                self.radiation_cps = fields['radiation_cps']
+                self.temperature_bme = fields['temperature_bme']
+                self.temperature_tmp = fields['temperature_tmp']
+                self.pressure = fields['pressure']
+                self.humidity = fields['humidity']
+                
+                # GPS
+                self.latitude = fields['latitude'] / 1e7
+                self.longitude = fields['longitude'] / 1e7
+                self.gps_altitude = fields['altitude'] / 1000.0
+                self.gps_quality = fields['gps_quality']
+                self.gps_satellites = fields['gps_satellites']
                 
-                # Parse extended data if available
-                if len(data) >= 53:
-                    self.latitude = struct.unpack('<i', data[41:45])[0] / 1e7
-                    self.longitude = struct.unpack('<i', data[45:49])[0] / 1e7
-                    self.gps_altitude = struct.unpack('<i', data[49:53])[0] / 1000.0
+                # System status
+                self.battery_voltage = fields['battery_voltage'] / 1000.0
+                self.battery_current = fields['battery_current']
+                self.boot_count = fields['boot_count']
+                self.error_flags = fields['error_flags']
+                self.system_state = fields['system_state']
+                self.uptime = fields['uptime']
                 
                 # Calculate derived values
                 self.mag_strength = np.sqrt(
@@ -721,7 +741,6 @@ class TelemetryData:
                 self.battery_level = max(0, min(100, self.battery_level))
                 self.power_consumption = self.battery_voltage * self.battery_current / 1000
                 
-                self.temperature_tmp = self.temperature_bme + 0.2
                 self.peak_flux = max(self.peak_flux, self.radiation_cps)
                 
                 self.timestamp = time.time()
@@ -820,6 +839,124 @@ class PreviewGenerator:
         self.packet_count += 1
         return t
 
+# ==============================================================================
+# FILE RECEIVER
+# ==============================================================================
+
+def crc32_mpeg2(data):
+    """CRC-32/MPEG-2 (poly 0x04C11DB7, init 0xFFFFFFFF), as the STM32 CRC unit"""
+    crc = 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte << 24
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else (crc << 1)
+        crc &= 0xFFFFFFFF
+    return crc
+
+class FileReceiver:
+    """Selective-repeat reassembly of image/file downlinks
+    
+    Chunk frame (raspberry-pi-code/file_downlink.py):
+    AA 58|59 <uint16 file_id> <uint16 chunk> <uint16 chunk_count> <uint16 length> <data> <CRC-32>
+    
+    Chunks failing the CRC are dropped. When a round ends (nothing missing
+    past the chunk just received), when a transfer stalls and when it
+    completes, the ground answers with FILE_ACK bitmaps
+    <uint16 file_id> <uint16 first_chunk> <bitmap, LSB first>; the Pi then
+    resends only what is still missing.
+    """
+    
+    HEADER = struct.Struct('<HHHH')
+    HEADER_SIZE = 10            # Sync and HEADER
+    MAX_CHUNK_DATA = 256        # COMM_MAX_CHUNK_DATA in the STM32 firmware
+    ACK_WINDOW = 256            # Chunks per FILE_ACK, a 32-byte bitmap
+    ACK_IDLE = 5.0              # Seconds without a chunk before acking anyway
+    DONE_HOLD = 600.0           # Seconds a finished file is re-acked for
+    
+    def __init__(self):
+        self.transfers = {}     # file_id -> chunks so far
+        self.done = {}          # file_id -> finished file, in case the final ACK is lost
+        self.crc_errors = 0
+    
+    def parse(self, data):
+        """Chunk frame -> (file_id, chunk, chunk_count, payload), None if malformed"""
+        if len(data) < self.HEADER_SIZE + 4:
+            return None
+        file_id, chunk, chunk_count, length = self.HEADER.unpack_from(data, 2)
+        end = self.HEADER_SIZE + length
+        if length > self.MAX_CHUNK_DATA or len(data) < end + 4 or chunk >= chunk_count:
+            return None
+        if struct.unpack_from('<I', data, end)[0] != crc32_mpeg2(data[:end]):
+            self.crc_errors += 1
+            return None
+        return file_id, chunk, chunk_count, bytes(data[self.HEADER_SIZE:end])
+    
+    def add(self, kind, data):
+        """One chunk frame -> (kind, file_id, contents) when it completes a file"""
+        parsed = self.parse(data)
+        if parsed is None:
+            return None
+        file_id, chunk, chunk_count, payload = parsed
+        now = time.time()
+        
+        done = self.done.get(file_id)
+        if done and done['chunk_count'] == chunk_count:
+            # Still coming: the Pi missed the final ACK
+            done['last_chunk'] = now
+            return None
+        
+        t = self.transfers.get(file_id)
+        if t is None or t['chunk_count'] != chunk_count:
+            t = {'kind': kind, 'chunk_count': chunk_count, 'chunks': {},
+                 'last_chunk': now, 'acked': 0, 'ack_due': False}
+            self.transfers[file_id] = t
+        t['chunks'][chunk] = payload
+        t['last_chunk'] = now
+        
+        if len(t['chunks']) == chunk_count:
+            del self.transfers[file_id]
+            self.done[file_id] = {'chunk_count': chunk_count, 'finished': now,
+                                  'last_chunk': now, 'acked': 0}
+            return kind, file_id, b''.join(t['chunks'][c] for c in range(chunk_count))
+        
+        if all(c in t['chunks'] for c in range(chunk + 1, chunk_count)):
+            t['ack_due'] = True
+        return None
+    
+    def ack_params(self, file_id, chunk_count, received):
+        """FILE_ACK parameters, one per ACK_WINDOW chunks that has any received"""
+        acks = []
+        for base in range(0, chunk_count, self.ACK_WINDOW):
+            span = min(self.ACK_WINDOW, chunk_count - base)
+            bitmap = bytearray((span + 7) // 8)
+            for i in range(span):
+                if received(base + i):
+                    bitmap[i // 8] |= 1 << (i % 8)
+            if any(bitmap):
+                acks.append(struct.pack('<HH', file_id, base) + bytes(bitmap))
+        return acks
+    
+    def service(self):
+        """FILE_ACK parameters due now, for send_command(CMD_FILE_ACK, ...)"""
+        now = time.time()
+        acks = []
+        
+        for file_id, t in self.transfers.items():
+            stalled = now - t['last_chunk'] > self.ACK_IDLE and t['acked'] < t['last_chunk']
+            if t['ack_due'] or stalled:
+                acks.extend(self.ack_params(file_id, t['chunk_count'], t['chunks'].__contains__))
+                t['ack_due'] = False
+                t['acked'] = now
+        
+        for file_id, done in list(self.done.items()):
+            if done['acked'] < done['last_chunk'] and now - done['acked'] > self.ACK_IDLE:
+                acks.extend(self.ack_params(file_id, done['chunk_count'], lambda c: True))
+                done['acked'] = now
+            elif now - done['finished'] > self.DONE_HOLD:
+                del self.done[file_id]
+        
+        return acks
+
 # ==============================================================================
 # COMMUNICATION HANDLER
 # ==============================================================================
@@ -833,6 +970,9 @@ class CommunicationHandler:
         self.running = False
         self.thread = None
         self.receive_queue = queue.Queue()
+        self.files = FileReceiver()
+        self.history = HistoryDecoder()
+        self.dumps = DumpReceiver()
         
         self.satellite_ip = Config.SATELLITE_IP
         self.satellite_port = Config.SATELLITE_PORT
@@ -885,10 +1025,12 @@ class CommunicationHandler:
                     self.satellite_ip = addr[0]
                 
                 self._process_packet(data)
+                self._send_file_acks()
                 
             except socket.timeout:
                 if self.connected and time.time() - self.last_activity > 10:
                     self.connected = False
+                self._send_file_acks()
             except Exception as e:
                 print(f"Communication error: {e}")
     
@@ -897,31 +1039,75 @@ class CommunicationHandler:
         if len(data) < 2:
             return
         
-        sync = struct.unpack('<H', data[0:2])[0]
+        sync = struct.unpack('>H', data[0:2])[0]  # 0xAA first on the wire
         
         if sync == Config.SYNC_TELEMETRY:
-            self.receive_queue.put(('telemetry', data))
-        elif sync == Config.SYNC_IMAGE:
-            self.receive_queue.put(('image', data))
-        elif sync == Config.SYNC_FILE:
-            self.receive_queue.put(('file', data))
+            if len(data) > telemetry_schema.FRAME_SIZE:
+                # Backfill burst - queue every frame that checks out,
+                # resyncing a byte on after a bad one
+                i = 0
+                while i + telemetry_schema.FRAME_SIZE <= len(data):
+                    frame = data[i:i + telemetry_schema.FRAME_SIZE]
+                    if telemetry_schema.decode(frame) is not None:
+                        self.receive_queue.put(('telemetry', frame))
+                        i += telemetry_schema.FRAME_SIZE
+                    else:
+                        i += 1
+            else:
+                self.receive_queue.put(('telemetry', data))
+        elif sync in (Config.SYNC_IMAGE, Config.SYNC_FILE):
+            # Chunks are reassembled here, only whole files are queued
+            complete = self.files.add('image' if sync == Config.SYNC_IMAGE else 'file', data)
+            if complete:
+                kind, file_id, contents = complete
+                self.receive_queue.put((kind, (file_id, contents)))
         elif sync == Config.SYNC_BEACON:
-            self.receive_queue.put(('beacon', data))
+            beacon = beacon_decoder.decode(data)
+            if beacon:
+                self.receive_queue.put(('beacon', beacon))
+        elif sync == Config.SYNC_HISTORY:
+            decoded = self.history.decode(data)
+            if decoded:
+                session, number, flags, frames = decoded
+                if session == 0:
+                    # GET_HISTORY: sent once, nothing to acknowledge
+                    self.receive_queue.put(('history', decoded))
+                    if flags & HistoryDecoder.FLAG_LAST:
+                        self.receive_queue.put(('history_done', session))
+                    return
+                
+                was_complete = self.dumps.complete
+                is_new, ack = self.dumps.add(session, number, flags)
+                if ack:
+                    self.send_command(Config.CMD_DUMP_ACK, ack)
+                if is_new:
+                    self.receive_queue.put(('history', decoded))
+                if self.dumps.complete and not was_complete:
+                    self.receive_queue.put(('history_done', session))
+    
+    def _send_file_acks(self):
+        """Report received chunks to the Pi"""
+        for params in self.files.service():
+            self.send_command(Config.CMD_FILE_ACK, params)
     
     def send_command(self, command_id, params=None):
-        """Send command to satellite"""
+        """Send command to satellite; bytes params go out as they are, others as JSON"""
         if not self.connected:
             return False
         
         try:
             # Build command packet
             packet = bytearray()
-            packet.extend(struct.pack('<H', Config.SYNC_COMMAND))
+            packet.extend(struct.pack('>H', Config.SYNC_COMMAND))  # 0xAA first
             packet.append(command_id)
             packet.extend(struct.pack('<H', self.packets_sent))
             
+            if command_id == Config.CMD_DUMP_HISTORY:
+                # The STM32 uses the sequence number as the dump's session
+                self.dumps.start(self.packets_sent)
+            
             if params:
-                param_bytes = json.dumps(params).encode()
+                param_bytes = bytes(params) if isinstance(params, (bytes, bytearray)) else json.dumps(params).encode()
                 packet.extend(struct.pack('<H', len(param_bytes)))
                 packet.extend(param_bytes)
             else:
@@ -970,8 +1156,9 @@ class DataManager:
         self.telemetry_dir = Config.TELEMETRY_DIR
         self.images_dir = Config.IMAGES_DIR
         self.logs_dir = Config.LOGS_DIR
+        self.files_dir = Config.FILES_DIR
         
-        for dir_path in [self.base_dir, self.telemetry_dir, self.images_dir, self.logs_dir]:
+        for dir_path in [self.base_dir, self.telemetry_dir, self.images_dir, self.logs_dir, self.files_dir]:
             dir_path.mkdir(parents=True, exist_ok=True)
         
         # Current session
@@ -1086,6 +1273,20 @@ class DataManager:
             print(f"Error saving image: {e}")
             return None
     
+    def save_file(self, file_data, file_id):
+        """Save a downlinked file to Downloads folder"""
+        try:
+            timestamp = datetime.now().strftime('%Y%m%d_%H%M%S')
+            filename = self.files_dir / f"file_{file_id}_{timestamp}.bin"
+            
+            with open(filename, 'wb') as f:
+                f.write(file_data)
+            return str(filename)
+            
+        except Exception as e:
+            print(f"Error saving file: {e}")
+            return None
+    
     def generate_test_image(self):
         """Generate a test image for preview mode"""
         # Create a simple test image (colored gradient)
@@ -1229,6 +1430,7 @@ def init_session_state():
         st.session_state.start_time = time.time()
         st.session_state.has_data = True  # Preview mode has data immediately
         st.session_state.last_saved_image = None
+        st.session_state.last_beacon = None
         
         # Graph data with timestamps
         st.session_state.time_stamps = deque(maxlen=Config.GRAPH_POINTS)
@@ -2194,6 +2396,22 @@ def render_command_center():
             with cols[3]:
                 if st.button("🔄 RESET", key="cmd_reset", use_container_width=True, disabled=cmd_disabled):
                     send_command(Config.CMD_RESET, "Reset commanded")
+        
+        with st.expander("🗂️ History Backfill"):
+            cols = st.columns(4)
+            with cols[0]:
+                first_seq = st.number_input("First sequence", 0, 65535, 0, key="hist_first")
+            with cols[1]:
+                last_seq = st.number_input("Last sequence", 0, 65535, 65535, key="hist_last")
+            with cols[2]:
+                if st.button("🗂️ GET HISTORY", key="cmd_get_history", use_container_width=True, disabled=cmd_disabled):
+                    send_command(Config.CMD_GET_HISTORY, f"History {first_seq}-{last_seq} requested",
+                                 struct.pack('<HH', int(first_seq), int(last_seq)))
+            with cols[3]:
+                if st.button("📥 DUMP HISTORY", key="cmd_dump_history", use_container_width=True, disabled=cmd_disabled):
+                    # Windowed, only lost frames are sent again
+                    send_command(Config.CMD_DUMP_HISTORY, f"History dump {first_seq}-{last_seq} started",
+                                 struct.pack('<HHB', int(first_seq), int(last_seq), 8))
     
     with col2:
         st.markdown("### 📋 Command Log")
@@ -2680,11 +2898,16 @@ def update_data():
                                             st.session_state.data_manager.save_telemetry(new_data)
                                     
                                     elif pkt_type == 'beacon':
-                                        add_log("Beacon received from satellite", "info")
+                                        st.session_state.last_beacon = data
+                                        add_log(f"Beacon: {Config.MODES.get(data['system_state'], 'UNKNOWN')}, "
+                                                f"{data['battery_voltage'] / 1000.0:.2f} V, {data['temperature_tmp']:.1f} °C, "
+                                                f"{data['radiation_cps']} cps, errors 0x{data['error_flags']:02X}, "
+                                                f"boot {data['boot_count']}, up {data['uptime'] // 60} min", "info")
                                     
                                     elif pkt_type == 'image':
-                                        # Save the actual image data
-                                        filename = st.session_state.data_manager.save_image(data[4:])  # Skip header
+                                        # Whole image, reassembled and CRC checked
+                                        file_id, contents = data
+                                        filename = st.session_state.data_manager.save_image(contents)
                                         if filename:
                                             st.session_state.images_received += 1
                                             st.session_state.last_saved_image = filename
@@ -2692,6 +2915,24 @@ def update_data():
                                             st.session_state.success_message = f"📸 Image saved to {filename}"
                                             add_log(f"Image data received and saved to {filename}", "success")
                                     
+                                    elif pkt_type == 'file':
+                                        file_id, contents = data
+                                        filename = st.session_state.data_manager.save_file(contents, file_id)
+                                        if filename:
+                                            add_log(f"File {file_id} received and saved to {filename}", "success")
+                                    
+                                    elif pkt_type == 'history':
+                                        # Records logged in the STM32's flash: saved, not shown as current
+                                        session, number, flags, frames = data
+                                        for frame in frames:
+                                            record = TelemetryData()
+                                            if record.from_packet(frame):
+                                                st.session_state.data_manager.save_telemetry(record)
+                                        add_log(f"History frame {number}: {len(frames)} records saved", "info")
+                                    
+                                    elif pkt_type == 'history_done':
+                                        add_log(f"History backfill complete (session {data})", "success")
+                                    
                                     packets_processed += 1
                                 
                                 # Check if we've lost connection (no data for a while)
@@ -0,0 +1,235 @@
+"""
+History backfill decoder for the ground station
+Unpacks the STM32's logged telemetry (CMD_GET_HISTORY / CMD_DUMP_HISTORY)
+into TelemetryPacket_t frames, bit for bit as HIST_Decode in
+stm32-firmware/Core/Src/history.c rebuilds them, and acknowledges the
+frames of a windowed dump with CMD_DUMP_ACK.
+"""
+import math
+import struct
+
+import telemetry_schema
+
+
+def _f32(value):
+    """Round to float32, as the firmware's float arithmetic does"""
+    try:
+        return struct.unpack('<f', struct.pack('<f', value))[0]
+    except OverflowError:
+        return float('inf') if value > 0 else float('-inf')
+
+
+class HistoryDecoder:
+    """Logged telemetry backfilled from the STM32's flash
+    
+    History frame (stm32-firmware/Core/Inc/dump.h):
+    AA 62 <uint16 session> <uint16 frame> <uint8 flags> <uint16 length> <records> <CRC-16>
+    
+    Records are [length] [payload] [CRC-16], each payload a delta against
+    the record before it in the frame (history.c); every frame starts on a
+    keyframe, so frames decode on their own and in any order. The payload
+    is a varint field mask, the radiation bins when mask bit 0 is set,
+    then a zigzag varint residual per set field bit.
+    """
+    
+    HEADER = struct.Struct('<HHBH')
+    HEADER_SIZE = 9             # Sync and HEADER
+    FRAME_DATA = 240            # DUMP_FRAME_DATA
+    FLAG_LAST = 0x01
+    PERIOD_MS = 1000            # HIST_PERIOD_MS
+    BINS = 10                   # TLM_RADIATION_BINS
+    
+    # (field, struct format, step, scale) in field mask order, as hist_fields[]
+    FIELDS = (
+        ('timestamp', 'I', PERIOD_MS, 0),
+        ('mag_x', 'f', 0, 6250.0),
+        ('mag_y', 'f', 0, 6250.0),
+        ('mag_z', 'f', 0, 6250.0),
+        ('temperature_bme', 'f', 0, 100.0),
+        ('pressure', 'f', 0, 100.0),
+        ('humidity', 'f', 0, 100.0),
+        ('temperature_tmp', 'f', 0, 128.0),
+        ('radiation_cps', 'I', 0, 0),
+        ('corrosion_raw', 'H', 0, 0),
+        ('battery_voltage', 'H', 0, 0),
+        ('battery_current', 'H', 0, 0),
+        ('uptime', 'I', 0, 0),
+        ('sequence_number', 'H', 1, 0),
+        ('latitude', 'i', 0, 0),
+        ('longitude', 'i', 0, 0),
+        ('altitude', 'i', 0, 0),
+        ('gps_quality', 'B', 0, 0),
+        ('gps_satellites', 'B', 0, 0),
+        ('boot_count', 'B', 0, 0),
+        ('error_flags', 'B', 0, 0),
+        ('system_state', 'B', 0, 0),
+    )
+    MASK_BINS = 0x01
+    MASK_KEYFRAME = 1 << (len(FIELDS) + 1)
+    
+    def __init__(self):
+        self.crc_errors = 0
+        self.bad_records = 0
+    
+    @staticmethod
+    def _varint(payload, pos):
+        value = shift = 0
+        while pos < len(payload) and shift < 35:
+            byte = payload[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            if not byte & 0x80:
+                return value & 0xFFFFFFFF, pos
+            shift += 7
+        raise ValueError("truncated varint")
+    
+    @staticmethod
+    def _get(packet, name, kind, scale):
+        """HIST_Get: the field as the codec's uint32"""
+        value = packet[name]
+        if kind == 'f':
+            value = _f32(value * scale)
+            if not -1e9 < value < 1e9:
+                return 0
+            value = int(math.floor(abs(value) + 0.5)) * (1 if value >= 0 else -1)  # lroundf
+        return value & 0xFFFFFFFF
+    
+    @staticmethod
+    def _set(packet, name, kind, scale, value):
+        """HIST_Set: a uint32 back into the field's C type"""
+        signed = value - (1 << 32) if value & 0x80000000 else value
+        if kind == 'f':
+            packet[name] = _f32(_f32(signed) / scale)
+        elif kind == 'i':
+            packet[name] = signed
+        else:
+            packet[name] = value & ((1 << (8 * struct.calcsize(kind))) - 1)
+    
+    def decode_record(self, payload, prev):
+        """HIST_Decode: one record payload -> field dict, prev None for none"""
+        mask, pos = self._varint(payload, 0)
+        keyframe = bool(mask & self.MASK_KEYFRAME)
+        if not keyframe and prev is None:
+            raise ValueError("delta record without a keyframe")
+        
+        bins = [0] * self.BINS
+        if mask & self.MASK_BINS:
+            width = payload[pos] if pos < len(payload) else 0xFF
+            if width > 16:
+                raise ValueError("bad bin width")
+            pos += 1
+            acc = bits = 0
+            for i in range(self.BINS):
+                while bits < width:
+                    if pos >= len(payload):
+                        raise ValueError("truncated bins")
+                    acc |= payload[pos] << bits
+                    pos += 1
+                    bits += 8
+                bins[i] = acc & ((1 << width) - 1)
+                acc >>= width
+                bits -= width
+        
+        packet = {'radiation_hist': bins}
+        for i, (name, kind, step, scale) in enumerate(self.FIELDS):
+            predicted = 0 if keyframe else (self._get(prev, name, kind, scale) + step)
+            value = 0
+            if mask & (1 << (i + 1)):
+                value, pos = self._varint(payload, pos)
+            residual = (value >> 1) ^ -(value & 1)
+            self._set(packet, name, kind, scale, (predicted + residual) & 0xFFFFFFFF)
+        if pos != len(payload):
+            raise ValueError("trailing bytes")
+        return packet
+    
+    def pack(self, packet):
+        """Field dict -> TelemetryPacket_t frame, as HIST_Decode fills it in"""
+        fields = dict(packet, sync1=0xAA, sync2=0x55, packet_type=0x01, checksum=0)
+        flat = []
+        for name, _, count, _ in telemetry_schema.FIELDS:
+            flat.extend(fields[name] if count > 1 else [fields[name]])
+        frame = telemetry_schema.STRUCT.pack(*flat)
+        return frame[:-2] + struct.pack('<H', telemetry_schema.crc16(frame[:-2]))
+    
+    def decode(self, data):
+        """History frame -> (session, frame, flags, [TelemetryPacket_t frames]),
+        None if the frame is malformed or fails its CRC. Decoding stops at
+        the first bad record; the ones before it are still returned."""
+        if len(data) < self.HEADER_SIZE + 2:
+            return None
+        session, number, flags, length = self.HEADER.unpack_from(data, 2)
+        end = self.HEADER_SIZE + length
+        if length > self.FRAME_DATA or len(data) < end + 2:
+            return None
+        if struct.unpack_from('<H', data, end)[0] != telemetry_schema.crc16(data[:end]):
+            self.crc_errors += 1
+            return None
+        
+        frames = []
+        prev = None
+        pos = self.HEADER_SIZE
+        while pos < end:
+            size = data[pos]
+            stop = pos + 1 + size
+            try:
+                if stop + 2 > end or struct.unpack_from('<H', data, stop)[0] != telemetry_schema.crc16(data[pos:stop]):
+                    raise ValueError("record CRC")
+                prev = self.decode_record(data[pos + 1:stop], prev)
+            except (ValueError, IndexError):
+                self.bad_records += 1
+                break
+            frames.append(self.pack(prev))
+            pos = stop + 2
+        return session, number, flags, frames
+
+
+class DumpReceiver:
+    """Ground side of the CMD_DUMP_HISTORY selective repeat (dump.c)
+    
+    The STM32 numbers the frames of a dump from 0 and uses the command's
+    sequence number as session. Every frame of the current session that
+    arrives, new or repeated, is answered with DUMP_ACK parameters
+    <uint16 session> <uint16 base> <uint32 bitmap>: all frames below base,
+    plus frame base + i for each set bit i, have arrived. Only new frames
+    are passed on, so resends never save a record twice.
+    """
+    
+    ACK = struct.Struct('<HHI')
+    BITMAP_BITS = 32
+    
+    def __init__(self):
+        self.session = None
+        self.received = set()
+        self.base = 0               # First frame not received yet
+        self.last = None            # Number of the LAST-flagged frame
+        self.complete = False
+    
+    def start(self, session):
+        """A CMD_DUMP_HISTORY with this sequence number is going out"""
+        self.session = session & 0xFFFF
+        self.received = set()
+        self.base = 0
+        self.last = None
+        self.complete = False
+    
+    def add(self, session, number, flags):
+        """A frame arrived -> (is_new, DUMP_ACK parameters), (False, None)
+        for a session other than the current one"""
+        if session != self.session:
+            return False, None
+        
+        is_new = number not in self.received and number >= self.base
+        self.received.add(number)
+        if flags & HistoryDecoder.FLAG_LAST:
+            self.last = number
+        while self.base in self.received:
+            self.received.discard(self.base)
+            self.base += 1
+        
+        bitmap = 0
+        for i in range(self.BITMAP_BITS):
+            if (self.base + i) in self.received:
+                bitmap |= 1 << i
+        if self.last is not None and self.base > self.last:
+            self.complete = True
+        return is_new, self.ACK.pack(self.session, self.base & 0xFFFF, bitmap)
@@ -0,0 +1,80 @@
+"""
+Telemetry packet schema - TelemetryPacket_t from stm32-firmware/Core/Inc/main.h
+
+GENERATED by stm32-firmware/tlm_schema.py, do not edit. decode() reads one
+frame with a single precompiled unpack.
+"""
+import struct
+
+SYNC = 0xAA55
+FRAME_SIZE = 90
+
+# (name, struct format, count, unit / meaning) in wire order
+FIELDS = (
+    ('sync1', 'B', 1, '0xAA'),
+    ('sync2', 'B', 1, '0x55'),
+    ('packet_type', 'B', 1, '0x01 = telemetry'),
+    ('sequence_number', 'H', 1, ''),
+    ('timestamp', 'I', 1, ''),
+    ('mag_x', 'f', 1, 'Gauss'),
+    ('mag_y', 'f', 1, ''),
+    ('mag_z', 'f', 1, ''),
+    ('corrosion_raw', 'H', 1, 'ADC value'),
+    ('radiation_cps', 'I', 1, 'Counts per second, dead-time corrected'),
+    ('temperature_bme', 'f', 1, '°C'),
+    ('pressure', 'f', 1, 'hPa'),
+    ('humidity', 'f', 1, '%RH'),
+    ('temperature_tmp', 'f', 1, '°C (precision)'),
+    ('latitude', 'i', 1, '1e7 degrees'),
+    ('longitude', 'i', 1, '1e7 degrees'),
+    ('altitude', 'i', 1, 'mm'),
+    ('gps_quality', 'B', 1, ''),
+    ('gps_satellites', 'B', 1, ''),
+    ('battery_voltage', 'H', 1, 'mV'),
+    ('battery_current', 'H', 1, 'mA drawn, 0 while charging'),
+    ('boot_count', 'B', 1, ''),
+    ('error_flags', 'B', 1, ''),
+    ('system_state', 'B', 1, ''),
+    ('uptime', 'I', 1, 'seconds'),
+    ('radiation_hist', 'H', 10, 'Raw counts per 100 ms, oldest first'),
+    ('checksum', 'H', 1, 'CRC-16/CCITT-FALSE'),
+)
+
+FORMAT = '<BBBHIfffHIffffiiiBBHHBBBI10HH'
+STRUCT = struct.Struct(FORMAT)
+assert STRUCT.size == FRAME_SIZE
+
+
+def _crc16_table():
+    table = []
+    for i in range(256):
+        crc = i << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+        table.append(crc & 0xFFFF)
+    return table
+
+_CRC16_TABLE = _crc16_table()
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as CRC16_Calculate in the firmware"""
+    crc = 0xFFFF
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ _CRC16_TABLE[((crc >> 8) ^ b) & 0xFF]
+    return crc
+
+
+def decode(frame, check=True):
+    """One frame -> dict of fields by C name, None if sync, length or CRC is wrong"""
+    if len(frame) < FRAME_SIZE or frame[0] != 0xAA or frame[1] != 0x55:
+        return None
+    values = STRUCT.unpack_from(frame)
+    if check and values[-1] != crc16(frame[:FRAME_SIZE - 2]):
+        return None
+    fields = {}
+    i = 0
+    for name, _, count, _ in FIELDS:
+        fields[name] = values[i] if count == 1 else list(values[i:i + count])
+        i += count
+    return fields
@@ -13,6 +13,38 @@ import threading
 import queue
 from typing import Optional, Dict, Any
 
+import telemetry_schema
+
+
+def _crc_table(poly, width):
+    """MSB-first CRC lookup table"""
+    top = 1 << (width - 1)
+    mask = (1 << width) - 1
+    table = []
+    for i in range(256):
+        crc = i << (width - 8)
+        for _ in range(8):
+            crc = ((crc << 1) ^ poly) if crc & top else (crc << 1)
+        table.append(crc & mask)
+    return table
+
+_CRC16_TABLE = _crc_table(0x1021, 16)
+_CRC32_TABLE = _crc_table(0x04C11DB7, 32)
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, matches CRC16_Calculate in the STM32 firmware"""
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ _CRC16_TABLE[((crc >> 8) ^ b) & 0xFF]
+    return crc
+
+
+def crc32_mpeg2(data, crc=0xFFFFFFFF):
+    """CRC-32/MPEG-2, matches CRC32_Calculate (STM32F4 CRC unit)"""
+    for b in data:
+        crc = ((crc << 8) & 0xFFFFFFFF) ^ _CRC32_TABLE[((crc >> 24) ^ b) & 0xFF]
+    return crc
+
 class CommunicationHandler:
     """Handles all communication interfaces"""
     
@@ -33,6 +65,61 @@ class CommunicationHandler:
         self.SYNC_COMMAND = 0xAA56
         self.SYNC_IMAGE = 0xAA58
         self.SYNC_FILE = 0xAA59
+        self.SYNC_COMMAND_V2 = 0xAA5B
+        self.SYNC_BRIDGE = 0xAA5C
+        
+        # Command framing: v1 pads parameters to 64 bytes, v2 sends only
+        # parameter_length bytes. Start with v1 (understood by every
+        # firmware) and upgrade once a PING reply advertises v2.
+        self.PROTOCOL_VERSION = 2
+        self.CMD_HEADER_SIZE = 7
+        self.CMD_MAX_PARAMETERS = 64
+        self.CMD_PING = 0x01
+        self.stm32_protocol = 1
+        
+        # Bridge mode: the STM32 forwards everything we send to the radio
+        # and reports progress in credit frames; at most bridge_window
+        # bytes may be outstanding
+        self.CMD_BRIDGE = 0x14
+        self.bridge_cond = threading.Condition()
+        self.bridge_active = False
+        self.bridge_sent = 0
+        self.bridge_forwarded = 0
+        self.bridge_window = 0
+        
+        # Firmware update: image chunks are programmed into the STM32's
+        # update slot, status frames report what it has (fwupdate.h)
+        self.SYNC_FIRMWARE = 0xAA5F
+        self.SYNC_FW_STATUS = 0xAA60
+        self.CMD_UPDATE_FIRMWARE = 0x07
+        self.FWU_CHUNK_SIZE = 256
+        self.FWU_STATE_PREPARING = 1
+        self.FWU_STATE_RECEIVING = 2
+        self.FWU_STATE_COMPLETE = 3
+        self.FWU_STATE_PENDING = 4
+        self.fw_cond = threading.Condition()
+        self.fw_status = None
+        
+        # Command schedule: stored v2 frames run at an STM32 mission
+        # time, ms since its boot (scheduler.h)
+        self.SYNC_SCHED_STATUS = 0xAA61
+        self.CMD_SET_SCHEDULE = 0x08
+        self.sched_cond = threading.Condition()
+        self.sched_status = None
+        
+        # History backfill: the STM32 sends logged telemetry as history
+        # frames for the ground (dump.h); we pass them on unchanged
+        self.SYNC_HISTORY = 0xAA62
+        self.HISTORY_HEADER_SIZE = 9
+        self.HISTORY_FRAME_DATA = 240
+        self.CMD_GET_HISTORY = 0x11
+        self.CMD_DUMP_HISTORY = 0x12
+        self.CMD_DUMP_ACK = 0x13
+        self.STM32_COMMANDS = (self.CMD_GET_HISTORY, self.CMD_DUMP_HISTORY, self.CMD_DUMP_ACK)
+        
+        # Frames cut off at the end of a read wait here for the rest
+        self.stm32_rx = b''
+        self.RX_TAIL_MAX = 1024
         
         # Initialize ports
         self.init_serial_ports()
@@ -43,6 +130,9 @@ class CommunicationHandler:
         self.reader_thread.daemon = True
         self.reader_thread.start()
         
+        # Ask the STM32 which command framing it supports
+        self.negotiate_protocol()
+        
     def init_serial_ports(self):
         """Initialize serial connections"""
         try:
@@ -86,22 +176,27 @@ class CommunicationHandler:
             
     def process_stm32_data(self, data):
         """Process data from STM32"""
-        # Parse packets
-        packets = self.parse_incoming_data(data)
+        # Parse packets, keeping a frame split across reads for the next one
+        packets, tail = self.parse_incoming_data(self.stm32_rx + data, keep_tail=True)
+        if len(tail) > self.RX_TAIL_MAX:
+            tail = tail[1:]  # Not a frame after all, resync past it
+        self.stm32_rx = tail
         
         for packet in packets:
             if packet['type'] == 'telemetry':
                 self.telemetry_queue.put(packet['data'])
             elif packet['type'] == 'command':
                 self.command_queue.put(packet['data'])
+            elif packet['type'] == 'history':
+                self.send_to_radio(packet['data'])
                 
     def process_radio_data(self, data):
         """Process data from radio (ground station)"""
         try:
-            # Try to parse as JSON first
-            text = data.decode('utf-8').strip()
-            if text.startswith('{'):
-                command = json.loads(text)
+            # JSON commands, else binary frames (which need not be UTF-8)
+            text = data.strip()
+            if text.startswith(b'{'):
+                command = json.loads(text.decode('utf-8'))
                 self.command_queue.put(command)
             else:
                 # Binary protocol
@@ -113,33 +208,120 @@ class CommunicationHandler:
         except Exception as e:
             self.logger.error(f"Error processing radio data: {e}")
             
-    def parse_incoming_data(self, data):
-        """Parse incoming binary data"""
+    def parse_incoming_data(self, data, keep_tail=False):
+        """Parse incoming binary data. With keep_tail, returns
+        (packets, unparsed bytes at the end) instead of just packets"""
         packets = []
         i = 0
         
         while i < len(data) - 1:
-            # Look for sync pattern
-            sync = struct.unpack('<H', data[i:i+2])[0]
+            # PING reply: AA 57 01 seq [protocol version]. v1 firmware
+            # sends no version byte, so the byte after seq (often the
+            # next frame's 0xAA) is the version only if it is one we speak
+            if data[i] == 0xAA and data[i+1] == 0x57:
+                if i + 5 <= len(data) or (i + 4 <= len(data) and not keep_tail):
+                    version = data[i+4] if i + 5 <= len(data) else 1
+                    if not 1 <= version <= self.PROTOCOL_VERSION:
+                        version = 1
+                    self.stm32_protocol = version
+                    packets.append({
+                        'type': 'command_response',
+                        'data': {
+                            'status': data[i+2],
+                            'sequence': data[i+3],
+                            'protocol': version
+                        }
+                    })
+                    i += 5 if version >= 2 else 4
+                    continue
+                else:
+                    break
+                    
+            # Look for sync pattern (0xAA first on the wire)
+            sync = struct.unpack('>H', data[i:i+2])[0]
             
+            if sync == self.SYNC_BRIDGE:
+                # Credit: <active> <uint32 forwarded> <uint16 window> <CRC-16>
+                if i + 11 <= len(data):
+                    if struct.unpack('<H', data[i+9:i+11])[0] == crc16_ccitt(data[i:i+9]):
+                        active, forwarded, window = struct.unpack('<BIH', data[i+2:i+9])
+                        self.update_bridge(active, forwarded, window)
+                        i += 11
+                    else:
+                        i += 1
+                    continue
+                else:
+                    break
+                    
+            if sync == self.SYNC_FW_STATUS:
+                # <state> <result> <uint32 session> <uint16 count> <uint16 base> <uint32 bitmap> <CRC-16>
+                if i + 18 <= len(data):
+                    if struct.unpack('<H', data[i+16:i+18])[0] == crc16_ccitt(data[i:i+16]):
+                        fields = struct.unpack('<BBIHHI', data[i+2:i+16])
+                        self.update_firmware_status(dict(zip(
+                            ('state', 'result', 'session', 'chunk_count', 'base', 'bitmap'), fields)))
+                        i += 18
+                    else:
+                        i += 1
+                    continue
+                else:
+                    break
+                    
+            if sync == self.SYNC_SCHED_STATUS:
+                # <result> <entries> <uint32 now ms> <uint32 next ms> <uint16 next seq> <CRC-16>
+                if i + 16 <= len(data):
+                    if struct.unpack('<H', data[i+14:i+16])[0] == crc16_ccitt(data[i:i+14]):
+                        fields = struct.unpack('<BBIIH', data[i+2:i+14])
+                        self.update_schedule_status(dict(zip(
+                            ('result', 'entries', 'now_ms', 'next_ms', 'next_sequence'), fields)))
+                        i += 16
+                    else:
+                        i += 1
+                    continue
+                else:
+                    break
+                    
+            if sync == self.SYNC_HISTORY:
+                # <session> <frame> <flags> <uint16 length> <records> <CRC-16>
+                if i + self.HISTORY_HEADER_SIZE <= len(data):
+                    length = struct.unpack('<H', data[i+7:i+9])[0]
+                    end = i + self.HISTORY_HEADER_SIZE + length
+                    if length > self.HISTORY_FRAME_DATA:
+                        i += 1
+                        continue
+                    if end + 2 > len(data):
+                        break
+                    if struct.unpack('<H', data[end:end+2])[0] == crc16_ccitt(data[i:end]):
+                        packets.append({'type': 'history', 'data': bytes(data[i:end+2])})
+                        i = end + 2
+                    else:
+                        i += 1
+                    continue
+                else:
+                    break
+                    
             if sync == self.SYNC_TELEMETRY:
-                # Telemetry packet
-                if i + 40 <= len(data):
-                    packet = self.parse_telemetry(data[i:i+40])
-                    packets.append({'type': 'telemetry', 'data': packet})
-                    i += 40
+                # Telemetry packet, TelemetryPacket_t
+                if i + telemetry_schema.FRAME_SIZE <= len(data):
+                    packet = self.parse_telemetry(data[i:i+telemetry_schema.FRAME_SIZE])
+                    if packet:
+                        packets.append({'type': 'telemetry', 'data': packet})
+                        i += telemetry_schema.FRAME_SIZE
+                    else:
+                        i += 1
                 else:
                     break
                     
             elif sync == self.SYNC_COMMAND:
-                # Command packet
-                if i + 8 <= len(data):
+                # Command packet: <id> <uint16 seq> <uint16 length> <params> <uint16 checksum>
+                if i + self.CMD_HEADER_SIZE + 2 <= len(data):
                     cmd_id = data[i+2]
                     seq = struct.unpack('<H', data[i+3:i+5])[0]
                     param_len = struct.unpack('<H', data[i+5:i+7])[0]
+                    start = i + self.CMD_HEADER_SIZE
                     
-                    if i + 8 + param_len <= len(data):
-                        params = data[i+8:i+8+param_len]
+                    if start + param_len + 2 <= len(data):
+                        params = data[start:start+param_len]
                         try:
                             params_dict = json.loads(params.decode())
                         except:
@@ -150,31 +332,37 @@ class CommunicationHandler:
                             'data': {
                                 'id': cmd_id,
                                 'sequence': seq,
-                                'params': params_dict
+                                'params': params_dict,
+                                'raw': bytes(params)  # Binary commands (FILE_ACK)
                             }
                         })
-                        i += 8 + param_len
+                        i = start + param_len + 2
                     else:
                         break
                 else:
                     break
                     
-            elif sync == self.SYNC_IMAGE:
-                # Image data packet
-                if i + 7 <= len(data):
-                    chunk_num = struct.unpack('<H', data[i+2:i+4])[0]
-                    data_len = struct.unpack('<H', data[i+4:i+6])[0]
+            elif sync in (self.SYNC_IMAGE, self.SYNC_FILE):
+                # Chunk: <file_id> <chunk> <chunk_count> <length> <data> <CRC-32>
+                if i + 10 <= len(data):
+                    file_id, chunk_num, chunk_count, data_len = struct.unpack('<HHHH', data[i+2:i+10])
+                    end = i + 10 + data_len
                     
-                    if i + 7 + data_len <= len(data):
-                        image_data = data[i+7:i+7+data_len]
-                        packets.append({
-                            'type': 'image_chunk',
-                            'data': {
-                                'chunk': chunk_num,
-                                'data': image_data
-                            }
-                        })
-                        i += 7 + data_len
+                    if end + 4 <= len(data):
+                        crc = struct.unpack('<I', data[end:end+4])[0]
+                        if crc == crc32_mpeg2(data[i:end]):
+                            packets.append({
+                                'type': 'image_chunk' if sync == self.SYNC_IMAGE else 'file_chunk',
+                                'data': {
+                                    'file_id': file_id,
+                                    'chunk': chunk_num,
+                                    'chunk_count': chunk_count,
+                                    'data': data[i+10:end]
+                                }
+                            })
+                            i = end + 4
+                        else:
+                            i += 1
                     else:
                         break
                 else:
@@ -182,30 +370,21 @@ class CommunicationHandler:
             else:
                 i += 1
                 
+        if keep_tail:
+            return packets, bytes(data[i:])
         return packets
         
     def parse_telemetry(self, data):
-        """Parse telemetry packet"""
-        try:
-            return {
-                'sync1': data[0],
-                'sync2': data[1],
-                'packet_type': data[2],
-                'sequence': struct.unpack('<H', data[3:5])[0],
-                'timestamp': struct.unpack('<I', data[5:9])[0],
-                'mag_x': struct.unpack('<f', data[9:13])[0],
-                'mag_y': struct.unpack('<f', data[13:17])[0],
-                'mag_z': struct.unpack('<f', data[17:21])[0],
-                'corrosion_raw': struct.unpack('<H', data[21:23])[0],
-                'radiation_cps': struct.unpack('<I', data[23:27])[0],
-                'temperature_bme': struct.unpack('<f', data[27:31])[0],
-                'pressure': struct.unpack('<f', data[31:35])[0],
-                'humidity': struct.unpack('<f', data[35:39])[0],
-                'checksum': struct.unpack('<H', data[39:41])[0] if len(data) >= 41 else 0
-            }
-        except Exception as e:
-            self.logger.error(f"Telemetry parse error: {e}")
+        """Parse telemetry packet, {} unless sync and CRC-16 check out
+
+        Fields are named as in TelemetryPacket_t, in its units; the layout
+        comes from telemetry_schema.py, generated from main.h.
+        """
+        packet = telemetry_schema.decode(data)
+        if packet is None:
             return {}
+        packet['sequence'] = packet['sequence_number']  # Database column
+        return packet
             
     def send_to_stm32(self, data):
         """Send data to STM32"""
@@ -216,11 +395,14 @@ class CommunicationHandler:
         try:
             if isinstance(data, dict):
                 # Convert to command packet
-                cmd_data = self.build_command_packet(data)
-                self.stm32_serial.write(cmd_data)
-            else:
-                self.stm32_serial.write(data)
+                data = self.build_command_packet(data)
                 
+            # In bridge mode every byte we send counts against the window
+            with self.bridge_cond:
+                if self.bridge_active:
+                    self.bridge_sent += len(data)
+                    
+            self.stm32_serial.write(data)
             return True
         except Exception as e:
             self.logger.error(f"Error sending to STM32: {e}")
@@ -245,53 +427,179 @@ class CommunicationHandler:
             self.logger.error(f"Error sending to radio: {e}")
             return False
             
-    def send_file_to_ground(self, filename, chunk_size=256):
-        """Send a file to ground station in chunks"""
-        if not self.radio_serial:
-            self.logger.error("Radio not available")
+    def send_chunk(self, packet):
+        """Send an image/file chunk to the ground. The STM32 relays chunk
+        frames to the radio itself; talk to the radio directly only if
+        the STM32 link is down."""
+        if self.bridge_active:
+            return self.bridge_write(packet)
+        if self.stm32_serial:
+            return self.send_to_stm32(packet)
+        return self.send_to_radio(packet)
+        
+    def update_bridge(self, active, forwarded, window):
+        """Credit frame from the STM32"""
+        with self.bridge_cond:
+            if active and not self.bridge_active:
+                self.bridge_sent = forwarded  # Bridge just opened
+            self.bridge_active = bool(active)
+            self.bridge_forwarded = forwarded
+            self.bridge_window = window
+            self.bridge_cond.notify_all()
+            
+    def start_bridge(self, idle_timeout=30, timeout=2.0):
+        """Put the STM32 into bridge mode; True once it confirms"""
+        if not self.stm32_serial:
             return False
+        self.send_to_stm32({'id': self.CMD_BRIDGE, 'sequence': 0,
+                            'params': struct.pack('<BH', 1, idle_timeout)})
+        with self.bridge_cond:
+            return self.bridge_cond.wait_for(lambda: self.bridge_active, timeout)
             
-        try:
-            file_size = os.path.getsize(filename)
-            num_chunks = (file_size + chunk_size - 1) // chunk_size
+    def stop_bridge(self):
+        if self.stm32_serial:
+            self.send_to_stm32({'id': self.CMD_BRIDGE, 'sequence': 0, 'params': b'\x00'})
             
-            self.logger.info(f"Sending file {filename} ({num_chunks} chunks)")
+    def bridge_write(self, data, timeout=10.0):
+        """Stream data to the radio through the STM32, waiting for credit
+        so its RX ring is never overrun"""
+        offset = 0
+        while offset < len(data):
+            with self.bridge_cond:
+                room = lambda: self.bridge_window - (self.bridge_sent - self.bridge_forwarded)
+                if not self.bridge_cond.wait_for(lambda: not self.bridge_active or room() > 0, timeout):
+                    self.logger.warning("Bridge stalled")
+                    return False
+                if not self.bridge_active:
+                    return False
+                n = min(room(), len(data) - offset)
+            if not self.send_to_stm32(data[offset:offset + n]):
+                return False
+            offset += n
+        return True
+        
+    def update_firmware_status(self, status):
+        """Firmware update status frame from the STM32"""
+        with self.fw_cond:
+            self.fw_status = status
+            self.fw_cond.notify_all()
             
-            with open(filename, 'rb') as f:
-                for chunk_num in range(num_chunks):
-                    chunk_data = f.read(chunk_size)
-                    
-                    # Build packet
-                    packet = struct.pack('<HHH', 
-                                        self.SYNC_FILE,
-                                        chunk_num,
-                                        len(chunk_data))
-                    packet += chunk_data
-                    
-                    # Send chunk
-                    self.radio_serial.write(packet)
-                    
-                    # Wait for acknowledgment (simplified)
-                    time.sleep(0.05)
-                    
-            self.logger.info(f"File sent successfully: {filename}")
-            return True
+    def firmware_command(self, params, until=None, timeout=3.0):
+        """Send an UPDATE_FIRMWARE operation and wait for a status that
+        satisfies until (any status by default); None on timeout"""
+        with self.fw_cond:
+            self.fw_status = None
+        self.send_to_stm32({'id': self.CMD_UPDATE_FIRMWARE, 'sequence': 0, 'params': params})
+        with self.fw_cond:
+            ok = self.fw_cond.wait_for(
+                lambda: self.fw_status is not None and (until is None or until(self.fw_status)),
+                timeout)
+            return self.fw_status if ok else None
             
-        except Exception as e:
-            self.logger.error(f"Error sending file: {e}")
+    def build_firmware_chunk(self, image, session, chunk, count):
+        data = image[chunk * self.FWU_CHUNK_SIZE:(chunk + 1) * self.FWU_CHUNK_SIZE]
+        frame = struct.pack('>H', self.SYNC_FIRMWARE) + \
+                struct.pack('<HHHH', session & 0xFFFF, chunk, count, len(data)) + data
+        return frame + struct.pack('<I', crc32_mpeg2(frame))
+        
+    def upload_firmware(self, image, session, commit=True, passes=8):
+        """Stream a firmware image into the STM32 update slot, resuming
+        whatever an earlier attempt with the same session left there.
+        With commit the STM32 installs it at the next RESET."""
+        image = bytes(image)
+        count = (len(image) + self.FWU_CHUNK_SIZE - 1) // self.FWU_CHUNK_SIZE
+        begin = struct.pack('<BIII', 0, session, len(image), crc32_mpeg2(image))
+        
+        # The slot erase takes ~2 s; nothing may be sent until it is done
+        status = self.firmware_command(
+            begin, lambda s: s['state'] != self.FWU_STATE_PREPARING, timeout=10.0)
+        
+        for _ in range(passes):
+            if status is None or status['state'] != self.FWU_STATE_RECEIVING:
+                break
+            # The bitmap covers 32 chunks past base; send the rest too,
+            # chunks already programmed are skipped by the STM32
+            base, bitmap = status['base'], status['bitmap']
+            for chunk in range(base, count):
+                if chunk - base < 32 and bitmap >> (chunk - base) & 1:
+                    continue
+                if not self.send_to_stm32(self.build_firmware_chunk(image, session, chunk, count)):
+                    return False
+            status = self.firmware_command(b'\x01')
+            
+        if status is None or status['state'] != self.FWU_STATE_COMPLETE:
+            self.logger.error(f"Firmware upload stopped: {status}")
             return False
+        if not commit:
+            return True
+        status = self.firmware_command(b'\x02')
+        return status is not None and status['state'] == self.FWU_STATE_PENDING
+        
+    def update_schedule_status(self, status):
+        """Command schedule status frame from the STM32"""
+        with self.sched_cond:
+            self.sched_status = status
+            self.sched_cond.notify_all()
+            
+    def schedule_operation(self, params, timeout=3.0):
+        """Send a SET_SCHEDULE operation and wait for its status; None on timeout"""
+        with self.sched_cond:
+            self.sched_status = None
+        self.send_to_stm32({'id': self.CMD_SET_SCHEDULE, 'sequence': 0, 'params': params})
+        with self.sched_cond:
+            ok = self.sched_cond.wait_for(lambda: self.sched_status is not None, timeout)
+            return self.sched_status if ok else None
             
-    def build_command_packet(self, command):
+    def schedule_command(self, time_ms, command):
+        """Have the STM32 run command at mission time time_ms; the
+        command's sequence number is what CANCEL matches"""
+        frame = self.build_command_packet(command, version=2)
+        return self.schedule_operation(struct.pack('<BI', 0, time_ms & 0xFFFFFFFF) + frame)
+        
+    def cancel_scheduled(self, sequence):
+        return self.schedule_operation(struct.pack('<BH', 1, sequence))
+        
+    def calculate_checksum(self, data, version=1):
+        """Frame check: additive sum for v1 commands, CRC-16 otherwise"""
+        if version >= 2:
+            return crc16_ccitt(data)
+        return ~sum(data) & 0xFFFF
+        
+    def negotiate_protocol(self):
+        """Send a PING; the reply sets stm32_protocol"""
+        if self.stm32_serial:
+            self.send_to_stm32({'id': self.CMD_PING, 'sequence': 0, 'params': b''})
+            
+    def build_command_packet(self, command, version=None):
         """Build a command packet for STM32"""
+        version = version or self.stm32_protocol
+        
+        params = command.get('params', {})
+        if isinstance(params, (bytes, bytearray)):
+            param_bytes = bytes(params)
+        elif params:
+            param_bytes = json.dumps(params).encode()
+        else:
+            param_bytes = b''
+            
+        if len(param_bytes) > self.CMD_MAX_PARAMETERS:
+            raise ValueError(f"Command parameters too long ({len(param_bytes)} > {self.CMD_MAX_PARAMETERS})")
+            
+        sync = self.SYNC_COMMAND_V2 if version >= 2 else self.SYNC_COMMAND
+        
+        # Sync word goes out high byte first (0xAA, 0x56 / 0x5B)
         packet = bytearray()
-        packet.extend(struct.pack('<H', self.SYNC_COMMAND))
+        packet.extend(struct.pack('>H', sync))
         packet.append(command.get('id', 0))
         packet.extend(struct.pack('<H', command.get('sequence', 0)))
+        packet.extend(struct.pack('<H', len(param_bytes)))
+        packet.extend(param_bytes)
         
-        params = command.get('params', {})
-        params_json = json.dumps(params).encode()
-        packet.extend(struct.pack('<H', len(params_json)))
-        packet.extend(params_json)
+        if version < 2:
+            # v1 frames always carry the full parameter block
+            packet.extend(bytes(self.CMD_MAX_PARAMETERS - len(param_bytes)))
+            
+        packet.extend(struct.pack('<H', self.calculate_checksum(packet, version)))
         
         return packet
         
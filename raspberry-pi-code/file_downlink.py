@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Selective-repeat file downlink for CubeSat
+Sends images/files to the ground in CRC-32 checked chunks and resends only
+the chunks the ground reports missing. Transfer state is kept on disk,
+so a transfer cut off by the end of a pass (or a reboot) resumes with
+the missing chunks on the next one.
+"""
+import os
+import json
+import time
+import struct
+import logging
+import threading
+
+from communication import crc32_mpeg2
+
+
+class FileDownlink:
+    """Chunked transfers driven by the ground's received-chunk bitmaps"""
+
+    # Chunk frame: AA 58|59 <file_id> <chunk> <chunk_count> <length> <data> <CRC-32>
+    CHUNK_HEADER = struct.Struct('<HHHH')
+    CHUNK_SIZE = 256          # COMM_MAX_CHUNK_DATA in the STM32 firmware
+
+    # Ground acknowledgement: <file_id> <first_chunk> <bitmap>, bit i of
+    # the bitmap (LSB first) set = chunk first_chunk + i received
+    CMD_FILE_ACK = 0x10
+
+    ROUND_INTERVAL = 60       # Seconds before resending a round nobody acked
+
+    def __init__(self, comm, config):
+        self.comm = comm
+        self.logger = logging.getLogger('Downlink')
+        self.lock = threading.Lock()
+
+        storage = config['storage']['base_path']
+        self.state_file = os.path.join(storage, 'downlink_state.json')
+        self.radio_baudrate = config['communication']['radio_baudrate']
+
+        self.next_id = 1
+        self.transfers = {}
+        self.load_state()
+
+    def load_state(self):
+        """Pick up transfers left over from an earlier pass"""
+        try:
+            if os.path.exists(self.state_file):
+                with open(self.state_file, 'r') as f:
+                    state = json.load(f)
+                self.next_id = state.get('next_id', 1)
+                for file_id, t in state.get('transfers', {}).items():
+                    t['received'] = bytearray.fromhex(t['received'])
+                    t['round_start'] = 0
+                    self.transfers[int(file_id)] = t
+                if self.transfers:
+                    self.logger.info(f"Resuming {len(self.transfers)} transfer(s)")
+        except Exception as e:
+            self.logger.error(f"Downlink state load error: {e}")
+
+    def save_state(self):
+        """Persist bitmaps; written to a temp file first so a power cut
+        cannot leave a half-written state behind"""
+        state = {
+            'next_id': self.next_id,
+            'transfers': {
+                str(file_id): dict(t, received=t['received'].hex())
+                for file_id, t in self.transfers.items()
+            }
+        }
+        try:
+            tmp = self.state_file + '.tmp'
+            with open(tmp, 'w') as f:
+                json.dump(state, f)
+            os.replace(tmp, self.state_file)
+        except Exception as e:
+            self.logger.error(f"Downlink state save error: {e}")
+
+    def add_file(self, filename, sync=None):
+        """Queue a file, returns its transfer id"""
+        size = os.path.getsize(filename)
+        chunk_count = max(1, (size + self.CHUNK_SIZE - 1) // self.CHUNK_SIZE)
+
+        with self.lock:
+            file_id = self.next_id
+            self.next_id = (self.next_id % 0xFFFF) + 1
+            self.transfers[file_id] = {
+                'filename': filename,
+                'size': size,
+                'mtime': os.path.getmtime(filename),
+                'sync': sync or self.comm.SYNC_FILE,
+                'chunk_count': chunk_count,
+                'received': bytearray((chunk_count + 7) // 8),
+                'next_chunk': 0,
+                'round_start': 0
+            }
+            self.save_state()
+
+        self.logger.info(f"Queued {filename} as transfer {file_id} ({chunk_count} chunks)")
+        return file_id
+
+    def handle_ack(self, params):
+        """Ground report of received chunks (CMD_FILE_ACK parameters)"""
+        if len(params) < 4:
+            return
+        file_id, first_chunk = struct.unpack('<HH', params[:4])
+
+        with self.lock:
+            t = self.transfers.get(file_id)
+            if t is None:
+                return  # Already complete, or unknown
+
+            for i, byte in enumerate(params[4:]):
+                for bit in range(8):
+                    chunk = first_chunk + i * 8 + bit
+                    if (byte >> bit) & 1 and chunk < t['chunk_count']:
+                        t['received'][chunk // 8] |= 1 << (chunk % 8)
+
+            missing = self.missing_count(t)
+            if missing == 0:
+                self.logger.info(f"Transfer {file_id} complete: {t['filename']}")
+                del self.transfers[file_id]
+            else:
+                # Resend what is still missing straight away
+                t['next_chunk'] = 0
+                t['round_start'] = 0
+            self.save_state()
+
+    @staticmethod
+    def missing_count(t):
+        received = sum(bin(b).count('1') for b in t['received'])
+        return t['chunk_count'] - received
+
+    def pending(self):
+        with self.lock:
+            return len(self.transfers)
+
+    def build_chunk(self, t, file_id, chunk, data):
+        packet = struct.pack('>H', t['sync'])
+        packet += self.CHUNK_HEADER.pack(file_id, chunk, t['chunk_count'], len(data))
+        packet += data
+        packet += struct.pack('<I', crc32_mpeg2(packet))
+        return packet
+
+    def service(self, max_chunks=8):
+        """Send up to max_chunks missing chunks of the oldest transfer.
+        Each round sends every missing chunk once, then waits for an ACK
+        (or ROUND_INTERVAL) before starting over. Returns chunks sent."""
+        with self.lock:
+            now = time.time()
+            for file_id, t in self.transfers.items():
+                if t['next_chunk'] >= t['chunk_count']:
+                    if now - t['round_start'] < self.ROUND_INTERVAL:
+                        continue  # Round done, waiting for the ground
+                    t['next_chunk'] = 0
+                break
+            else:
+                return 0
+
+            if t['next_chunk'] == 0:
+                t['round_start'] = now
+
+            if not os.path.exists(t['filename']) or os.path.getmtime(t['filename']) != t['mtime']:
+                self.logger.warning(f"Transfer {file_id} dropped, {t['filename']} changed")
+                del self.transfers[file_id]
+                self.save_state()
+                return 0
+
+            sent = 0
+            with open(t['filename'], 'rb') as f:
+                while sent < max_chunks and t['next_chunk'] < t['chunk_count']:
+                    chunk = t['next_chunk']
+                    t['next_chunk'] += 1
+                    if t['received'][chunk // 8] & (1 << (chunk % 8)):
+                        continue
+
+                    f.seek(chunk * self.CHUNK_SIZE)
+                    packet = self.build_chunk(t, file_id, chunk, f.read(self.CHUNK_SIZE))
+                    if not self.comm.send_chunk(packet):
+                        t['next_chunk'] = chunk
+                        break
+
+                    # The STM32 holds only a few chunks for the radio; hold
+                    # to the radio rate so it never runs out of room
+                    # (bridge mode paces itself with credits)
+                    if not self.comm.bridge_active:
+                        time.sleep(len(packet) * 10 / self.radio_baudrate)
+                    sent += 1
+
+            return sent
@@ -59,6 +59,8 @@ from pathlib import Path
 from camera_handler import CameraHandler
 from telemetry_handler import TelemetryHandler
 from communication import CommunicationHandler
+from file_downlink import FileDownlink
+import telemetry_schema
 
 class CubeSatFlightController:
     """Main flight controller for Raspberry Pi"""
@@ -94,6 +96,7 @@ class CubeSatFlightController:
         self.camera = CameraHandler(self.config)
         self.telemetry = TelemetryHandler(self.config)
         self.comm = CommunicationHandler(self.config)
+        self.downlink = FileDownlink(self.comm, self.config)
         
         # Queues for inter-thread communication
         self.telemetry_queue = queue.Queue(maxsize=100)
@@ -207,7 +210,7 @@ class CubeSatFlightController:
         """Read data from STM32 via UART"""
         while self.running:
             try:
-                if self.comm.stm32_serial and self.comm.stm32_serial.in_waiting >= 40:
+                if self.comm.stm32_serial and self.comm.stm32_serial.in_waiting >= telemetry_schema.FRAME_SIZE:
                     data = self.comm.stm32_serial.read(self.comm.stm32_serial.in_waiting)
                     
                     # Process telemetry packets
@@ -217,6 +220,8 @@ class CubeSatFlightController:
                             self.telemetry_queue.put(packet['data'])
                         elif packet['type'] == 'command_response':
                             self.logger.info(f"Command response: {packet['data']}")
+                        elif packet['type'] == 'history':
+                            self.comm.send_to_radio(packet['data'])
                             
             except Exception as e:
                 self.logger.error(f"STM32 reader error: {e}")
@@ -261,7 +266,20 @@ class CubeSatFlightController:
         cmd_type = cmd.get('type')
         params = cmd.get('params', {})
         
-        if cmd_type == 'PING':
+        if cmd.get('id') == FileDownlink.CMD_FILE_ACK:
+            # Ground's bitmap of received chunks, binary parameters
+            self.downlink.handle_ack(cmd.get('raw', b''))
+            
+        elif cmd.get('id') in self.comm.STM32_COMMANDS:
+            # History requests and dump ACKs are served by the STM32; pass
+            # them on with the ground's sequence number, binary parameters
+            self.comm.send_to_stm32({
+                'id': cmd['id'],
+                'sequence': cmd.get('sequence', 0),
+                'params': cmd.get('raw', b'')
+            })
+            
+        elif cmd_type == 'PING':
             response = {'type': 'PONG', 'timestamp': time.time()}
             self.comm.send_to_stm32(response)
             
@@ -417,6 +435,15 @@ class CubeSatFlightController:
                     for item in items[1:]:
                         self.downlink_queue.put(item)
                         
+                # Chunks of queued files, resent until the ground has them
+                # all. The STM32 bridge paces them to the radio.
+                if self.downlink.pending():
+                    if not self.comm.bridge_active:
+                        self.comm.start_bridge()
+                    self.downlink.service()
+                elif self.comm.bridge_active:
+                    self.comm.stop_bridge()
+                        
             except Exception as e:
                 self.logger.error(f"Downlink manager error: {e}")
                 
@@ -442,8 +469,10 @@ class CubeSatFlightController:
         self.logger.info(f"Sending to ground: {data.get('type')}")
         
         if data['type'] in ['image', 'thumbnail']:
-            # Send image in chunks
-            self.comm.send_file_to_ground(data['filename'])
+            # Chunked, selective-repeat transfer
+            self.downlink.add_file(data['filename'], self.comm.SYNC_IMAGE)
+        elif data['type'] == 'file':
+            self.downlink.add_file(data['filename'], self.comm.SYNC_FILE)
         else:
             # Send as JSON
             self.comm.send_to_radio(data)
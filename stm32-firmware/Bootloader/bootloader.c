@@ -0,0 +1,198 @@
+/* bootloader.c - Firmware Update Bootloader
+ *
+ * Lives in flash sector 0 and runs before the application on every
+ * reset. A committed image in the update slot (fwslot.h) is installed
+ * over the application after a backup of the running one is taken; the
+ * new image then has FWU_MAX_TRIALS starts to confirm itself, after
+ * which the backup is put back. Every step is recorded in the slot
+ * header before the next one starts, so a reset part-way through just
+ * repeats the unfinished step.
+ *
+ * Register-level and interrupt-free, running on the 16 MHz HSI: no HAL,
+ * so it fits the 16 KB sector. Build with the CMSIS startup file and
+ * system_stm32f4xx.c, linked at 0x08000000 with FLASH LENGTH = 16K; the
+ * application is linked at FWU_APP_BASE.
+ */
+#include "stm32f4xx.h"
+#include "fwslot.h"
+
+#define BOOT_FLASH_ERRORS (FLASH_SR_OPERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                           FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+
+/* ==================== FLASH ==================== */
+
+static void BOOT_FlashWait(void) {
+    while(FLASH->SR & FLASH_SR_BSY) {
+        IWDG->KR = 0xAAAA;  /* In case the IWDG option byte starts it */
+    }
+}
+
+static void BOOT_FlashUnlock(void) {
+    if(FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = 0x45670123;
+        FLASH->KEYR = 0xCDEF89AB;
+    }
+}
+
+static uint8_t BOOT_EraseSector(uint32_t sector) {
+    BOOT_FlashWait();
+    FLASH->SR = BOOT_FLASH_ERRORS | FLASH_SR_EOP;
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+    BOOT_FlashWait();
+    FLASH->CR = 0;
+    
+    return (FLASH->SR & BOOT_FLASH_ERRORS) == 0;
+}
+
+/* x32 parallelism, needs VDD >= 2.7 V. Programming a word again with
+ * the same value is harmless on the F4, which is what makes a repeated
+ * step safe. */
+static uint8_t BOOT_ProgramWord(uint32_t addr, uint32_t value) {
+    BOOT_FlashWait();
+    FLASH->SR = BOOT_FLASH_ERRORS | FLASH_SR_EOP;
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+    *(volatile uint32_t*)addr = value;
+    BOOT_FlashWait();
+    FLASH->CR = 0;
+    
+    return *(volatile uint32_t*)addr == value;
+}
+
+static uint8_t BOOT_SetFlag(const volatile uint32_t* flag) {
+    return *flag == FWU_FLAG_SET || BOOT_ProgramWord((uint32_t)flag, FWU_FLAG_SET);
+}
+
+static uint8_t BOOT_Copy(uint32_t dst, uint32_t src, uint32_t length) {
+    for(uint32_t i = 0; i < length; i += 4) {
+        if(!BOOT_ProgramWord(dst + i, *(const volatile uint32_t*)(src + i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t BOOT_EraseApp(void) {
+    for(uint32_t s = 0; s < FWU_APP_SECTORS; s++) {
+        if(!BOOT_EraseSector(FWU_APP_FIRST_SECTOR + s)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* CRC-32/MPEG-2, the same as CRC32_Calculate in the application: words
+ * MSB first through the CRC unit, a tail shorter than a word bitwise */
+static uint32_t BOOT_Crc(uint32_t addr, uint32_t length) {
+    const volatile uint8_t* bytes = (const volatile uint8_t*)addr;
+    uint32_t words = length / 4;
+    uint32_t crc;
+    
+    CRC->CR = CRC_CR_RESET;
+    for(uint32_t i = 0; i < words; i++) {
+        CRC->DR = __REV(*(const volatile uint32_t*)(addr + i * 4));
+    }
+    crc = CRC->DR;
+    
+    for(uint32_t i = words * 4; i < length; i++) {
+        crc ^= (uint32_t)bytes[i] << 24;
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* ==================== UPDATE ==================== */
+
+/* Put the saved application back */
+static void BOOT_Restore(const volatile FWU_Slot_t* slot) {
+    if(slot->backed_up != FWU_FLAG_SET) {
+        return;  /* Nothing saved - keep what is there */
+    }
+    if(BOOT_EraseApp() &&
+       BOOT_Copy(FWU_APP_BASE, FWU_SLOT_BACKUP, FWU_APP_SIZE) &&
+       BOOT_Crc(FWU_APP_BASE, FWU_APP_SIZE) == slot->backup_crc) {
+        BOOT_SetFlag(&slot->rolled_back);
+    }
+}
+
+static void BOOT_Install(const volatile FWU_Slot_t* slot) {
+    uint32_t crc;
+    
+    /* The slot was erased when the upload began, backup area included */
+    if(slot->backed_up != FWU_FLAG_SET) {
+        crc = BOOT_Crc(FWU_APP_BASE, FWU_APP_SIZE);
+        if(!BOOT_Copy(FWU_SLOT_BACKUP, FWU_APP_BASE, FWU_APP_SIZE) ||
+           BOOT_Crc(FWU_SLOT_BACKUP, FWU_APP_SIZE) != crc ||
+           !BOOT_ProgramWord((uint32_t)&slot->backup_crc, crc) ||
+           !BOOT_SetFlag(&slot->backed_up)) {
+            return;  /* Old application untouched, tried again next reset */
+        }
+    }
+    
+    /* It has sat in flash since the commit - check it before erasing */
+    if(BOOT_Crc(FWU_SLOT_IMAGE, slot->image_size) != slot->image_crc) {
+        return;
+    }
+    
+    if(BOOT_EraseApp() &&
+       BOOT_Copy(FWU_APP_BASE, FWU_SLOT_IMAGE, (slot->image_size + 3) & ~3u) &&
+       BOOT_Crc(FWU_APP_BASE, slot->image_size) == slot->image_crc) {
+        BOOT_SetFlag(&slot->installed);
+    } else {
+        BOOT_Restore(slot);
+    }
+}
+
+/* Count this start of an unconfirmed image, or give up on it */
+static void BOOT_Trial(const volatile FWU_Slot_t* slot) {
+    for(uint8_t i = 0; i < FWU_MAX_TRIALS; i++) {
+        if(slot->trials[i] != FWU_FLAG_SET) {
+            BOOT_SetFlag(&slot->trials[i]);
+            return;
+        }
+    }
+    BOOT_Restore(slot);
+}
+
+/* ==================== START ==================== */
+
+static void BOOT_Jump(void) {
+    const volatile uint32_t* vectors = (const volatile uint32_t*)FWU_APP_BASE;
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1];
+    
+    if((sp - FWU_RAM_BASE - 1) >= FWU_RAM_SIZE) {
+        while(1) {
+            /* No application - wait for the debugger */
+        }
+    }
+    
+    SCB->VTOR = FWU_APP_BASE;
+    __set_MSP(sp);
+    ((void (*)(void))reset)();
+}
+
+int main(void) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    
+    if(slot->magic == FWU_MAGIC &&
+       slot->confirmed != FWU_FLAG_SET && slot->rolled_back != FWU_FLAG_SET) {
+        RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+        BOOT_FlashUnlock();
+        
+        if(slot->pending == FWU_FLAG_SET && slot->installed != FWU_FLAG_SET) {
+            BOOT_Install(slot);
+        }
+        if(slot->installed == FWU_FLAG_SET && slot->rolled_back != FWU_FLAG_SET) {
+            BOOT_Trial(slot);
+        }
+        
+        FLASH->CR |= FLASH_CR_LOCK;
+        RCC->AHB1ENR &= ~RCC_AHB1ENR_CRCEN;
+    }
+    
+    BOOT_Jump();
+    return 0;
+}
@@ -0,0 +1,100 @@
+/* FreeRTOSConfig.h - Kernel Configuration (CMSIS-RTOS v2, Cortex-M4F)
+ *
+ * Generated from STM32CubeMX.ioc; keep hand edits inside the USER CODE
+ * blocks so they survive regeneration. */
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/* USER CODE BEGIN Includes */
+/* USER CODE END Includes */
+
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+#include <stdint.h>
+extern uint32_t SystemCoreClock;
+void DIAG_Init(void);
+uint32_t DIAG_RunTimeCounter(void);
+#endif
+
+#define configENABLE_FPU                         1
+#define configENABLE_MPU                         0
+
+#define configUSE_PREEMPTION                     1
+#define configSUPPORT_STATIC_ALLOCATION          1
+#define configSUPPORT_DYNAMIC_ALLOCATION         0
+#define configUSE_IDLE_HOOK                      0
+#define configUSE_TICK_HOOK                      0
+#define configCPU_CLOCK_HZ                       (SystemCoreClock)
+#define configTICK_RATE_HZ                       ((TickType_t)1000)
+#define configMAX_PRIORITIES                     (56)
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
+#define configTOTAL_HEAP_SIZE                    ((size_t)15360)
+#define configMAX_TASK_NAME_LEN                  (16)
+#define configUSE_TRACE_FACILITY                 1
+#define configUSE_16_BIT_TICKS                   0
+#define configUSE_MUTEXES                        1
+#define configQUEUE_REGISTRY_SIZE                8
+#define configUSE_RECURSIVE_MUTEXES              1
+#define configUSE_COUNTING_SEMAPHORES            1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define configCHECK_FOR_STACK_OVERFLOW           0
+
+/* Run-time stats off the DWT cycle counter (diag.h) */
+#define configGENERATE_RUN_TIME_STATS            1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() DIAG_Init()
+#define portGET_RUN_TIME_COUNTER_VALUE()         DIAG_RunTimeCounter()
+
+/* Co-routine definitions */
+#define configUSE_CO_ROUTINES                    0
+#define configMAX_CO_ROUTINE_PRIORITIES          (2)
+
+/* Software timer definitions */
+#define configUSE_TIMERS                         1
+#define configTIMER_TASK_PRIORITY                (2)
+#define configTIMER_QUEUE_LENGTH                 10
+#define configTIMER_TASK_STACK_DEPTH             256
+
+/* CMSIS-RTOS v2 needs these */
+#define INCLUDE_vTaskPrioritySet                 1
+#define INCLUDE_uxTaskPriorityGet                1
+#define INCLUDE_vTaskDelete                      1
+#define INCLUDE_vTaskCleanUpResources            0
+#define INCLUDE_vTaskSuspend                     1
+#define INCLUDE_vTaskDelayUntil                  1
+#define INCLUDE_vTaskDelay                       1
+#define INCLUDE_xTaskGetSchedulerState           1
+#define INCLUDE_xTimerPendFunctionCall           1
+#define INCLUDE_xQueueGetMutexHolder             1
+#define INCLUDE_uxTaskGetStackHighWaterMark      1
+#define INCLUDE_xTaskGetCurrentTaskHandle        1
+#define INCLUDE_eTaskGetState                    1
+
+/* Cortex-M interrupt priorities: 4 priority bits on the STM32F4 */
+#ifdef __NVIC_PRIO_BITS
+#define configPRIO_BITS                          __NVIC_PRIO_BITS
+#else
+#define configPRIO_BITS                          4
+#endif
+
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY      15
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+#define configKERNEL_INTERRUPT_PRIORITY      (configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+
+/* USER CODE BEGIN 1 */
+#define configASSERT(x) if((x) == 0) { taskDISABLE_INTERRUPTS(); for(;;); }
+/* USER CODE END 1 */
+
+/* Handlers the port supplies, under the CMSIS names */
+#define vPortSVCHandler    SVC_Handler
+#define xPortPendSVHandler PendSV_Handler
+
+/* USER CODE BEGIN Defines */
+/* Tickless idle with our own vPortSuppressTicksAndSleep (system.c):
+ * STOP on the RTC wakeup timer in STATE_LOW_POWER, WFI otherwise.
+ * Idles under POWER_MIN_STOP_MS just WFI there, so hand over any idle
+ * of two ticks or more. */
+#define configUSE_TICKLESS_IDLE                  2
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP    2
+/* USER CODE END Defines */
+
+#endif /* FREERTOS_CONFIG_H */
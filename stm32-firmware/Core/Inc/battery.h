@@ -0,0 +1,40 @@
+/* battery.h - Battery Monitor Header */
+#ifndef __BATTERY_H
+#define __BATTERY_H
+
+#include "main.h"
+
+/* ADC1 regular sequence, started by TIM3 TRGO on every 100 ms radiation
+ * gate: a burst of battery divider conversions for oversampling, then
+ * VREFINT to measure VDDA (it sags with the LDO as the cell runs down) */
+#define BATT_VBAT_RANKS         12
+#define BATT_VREF_RANKS         4
+#define BATT_SEQ_LENGTH         (BATT_VBAT_RANKS + BATT_VREF_RANKS)
+#define BATT_DMA_SEQUENCES      10      /* Circular buffer, 1 s of triggers */
+#define BATT_DMA_LENGTH         (BATT_SEQ_LENGTH * BATT_DMA_SEQUENCES)
+#define BATT_BLOCK_SEQUENCES    (BATT_DMA_SEQUENCES / 2)  /* Averaged per half */
+
+#define BATT_DIVIDER            2       /* Battery to PB0 divider, 1:2 */
+#define BATT_VREFINT_CAL_ADDR   ((const uint16_t*)0x1FFF7A2A)  /* Raw at 3.3 V */
+#define BATT_VREFINT_CAL_MV     3300
+#define BATT_FILTER_SHIFT       3       /* IIR over half-buffer blocks, tau 4 s */
+
+/* Battery current: bidirectional sense amplifier (20 mOhm shunt, gain
+ * 50, 1.65 V reference) on MCP3008 CH1, positive = discharging */
+#define BATT_CURRENT_ZERO_CODE  512
+#define BATT_CURRENT_UA_PER_LSB 3223    /* 3.3 V / 1024 per 1 V/A */
+
+typedef struct {
+    uint16_t voltage_mv;       /* Filtered battery voltage */
+    uint16_t vdda_mv;          /* From VREFINT, last block */
+    int16_t  current_ma;       /* Last current sample, + = discharge */
+    int32_t  charge_mah;       /* Net charge drawn since boot */
+    uint32_t blocks;           /* Voltage blocks averaged, 0 = no data yet */
+} BATT_Status_t;
+
+HAL_StatusTypeDef BATT_Init(ADC_HandleTypeDef* hadc);
+void BATT_UpdateCurrent(uint16_t average, uint32_t now_ms);
+void BATT_GetStatus(BATT_Status_t* status);
+uint8_t BATT_SequenceIdle(void);
+
+#endif /* __BATTERY_H */
@@ -0,0 +1,31 @@
+/* clock.h - Clock Profile Header */
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include "main.h"
+
+/* Clock Profiles (HSE = 8 MHz) */
+#define CLOCK_PROFILE_FULL       0  /* PLL 84 MHz, F401 maximum - image/file relay */
+#define CLOCK_PROFILE_NOMINAL    1  /* PLL 84 MHz, HCLK /4 = 21 MHz - telemetry */
+#define CLOCK_PROFILE_LOW_POWER  2  /* HSI 16 MHz, PLL and HSE off */
+#define CLOCK_PROFILE_COUNT      3
+
+#define CLOCK_SWITCH_TIMEOUT_MS  50       /* Wait for UART/I2C/SPI to go idle */
+#define CLOCK_SPI1_MAX_HZ        1350000  /* MCP3008 limit at 2.7 V */
+
+typedef struct {
+    uint8_t  use_pll;          /* 0 = run straight from HSI */
+    uint32_t ahb_divider;
+    uint32_t apb1_divider;     /* PCLK1 <= 42 MHz */
+    uint32_t apb2_divider;
+    uint32_t flash_latency;
+    uint32_t voltage_scale;
+} CLOCK_Profile_t;
+
+HAL_StatusTypeDef CLOCK_Configure(uint8_t profile);
+HAL_StatusTypeDef CLOCK_SetProfile(uint8_t profile);
+uint8_t CLOCK_GetProfile(void);
+uint8_t CLOCK_ProfileForState(uint8_t state);
+uint32_t CLOCK_SpiPrescaler(uint32_t max_hz);
+
+#endif /* __CLOCK_H */
@@ -5,25 +5,120 @@
 #include "main.h"
 
 /* UART Buffers */
-#define UART_TX_BUFFER_SIZE 512
-#define UART_RX_BUFFER_SIZE 256
+#define UART_TX_BUFFER_SIZE 512        /* USART1 (Pi) TX ring */
+#define UART_RADIO_TX_BUFFER_SIZE 256  /* USART2 (radio) TX ring */
+#define UART_RX_BUFFER_SIZE 320      /* Linearizes frames that wrap the RX ring */
+#define UART_RX_DMA_BUFFER_SIZE 1024 /* Circular DMA ring for USART1 RX (power of 2) */
+#define COMM_CMD_RING_SIZE 8          /* Command/firmware frames awaiting CommTask (power of 2) */
+#define COMM_RELAY_RING_SIZE 4        /* Chunks copied for the radio (power of 2) */
 
 /* Protocol Constants */
 #define SYNC_TELEMETRY   0xAA55
 #define SYNC_COMMAND     0xAA56
+#define SYNC_COMMAND_V2  0xAA5B  /* Length-prefixed command */
 #define SYNC_IMAGE       0xAA58
 #define SYNC_FILE        0xAA59
+#define SYNC_BRIDGE      0xAA5C  /* Bridge credit report, STM32 to Pi */
+#define SYNC_BEACON      0xAA5D  /* Beacon v2, radio only */
+#define SYNC_DIAG        0xAA5E  /* Diagnostics report, to the Pi */
+#define SYNC_FIRMWARE    0xAA5F  /* Firmware image chunk, Pi to STM32 */
+#define SYNC_FW_STATUS   0xAA60  /* Firmware update status, to the Pi */
+#define SYNC_HISTORY     0xAA62  /* Flash history backfill, downlink only */
+
+#define COMM_MAX_CHUNK_DATA 256
+
+/* CommTask Events (thread flags) */
+#define COMM_EVT_TELEMETRY  0x0010  /* New sensor snapshot published */
+#define COMM_EVT_COMMAND    0x0020  /* Command frame queued */
+#define COMM_EVT_TX_DONE    0x0040  /* USART1 TX ring drained */
+#define COMM_EVT_BEACON     0x0080  /* Beacon timer expired */
+#define COMM_EVT_BRIDGE     0x0100  /* Bridge credit report due */
+#define COMM_EVT_SCHEDULE   0x0200  /* Scheduled command due */
+#define COMM_EVT_ALL        (COMM_EVT_TELEMETRY | COMM_EVT_COMMAND | \
+                             COMM_EVT_TX_DONE | COMM_EVT_BEACON | \
+                             COMM_EVT_BRIDGE | COMM_EVT_SCHEDULE)
+
+/* Beacon v2: AA 5D <8-byte status word, LE> <CRC-16>
+ *   bits  0-2   system state
+ *   bits  3-10  battery, (mV - 2500) / 8
+ *   bits 11-18  temperature (TMP117), int8 in 0.5 C
+ *   bits 19-26  error flags
+ *   bits 27-38  radiation, cps
+ *   bits 39-46  boot count
+ *   bits 47-63  uptime, minutes
+ * Fields saturate at their range. */
+#define COMM_BEACON_FRAME_SIZE     12
+#define COMM_BEACON_INTERVAL_MS    30000   /* Default, CMD_BEACON changes it */
+#define COMM_BEACON_MIN_INTERVAL_S 5
+#define COMM_BEACON_MAX_INTERVAL_S 3600
+#define COMM_BEACON_BACKOFF_MAX_MS 480000  /* Low-power doubling stops here */
+
+/* Bridge mode: every byte the Pi sends on USART1 is forwarded to the
+ * radio by DMA, straight from the RX ring. The Pi may have at most
+ * COMM_BRIDGE_WINDOW bytes outstanding; credit frames
+ *   AA 5C <uint8 active> <uint32 forwarded> <uint16 window> <CRC-16>
+ * report how many bytes have been taken off the window since the bridge
+ * opened. Frames addressed to the STM32 (commands and firmware chunks)
+ * are still parsed, so a command can close it, and are cut out of the
+ * forwarded stream; they count as forwarded. */
+#define COMM_BRIDGE_WINDOW      768    /* Outstanding bytes, < RX ring */
+#define COMM_BRIDGE_HOLES       8      /* STM32 frames in flight (power of 2) */
+#define COMM_BRIDGE_CREDIT_STEP 128    /* Report after this many bytes */
+#define COMM_BRIDGE_IDLE_MS     30000  /* Close after this long without data */
+#define COMM_BRIDGE_FRAME_SIZE  11
+
+/* Image/File Chunk Header, followed by data_length bytes and a CRC-32
+ * over header and data. The Pi drives the transfer (selective repeat
+ * against the ground's bitmap of received chunks); the STM32 relays
+ * chunks to the radio unchanged. Firmware chunks use the same layout
+ * with file_id = low half of the update session (see fwupdate.h). */
+typedef struct __attribute__((packed)) {
+    uint8_t  sync1;              /* 0xAA */
+    uint8_t  sync2;              /* 0x58 = image, 0x59 = file, 0x5F = firmware */
+    uint16_t file_id;
+    uint16_t chunk_number;
+    uint16_t chunk_count;        /* Chunks in the whole file */
+    uint16_t data_length;
+} ChunkHeader_t;
+
+/* Reference to a received frame. data points into the RX ring (or the
+ * wrap buffer for the rare frame that straddles the end of the ring),
+ * so it stays valid only until the DMA laps it or the next wrapped frame
+ * refills the wrap buffer - see COMM_FrameValid(). Copy the frame out
+ * before checking it if it must not change under the reader. */
+typedef struct {
+    const uint8_t* data;
+    uint16_t length;
+    uint16_t sync_word;
+    uint32_t stream_pos;         /* Absolute RX byte position of data[0] */
+    uint32_t wrap_gen;           /* Wrap buffer fill data was copied by */
+} COMM_Frame_t;
 
 /* Communication Functions */
 HAL_StatusTypeDef COMM_Init(void);
-HAL_StatusTypeDef COMM_SendTelemetry(TelemetryPacket_t* packet);
+HAL_StatusTypeDef COMM_SendTelemetry(const TelemetryPacket_t* packet);
 HAL_StatusTypeDef COMM_SendData(uint8_t* data, uint16_t length, uint16_t sync_word);
 void COMM_ProcessReceivedData(uint8_t* data, uint16_t length);
 void COMM_StartReception(void);
+uint8_t COMM_FrameValid(const COMM_Frame_t* frame);
+uint8_t COMM_NextCommand(COMM_Frame_t* frame);
+void COMM_Notify(uint32_t events);
+
+/* Queued DMA Transmit - copies the frame into the UART's TX ring and
+ * returns immediately; HAL_BUSY if the ring has no room for it */
+HAL_StatusTypeDef COMM_Transmit(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t length);
+uint16_t COMM_TxFree(UART_HandleTypeDef* huart);
 
 /* UART Callbacks */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+/* Bridge Mode */
+HAL_StatusTypeDef COMM_BridgeStart(uint32_t idle_ms);
+void COMM_BridgeStop(void);
+uint8_t COMM_BridgeActive(void);
+uint32_t COMM_BridgeService(void);
 
 /* Beacon Functions */
 void COMM_SendBeacon(void);
@@ -0,0 +1,30 @@
+/* crc.h - Frame Integrity Header */
+#ifndef __CRC_H
+#define __CRC_H
+
+#include "main.h"
+
+/* CRC-32 on the STM32F4 CRC peripheral (set to 0 to force the table) */
+#ifndef CRC32_USE_HARDWARE
+#define CRC32_USE_HARDWARE 1
+#endif
+
+/* Initial values */
+#define CRC16_INIT 0xFFFF
+#define CRC32_INIT 0xFFFFFFFF
+
+/* CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, no reflection, no xorout.
+ * Used for telemetry and v2 command frames. */
+uint16_t CRC16_Calculate(const void* data, uint16_t length);
+uint16_t CRC16_Update(uint16_t crc, const void* data, uint16_t length);
+
+/* CRC-32/MPEG-2: poly 0x04C11DB7, init 0xFFFFFFFF, no reflection, no xorout.
+ * This is what the F4 CRC unit computes when fed big-endian words, so
+ * Calculate runs on the peripheral; Update resumes from an arbitrary
+ * value and is always done with the table (the F4 unit cannot be seeded).
+ * Calculate is for task context only. */
+void CRC32_Init(void);
+uint32_t CRC32_Calculate(const void* data, uint32_t length);
+uint32_t CRC32_Update(uint32_t crc, const void* data, uint32_t length);
+
+#endif /* __CRC_H */
@@ -0,0 +1,96 @@
+/* diag.h - Runtime Diagnostics Header */
+#ifndef __DIAG_H
+#define __DIAG_H
+
+#include "main.h"
+#include "system.h"
+
+/* DWT cycle-count probes around ISRs, command handling, sensor reads
+ * and UART transmits (set to 0 to compile them out) */
+#ifndef DIAG_ENABLE_PROBES
+#define DIAG_ENABLE_PROBES 1
+#endif
+
+/* FreeRTOS run-time stats run off the same counter (FreeRTOSConfig.h
+ * points the run-time stats port hooks here). The core clock is gated in WFI and STOP, so task shares are of the
+ * time the CPU was awake. */
+#define DIAG_RUNTIME_SHIFT     10      /* Run-time stat tick = 1024 cycles */
+#define DIAG_MAX_TASKS         8
+
+/* Probe slots. Handlers sharing a slot run at the same NVIC level and
+ * never nest, so each slot has one writer at a time. A probe includes
+ * any higher-level handler that preempted it. */
+typedef enum {
+    DIAG_ISR_USART1 = 0,       /* USART1 IRQ and its RX DMA stream */
+    DIAG_ISR_USART2,
+    DIAG_ISR_UART_DMA_TX,      /* Both TX DMA streams */
+    DIAG_ISR_I2C,              /* Event, error and RX DMA */
+    DIAG_ISR_SPI,              /* SPI1 RX/TX DMA, chains the ADC scan */
+    DIAG_ISR_ADC,              /* ADC1 DMA, battery block averaging */
+    DIAG_ISR_MAG_DRDY,
+    DIAG_ISR_RAD_GATE,
+    DIAG_ISR_RTC,
+    DIAG_COMMAND,              /* ProcessCommand */
+    DIAG_SENSOR_SWEEP,         /* Asynchronous I2C sweep */
+    DIAG_SENSOR_ADC_SCAN,      /* MCP3008 scan, all channels */
+    DIAG_HIST_APPEND,
+    DIAG_FW_CHUNK,             /* Firmware chunk check and program */
+    DIAG_UART_TX,              /* COMM_Transmit */
+    DIAG_PROBE_COUNT
+} DIAG_ProbeId_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max;              /* Cycles */
+    uint64_t total;
+} DIAG_Probe_t;
+
+extern DIAG_Probe_t diag_probes[DIAG_PROBE_COUNT];
+
+static inline void DIAG_Record(DIAG_ProbeId_t id, uint32_t cycles) {
+    DIAG_Probe_t* p = &diag_probes[id];
+    
+    p->count++;
+    p->total += cycles;
+    if(cycles > p->max) {
+        p->max = cycles;
+    }
+}
+
+/* BEGIN/END bracket a whole function body (one pair per scope);
+ * DIAG_TIMED wraps a single statement at a call site */
+#if DIAG_ENABLE_PROBES
+#define DIAG_PROBE_BEGIN()    uint32_t diag_t0 = DWT->CYCCNT
+#define DIAG_PROBE_END(id)    DIAG_Record((id), DWT->CYCCNT - diag_t0)
+#define DIAG_TIMED(id, ...)   do { DIAG_PROBE_BEGIN(); __VA_ARGS__; \
+                                   DIAG_PROBE_END(id); } while(0)
+#else
+#define DIAG_PROBE_BEGIN()
+#define DIAG_PROBE_END(id)
+#define DIAG_TIMED(id, ...)   do { __VA_ARGS__; } while(0)
+#endif
+
+/* Diagnostics report (SYNC_DIAG, to the Pi, on CMD_GET_DIAGNOSTICS):
+ *   AA 5E <uint8 probes> <uint8 tasks> <uint32 core clock Hz>
+ *   per probe: <uint32 count> <uint32 max cycles> <uint32 mean cycles>
+ *   per task:  <char name[4]> <uint16 CPU permille> <uint16 stack free words>
+ *   <uint8 supervised tasks>, per supervised task (SUPV_TaskId_t order):
+ *              <uint16 max interval ms> <uint16 max jitter us> <uint16 missed>
+ *   <uint32 magnetometer samples dropped>
+ *   <uint32 STOP entries> <uint32 ms in STOP>
+ *   <CRC-16 over all of the above>
+ * CPU shares are over the interval since the previous report. */
+#define DIAG_HEADER_SIZE       8
+#define DIAG_PROBE_RECORD_SIZE 12
+#define DIAG_TASK_RECORD_SIZE  8
+#define DIAG_SUPV_RECORD_SIZE  6
+#define DIAG_REPORT_MAX        (DIAG_HEADER_SIZE + \
+                                DIAG_PROBE_COUNT * DIAG_PROBE_RECORD_SIZE + \
+                                DIAG_MAX_TASKS * DIAG_TASK_RECORD_SIZE + \
+                                1 + SUPV_TASK_COUNT * DIAG_SUPV_RECORD_SIZE + 4 + 8 + 2)
+
+void DIAG_Init(void);
+uint32_t DIAG_RunTimeCounter(void);
+HAL_StatusTypeDef DIAG_SendReport(uint8_t reset);
+
+#endif /* __DIAG_H */
@@ -0,0 +1,45 @@
+/* dump.h - History Bulk Transfer Header */
+#ifndef __DUMP_H
+#define __DUMP_H
+
+#include "main.h"
+
+/* History frame (SYNC_HISTORY, to the Pi):
+ *   AA 62 <uint16 session> <uint16 frame> <uint8 flags> <uint16 length>
+ *   <length bytes of history records> <CRC-16 over all of the above>
+ * Records use the flash format and every frame starts on a keyframe, so
+ * frames decode independently and can arrive in any order. */
+#define DUMP_HEADER_SIZE       9
+#define DUMP_FRAME_DATA        240     /* Record bytes per frame */
+#define DUMP_FRAME_MAX         (DUMP_HEADER_SIZE + DUMP_FRAME_DATA + 2)
+#define DUMP_FLAG_LAST         0x01    /* Final frame of the transfer */
+
+/* CMD_GET_HISTORY: one-shot, session 0, no ACKs */
+#define DUMP_ONESHOT_TIMEOUT_MS 1000   /* Give up if the Pi link stalls */
+
+/* CMD_DUMP_HISTORY: selective repeat. Up to window frames are in flight;
+ * CMD_DUMP_ACK reports <uint16 session> <uint16 base> <uint32 bitmap>,
+ * every frame below base plus frame base + i for each set bit i. */
+#define DUMP_MAX_WINDOW        8       /* Frames buffered for resend */
+#define DUMP_DEFAULT_WINDOW    8
+#define DUMP_RTO_MS            5000    /* Resend an unacked frame after this */
+#define DUMP_GAP_RETX_MS       1000    /* ...or sooner if a later one is acked */
+#define DUMP_SESSION_TIMEOUT_MS 30000  /* Abandon after this long without an ACK */
+#define DUMP_POLL_MS           50      /* DownlinkTask service period while active */
+
+/* Transfers run in DownlinkTask at low priority. CommTask only queues
+ * requests and ACKs (HAL_BUSY if the queue is full) and wakes it. */
+#define DUMP_REQUEST_RING_SIZE 4       /* Power of 2 */
+#define DUMP_ACK_RING_SIZE     8       /* Power of 2, an overflow is resent */
+#define DUMP_FLAG_WAKE         0x0001  /* DownlinkTask thread flag */
+
+HAL_StatusTypeDef DUMP_SendRange(uint16_t first_seq, uint16_t last_seq);
+HAL_StatusTypeDef DUMP_Start(uint16_t session, uint16_t first_seq, uint16_t last_seq, uint8_t window);
+HAL_StatusTypeDef DUMP_HandleAck(uint16_t session, uint16_t base, uint32_t bitmap);
+void DUMP_Notify(void);
+
+/* DownlinkTask side */
+void DUMP_Init(void);
+uint32_t DUMP_Service(void);
+
+#endif /* __DUMP_H */
@@ -0,0 +1,62 @@
+/* fwslot.h - Firmware Update Slot Layout
+ *
+ * Shared by the application and the bootloader, so plain types only.
+ *
+ *   0x08000000  sector 0      16 KB  bootloader
+ *   0x08004000  sectors 1-3   48 KB  application
+ *   0x08010000  sector 4      64 KB  history A
+ *   0x08020000  sector 5     128 KB  history B, or the update slot:
+ *                 +0x00000  FWU_Slot_t header and chunk map
+ *                 +0x00400  staged image (up to 48 KB)
+ *                 +0x10000  backup of the running application
+ *
+ * Every state change programs one erased word to FWU_FLAG_SET, so the
+ * header is append-only and a reset at any point leaves it consistent.
+ * STM32F401CCUX_FLASH.ld and Bootloader/STM32F401CCUX_BOOT.ld repeat the
+ * application base and size and check both at link time.
+ */
+#ifndef __FWSLOT_H
+#define __FWSLOT_H
+
+#include <stdint.h>
+
+#define FWU_APP_BASE          0x08004000u
+#define FWU_APP_SIZE          0x0000C000u   /* 48 KB */
+#define FWU_APP_FIRST_SECTOR  1
+#define FWU_APP_SECTORS       3
+
+#define FWU_SLOT_BASE         0x08020000u   /* = HIST_SECTOR_B_BASE */
+#define FWU_SLOT_SECTOR       5
+#define FWU_SLOT_IMAGE        (FWU_SLOT_BASE + 0x00400u)
+#define FWU_SLOT_BACKUP       (FWU_SLOT_BASE + 0x10000u)
+
+#define FWU_CHUNK_SIZE        256
+#define FWU_MAX_CHUNKS        (FWU_APP_SIZE / FWU_CHUNK_SIZE)
+#define FWU_MAX_TRIALS        3       /* Unconfirmed boots before rollback */
+
+#define FWU_RAM_BASE          0x20000000u  /* Initial stack pointer check */
+#define FWU_RAM_SIZE          0x00010000u
+
+#define FWU_MAGIC             0x55425746u  /* "FWBU" */
+#define FWU_FLAG_SET          0x00000000u
+#define FWU_FLAG_CLEAR        0xFFFFFFFFu  /* Erased */
+
+typedef struct {
+    uint32_t magic;          /* Programmed last when the upload starts */
+    uint32_t session;        /* Ground's id for the upload, matched on resume */
+    uint32_t image_size;
+    uint32_t image_crc;      /* CRC-32/MPEG-2 over image_size bytes */
+    uint32_t complete;       /* App: every chunk in, image CRC checked */
+    uint32_t pending;        /* App: install at the next reset */
+    uint32_t backup_crc;     /* Boot: CRC of the saved application */
+    uint32_t backed_up;      /* Boot: backup_crc is valid */
+    uint32_t installed;      /* Boot: new image copied and verified */
+    uint32_t trials[FWU_MAX_TRIALS];  /* Boot: one per unconfirmed start */
+    uint32_t confirmed;      /* App: new image ran healthy */
+    uint32_t rolled_back;    /* Boot: backup restored */
+    uint32_t chunk_done[FWU_MAX_CHUNKS];  /* Flag per chunk, set once programmed */
+} FWU_Slot_t;
+
+#define FWU_SLOT ((const volatile FWU_Slot_t*)(uintptr_t)FWU_SLOT_BASE)
+
+#endif /* __FWSLOT_H */
@@ -0,0 +1,52 @@
+/* fwupdate.h - Firmware Update Header */
+#ifndef __FWUPDATE_H
+#define __FWUPDATE_H
+
+#include "main.h"
+#include "fwslot.h"
+#include "communication.h"
+
+/* CMD_UPDATE_FIRMWARE operations, parameters[0] */
+#define FWU_OP_BEGIN    0x00    /* uint32 session, uint32 size, uint32 crc */
+#define FWU_OP_STATUS   0x01
+#define FWU_OP_COMMIT   0x02    /* Install at the next reset */
+#define FWU_OP_ABORT    0x03
+
+/* Status report, STM32 to Pi, in reply to every operation, every
+ * FWU_ACK_INTERVAL chunks and when the image is complete:
+ *   AA 60 <uint8 state> <uint8 result> <uint32 session>
+ *         <uint16 chunk_count> <uint16 base> <uint32 bitmap> <CRC-16>
+ * base is the first missing chunk, bit i of bitmap is chunk base + i. */
+#define FWU_STATUS_FRAME_SIZE   18
+#define FWU_ACK_INTERVAL        8
+#define FWU_PREPARE_POLL_MS     100     /* Waiting for history to free the slot */
+#define FWU_CONFIRM_UPTIME_S    120     /* Healthy run before a new image is kept */
+
+typedef enum {
+    FWU_STATE_IDLE = 0,
+    FWU_STATE_PREPARING,     /* History moving off the slot, then erase */
+    FWU_STATE_RECEIVING,     /* Ready for chunks */
+    FWU_STATE_COMPLETE,      /* Every chunk in, image CRC verified */
+    FWU_STATE_PENDING,       /* Committed, installs at the next reset */
+    FWU_STATE_TRIAL,         /* Running the new image, not confirmed yet */
+    FWU_STATE_CONFIRMED,
+    FWU_STATE_ROLLED_BACK
+} FWU_State_t;
+
+typedef enum {
+    FWU_OK = 0,
+    FWU_ERR_STATE,           /* Operation not valid now */
+    FWU_ERR_SIZE,            /* Image too large or chunk out of range */
+    FWU_ERR_CRC,             /* Chunk or image CRC mismatch */
+    FWU_ERR_FLASH,           /* Erase or program failed */
+    FWU_ERR_IMAGE            /* Vector table does not point into the app */
+} FWU_Result_t;
+
+void FWU_Init(void);
+void FWU_HandleCommand(const uint8_t* params, uint16_t length);
+void FWU_HandleChunk(const COMM_Frame_t* frame);
+uint32_t FWU_Service(void);
+void FWU_Confirm(void);
+FWU_State_t FWU_GetState(void);
+
+#endif /* __FWUPDATE_H */
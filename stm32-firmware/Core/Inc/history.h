@@ -0,0 +1,63 @@
+/* history.h - Flash Telemetry History Header */
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include "main.h"
+
+/* Log-structured ring over two internal flash sectors. Records are
+ * appended to the active sector; when it fills, the other (oldest)
+ * sector is erased and becomes active, so wear is spread over both.
+ * Sector B is also the firmware update slot (fwslot.h); while it is lent
+ * the log runs in sector A alone, which is recycled in place. */
+#define HIST_SECTOR_A          FLASH_SECTOR_4
+#define HIST_SECTOR_A_BASE     0x08010000u
+#define HIST_SECTOR_A_SIZE     0x10000u     /* 64 KB */
+#define HIST_SECTOR_B          FLASH_SECTOR_5
+#define HIST_SECTOR_B_BASE     0x08020000u
+#define HIST_SECTOR_B_SIZE     0x20000u     /* 128 KB */
+#define HIST_MAGIC             0x54534948u  /* "HIST" */
+
+#define HIST_LOG_INTERVAL      1       /* Log every Nth sensor sweep */
+#define HIST_PERIOD_MS         (1000 * HIST_LOG_INTERVAL)
+#define HIST_KEYFRAME_INTERVAL 64      /* Records between full frames */
+#define HIST_MAX_PAYLOAD       160
+#define HIST_RECORD_OVERHEAD   3       /* Length byte + CRC-16 */
+
+/* Record: [len][payload: varint field mask, then one zigzag varint per
+ * set field][CRC-16 over len and payload]. Each field is predicted from
+ * the previous record (plus a fixed step for counters), only non-zero
+ * residuals are stored. Floats are kept at sensor resolution (see the
+ * field table in history.c). A keyframe predicts from zero. */
+
+/* Range walk, resumable so a transfer can pull packets as the link
+ * takes them */
+typedef struct {
+    uint16_t first_seq;
+    uint16_t span;           /* last_seq - first_seq */
+    uint8_t  phase;          /* 0 = older sector, 1 = active, 2 = done */
+    uint8_t  sector;
+    uint8_t  chained;        /* prev is valid for the next delta */
+    uint32_t addr;
+    uint32_t end;
+    uint32_t active_end;     /* Write position when the walk began */
+    uint32_t generation;     /* Of the sector being walked */
+    uint32_t active_generation;
+    TelemetryPacket_t prev;
+} HIST_Iter_t;
+
+HAL_StatusTypeDef HIST_Init(void);
+HAL_StatusTypeDef HIST_Append(const TelemetryPacket_t* packet);
+void HIST_IterBegin(HIST_Iter_t* it, uint16_t first_seq, uint16_t last_seq);
+uint8_t HIST_IterNext(HIST_Iter_t* it, TelemetryPacket_t* packet);
+
+/* Sector B loan, any task. Lent once SensorTask has moved off it. */
+void HIST_LendSector(void);
+uint8_t HIST_SectorLent(void);
+void HIST_ReturnSector(void);
+
+/* Codec, shared with the downlink. prev = NULL encodes a keyframe. */
+uint16_t HIST_Encode(const TelemetryPacket_t* packet, const TelemetryPacket_t* prev, uint8_t* out);
+HAL_StatusTypeDef HIST_Decode(const uint8_t* in, uint16_t length,
+                              const TelemetryPacket_t* prev, TelemetryPacket_t* packet);
+
+#endif /* __HISTORY_H */
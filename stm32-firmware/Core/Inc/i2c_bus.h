@@ -0,0 +1,35 @@
+/* i2c_bus.h - Asynchronous I2C Transaction Queue Header */
+#ifndef __I2C_BUS_H
+#define __I2C_BUS_H
+
+#include "main.h"
+
+/* Reads at least this long go by DMA, shorter ones by interrupt: the
+ * magnetometer sample (6 bytes, streamed at 155 Hz) and the BME280 burst
+ * (8) by DMA, the TMP117 result (2) byte by byte */
+#define I2CBUS_DMA_THRESHOLD  6
+#define I2CBUS_QUEUE_SIZE     8
+#define I2CBUS_FLAG_DONE      0x0001  /* Thread flag set on completion */
+
+typedef struct I2CBUS_Transaction {
+    uint16_t dev_addr;            /* 7-bit address */
+    uint8_t  reg;
+    uint8_t  is_read;
+    uint8_t* data;
+    uint16_t length;
+    uint32_t timeout_ms;
+    /* Optional, called from interrupt context when the transaction ends */
+    void (*complete)(struct I2CBUS_Transaction* txn);
+    
+    /* Filled in by the bus */
+    volatile HAL_StatusTypeDef status;  /* HAL_BUSY until finished */
+    uint32_t start_tick;
+    void* notify_thread;          /* Submitting thread, woken on completion */
+} I2CBUS_Transaction_t;
+
+HAL_StatusTypeDef I2CBUS_Init(I2C_HandleTypeDef* hi2c);
+HAL_StatusTypeDef I2CBUS_Submit(I2CBUS_Transaction_t* txn);
+HAL_StatusTypeDef I2CBUS_SubmitFromISR(I2CBUS_Transaction_t* txn);
+HAL_StatusTypeDef I2CBUS_Wait(I2CBUS_Transaction_t* txn);
+
+#endif /* __I2C_BUS_H */
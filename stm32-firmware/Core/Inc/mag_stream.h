@@ -0,0 +1,49 @@
+/* mag_stream.h - LIS3MDL Data-Ready Streaming and Decimation Header */
+#ifndef __MAG_STREAM_H
+#define __MAG_STREAM_H
+
+#include "main.h"
+
+/* Stream every LIS3MDL sample instead of one read per sensor sweep */
+#ifndef MAG_STREAM_ENABLE
+#define MAG_STREAM_ENABLE     1
+#endif
+
+#define LIS3MDL_OUT_X_L_AI    0xA8       /* OUT_X_L with auto-increment */
+#define LIS3MDL_GAUSS_PER_LSB 0.00016f   /* Same scale as LIS3MDL_Convert */
+
+/* Samples buffered between the I2C ISR and SensorTask, power of 2.
+ * SensorTask drains it once a second, so it must hold a second of
+ * samples at the 155 Hz ODR plus a late wake-up. */
+#define MAG_RING_SIZE         256
+
+/* CIC decimator: order 1 is a plain boxcar average. One output per
+ * MAG_CIC_DECIMATION samples, 155 = 1 s at the 155 Hz ODR. */
+#define MAG_CIC_ORDER         2
+#define MAG_CIC_DECIMATION    155
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} MAG_Sample_t;
+
+/* One decimation window, in gauss */
+typedef struct {
+    float    mean[3];        /* CIC output */
+    float    min[3];
+    float    max[3];
+    float    variance[3];    /* gauss^2 */
+    uint16_t samples;        /* Samples in the window */
+    uint16_t dropped;        /* Samples lost to ring or bus overrun */
+} MAG_Stats_t;
+
+extern MAG_Stats_t mag_stats;
+
+HAL_StatusTypeDef MAG_StreamStart(void);
+void MAG_StreamKick(void);
+void MAG_DataReadyCallback(void);
+uint8_t MAG_StreamProcess(MAG_Stats_t* stats);
+uint32_t MAG_DroppedTotal(uint8_t reset);
+
+#endif /* __MAG_STREAM_H */
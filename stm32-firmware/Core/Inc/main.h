@@ -28,9 +28,24 @@ extern "C" {
 #define CMD_SET_MODE        0x04
 #define CMD_RESET           0x05
 #define CMD_TRANSMIT_FILE   0x06
-#define CMD_UPDATE_FIRMWARE 0x07
-#define CMD_SET_SCHEDULE    0x08
-#define CMD_BEACON          0x09
+#define CMD_UPDATE_FIRMWARE 0x07  /* uint8 op, ... - see fwupdate.h */
+#define CMD_SET_SCHEDULE    0x08  /* uint8 op, ... - see scheduler.h */
+#define CMD_BEACON          0x09  /* [uint16 interval s] - none sends one now */
+#define CMD_GET_DIAGNOSTICS 0x0F  /* [uint8 reset] - probe and task statistics */
+#define CMD_FILE_ACK        0x10  /* uint16 file_id, uint16 first_chunk, bitmap - for the Pi */
+#define CMD_GET_HISTORY     0x11  /* uint16 first_seq, uint16 last_seq */
+#define CMD_DUMP_HISTORY    0x12  /* uint16 first_seq, uint16 last_seq, [uint8 window] */
+#define CMD_DUMP_ACK        0x13  /* uint16 session, uint16 base, uint32 bitmap */
+#define CMD_BRIDGE          0x14  /* uint8 enable, [uint16 idle timeout s] */
+
+/* Command Framing
+ * v1: sync 0xAA 0x56, parameters always padded to 64 bytes
+ * v2: sync 0xAA 0x5B, only parameter_length bytes are sent, a CRC-16
+ *     follows them directly. Both are accepted; PING replies carry the
+ *     highest version supported so ground software can pick one. */
+#define CMD_PROTOCOL_VERSION 2
+#define CMD_HEADER_SIZE      7    /* sync1 .. parameter_length */
+#define CMD_MAX_PARAMETERS   64
 
 /* Error Codes */
 #define ERROR_NONE          0x00
@@ -42,6 +57,7 @@ extern "C" {
 #define ERROR_TEMPERATURE   0x06
 #define ERROR_TASK_HANG     0x07
 #define ERROR_MEMORY        0x08
+#define ERROR_UNKNOWN_COMMAND 0x09
 
 /* Battery Thresholds (mV) */
 #define BATTERY_NOMINAL     3700
@@ -54,6 +70,39 @@ extern "C" {
 #define TMP117_ADDR         0x48  /* Precision temperature */
 #define MCP3008_ADDR        0x00  /* ADC (SPI, not I2C) */
 
+/* Task Stacks (32-bit words). Tasks, stacks and the beacon timer are
+ * allocated statically in main.c; tune these from the free-stack figures
+ * in the GET_DIAGNOSTICS report. FreeRTOSConfig.h allows static
+ * allocation only, so cmsis_os2.c supplies the idle and timer task memory
+ * statically too, and nothing is left on the FreeRTOS heap. */
+#define SENSOR_TASK_STACK_WORDS     320   /* History append and delta encode */
+#define RADIATION_TASK_STACK_WORDS  160
+#define COMM_TASK_STACK_WORDS       256   /* Diagnostics report */
+#define DOWNLINK_TASK_STACK_WORDS   384   /* Dump frame fill and history decode */
+#define WATCHDOG_TASK_STACK_WORDS   192   /* Clock profile switch */
+
+/* Task Priorities. Acquisition first, so a sample is never late because
+ * of I/O; commands next; bulk downlink (history dumps) takes whatever is
+ * left. The supervisor sits just under acquisition - it is short, and a
+ * clock switch from it must not delay a sample. */
+#define SENSOR_TASK_PRIORITY        osPriorityHigh
+#define RADIATION_TASK_PRIORITY     osPriorityAboveNormal
+#define WATCHDOG_TASK_PRIORITY      osPriorityAboveNormal
+#define COMM_TASK_PRIORITY          osPriorityNormal
+#define DOWNLINK_TASK_PRIORITY      osPriorityBelowNormal
+
+/* Interrupt Priorities (NVIC preemption level, lower preempts higher).
+ * All of them call the RTOS API, so none may be above (numerically
+ * below) configMAX_SYSCALL_INTERRUPT_PRIORITY, which is 5. Handlers
+ * that share state share a level and therefore never nest. */
+#define IRQ_PRIO_RAD_GATE   5   /* TIM3 - entry latency widens the bins */
+#define IRQ_PRIO_SENSOR     6   /* EXTI1 DRDY, I2C1 EV/ER, I2C1/SPI1/ADC1 DMA */
+#define IRQ_PRIO_COMM       7   /* USART1/2 and their DMA - share the TX rings */
+#define IRQ_PRIO_WAKEUP     8   /* RTC wakeup, EXTI0 (STOP only) */
+
+/* Radiation histogram bins per telemetry frame (1 s of 100 ms gates) */
+#define TLM_RADIATION_BINS  10
+
 /* Pin Definitions */
 #define RADIATION_PIN       GPIO_PIN_0
 #define RADIATION_PORT      GPIOA
@@ -63,6 +112,10 @@ extern "C" {
 #define ADC_PORT            GPIOB
 #define PI_WAKE_PIN         GPIO_PIN_1
 #define PI_WAKE_PORT        GPIOA
+#define MAG_DRDY_PIN        GPIO_PIN_1   /* LIS3MDL data-ready */
+#define MAG_DRDY_PORT       GPIOB
+#define MCP3008_CS_PIN      GPIO_PIN_4   /* SPI1 NSS, driven as a GPIO */
+#define MCP3008_CS_PORT     GPIOA
 
 /* Telemetry Packet Structure */
 typedef struct __attribute__((packed)) {
@@ -77,7 +130,7 @@ typedef struct __attribute__((packed)) {
     float    mag_y;
     float    mag_z;
     uint16_t corrosion_raw;       /* ADC value */
-    uint32_t radiation_cps;       /* Counts per second */
+    uint32_t radiation_cps;       /* Counts per second, dead-time corrected */
     float    temperature_bme;      /* °C */
     float    pressure;             /* hPa */
     float    humidity;             /* %RH */
@@ -92,24 +145,27 @@ typedef struct __attribute__((packed)) {
     
     /* System Status */
     uint16_t battery_voltage;     /* mV */
-    uint16_t battery_current;      /* mA */
+    uint16_t battery_current;      /* mA drawn, 0 while charging */
     uint8_t  boot_count;
     uint8_t  error_flags;
     uint8_t  system_state;
     uint32_t uptime;              /* seconds */
     
-    uint16_t checksum;
+    /* Radiation Detail */
+    uint16_t radiation_hist[TLM_RADIATION_BINS];  /* Raw counts per 100 ms, oldest first */
+    
+    uint16_t checksum;            /* CRC-16/CCITT-FALSE */
 } TelemetryPacket_t;
 
 /* Command Packet Structure */
 typedef struct __attribute__((packed)) {
     uint8_t  sync1;              /* 0xAA */
-    uint8_t  sync2;              /* 0x56 */
+    uint8_t  sync2;              /* 0x56 (v1) or 0x5B (v2) */
     uint8_t  command_id;
     uint16_t sequence_number;
     uint16_t parameter_length;
-    uint8_t  parameters[64];
-    uint16_t checksum;
+    uint8_t  parameters[CMD_MAX_PARAMETERS];
+    uint16_t checksum;           /* v1 sum only - v2 CRC-16 ends the frame */
 } CommandPacket_t;
 
 /* Function Prototypes */
@@ -117,12 +173,26 @@ void SystemClock_Config(void);
 void Error_Handler(void);
 uint16_t CalculateChecksum(void* data, uint16_t length);
 void ProcessCommand(CommandPacket_t* cmd);
+uint16_t CommandFrameLength(const CommandPacket_t* cmd);
 void LogError(uint8_t error_code);
 void SendBeacon(void);
 void ShutdownPayload(void);
 
 extern uint8_t system_state;
-extern TelemetryPacket_t current_telemetry;
+
+/* Peripheral Handles (defined in main.c) */
+extern UART_HandleTypeDef huart1;
+extern UART_HandleTypeDef huart2;
+extern I2C_HandleTypeDef hi2c1;
+extern SPI_HandleTypeDef hspi1;
+extern ADC_HandleTypeDef hadc1;
+extern IWDG_HandleTypeDef hiwdg;
+extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim3;
+extern DMA_HandleTypeDef hdma_usart1_rx;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern DMA_HandleTypeDef hdma_i2c1_rx;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,41 @@
+/* mcp3008.h - MCP3008 Multi-Channel ADC Scan Header */
+#ifndef __MCP3008_H
+#define __MCP3008_H
+
+#include "main.h"
+
+#define MCP3008_CHANNELS         8
+#define MCP3008_MAX_OVERSAMPLE   8
+#define MCP3008_CONVERSION_BYTES 3       /* Start, SGL/channel, clock-out */
+#define MCP3008_MAX_CONVERSIONS  (MCP3008_CHANNELS * MCP3008_MAX_OVERSAMPLE)
+#define MCP3008_CS_HIGH_NS       270     /* tCSH between conversions */
+#define MCP3008_SCAN_TIMEOUT_MS  10      /* 64 conversions take ~2 ms */
+#define MCP3008_FLAG_DONE        0x0002  /* Thread flag set when a scan ends */
+
+/* Channel assignment: corrosion probe on CH0, panel currents and
+ * thermistors on the rest */
+#define MCP3008_CH_CORROSION     0
+#define MCP3008_CH_BATT_CURRENT  1       /* Battery shunt amplifier */
+#define MCP3008_SCAN_MASK        0xFF    /* Channels SensorTask scans */
+#define MCP3008_SCAN_OVERSAMPLE  4
+
+/* Average is the mean of the oversamples in 1/16 LSB, so oversampling
+ * below the noise floor keeps its extra resolution */
+#define MCP3008_AVERAGE_SHIFT    4
+
+typedef struct {
+    uint8_t  mask;                          /* Channels converted */
+    uint8_t  oversample;                    /* Conversions per channel */
+    uint16_t raw[MCP3008_CHANNELS];         /* Last conversion, 10-bit */
+    uint16_t average[MCP3008_CHANNELS];     /* 1/16 LSB */
+    uint32_t tick;                          /* HAL tick at completion */
+} MCP3008_Scan_t;
+
+extern MCP3008_Scan_t adc_scan;             /* SensorTask's last scan */
+
+HAL_StatusTypeDef MCP3008_Init(SPI_HandleTypeDef* hspi);
+HAL_StatusTypeDef MCP3008_Scan(uint8_t mask, uint8_t oversample, MCP3008_Scan_t* result);
+uint16_t MCP3008_Read(uint8_t channel);
+uint16_t MCP3008_Rounded(const MCP3008_Scan_t* scan, uint8_t channel);
+
+#endif /* __MCP3008_H */
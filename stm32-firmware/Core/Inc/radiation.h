@@ -0,0 +1,43 @@
+/* radiation.h - Gated Radiation Counter Header */
+#ifndef __RADIATION_H
+#define __RADIATION_H
+
+#include "main.h"
+
+/* SBM-20 pulses on PA0 clock TIM2 through its ETR input, so the count
+ * costs no CPU. TIM3 closes a 100 ms gate bin on each update; every
+ * RAD_GATE_BINS bins make one window handed to RadiationTask. */
+#define RAD_BIN_MS            100
+#define RAD_GATE_BINS         TLM_RADIATION_BINS  /* 10 x 100 ms = 1 s */
+#define RAD_GATE_TICK_HZ      10000   /* TIM3 count rate after prescaler */
+#define RAD_ETR_FILTER        3       /* 8 samples at fCK_INT, rejects glitches */
+#define RAD_DEAD_TIME_US      190     /* SBM-20 dead time, non-paralyzable */
+#define RAD_MAX_LOSS          0.9f    /* Past this the tube is saturated */
+#define RAD_WINDOW_RING_SIZE  4       /* Completed windows queued, power of 2 */
+#define RAD_FLAG_WINDOW       0x0001  /* Thread flag: a window completed */
+
+/* One completed gate window */
+typedef struct {
+    uint16_t counts[RAD_GATE_BINS];   /* Raw pulses per bin */
+    uint16_t bin_ms[RAD_GATE_BINS];   /* Measured bin length */
+    uint32_t window_ms;
+} RAD_Window_t;
+
+HAL_StatusTypeDef RAD_Start(void);
+void RAD_GateRetune(void);
+uint8_t RAD_GetWindow(RAD_Window_t* window);
+uint32_t RAD_CorrectedCps(const RAD_Window_t* window);
+
+uint32_t RAD_GatePrescaler(void);
+
+/* TIM3 update interrupt */
+void RAD_GateElapsed(void);
+
+/* STOP halts both timers, so PA0 is also routed to EXTI0 while the
+ * core sleeps and each pulse is counted by software. Interrupts are
+ * masked from RAD_EnterStop to RAD_ExitStop. */
+void RAD_EnterStop(void);
+uint8_t RAD_StopWakeup(void);     /* 1 if a pulse was the wakeup */
+void RAD_ExitStop(void);
+
+#endif /* __RADIATION_H */
@@ -0,0 +1,40 @@
+/* scheduler.h - Time-Tagged Command Scheduler Header */
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include "main.h"
+
+/* Stored commands run at a set mission time: ms since boot on the RTOS
+ * tick, which keeps counting through STOP. A time up to ~24.8 days
+ * ahead is in the future, anything else has passed and runs at once.
+ * The schedule is in RAM and starts empty after a reset; status reports
+ * carry the current time so the ground can convert. */
+#define SCHED_MAX_ENTRIES   24
+#define SCHED_MAX_FRAME     (CMD_MAX_PARAMETERS - 5)  /* After op and time */
+
+/* CMD_SET_SCHEDULE operations, parameters[0] */
+#define SCHED_OP_ADD        0x00    /* uint32 time ms, v2 command frame */
+#define SCHED_OP_CANCEL     0x01    /* uint16 sequence number */
+#define SCHED_OP_CLEAR      0x02
+#define SCHED_OP_STATUS     0x03
+
+/* Status report, STM32 to Pi, in reply to every operation:
+ *   AA 61 <uint8 result> <uint8 entries> <uint32 now ms>
+ *         <uint32 next ms> <uint16 next sequence> <CRC-16>
+ * next is 0xFFFFFFFF / 0xFFFF when the schedule is empty. */
+#define SCHED_STATUS_FRAME_SIZE 16
+
+typedef enum {
+    SCHED_OK = 0,
+    SCHED_ERR_FULL,
+    SCHED_ERR_FRAME,         /* Embedded command malformed or bad checksum */
+    SCHED_ERR_NOT_FOUND,
+    SCHED_ERR_OP
+} SCHED_Result_t;
+
+void SCHED_Init(void);
+void SCHED_HandleCommand(const uint8_t* params, uint16_t length);
+void SCHED_RunDue(void);
+uint32_t SCHED_Now(void);
+
+#endif /* __SCHEDULER_H */
@@ -4,30 +4,72 @@
 
 #include "main.h"
 
+/* I2C1 runs in fast mode - LIS3MDL, BME280 and TMP117 all support 400 kHz */
+#define I2C1_CLOCK_SPEED      400000
+#define I2C_SENSOR_TIMEOUT_MS 10
+
+/* BME280 compensation path: 1 = Bosch int32/int64, 0 = float */
+#ifndef BME280_USE_FIXED_POINT
+#define BME280_USE_FIXED_POINT 1
+#endif
+#define BME280_BENCHMARK_ITERATIONS 100  /* Build with -DBME280_RUN_BENCHMARK */
+
 /* Sensor Initialization */
 HAL_StatusTypeDef Sensors_Init(void);
+HAL_StatusTypeDef Sensors_ReadSweep(TelemetryPacket_t* tlm);
 
 /* LIS3MDL Magnetometer */
 HAL_StatusTypeDef LIS3MDL_Init(void);
 HAL_StatusTypeDef LIS3MDL_Read(float* mx, float* my, float* mz);
+void LIS3MDL_Convert(const uint8_t* data, float* mx, float* my, float* mz);
 
 /* BME280 Environmental Sensor */
 HAL_StatusTypeDef BME280_Init(void);
 HAL_StatusTypeDef BME280_Read(float* temp, float* press, float* hum);
+void BME280_Convert(const uint8_t* data, float* temp, float* press, float* hum);
 float BME280_CompensateTemperature(int32_t raw_temp);
 float BME280_CompensatePressure(int32_t raw_press);
 float BME280_CompensateHumidity(int32_t raw_hum);
 
+/* Bosch integer compensation (default) or the float reference path.
+ * Both are always built so BME280_Benchmark can compare them. */
+int32_t  BME280_CompensateTemperatureFixed(int32_t raw_temp);  /* 0.01 degC */
+uint32_t BME280_CompensatePressureFixed(int32_t raw_press);    /* Pa, Q24.8 */
+uint32_t BME280_CompensateHumidityFixed(int32_t raw_hum);      /* %RH, Q22.10 */
+float BME280_CompensateTemperatureFloat(int32_t raw_temp);
+float BME280_CompensatePressureFloat(int32_t raw_press);
+float BME280_CompensateHumidityFloat(int32_t raw_hum);
+
+/* BME280 acquisition profiles - all run in forced mode, one conversion
+ * per sensor sweep, and the sensor sleeps in between */
+#define BME280_PROFILE_STANDARD   0  /* Nominal: T x2, P x4, H x1 */
+#define BME280_PROFILE_LOW_POWER  1  /* Low power: x1 everything */
+#define BME280_PROFILE_HIGH_RES   2  /* Safe mode: T x2, P x16, H x1, IIR 4 */
+#define BME280_PROFILE_COUNT      3
+
+typedef struct {
+    uint8_t ctrl_hum;    /* 0xF2: osrs_h */
+    uint8_t ctrl_meas;   /* 0xF4: osrs_t | osrs_p, mode bits clear */
+    uint8_t config;      /* 0xF5: IIR filter */
+} BME280_Profile_t;
+
+HAL_StatusTypeDef BME280_SetProfile(uint8_t profile);
+uint8_t BME280_ProfileForState(uint8_t state);
+uint32_t BME280_MeasureTime(void);
+HAL_StatusTypeDef BME280_TriggerMeasurement(void);
+
+typedef struct {
+    uint32_t fixed_cycles;   /* DWT cycles per T/P/H conversion */
+    uint32_t float_cycles;
+} BME280_Benchmark_t;
+
+void BME280_Benchmark(int32_t raw_temp, int32_t raw_press, int32_t raw_hum,
+                      BME280_Benchmark_t* result);
+
 /* TMP117 Precision Temperature */
 HAL_StatusTypeDef TMP117_Init(void);
 HAL_StatusTypeDef TMP117_Read(float* temp);
-
-/* MCP3008 ADC (SPI) */
-uint16_t MCP3008_Read(uint8_t channel);
-
-/* Battery Monitoring */
-uint16_t Read_Battery_Voltage(void);
-uint16_t Read_Battery_Current(void);
+void TMP117_Convert(const uint8_t* data, float* temp);
 
 /* Radiation Counter */
 uint32_t Get_Radiation_Counts(void);
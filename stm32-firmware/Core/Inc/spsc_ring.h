@@ -0,0 +1,88 @@
+/* spsc_ring.h - Lock-Free Single-Producer/Single-Consumer Ring
+ *
+ * For handing data from one interrupt to one task (or the reverse)
+ * without a critical section. head is written only by the producer and
+ * tail only by the consumer; both run freely and are masked on use, so
+ * the capacity must be a power of 2 and full/empty need no spare slot.
+ * A DMB orders the slot contents against each index update, which is
+ * all a single Cortex-M core needs.
+ *
+ * Producer:  slot = SPSC_CLAIM(r); fill *slot; SPSC_COMMIT(r);
+ * Consumer:  slot = SPSC_FRONT(r); read *slot; SPSC_RELEASE(r);
+ */
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include "main.h"
+
+typedef struct {
+    volatile uint32_t head;   /* Items ever produced */
+    volatile uint32_t tail;   /* Items ever consumed */
+} SPSC_Index_t;
+
+#define SPSC_IS_POW2(n)  ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+/* Define a ring of capacity items (file scope) */
+#define SPSC_RING(name, type, capacity)                                   \
+    _Static_assert(SPSC_IS_POW2(capacity), #name " capacity must be a power of 2"); \
+    static struct {                                                       \
+        SPSC_Index_t idx;                                                 \
+        type slot[capacity];                                              \
+    } name
+
+#define SPSC_CAPACITY(r)  (sizeof((r).slot) / sizeof((r).slot[0]))
+
+/* ==================== INDEX OPERATIONS ==================== */
+
+/* Consumer side: items ready to read. The barrier keeps slot reads
+ * from being hoisted above the head load. */
+static inline uint32_t SPSC_Used(SPSC_Index_t* idx) {
+    uint32_t used = idx->head - idx->tail;
+    
+    __DMB();
+    return used;
+}
+
+/* Producer side: slots free to write */
+static inline uint32_t SPSC_Free(SPSC_Index_t* idx, uint32_t capacity) {
+    uint32_t used = idx->head - idx->tail;
+    
+    __DMB();
+    return capacity - used;
+}
+
+/* Producer: make n written slots visible to the consumer */
+static inline void SPSC_Publish(SPSC_Index_t* idx, uint32_t n) {
+    __DMB();
+    idx->head = idx->head + n;
+}
+
+/* Consumer: hand n read slots back to the producer */
+static inline void SPSC_Retire(SPSC_Index_t* idx, uint32_t n) {
+    __DMB();
+    idx->tail = idx->tail + n;
+}
+
+/* Either side while the other is stopped */
+static inline void SPSC_Reset(SPSC_Index_t* idx) {
+    idx->head = 0;
+    idx->tail = 0;
+}
+
+/* ==================== SLOT OPERATIONS ==================== */
+
+/* Next slot to fill, NULL when full */
+#define SPSC_CLAIM(r)                                                     \
+    (SPSC_Free(&(r).idx, SPSC_CAPACITY(r)) != 0                           \
+        ? &(r).slot[(r).idx.head & (SPSC_CAPACITY(r) - 1)] : NULL)
+#define SPSC_COMMIT(r)   SPSC_Publish(&(r).idx, 1)
+
+/* Oldest unread slot, NULL when empty */
+#define SPSC_FRONT(r)                                                     \
+    (SPSC_Used(&(r).idx) != 0                                             \
+        ? &(r).slot[(r).idx.tail & (SPSC_CAPACITY(r) - 1)] : NULL)
+#define SPSC_RELEASE(r)  SPSC_Retire(&(r).idx, 1)
+
+#define SPSC_RESET(r)    SPSC_Reset(&(r).idx)
+
+#endif /* __SPSC_RING_H */
@@ -8,22 +8,66 @@
 void SYSTEM_Init(void);
 void SYSTEM_Process(void);
 
-/* Power Management */
+/* Power Management
+ * In STATE_LOW_POWER the FreeRTOS idle task stops the tick and enters
+ * STOP mode until the next task deadline, woken by the RTC wakeup timer
+ * (or any EXTI). Needs configUSE_TICKLESS_IDLE 2 in FreeRTOSConfig.h;
+ * STOP entries and the time spent in STOP go out in GET_DIAGNOSTICS. */
+#define POWER_RTC_ASYNC_PREDIV  31     /* LSI 32 kHz / 32 = 1 kHz */
+#define POWER_RTC_SYNC_PREDIV   999    /* 1 kHz / 1000 = 1 Hz calendar */
+#define POWER_RTC_WAKEUP_HZ     2000   /* RTCCLK / 16 wakeup counter */
+#define POWER_MIN_STOP_MS       5      /* Shorter idles just WFI */
+#define POWER_STOP_WAKE_MARGIN_MS 2    /* HSE start + PLL lock after STOP */
+
+extern RTC_HandleTypeDef hrtc;
+
 void SYSTEM_EnterLowPower(void);
 void SYSTEM_ExitLowPower(void);
 void SYSTEM_ShutdownPeripherals(void);
 void SYSTEM_RestartPeripherals(void);
+void SYSTEM_GetStopStats(uint32_t* entries, uint32_t* stop_ms, uint8_t reset);
+
+/* Task Supervision
+ * SensorTask, RadiationTask, CommTask and DownlinkTask each call
+ * SYSTEM_Heartbeat once per pass of their loop. WatchdogTask runs SYSTEM_RefreshWatchdog every
+ * SUPV_CHECK_PERIOD_MS and feeds the IWDG (8.2 s) only while every task
+ * has beaten within its deadline, so one stuck task resets the board.
+ * Event-driven tasks wait at most SUPV_IDLE_BEAT_MS so they beat when
+ * idle. Periodic tasks also record how far each interval strays from
+ * the period, in microseconds off the SysTick phase, to show overload
+ * before it becomes a reset. */
+#define SUPV_CHECK_PERIOD_MS    5000
+#define SUPV_IDLE_BEAT_MS       1000   /* Longest wait of an event-driven task */
+#define SUPV_STARTUP_GRACE_MS   15000  /* Init may erase a history sector */
+#define SUPV_SENSOR_PERIOD_MS   1000
+#define SUPV_SENSOR_DEADLINE_MS 4000   /* One history sector erase stall fits */
+#define SUPV_EVENT_DEADLINE_MS  4000
+
+typedef enum {
+    SUPV_TASK_SENSOR = 0,
+    SUPV_TASK_RADIATION,
+    SUPV_TASK_COMM,
+    SUPV_TASK_DOWNLINK,
+    SUPV_TASK_COUNT
+} SUPV_TaskId_t;
+
+typedef struct {
+    uint32_t max_interval_ms;  /* Longest gap between heartbeats */
+    uint32_t max_jitter_us;    /* Worst |interval - period|, periodic tasks */
+    uint32_t missed;           /* Deadlines missed */
+    uint32_t beats;
+} SUPV_Stats_t;
 
-/* Watchdog Management */
-void SYSTEM_RefreshWatchdog(void);
-void SYSTEM_CheckHealth(void);
+void SYSTEM_Heartbeat(SUPV_TaskId_t task);
+uint8_t SYSTEM_CheckTaskHealth(void);   /* 1 if every task is on time */
+uint8_t SYSTEM_RefreshWatchdog(void);   /* 1 if it was fed */
+void SYSTEM_GetTaskStats(SUPV_Stats_t* stats, uint8_t reset);
 
 /* Error Handling */
 void SYSTEM_HandleError(uint8_t error_code);
 void SYSTEM_LogEvent(const char* event);
 
 /* Task Management */
-uint8_t SYSTEM_CheckTaskHealth(void);
 void SYSTEM_ResetSystem(void);
 
 #endif /* __SYSTEM_H */
\ No newline at end of file
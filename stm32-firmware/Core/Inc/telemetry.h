@@ -0,0 +1,23 @@
+/* telemetry.h - Telemetry Snapshot Header */
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include "main.h"
+
+/* Double-buffered snapshot guarded by a sequence counter. Each producer
+ * publishes only the fields it owns; publishing copies the current
+ * snapshot into the spare buffer, applies the update, reframes it
+ * (sync, timestamp, CRC) and flips. Readers get a pointer to the live
+ * buffer and confirm with TLM_Release that no second publish overwrote
+ * it while they were using it. */
+
+/* Producers */
+void TLM_PublishSensors(const TelemetryPacket_t* staged);  /* SensorTask */
+void TLM_PublishRadiation(uint32_t cps, const uint16_t* hist);  /* RadiationTask */
+void TLM_LogError(uint8_t error_code);                     /* Any context */
+
+/* Consumers */
+const TelemetryPacket_t* TLM_Acquire(uint32_t* seq);
+uint8_t TLM_Release(uint32_t seq);   /* 1 if the snapshot stayed intact */
+
+#endif /* __TELEMETRY_H */
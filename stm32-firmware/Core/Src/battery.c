@@ -0,0 +1,132 @@
+/* battery.c - Battery Monitor
+ *
+ * ADC1 scans the battery divider and VREFINT on every TIM3 trigger and
+ * DMA lays the results into a circular buffer. Each half-buffer
+ * interrupt averages its 60 divider and 20 VREFINT samples into one
+ * VDDA-corrected reading and runs the smoothing filter, so the CPU only
+ * wakes twice a second for it. Battery current comes from the MCP3008
+ * scan and is integrated into a coulomb counter.
+ */
+#include "battery.h"
+#include "mcp3008.h"
+#include "radiation.h"
+#include "cmsis_os.h"
+
+#define BATT_VBAT_SAMPLES    (BATT_VBAT_RANKS * BATT_BLOCK_SEQUENCES)
+#define BATT_VREF_SAMPLES    (BATT_VREF_RANKS * BATT_BLOCK_SEQUENCES)
+#define BATT_SEQ_GUARD_TICKS ((RAD_GATE_TICK_HZ / 1000) * 2)  /* 16 x 480 cycles at 4 MHz */
+#define BATT_MAMS_PER_MAH    3600000
+
+static ADC_HandleTypeDef* adc = NULL;
+static uint16_t batt_dma[BATT_DMA_LENGTH];
+
+/* Written by the DMA interrupt, read under a critical section */
+static int32_t batt_filtered = 0;       /* 1/16 mV */
+static uint16_t batt_vdda_mv = BATT_VREFINT_CAL_MV;
+static uint32_t batt_blocks = 0;
+
+/* Coulomb counter, written by SensorTask */
+static int16_t batt_current_ma = 0;
+static int64_t batt_charge_mams = 0;    /* mA x ms */
+static uint32_t batt_current_ms = 0;
+static uint8_t batt_current_valid = 0;
+
+HAL_StatusTypeDef BATT_Init(ADC_HandleTypeDef* hadc) {
+    adc = hadc;
+    batt_blocks = 0;
+    
+    /* Runs from here on; conversions start with TIM3 */
+    return HAL_ADC_Start_DMA(adc, (uint32_t*)batt_dma, BATT_DMA_LENGTH);
+}
+
+/* Average one half of the buffer into a reading (ISR) */
+static void BATT_ProcessBlock(const uint16_t* block) {
+    uint32_t vbat_sum = 0;
+    uint32_t vref_sum = 0;
+    uint32_t vdda_mv;
+    int32_t vbat;
+    uint8_t rank;
+    
+    for(uint8_t s = 0; s < BATT_BLOCK_SEQUENCES; s++) {
+        for(rank = 0; rank < BATT_VBAT_RANKS; rank++) {
+            vbat_sum += block[rank];
+        }
+        for(; rank < BATT_SEQ_LENGTH; rank++) {
+            vref_sum += block[rank];
+        }
+        block += BATT_SEQ_LENGTH;
+    }
+    
+    if(vref_sum == 0) {
+        return;
+    }
+    
+    /* VREFINT_CAL was taken at VDDA = 3.3 V; VDDA scales inversely */
+    vdda_mv = (BATT_VREFINT_CAL_MV * (uint32_t)*BATT_VREFINT_CAL_ADDR * BATT_VREF_SAMPLES) / vref_sum;
+    vbat = (int32_t)((vbat_sum * vdda_mv * BATT_DIVIDER) / (4096u * BATT_VBAT_SAMPLES)) << 4;
+    
+    if(batt_blocks == 0) {
+        batt_filtered = vbat;
+    } else {
+        batt_filtered += (vbat - batt_filtered) >> BATT_FILTER_SHIFT;
+    }
+    batt_vdda_mv = (uint16_t)vdda_mv;
+    batt_blocks++;
+}
+
+/* Current from the MCP3008 sense channel average (1/16 LSB), then
+ * trapezoidal integration. now_ms must be the RTOS tick in ms, which
+ * keeps counting across STOP where the HAL tick is suspended. */
+void BATT_UpdateCurrent(uint16_t average, uint32_t now_ms) {
+    int32_t code = (int32_t)average - (BATT_CURRENT_ZERO_CODE << MCP3008_AVERAGE_SHIFT);
+    int16_t current_ma = (int16_t)((code * BATT_CURRENT_UA_PER_LSB) /
+                                   (1000 << MCP3008_AVERAGE_SHIFT));
+    
+    taskENTER_CRITICAL();
+    if(batt_current_valid) {
+        batt_charge_mams += ((int64_t)batt_current_ma + current_ma) *
+                            (uint32_t)(now_ms - batt_current_ms) / 2;
+    }
+    batt_current_ma = current_ma;
+    batt_current_ms = now_ms;
+    batt_current_valid = 1;
+    taskEXIT_CRITICAL();
+}
+
+void BATT_GetStatus(BATT_Status_t* status) {
+    int64_t charge;
+    
+    taskENTER_CRITICAL();
+    status->voltage_mv = (uint16_t)((batt_filtered + 8) >> 4);
+    status->vdda_mv = batt_vdda_mv;
+    status->current_ma = batt_current_ma;
+    status->blocks = batt_blocks;
+    charge = batt_charge_mams;
+    taskEXIT_CRITICAL();
+    
+    status->charge_mah = (int32_t)(charge / BATT_MAMS_PER_MAH);
+}
+
+/* STOP gates the ADC clock and would stall a sequence half-way. One is
+ * in flight from each TIM3 update until the DMA has taken all ranks. */
+uint8_t BATT_SequenceIdle(void) {
+    if(adc == NULL) {
+        return 1;
+    }
+    return (__HAL_DMA_GET_COUNTER(adc->DMA_Handle) % BATT_SEQ_LENGTH) == 0 &&
+           __HAL_TIM_GET_COUNTER(&htim3) >= BATT_SEQ_GUARD_TICKS;
+}
+
+/* ==================== HAL CALLBACKS ==================== */
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+    if(hadc == adc) {
+        BATT_ProcessBlock(&batt_dma[0]);
+    }
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+    if(hadc == adc) {
+        BATT_ProcessBlock(&batt_dma[BATT_DMA_LENGTH / 2]);
+    }
+}
@@ -0,0 +1,189 @@
+/* clock.c - Clock Profiles
+ *
+ * SystemClock_Config brings up whichever profile is active; profiles are
+ * switched at runtime with CLOCK_SetProfile, which then recomputes the
+ * USART baud registers, I2C timing and SPI prescaler from the new bus
+ * clocks so link rates do not move.
+ */
+#include "clock.h"
+#include "radiation.h"
+#include "cmsis_os.h"
+
+static const CLOCK_Profile_t clock_profiles[CLOCK_PROFILE_COUNT] = {
+    /* FULL      */ { 1, RCC_SYSCLK_DIV1, RCC_HCLK_DIV2, RCC_HCLK_DIV1,
+                      FLASH_LATENCY_2, PWR_REGULATOR_VOLTAGE_SCALE2 },
+    /* NOMINAL   */ { 1, RCC_SYSCLK_DIV4, RCC_HCLK_DIV1, RCC_HCLK_DIV1,
+                      FLASH_LATENCY_0, PWR_REGULATOR_VOLTAGE_SCALE2 },
+    /* LOW_POWER */ { 0, RCC_SYSCLK_DIV1, RCC_HCLK_DIV1, RCC_HCLK_DIV1,
+                      FLASH_LATENCY_0, PWR_REGULATOR_VOLTAGE_SCALE3 },
+};
+
+static uint8_t clock_profile = CLOCK_PROFILE_FULL;  /* Boot at full speed */
+
+/* Program the RCC for a profile. SYSCLK is parked on HSI first, since
+ * the PLL cannot be reconfigured while it drives the core. */
+HAL_StatusTypeDef CLOCK_Configure(uint8_t profile) {
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+    const CLOCK_Profile_t* p;
+    
+    if(profile >= CLOCK_PROFILE_COUNT) {
+        return HAL_ERROR;
+    }
+    p = &clock_profiles[profile];
+    
+    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK |
+                                   RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+    if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_2) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    
+    /* Voltage scaling only changes while the PLL is off */
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+    HAL_RCC_OscConfig(&RCC_OscInitStruct);
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_PWR_VOLTAGESCALING_CONFIG(p->voltage_scale);
+    
+    if(p->use_pll) {
+        RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+        RCC_OscInitStruct.HSEState = RCC_HSE_ON;
+        RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+        RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+        RCC_OscInitStruct.PLL.PLLM = 8;
+        RCC_OscInitStruct.PLL.PLLN = 336;
+        RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV4;
+        RCC_OscInitStruct.PLL.PLLQ = 7;
+        if(HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
+            return HAL_ERROR;
+        }
+        RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    } else {
+        RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+        RCC_OscInitStruct.HSEState = RCC_HSE_OFF;
+        RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+        HAL_RCC_OscConfig(&RCC_OscInitStruct);
+    }
+    
+    RCC_ClkInitStruct.AHBCLKDivider = p->ahb_divider;
+    RCC_ClkInitStruct.APB1CLKDivider = p->apb1_divider;
+    RCC_ClkInitStruct.APB2CLKDivider = p->apb2_divider;
+    if(HAL_RCC_ClockConfig(&RCC_ClkInitStruct, p->flash_latency) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    
+    clock_profile = profile;
+    return HAL_OK;
+}
+
+uint8_t CLOCK_GetProfile(void) {
+    return clock_profile;
+}
+
+uint8_t CLOCK_ProfileForState(uint8_t state) {
+    switch(state) {
+        case STATE_IMAGE_CAPTURE:
+        case STATE_DATA_TX:
+            return CLOCK_PROFILE_FULL;
+        
+        case STATE_LOW_POWER:
+        case STATE_EMERGENCY:
+            return CLOCK_PROFILE_LOW_POWER;
+        
+        default:
+            return CLOCK_PROFILE_NOMINAL;
+    }
+}
+
+/* Smallest SPI1 prescaler that keeps SCK at or below max_hz */
+uint32_t CLOCK_SpiPrescaler(uint32_t max_hz) {
+    static const uint32_t prescalers[] = {
+        SPI_BAUDRATEPRESCALER_2, SPI_BAUDRATEPRESCALER_4, SPI_BAUDRATEPRESCALER_8,
+        SPI_BAUDRATEPRESCALER_16, SPI_BAUDRATEPRESCALER_32, SPI_BAUDRATEPRESCALER_64,
+        SPI_BAUDRATEPRESCALER_128, SPI_BAUDRATEPRESCALER_256
+    };
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+    
+    for(uint8_t i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); i++) {
+        if((pclk >> (i + 1)) <= max_hz) {
+            return prescalers[i];
+        }
+    }
+    return SPI_BAUDRATEPRESCALER_256;
+}
+
+static uint8_t CLOCK_BusesIdle(void) {
+    return huart1.gState == HAL_UART_STATE_READY &&
+           huart2.gState == HAL_UART_STATE_READY &&
+           __HAL_UART_GET_FLAG(&huart1, UART_FLAG_TC) &&
+           __HAL_UART_GET_FLAG(&huart2, UART_FLAG_TC) &&
+           hi2c1.State == HAL_I2C_STATE_READY &&
+           hspi1.State == HAL_SPI_STATE_READY;
+}
+
+/* Re-derive every clock-dependent peripheral setting */
+static void CLOCK_RetunePeripherals(void) {
+    /* USART1 sits on APB2, USART2 on APB1. RX DMA keeps running. */
+    huart1.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), huart1.Init.BaudRate);
+    huart2.Instance->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK1Freq(), huart2.Init.BaudRate);
+    
+    /* CCR/TRISE are computed from PCLK1 */
+    HAL_I2C_Init(&hi2c1);
+    
+    hspi1.Init.BaudRatePrescaler = CLOCK_SpiPrescaler(CLOCK_SPI1_MAX_HZ);
+    HAL_SPI_Init(&hspi1);
+    
+    /* Radiation gate timer sits on APB1 */
+    RAD_GateRetune();
+    
+    /* RTOS tick runs from SysTick at the core clock */
+    SysTick->LOAD = (SystemCoreClock / configTICK_RATE_HZ) - 1;
+    SysTick->VAL = 0;
+}
+
+/* Switch profile at runtime. Waits for the UARTs, I2C and SPI to go
+ * idle; HAL_BUSY if they do not within CLOCK_SWITCH_TIMEOUT_MS.
+ * Interrupts stay on through the switch: the RCC calls time the HSE
+ * start and PLL lock off the SysTick-driven HAL tick, which a critical
+ * section would freeze. Only the tasks and the magnetometer data-ready
+ * line, the one interrupt that starts a transfer on its own, are held
+ * off; a DRDY edge meanwhile stays pending in the EXTI. */
+HAL_StatusTypeDef CLOCK_SetProfile(uint8_t profile) {
+    uint32_t start = HAL_GetTick();
+    HAL_StatusTypeDef status;
+    
+    if(profile >= CLOCK_PROFILE_COUNT) {
+        return HAL_ERROR;
+    }
+    if(profile == clock_profile) {
+        return HAL_OK;
+    }
+    
+    while(1) {
+        if(CLOCK_BusesIdle()) {
+            vTaskSuspendAll();
+            HAL_NVIC_DisableIRQ(EXTI1_IRQn);
+            /* An interrupt may have started a transfer since the check */
+            if(CLOCK_BusesIdle()) {
+                break;
+            }
+            HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+            xTaskResumeAll();
+        }
+        if((HAL_GetTick() - start) >= CLOCK_SWITCH_TIMEOUT_MS) {
+            return HAL_BUSY;
+        }
+        osDelay(1);
+    }
+    
+    status = CLOCK_Configure(profile);
+    CLOCK_RetunePeripherals();
+    HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+    xTaskResumeAll();
+    
+    return status;
+}
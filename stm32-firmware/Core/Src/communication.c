@@ -1,56 +1,671 @@
 /* communication.c - Communication Implementation */
 #include "communication.h"
+#include "spsc_ring.h"
+#include "crc.h"
+#include "diag.h"
+#include "cmsis_os.h"
 
 static uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
-static uint8_t rx_buffer[UART_RX_BUFFER_SIZE];
-static uint16_t rx_index = 0;
+static uint8_t radio_tx_buffer[UART_RADIO_TX_BUFFER_SIZE];
+
+/* One TX ring per UART so the 9600 baud radio link can never hold up
+ * the Pi link. Tasks append at head, the DMA drains from tail. */
+typedef struct {
+    UART_HandleTypeDef* huart;
+    uint8_t* buffer;
+    uint16_t size;
+    volatile uint16_t head;
+    volatile uint16_t tail;
+    volatile uint16_t in_flight;  /* Bytes currently owned by the DMA */
+    uint8_t relays;               /* Also drains relay_ring and the bridge */
+    volatile uint8_t source;      /* What in_flight belongs to */
+} COMM_TxQueue_t;
+
+/* TX span sources */
+#define COMM_TX_RING    0
+#define COMM_TX_RELAY   1
+#define COMM_TX_BRIDGE  2
+
+static COMM_TxQueue_t tx_queues[] = {
+    { &huart1, tx_buffer,       UART_TX_BUFFER_SIZE,       0, 0, 0, 0, 0 },
+    { &huart2, radio_tx_buffer, UART_RADIO_TX_BUFFER_SIZE, 0, 0, 0, 1, 0 },
+};
+
+/* Chunk pass-through: image/file chunks are copied out of the USART1 RX
+ * ring as they are parsed and the radio DMA sends the copy. A chunk
+ * takes ~280 ms at 9600 baud, in which the Pi link can lap the ring
+ * three times over, so the ring itself cannot be the source. The Pi
+ * paces chunks to the radio rate; one that finds every slot taken is
+ * dropped and recovered by the ground's retransmit request. */
+#define COMM_RELAY_FRAME_MAX (sizeof(ChunkHeader_t) + COMM_MAX_CHUNK_DATA + 4)
+
+typedef struct {
+    uint16_t length;
+    uint16_t sent;               /* Bytes already handed to the radio */
+    uint8_t data[COMM_RELAY_FRAME_MAX];
+} COMM_Relay_t;
+
+/* USART1 RX runs as circular DMA with idle-line detection. The HAL reports
+ * the DMA write position on idle line, half transfer and transfer complete,
+ * and frames are parsed in place in the ring - nothing is copied out of it
+ * except relayed chunks and a frame that wraps past the end. */
+#define RX_RING_MASK (UART_RX_DMA_BUFFER_SIZE - 1)
+
+static uint8_t rx_dma_buffer[UART_RX_DMA_BUFFER_SIZE];
+static uint16_t rx_dma_tail = 0;        /* Ring index of the last reported DMA position */
+static volatile uint32_t rx_stream_pos = 0;  /* Absolute count of bytes received */
+static uint32_t rx_parse_pos = 0;       /* Absolute position of the first unparsed byte */
+static uint8_t rx_wrap_buffer[UART_RX_BUFFER_SIZE];
+static volatile uint32_t rx_wrap_gen = 0;    /* Bumped before each refill */
+
+static osThreadId_t comm_thread = NULL;  /* Receives COMM_EVT_* flags */
+
+/* Command and firmware chunk frame references, RX event ISR to CommTask */
+SPSC_RING(cmd_ring, COMM_Frame_t, COMM_CMD_RING_SIZE);
+
+/* Chunks to relay, RX event ISR to radio TX */
+SPSC_RING(relay_ring, COMM_Relay_t, COMM_RELAY_RING_SIZE);
+
+/* Bridge mode: the radio DMA follows the parser through the ring. All
+ * positions are absolute RX stream positions. */
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} COMM_BridgeHole_t;
+
+static struct {
+    volatile uint8_t active;
+    volatile uint8_t credit_due;  /* Report to the Pi at the next service */
+    uint32_t start;               /* Stream position the bridge opened at */
+    volatile uint32_t pos;        /* Next byte to forward */
+    uint32_t reported;            /* pos in the last credit frame */
+    uint32_t idle_ms;
+    volatile uint32_t last_rx_tick;
+} bridge;
+
+/* Frames for the STM32 inside the bridged stream, RX event ISR to radio
+ * TX; they are skipped rather than forwarded */
+SPSC_RING(bridge_holes, COMM_BridgeHole_t, COMM_BRIDGE_HOLES);
+
+static void COMM_HandleTelemetry(const COMM_Frame_t* frame);
+static void COMM_HandleCommand(const COMM_Frame_t* frame);
+static void COMM_HandleChunk(const COMM_Frame_t* frame);
+static uint32_t COMM_RxHead(void);
+static uint8_t COMM_RelayKick(COMM_TxQueue_t* q);
+static uint8_t COMM_BridgeKick(COMM_TxQueue_t* q);
+
+typedef void (*COMM_FrameHandler_t)(const COMM_Frame_t* frame);
+
+static const struct {
+    uint16_t sync_word;
+    COMM_FrameHandler_t handler;
+} frame_handlers[] = {
+    { SYNC_TELEMETRY, COMM_HandleTelemetry },
+    { SYNC_COMMAND,   COMM_HandleCommand },
+    { SYNC_COMMAND_V2, COMM_HandleCommand },
+    { SYNC_IMAGE,     COMM_HandleChunk },
+    { SYNC_FILE,      COMM_HandleChunk },
+    { SYNC_FIRMWARE,  COMM_HandleCommand },  /* Programmed by CommTask */
+};
 
 HAL_StatusTypeDef COMM_Init(void) {
-    /* Start reception */
-    HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
-    return HAL_OK;
+    /* The calling task becomes the event loop */
+    comm_thread = osThreadGetId();
+    
+    rx_dma_tail = 0;
+    rx_stream_pos = 0;
+    rx_parse_pos = 0;
+    SPSC_RESET(cmd_ring);
+    SPSC_RESET(relay_ring);
+    
+    return HAL_UARTEx_ReceiveToIdle_DMA(&huart1, rx_dma_buffer, UART_RX_DMA_BUFFER_SIZE);
 }
 
-void COMM_ProcessReceivedData(uint8_t* data, uint16_t length) {
-    static uint16_t expected_length = 0;
-    static uint8_t packet_type = 0;
+void COMM_StartReception(void) {
+    /* Restarting the DMA resets its write position to the top of the ring;
+     * move the stream position to the next lap so the two stay in step */
+    rx_stream_pos = (rx_stream_pos + RX_RING_MASK) & ~(uint32_t)RX_RING_MASK;
+    rx_dma_tail = 0;
+    rx_parse_pos = rx_stream_pos;
+    HAL_UARTEx_ReceiveToIdle_DMA(&huart1, rx_dma_buffer, UART_RX_DMA_BUFFER_SIZE);
+}
+
+/* Wake the comm event loop - task or interrupt context */
+void COMM_Notify(uint32_t events) {
+    if(comm_thread != NULL) {
+        osThreadFlagsSet(comm_thread, events);
+    }
+}
+
+/* ==================== TRANSMIT ==================== */
+
+static COMM_TxQueue_t* COMM_GetTxQueue(UART_HandleTypeDef* huart) {
+    for(uint8_t i = 0; i < sizeof(tx_queues) / sizeof(tx_queues[0]); i++) {
+        if(tx_queues[i].huart->Instance == huart->Instance) {
+            return &tx_queues[i];
+        }
+    }
+    return NULL;
+}
+
+static uint16_t COMM_TxUsed(COMM_TxQueue_t* q) {
+    return (q->head >= q->tail) ? (q->head - q->tail) : (q->size - q->tail + q->head);
+}
+
+/* Start DMA on the next contiguous span. Caller must hold the queue
+ * (critical section, or TX complete interrupt context). */
+static void COMM_TxKick(COMM_TxQueue_t* q) {
+    uint16_t span;
+    
+    if(q->in_flight != 0) {
+        return;
+    }
+    if(q->head == q->tail) {
+        /* Queued frames first, then relayed chunks, then the bridge */
+        if(q->relays && !COMM_RelayKick(q) && bridge.active) {
+            COMM_BridgeKick(q);
+        }
+        return;
+    }
+    
+    /* A frame that wraps goes out as two back-to-back transfers */
+    span = (q->head > q->tail) ? (q->head - q->tail) : (q->size - q->tail);
+    
+    if(HAL_UART_Transmit_DMA(q->huart, &q->buffer[q->tail], span) == HAL_OK) {
+        q->in_flight = span;
+    }
+}
+
+HAL_StatusTypeDef COMM_Transmit(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t length) {
+    COMM_TxQueue_t* q = COMM_GetTxQueue(huart);
+    HAL_StatusTypeDef status = HAL_BUSY;
+    uint16_t first;
+    
+    if(q == NULL || length == 0) {
+        return HAL_ERROR;
+    }
+    
+    taskENTER_CRITICAL();
+    DIAG_PROBE_BEGIN();
+    
+    /* Whole frames only - one slot stays empty to tell full from empty */
+    if(length <= q->size - 1 - COMM_TxUsed(q)) {
+        first = q->size - q->head;
+        if(first > length) {
+            first = length;
+        }
+        memcpy(&q->buffer[q->head], data, first);
+        memcpy(q->buffer, data + first, length - first);
+        q->head = (q->head + length) % q->size;
+        
+        COMM_TxKick(q);
+        status = HAL_OK;
+    }
+    
+    DIAG_PROBE_END(DIAG_UART_TX);
+    taskEXIT_CRITICAL();
+    return status;
+}
+
+uint16_t COMM_TxFree(UART_HandleTypeDef* huart) {
+    COMM_TxQueue_t* q = COMM_GetTxQueue(huart);
     
-    for(uint16_t i = 0; i < length; i++) {
-        rx_buffer[rx_index++] = data[i];
+    if(q == NULL) {
+        return 0;
+    }
+    return q->size - 1 - COMM_TxUsed(q);
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    COMM_TxQueue_t* q = COMM_GetTxQueue(huart);
+    
+    if(q != NULL) {
+        /* Release the finished span and chain the next one */
+        if(q->source == COMM_TX_RELAY) {
+            COMM_Relay_t* relay = SPSC_FRONT(relay_ring);
+            relay->sent += q->in_flight;
+            if(relay->sent >= relay->length) {
+                SPSC_RELEASE(relay_ring);
+            }
+        } else if(q->source == COMM_TX_BRIDGE) {
+            bridge.pos += q->in_flight;
+            if((bridge.pos - bridge.reported) >= COMM_BRIDGE_CREDIT_STEP ||
+               bridge.pos == rx_parse_pos) {
+                bridge.credit_due = 1;
+                COMM_Notify(COMM_EVT_BRIDGE);
+            }
+        } else {
+            q->tail = (q->tail + q->in_flight) % q->size;
+        }
+        q->source = COMM_TX_RING;
+        q->in_flight = 0;
+        COMM_TxKick(q);
         
-        /* Check for packet start */
-        if(rx_index == 1 && rx_buffer[0] != 0xAA) {
-            rx_index = 0;
-            continue;
+        /* Pi link drained - anything deferred on a full ring can go now */
+        if(q->in_flight == 0 && huart->Instance == USART1) {
+            COMM_Notify(COMM_EVT_TX_DONE);
         }
+    }
+}
+
+/* ==================== RECEIVE ==================== */
+
+static uint8_t COMM_RxPeek(uint32_t pos) {
+    return rx_dma_buffer[pos & RX_RING_MASK];
+}
+
+/* Total frame length for a sync word, 0 while the header is still
+ * incomplete, UINT16_MAX if the header is not plausible */
+static uint16_t COMM_FrameLength(uint16_t sync_word, uint32_t available) {
+    uint16_t data_length;
+    
+    switch(sync_word) {
+        case SYNC_TELEMETRY:
+            return sizeof(TelemetryPacket_t);
         
-        if(rx_index == 2) {
-            if(rx_buffer[1] == 0x55) {
-                packet_type = 0x01;  /* Telemetry */
-                expected_length = sizeof(TelemetryPacket_t);
-            } else if(rx_buffer[1] == 0x56) {
-                packet_type = 0x02;  /* Command */
-                expected_length = sizeof(CommandPacket_t);
-            } else {
-                rx_index = 0;
+        case SYNC_COMMAND:
+            return sizeof(CommandPacket_t);
+        
+        case SYNC_COMMAND_V2:
+            if(available < CMD_HEADER_SIZE) {
+                return 0;
+            }
+            data_length = COMM_RxPeek(rx_parse_pos + 5) |
+                          (COMM_RxPeek(rx_parse_pos + 6) << 8);
+            if(data_length > CMD_MAX_PARAMETERS) {
+                return UINT16_MAX;
             }
+            return CMD_HEADER_SIZE + data_length + 2;
+        
+        case SYNC_IMAGE:
+        case SYNC_FILE:
+        case SYNC_FIRMWARE:
+            if(available < sizeof(ChunkHeader_t)) {
+                return 0;
+            }
+            data_length = COMM_RxPeek(rx_parse_pos + 8) |
+                          (COMM_RxPeek(rx_parse_pos + 9) << 8);
+            if(data_length > COMM_MAX_CHUNK_DATA) {
+                return UINT16_MAX;
+            }
+            return sizeof(ChunkHeader_t) + data_length + 4;
+        
+        default:
+            return UINT16_MAX;
+    }
+}
+
+/* Walk every complete frame between rx_parse_pos and rx_stream_pos */
+static void COMM_DispatchFrames(void) {
+    uint32_t available;
+    uint16_t sync_word;
+    uint16_t length;
+    uint16_t offset;
+    COMM_Frame_t frame;
+    
+    while(1) {
+        available = rx_stream_pos - rx_parse_pos;
+        
+        if(available > UART_RX_DMA_BUFFER_SIZE) {
+            /* Parser fell a full lap behind the DMA - resync at the head */
+            rx_parse_pos = rx_stream_pos;
+            LogError(ERROR_UART);
+            return;
+        }
+        if(available == 0) {
+            return;
+        }
+        
+        /* Step past noise before waiting for a second byte, so a lone
+         * trailing byte does not hold up the bridge */
+        if(COMM_RxPeek(rx_parse_pos) != 0xAA) {
+            rx_parse_pos++;
+            continue;
+        }
+        if(available < 2) {
+            return;
         }
         
-        /* Check if we have complete packet */
-        if(rx_index >= expected_length && expected_length > 0) {
-            if(packet_type == 0x02) {
-                CommandPacket_t* cmd = (CommandPacket_t*)rx_buffer;
-                osMessageQueuePut(commandQueueHandle, cmd, 0, 0);
+        sync_word = (uint16_t)((0xAA << 8) | COMM_RxPeek(rx_parse_pos + 1));
+        length = COMM_FrameLength(sync_word, available);
+        
+        if(length == UINT16_MAX) {
+            rx_parse_pos++;
+            continue;
+        }
+        if(length == 0 || available < length) {
+            return;  /* Wait for the rest of the frame */
+        }
+        
+        offset = rx_parse_pos & RX_RING_MASK;
+        if(offset + length <= UART_RX_DMA_BUFFER_SIZE) {
+            frame.data = &rx_dma_buffer[offset];
+        } else {
+            uint16_t first = UART_RX_DMA_BUFFER_SIZE - offset;
+            rx_wrap_gen++;
+            memcpy(rx_wrap_buffer, &rx_dma_buffer[offset], first);
+            memcpy(&rx_wrap_buffer[first], rx_dma_buffer, length - first);
+            frame.data = rx_wrap_buffer;
+        }
+        frame.length = length;
+        frame.sync_word = sync_word;
+        frame.stream_pos = rx_parse_pos;
+        frame.wrap_gen = rx_wrap_gen;
+        
+        for(uint8_t i = 0; i < sizeof(frame_handlers) / sizeof(frame_handlers[0]); i++) {
+            if(frame_handlers[i].sync_word == sync_word) {
+                frame_handlers[i].handler(&frame);
+                break;
             }
-            rx_index = 0;
-            expected_length = 0;
         }
+        
+        rx_parse_pos += length;
+    }
+}
+
+/* Account for length new bytes at the write position and parse them */
+static void COMM_RxAdvance(uint16_t length) {
+    rx_dma_tail = (rx_dma_tail + length) & RX_RING_MASK;
+    rx_stream_pos += length;
+    COMM_DispatchFrames();
+    
+    if(bridge.active) {
+        bridge.last_rx_tick = HAL_GetTick();
+        COMM_TxKick(COMM_GetTxQueue(&huart2));
+    }
+}
+
+/* Absolute position of the DMA write pointer, including bytes written
+ * since the last RX event. Caller must hold off the RX interrupts. */
+static uint32_t COMM_RxHead(void) {
+    uint16_t dma_pos = UART_RX_DMA_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(huart1.hdmarx);
+    
+    return rx_stream_pos + ((dma_pos - rx_dma_tail) & RX_RING_MASK);
+}
+
+uint8_t COMM_FrameValid(const COMM_Frame_t* frame) {
+    uint32_t head;
+    uint32_t wrap_gen;
+    
+    taskENTER_CRITICAL();
+    head = COMM_RxHead();
+    wrap_gen = rx_wrap_gen;
+    taskEXIT_CRITICAL();
+    
+    /* A wrapped frame is gone once the wrap buffer is refilled, whether
+     * or not the DMA has lapped it yet */
+    if(frame->data == rx_wrap_buffer && frame->wrap_gen != wrap_gen) {
+        return 0;
+    }
+    return (head - frame->stream_pos) <= UART_RX_DMA_BUFFER_SIZE;
+}
+
+/* Software feed: writes bytes where the DMA would have put them. Only for
+ * use while DMA reception is not running (bench replay, loopback). */
+void COMM_ProcessReceivedData(uint8_t* data, uint16_t length) {
+    while(length > 0) {
+        uint16_t span = UART_RX_DMA_BUFFER_SIZE - rx_dma_tail;
+        if(span > length) {
+            span = length;
+        }
+        memcpy(&rx_dma_buffer[rx_dma_tail], data, span);
+        COMM_RxAdvance(span);
+        data += span;
+        length -= span;
+    }
+}
+
+static void COMM_HandleTelemetry(const COMM_Frame_t* frame) {
+    /* Telemetry only flows downlink; an echo from the Pi is dropped */
+    (void)frame;
+}
+
+static void COMM_HandleCommand(const COMM_Frame_t* frame) {
+    /* Queue the reference only - CommTask reads the packet in place */
+    COMM_Frame_t* slot = SPSC_CLAIM(cmd_ring);
+    COMM_BridgeHole_t* hole;
+    
+    /* Ours, so it must not go out on the radio with the bridged bytes */
+    if(bridge.active) {
+        hole = SPSC_CLAIM(bridge_holes);
+        if(hole != NULL) {
+            hole->start = frame->stream_pos;
+            hole->end = frame->stream_pos + frame->length;
+            SPSC_COMMIT(bridge_holes);
+        } else {
+            LogError(ERROR_UART);
+        }
+    }
+    
+    if(slot == NULL) {
+        LogError(ERROR_UART);
+        return;
+    }
+    *slot = *frame;
+    SPSC_COMMIT(cmd_ring);
+    COMM_Notify(COMM_EVT_COMMAND);
+}
+
+/* CommTask side: take the oldest queued command frame */
+uint8_t COMM_NextCommand(COMM_Frame_t* frame) {
+    const COMM_Frame_t* slot = SPSC_FRONT(cmd_ring);
+    
+    if(slot == NULL) {
+        return 0;
+    }
+    *frame = *slot;
+    SPSC_RELEASE(cmd_ring);
+    
+    return 1;
+}
+
+static void COMM_HandleChunk(const COMM_Frame_t* frame) {
+    /* Image/file chunks from the Pi go out on the radio unchanged, from
+     * a copy taken while the frame is still fresh in the RX ring */
+    COMM_Relay_t* relay;
+    
+    if(bridge.active) {
+        return;  /* Already on its way as part of the byte stream */
+    }
+    if(frame->length > COMM_RELAY_FRAME_MAX) {
+        LogError(ERROR_UART);
+        return;
+    }
+    
+    relay = SPSC_CLAIM(relay_ring);
+    if(relay == NULL) {
+        LogError(ERROR_UART);  /* Pi is ahead of the radio */
+        return;
+    }
+    memcpy(relay->data, frame->data, frame->length);
+    relay->length = frame->length;
+    relay->sent = 0;
+    SPSC_COMMIT(relay_ring);
+    
+    /* All UART and DMA interrupts share IRQ_PRIO_COMM, so this cannot
+     * race the radio TX complete callback */
+    COMM_TxKick(COMM_GetTxQueue(&huart2));
+}
+
+/* Start the radio DMA on the rest of the oldest relayed chunk.
+ * Caller must hold the radio queue. Returns 0 if nothing was started. */
+static uint8_t COMM_RelayKick(COMM_TxQueue_t* q) {
+    COMM_Relay_t* relay = SPSC_FRONT(relay_ring);
+    uint16_t span;
+    
+    if(relay == NULL) {
+        return 0;
+    }
+    
+    span = relay->length - relay->sent;
+    if(HAL_UART_Transmit_DMA(q->huart, &relay->data[relay->sent], span) != HAL_OK) {
+        return 0;
+    }
+    q->in_flight = span;
+    q->source = COMM_TX_RELAY;
+    return 1;
+}
+
+/* ==================== BRIDGE MODE ==================== */
+
+/* Start the radio DMA on everything parsed but not yet forwarded, up to
+ * the next frame addressed to the STM32 or the end of the ring. Bytes
+ * past the parser wait, as they may yet turn out to be such a frame.
+ * Caller must hold the radio queue. */
+static uint8_t COMM_BridgeKick(COMM_TxQueue_t* q) {
+    uint32_t limit = rx_parse_pos;
+    uint32_t pending;
+    uint16_t offset;
+    uint16_t span;
+    COMM_BridgeHole_t* hole;
+    
+    /* Step over our own frames; they still count as forwarded so the
+     * Pi's window stays in step */
+    while((hole = SPSC_FRONT(bridge_holes)) != NULL &&
+          (int32_t)(bridge.pos - hole->start) >= 0) {
+        if((int32_t)(hole->end - bridge.pos) > 0) {
+            bridge.pos = hole->end;
+            bridge.credit_due = 1;
+            COMM_Notify(COMM_EVT_BRIDGE);
+        }
+        SPSC_RELEASE(bridge_holes);
+    }
+    if(hole != NULL && (int32_t)(limit - hole->start) > 0) {
+        limit = hole->start;
+    }
+    
+    if((int32_t)(limit - bridge.pos) <= 0) {
+        return 0;
+    }
+    pending = limit - bridge.pos;
+    if(pending > UART_RX_DMA_BUFFER_SIZE) {
+        /* Pi ignored the window (or RX restarted) - skip what was lost
+         * and count it as forwarded so the credits stay in step */
+        bridge.pos = limit;
+        bridge.credit_due = 1;
+        LogError(ERROR_UART);
+        return 0;
+    }
+    
+    offset = bridge.pos & RX_RING_MASK;
+    span = UART_RX_DMA_BUFFER_SIZE - offset;
+    if(span > pending) {
+        span = (uint16_t)pending;
     }
+    
+    if(HAL_UART_Transmit_DMA(q->huart, &rx_dma_buffer[offset], span) != HAL_OK) {
+        return 0;
+    }
+    q->in_flight = span;
+    q->source = COMM_TX_BRIDGE;
+    return 1;
+}
+
+static HAL_StatusTypeDef COMM_SendBridgeCredit(void) {
+    uint8_t frame[COMM_BRIDGE_FRAME_SIZE];
+    uint32_t pos = bridge.pos;
+    uint32_t forwarded = pos - bridge.start;
+    uint16_t window = COMM_BRIDGE_WINDOW;
+    uint16_t crc;
+    
+    frame[0] = 0xAA;
+    frame[1] = 0x5C;
+    frame[2] = bridge.active;
+    memcpy(&frame[3], &forwarded, sizeof(forwarded));
+    memcpy(&frame[7], &window, sizeof(window));
+    crc = CRC16_Calculate(frame, COMM_BRIDGE_FRAME_SIZE - 2);
+    memcpy(&frame[9], &crc, sizeof(crc));
+    
+    if(COMM_Transmit(&huart1, frame, sizeof(frame)) != HAL_OK) {
+        return HAL_BUSY;  /* Stays due, TX_DONE retries */
+    }
+    bridge.reported = pos;
+    bridge.credit_due = 0;
+    return HAL_OK;
+}
+
+/* Open the bridge at the current RX position. The Pi should wait for
+ * the first credit frame before streaming. */
+HAL_StatusTypeDef COMM_BridgeStart(uint32_t idle_ms) {
+    taskENTER_CRITICAL();
+    SPSC_RESET(bridge_holes);
+    bridge.start = COMM_RxHead();
+    bridge.pos = bridge.start;
+    bridge.reported = bridge.start;
+    bridge.idle_ms = (idle_ms != 0) ? idle_ms : COMM_BRIDGE_IDLE_MS;
+    bridge.last_rx_tick = HAL_GetTick();
+    bridge.credit_due = 1;
+    bridge.active = 1;
+    taskEXIT_CRITICAL();
+    
+    return COMM_SendBridgeCredit();
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+/* Close the bridge; bytes already handed to the DMA still go out */
+void COMM_BridgeStop(void) {
+    if(!bridge.active) {
+        return;
+    }
+    bridge.active = 0;
+    bridge.credit_due = 1;
+    COMM_SendBridgeCredit();
+}
+
+uint8_t COMM_BridgeActive(void) {
+    return bridge.active;
+}
+
+/* CommTask: report credits and close an idle bridge. Returns how long
+ * the task may sleep before the next call. */
+uint32_t COMM_BridgeService(void) {
+    uint32_t idle;
+    
+    if(bridge.credit_due) {
+        COMM_SendBridgeCredit();
+    }
+    if(!bridge.active) {
+        return osWaitForever;
+    }
+    
+    idle = HAL_GetTick() - bridge.last_rx_tick;
+    if(idle >= bridge.idle_ms) {
+        COMM_BridgeStop();
+        return osWaitForever;
+    }
+    return bridge.idle_ms - idle;
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size) {
     if(huart->Instance == USART1) {
-        COMM_ProcessReceivedData(rx_buffer, 1);
-        HAL_UART_Receive_IT(&huart1, rx_buffer, 1);
+        /* Size is the DMA write position inside rx_dma_buffer */
+        uint16_t length = (Size >= rx_dma_tail) ? (Size - rx_dma_tail)
+                                                : (UART_RX_DMA_BUFFER_SIZE - rx_dma_tail + Size);
+        if(length > 0) {
+            COMM_RxAdvance(length);
+        }
     }
-}
\ No newline at end of file
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    COMM_TxQueue_t* q = COMM_GetTxQueue(huart);
+    
+    if(huart->Instance == USART1) {
+        /* Overrun/framing errors stop the DMA stream - re-arm it */
+        COMM_StartReception();
+    }
+    
+    /* A DMA error aborts the transmit without TxCplt; drop the span
+     * so the queue does not stall */
+    if(q != NULL && q->in_flight != 0 && huart->gState == HAL_UART_STATE_READY) {
+        if(q->source == COMM_TX_RELAY) {
+            SPSC_RELEASE(relay_ring);  /* Whole chunk, the ground re-requests it */
+        } else if(q->source == COMM_TX_BRIDGE) {
+            bridge.pos += q->in_flight;  /* Lost, but keep the credits in step */
+        } else {
+            q->tail = (q->tail + q->in_flight) % q->size;
+        }
+        q->source = COMM_TX_RING;
+        q->in_flight = 0;
+        COMM_TxKick(q);
+    }
+}
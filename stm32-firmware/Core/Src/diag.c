@@ -0,0 +1,173 @@
+/* diag.c - Runtime Diagnostics
+ *
+ * Cycle-count probes, per-task CPU and stack figures and the heartbeat
+ * supervisor's timing, packed into one frame for the Pi to downlink.
+ * Probes record from any context; the report is built in CommTask.
+ */
+#include "diag.h"
+#include "communication.h"
+#include "crc.h"
+#include "mag_stream.h"
+#include "cmsis_os.h"
+#include <string.h>
+
+DIAG_Probe_t diag_probes[DIAG_PROBE_COUNT];
+
+/* Run-time counter at the previous report, per task */
+static struct {
+    UBaseType_t number;
+    uint32_t runtime;
+} diag_last[DIAG_MAX_TASKS];
+static uint8_t diag_last_count = 0;
+static uint32_t diag_last_total = 0;
+
+static TaskStatus_t diag_tasks[DIAG_MAX_TASKS];
+static uint8_t diag_frame[DIAG_REPORT_MAX];
+
+void DIAG_Init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/* CYCCNT wraps every 51 s at 84 MHz; the scheduler reads this on every
+ * context switch, far more often than that, so counting wraps here is
+ * enough to extend it. The counter stops while the core is gated. */
+uint32_t DIAG_RunTimeCounter(void) {
+    static uint32_t last = 0;
+    static uint32_t wraps = 0;
+    uint32_t now = DWT->CYCCNT;
+    
+    if(now < last) {
+        wraps++;
+    }
+    last = now;
+    
+    return (wraps << (32 - DIAG_RUNTIME_SHIFT)) | (now >> DIAG_RUNTIME_SHIFT);
+}
+
+static uint32_t DIAG_LastRuntime(UBaseType_t number) {
+    for(uint8_t i = 0; i < diag_last_count; i++) {
+        if(diag_last[i].number == number) {
+            return diag_last[i].runtime;
+        }
+    }
+    return 0;  /* New task - everything it ran is in this interval */
+}
+
+/* Task records, and the run-time counters saved for the next report */
+static uint16_t DIAG_PackTasks(uint8_t* out, uint8_t* count) {
+    uint32_t total;
+    uint32_t elapsed;
+    uint32_t ran;
+    uint32_t permille;
+    uint16_t stack_free;
+    UBaseType_t n;
+    
+    n = uxTaskGetSystemState(diag_tasks, DIAG_MAX_TASKS, &total);
+    elapsed = total - diag_last_total;
+    
+    for(UBaseType_t i = 0; i < n; i++) {
+        TaskStatus_t* t = &diag_tasks[i];
+        uint8_t* rec = &out[i * DIAG_TASK_RECORD_SIZE];
+        
+        ran = t->ulRunTimeCounter - DIAG_LastRuntime(t->xTaskNumber);
+        permille = elapsed ? (uint32_t)(((uint64_t)ran * 1000) / elapsed) : 0;
+        if(permille > 1000) {
+            permille = 1000;
+        }
+        stack_free = t->usStackHighWaterMark;
+        
+        memset(rec, 0, 4);
+        if(t->pcTaskName != NULL) {
+            strncpy((char*)rec, t->pcTaskName, 4);
+        }
+        rec[4] = (uint8_t)permille;
+        rec[5] = (uint8_t)(permille >> 8);
+        memcpy(&rec[6], &stack_free, sizeof(stack_free));
+    }
+    
+    for(UBaseType_t i = 0; i < n; i++) {
+        diag_last[i].number = diag_tasks[i].xTaskNumber;
+        diag_last[i].runtime = diag_tasks[i].ulRunTimeCounter;
+    }
+    diag_last_count = (uint8_t)n;
+    diag_last_total = total;
+    
+    *count = (uint8_t)n;
+    return (uint16_t)(n * DIAG_TASK_RECORD_SIZE);
+}
+
+static uint16_t DIAG_Saturate16(uint32_t v) {
+    return (v > 0xFFFF) ? 0xFFFF : (uint16_t)v;
+}
+
+/* Heartbeat supervisor figures, cleared along with the probes */
+static uint16_t DIAG_PackSupervisor(uint8_t* out, uint8_t reset) {
+    SUPV_Stats_t stats[SUPV_TASK_COUNT];
+    uint16_t v[3];
+    uint8_t* rec = &out[1];
+    
+    SYSTEM_GetTaskStats(stats, reset);
+    
+    out[0] = SUPV_TASK_COUNT;
+    for(uint8_t i = 0; i < SUPV_TASK_COUNT; i++) {
+        v[0] = DIAG_Saturate16(stats[i].max_interval_ms);
+        v[1] = DIAG_Saturate16(stats[i].max_jitter_us);
+        v[2] = DIAG_Saturate16(stats[i].missed);
+        memcpy(rec, v, sizeof(v));
+        rec += DIAG_SUPV_RECORD_SIZE;
+    }
+    
+    return (uint16_t)(rec - out);
+}
+
+/* CMD_GET_DIAGNOSTICS - reset clears the counters once they are reported */
+HAL_StatusTypeDef DIAG_SendReport(uint8_t reset) {
+    DIAG_Probe_t probes[DIAG_PROBE_COUNT];
+    uint8_t* rec;
+    uint32_t mean;
+    uint16_t length;
+    uint16_t crc;
+    uint8_t tasks;
+    uint32_t mag_dropped;
+    uint32_t stop_entries, stop_ms;
+    
+    taskENTER_CRITICAL();
+    memcpy(probes, diag_probes, sizeof(probes));
+    if(reset) {
+        memset(diag_probes, 0, sizeof(diag_probes));
+    }
+    mag_dropped = MAG_DroppedTotal(reset);
+    taskEXIT_CRITICAL();
+    SYSTEM_GetStopStats(&stop_entries, &stop_ms, reset);
+    
+    diag_frame[0] = 0xAA;
+    diag_frame[1] = 0x5E;
+    diag_frame[2] = DIAG_PROBE_COUNT;
+    memcpy(&diag_frame[4], &SystemCoreClock, sizeof(uint32_t));
+    
+    rec = &diag_frame[DIAG_HEADER_SIZE];
+    for(uint8_t i = 0; i < DIAG_PROBE_COUNT; i++) {
+        mean = probes[i].count ? (uint32_t)(probes[i].total / probes[i].count) : 0;
+        memcpy(&rec[0], &probes[i].count, sizeof(uint32_t));
+        memcpy(&rec[4], &probes[i].max, sizeof(uint32_t));
+        memcpy(&rec[8], &mean, sizeof(uint32_t));
+        rec += DIAG_PROBE_RECORD_SIZE;
+    }
+    
+    length = (uint16_t)(rec - diag_frame);
+    length += DIAG_PackTasks(rec, &tasks);
+    diag_frame[3] = tasks;
+    length += DIAG_PackSupervisor(&diag_frame[length], reset);
+    memcpy(&diag_frame[length], &mag_dropped, sizeof(mag_dropped));
+    length += sizeof(mag_dropped);
+    memcpy(&diag_frame[length], &stop_entries, sizeof(stop_entries));
+    length += sizeof(stop_entries);
+    memcpy(&diag_frame[length], &stop_ms, sizeof(stop_ms));
+    length += sizeof(stop_ms);
+    
+    crc = CRC16_Calculate(diag_frame, length);
+    memcpy(&diag_frame[length], &crc, sizeof(crc));
+    
+    return COMM_Transmit(&huart1, diag_frame, length + 2);
+}
@@ -0,0 +1,358 @@
+/* dump.c - History Bulk Transfer
+ *
+ * Streams a range of the flash history to the Pi. A dump session keeps
+ * its last DUMP_MAX_WINDOW frames in RAM and runs selective repeat over
+ * them: new frames go out as soon as the window and TX ring allow, and
+ * only the frames the ground reports missing are sent again. Throughput
+ * is then set by the link, not by the round trip. Transfers run in
+ * DownlinkTask, below the acquisition and command tasks; CommTask hands
+ * over requests and ACKs through SPSC rings.
+ */
+#include "dump.h"
+#include "history.h"
+#include "communication.h"
+#include "spsc_ring.h"
+#include "crc.h"
+#include "cmsis_os.h"
+
+/* History walk plus the packet that did not fit in the last frame */
+typedef struct {
+    HIST_Iter_t it;
+    TelemetryPacket_t pending;
+    uint8_t has_pending;
+    uint8_t exhausted;
+} DUMP_Source_t;
+
+typedef struct {
+    uint16_t length;
+    uint8_t  acked;
+    uint32_t sent_tick;
+    uint8_t  data[DUMP_FRAME_MAX];
+} DUMP_Slot_t;
+
+static struct {
+    uint8_t  active;
+    uint16_t session;
+    uint8_t  window;
+    uint16_t base;            /* Oldest unacked frame */
+    uint16_t next;            /* Next frame to build */
+    uint32_t last_ack_tick;
+    DUMP_Source_t source;
+    DUMP_Slot_t slots[DUMP_MAX_WINDOW];
+} dump;
+
+static struct {
+    uint8_t  active;
+    uint16_t number;          /* Next frame number */
+    uint16_t length;          /* Built frame waiting for TX room, 0 = none */
+    uint32_t progress_tick;
+    DUMP_Source_t source;
+    uint8_t  frame[DUMP_FRAME_MAX];
+} oneshot;
+
+/* CommTask to DownlinkTask */
+typedef struct {
+    uint8_t  oneshot;
+    uint8_t  window;
+    uint16_t session;
+    uint16_t first_seq;
+    uint16_t last_seq;
+} DUMP_Request_t;
+
+typedef struct {
+    uint16_t session;
+    uint16_t base;
+    uint32_t bitmap;
+} DUMP_Ack_t;
+
+SPSC_RING(request_ring, DUMP_Request_t, DUMP_REQUEST_RING_SIZE);
+SPSC_RING(ack_ring, DUMP_Ack_t, DUMP_ACK_RING_SIZE);
+
+static osThreadId_t dump_thread = NULL;
+
+static void DUMP_SourceBegin(DUMP_Source_t* src, uint16_t first_seq, uint16_t last_seq) {
+    HIST_IterBegin(&src->it, first_seq, last_seq);
+    src->has_pending = 0;
+    src->exhausted = 0;
+}
+
+/* Pack records into one frame until the next does not fit. Returns the
+ * frame length including header and CRC. */
+static uint16_t DUMP_FillFrame(DUMP_Source_t* src, uint8_t* frame, uint16_t session, uint16_t number) {
+    uint8_t record[HIST_MAX_PAYLOAD + HIST_RECORD_OVERHEAD];
+    TelemetryPacket_t prev;
+    uint8_t chained = 0;
+    uint16_t used = 0;
+    uint16_t length;
+    uint16_t crc;
+    
+    while(1) {
+        if(!src->has_pending) {
+            if(!HIST_IterNext(&src->it, &src->pending)) {
+                src->exhausted = 1;
+                break;
+            }
+            src->has_pending = 1;
+        }
+    
+        length = HIST_Encode(&src->pending, chained ? &prev : NULL, &record[1]);
+        if(used + length + HIST_RECORD_OVERHEAD > DUMP_FRAME_DATA) {
+            break;  /* Starts the next frame, as a keyframe */
+        }
+        record[0] = (uint8_t)length;
+        crc = CRC16_Calculate(record, length + 1);
+        memcpy(&record[length + 1], &crc, sizeof(crc));
+        memcpy(&frame[DUMP_HEADER_SIZE + used], record, length + HIST_RECORD_OVERHEAD);
+        used += length + HIST_RECORD_OVERHEAD;
+    
+        prev = src->pending;
+        chained = 1;
+        src->has_pending = 0;
+    }
+    
+    frame[0] = 0xAA;
+    frame[1] = 0x62;
+    memcpy(&frame[2], &session, sizeof(session));
+    memcpy(&frame[4], &number, sizeof(number));
+    frame[6] = src->exhausted ? DUMP_FLAG_LAST : 0;
+    memcpy(&frame[7], &used, sizeof(used));
+    crc = CRC16_Calculate(frame, DUMP_HEADER_SIZE + used);
+    memcpy(&frame[DUMP_HEADER_SIZE + used], &crc, sizeof(crc));
+    
+    return DUMP_HEADER_SIZE + used + 2;
+}
+
+/* ==================== REQUESTS ==================== */
+
+void DUMP_Init(void) {
+    dump_thread = osThreadGetId();
+}
+
+/* Wake DownlinkTask - new work, or room in the TX ring */
+void DUMP_Notify(void) {
+    if(dump_thread != NULL) {
+        osThreadFlagsSet(dump_thread, DUMP_FLAG_WAKE);
+    }
+}
+
+static HAL_StatusTypeDef DUMP_PostRequest(uint8_t is_oneshot, uint16_t session, uint16_t first_seq,
+                                          uint16_t last_seq, uint8_t window) {
+    DUMP_Request_t* req = SPSC_CLAIM(request_ring);
+    
+    if(req == NULL) {
+        return HAL_BUSY;
+    }
+    req->oneshot = is_oneshot;
+    req->session = session;
+    req->first_seq = first_seq;
+    req->last_seq = last_seq;
+    req->window = window;
+    SPSC_COMMIT(request_ring);
+    
+    DUMP_Notify();
+    return HAL_OK;
+}
+
+/* CMD_GET_HISTORY: send the whole range back to back as session 0,
+ * replacing a one-shot still running */
+HAL_StatusTypeDef DUMP_SendRange(uint16_t first_seq, uint16_t last_seq) {
+    return DUMP_PostRequest(1, 0, first_seq, last_seq, 0);
+}
+
+/* CMD_DUMP_HISTORY: a new dump replaces any running one; window 0 just
+ * cancels */
+HAL_StatusTypeDef DUMP_Start(uint16_t session, uint16_t first_seq, uint16_t last_seq, uint8_t window) {
+    return DUMP_PostRequest(0, session, first_seq, last_seq, window);
+}
+
+HAL_StatusTypeDef DUMP_HandleAck(uint16_t session, uint16_t base, uint32_t bitmap) {
+    DUMP_Ack_t* ack = SPSC_CLAIM(ack_ring);
+    
+    if(ack == NULL) {
+        return HAL_BUSY;  /* The ground repeats its ACK */
+    }
+    ack->session = session;
+    ack->base = base;
+    ack->bitmap = bitmap;
+    SPSC_COMMIT(ack_ring);
+    
+    DUMP_Notify();
+    return HAL_OK;
+}
+
+/* ==================== ONE-SHOT ==================== */
+
+static void DUMP_OneshotBegin(uint16_t first_seq, uint16_t last_seq) {
+    DUMP_SourceBegin(&oneshot.source, first_seq, last_seq);
+    oneshot.number = 0;
+    oneshot.length = 0;
+    oneshot.progress_tick = HAL_GetTick();
+    oneshot.active = 1;
+}
+
+/* Send frames while the TX ring has room. Returns the service timeout. */
+static uint32_t DUMP_OneshotService(void) {
+    while(oneshot.active) {
+        if(oneshot.length == 0) {
+            oneshot.length = DUMP_FillFrame(&oneshot.source, oneshot.frame, 0, oneshot.number++);
+        }
+        if(COMM_Transmit(&huart1, oneshot.frame, oneshot.length) != HAL_OK) {
+            if((HAL_GetTick() - oneshot.progress_tick) >= DUMP_ONESHOT_TIMEOUT_MS) {
+                oneshot.active = 0;
+                LogError(ERROR_UART);  /* Pi link stalled */
+                break;
+            }
+            return DUMP_POLL_MS;  /* TX_DONE wakes us sooner */
+        }
+        oneshot.length = 0;
+        oneshot.progress_tick = HAL_GetTick();
+        if(oneshot.source.exhausted) {
+            oneshot.active = 0;
+        }
+    }
+    return osWaitForever;
+}
+
+/* ==================== SELECTIVE REPEAT ==================== */
+
+static DUMP_Slot_t* DUMP_Slot(uint16_t frame) {
+    return &dump.slots[frame % DUMP_MAX_WINDOW];
+}
+
+static uint8_t DUMP_InFlight(uint16_t frame) {
+    return (uint16_t)(frame - dump.base) < (uint16_t)(dump.next - dump.base);
+}
+
+static void DUMP_Begin(uint16_t session, uint16_t first_seq, uint16_t last_seq, uint8_t window) {
+    dump.active = 0;
+    if(window == 0) {
+        return;
+    }
+    
+    dump.session = session;
+    dump.window = (window > DUMP_MAX_WINDOW) ? DUMP_MAX_WINDOW : window;
+    dump.base = 0;
+    dump.next = 0;
+    dump.last_ack_tick = HAL_GetTick();
+    DUMP_SourceBegin(&dump.source, first_seq, last_seq);
+    dump.active = 1;
+}
+
+static void DUMP_ApplyAck(uint16_t session, uint16_t base, uint32_t bitmap) {
+    uint32_t now = HAL_GetTick();
+    uint16_t frame;
+    uint16_t highest = dump.base;
+    uint8_t any = 0;
+    
+    if(!dump.active || session != dump.session) {
+        return;  /* Stale ACK from an earlier session */
+    }
+    if((uint16_t)(base - dump.base) > (uint16_t)(dump.next - dump.base)) {
+        return;  /* Base outside the window */
+    }
+    dump.last_ack_tick = now;
+    
+    /* Cumulative part, then the selective bitmap */
+    for(frame = dump.base; frame != base; frame++) {
+        DUMP_Slot(frame)->acked = 1;
+    }
+    for(uint8_t i = 0; i < 32; i++) {
+        frame = base + i;
+        if((bitmap & (1u << i)) && DUMP_InFlight(frame)) {
+            DUMP_Slot(frame)->acked = 1;
+            highest = frame;
+            any = 1;
+        }
+    }
+    
+    /* A hole below an acked frame was lost - resend it without waiting
+     * for the full RTO, unless it only just went out again */
+    if(any) {
+        for(frame = dump.base; frame != highest; frame++) {
+            DUMP_Slot_t* slot = DUMP_Slot(frame);
+            if(!slot->acked && (now - slot->sent_tick) >= DUMP_GAP_RETX_MS) {
+                slot->sent_tick = now - DUMP_RTO_MS;
+            }
+        }
+    }
+    
+    while(dump.base != dump.next && DUMP_Slot(dump.base)->acked) {
+        dump.base++;
+    }
+}
+
+/* Push out what the window allows. Returns the service timeout. */
+static uint32_t DUMP_WindowService(void) {
+    uint32_t now = HAL_GetTick();
+    DUMP_Slot_t* slot;
+    uint16_t frame;
+    
+    if(!dump.active) {
+        return osWaitForever;
+    }
+    if((now - dump.last_ack_tick) >= DUMP_SESSION_TIMEOUT_MS) {
+        dump.active = 0;  /* Ground went away */
+        return osWaitForever;
+    }
+    
+    /* Resends first, oldest first */
+    for(frame = dump.base; frame != dump.next; frame++) {
+        slot = DUMP_Slot(frame);
+        if(slot->acked || (now - slot->sent_tick) < DUMP_RTO_MS) {
+            continue;
+        }
+        if(COMM_Transmit(&huart1, slot->data, slot->length) != HAL_OK) {
+            return DUMP_POLL_MS;  /* TX ring full, TX_DONE wakes us */
+        }
+        slot->sent_tick = now;
+    }
+    
+    /* Then new frames while the window has room */
+    while(!dump.source.exhausted || dump.source.has_pending) {
+        if((uint16_t)(dump.next - dump.base) >= dump.window ||
+           COMM_TxFree(&huart1) < DUMP_FRAME_MAX) {
+            return DUMP_POLL_MS;
+        }
+        slot = DUMP_Slot(dump.next);
+        slot->length = DUMP_FillFrame(&dump.source, slot->data, dump.session, dump.next);
+        slot->acked = 0;
+        slot->sent_tick = now;
+        COMM_Transmit(&huart1, slot->data, slot->length);
+        dump.next++;
+    }
+    
+    if(dump.base == dump.next) {
+        dump.active = 0;  /* Everything acked */
+        return osWaitForever;
+    }
+    return DUMP_POLL_MS;
+}
+
+/* ==================== SERVICE ==================== */
+
+/* DownlinkTask: apply what CommTask queued, then send. Returns how long
+ * the task may sleep before the next call. */
+uint32_t DUMP_Service(void) {
+    const DUMP_Request_t* req;
+    const DUMP_Ack_t* ack;
+    uint32_t timeout;
+    uint32_t window_timeout;
+    
+    while((req = SPSC_FRONT(request_ring)) != NULL) {
+        if(req->oneshot) {
+            DUMP_OneshotBegin(req->first_seq, req->last_seq);
+        } else {
+            DUMP_Begin(req->session, req->first_seq, req->last_seq, req->window);
+        }
+        SPSC_RELEASE(request_ring);
+    }
+    while((ack = SPSC_FRONT(ack_ring)) != NULL) {
+        DUMP_ApplyAck(ack->session, ack->base, ack->bitmap);
+        SPSC_RELEASE(ack_ring);
+    }
+    
+    timeout = DUMP_OneshotService();
+    window_timeout = DUMP_WindowService();
+    
+    return (window_timeout < timeout) ? window_timeout : timeout;
+}
@@ -0,0 +1,401 @@
+/* fwupdate.c - Firmware Update
+ *
+ * Image chunks from the Pi are copied out of the RX ring one at a time,
+ * checked, and programmed into the update slot, so only a single chunk
+ * is ever held in RAM. The slot is
+ * history sector B, lent by the history log while an update needs it.
+ * It is erased once when the upload begins - the only long flash stall,
+ * taken before the Pi starts streaming - and after that a 256-byte chunk
+ * costs ~1 ms of word programming against ~23 ms on the wire at 115200
+ * baud, so the uplink sets the pace. The chunk map lives in the slot
+ * header and survives resets; BEGIN with the same session resumes. The
+ * bootloader installs a committed image and rolls it back unless the new
+ * application confirms itself.
+ */
+#include "fwupdate.h"
+#include "history.h"
+#include "crc.h"
+#include "diag.h"
+#include "cmsis_os.h"
+#include <string.h>
+#include <stddef.h>
+
+_Static_assert(sizeof(FWU_Slot_t) <= FWU_SLOT_IMAGE - FWU_SLOT_BASE,
+               "slot header overlaps the image");
+
+/* CommTask only, except FWU_Confirm */
+static uint8_t fwu_preparing = 0;       /* BEGIN accepted, slot not erased yet */
+static uint8_t fwu_result = FWU_OK;     /* Last operation or chunk */
+static uint8_t fwu_status_due = 0;      /* TX ring was full */
+static uint16_t fwu_since_ack = 0;
+static uint32_t fwu_begin[3];           /* session, size, crc while preparing */
+
+/* One chunk frame, out of reach of the RX DMA while it is checked and
+ * programmed */
+#define FWU_CHUNK_FRAME_MAX (sizeof(ChunkHeader_t) + FWU_CHUNK_SIZE + 4)
+static uint8_t fwu_chunk[FWU_CHUNK_FRAME_MAX];
+
+static uint16_t FWU_ChunkCount(uint32_t size) {
+    return (uint16_t)((size + FWU_CHUNK_SIZE - 1) / FWU_CHUNK_SIZE);
+}
+
+FWU_State_t FWU_GetState(void) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    
+    if(fwu_preparing) {
+        return FWU_STATE_PREPARING;
+    }
+    if(slot->magic != FWU_MAGIC) {
+        return FWU_STATE_IDLE;
+    }
+    if(slot->rolled_back == FWU_FLAG_SET) {
+        return FWU_STATE_ROLLED_BACK;
+    }
+    if(slot->confirmed == FWU_FLAG_SET) {
+        return FWU_STATE_CONFIRMED;
+    }
+    if(slot->installed == FWU_FLAG_SET) {
+        return FWU_STATE_TRIAL;
+    }
+    if(slot->pending == FWU_FLAG_SET) {
+        return FWU_STATE_PENDING;
+    }
+    if(slot->complete == FWU_FLAG_SET) {
+        return FWU_STATE_COMPLETE;
+    }
+    return FWU_STATE_RECEIVING;
+}
+
+/* At boot, before the scheduler: an upload in progress, or an image the
+ * bootloader may still roll back, keeps the slot from the history log */
+void FWU_Init(void) {
+    switch(FWU_GetState()) {
+        case FWU_STATE_RECEIVING:
+        case FWU_STATE_COMPLETE:
+        case FWU_STATE_PENDING:
+        case FWU_STATE_TRIAL:
+            HIST_LendSector();
+            break;
+        default:
+            break;
+    }
+}
+
+/* ==================== FLASH ==================== */
+
+/* The flash controller is shared with the history log, whose writer
+ * (SensorTask) outranks CommTask - hold the scheduler so the two never
+ * interleave. A tail shorter than a word is padded with erased bytes. */
+static HAL_StatusTypeDef FWU_Program(uint32_t addr, const uint8_t* data, uint16_t length) {
+    HAL_StatusTypeDef status = HAL_OK;
+    uint32_t word;
+    
+    vTaskSuspendAll();
+    HAL_FLASH_Unlock();
+    for(uint16_t i = 0; i < length && status == HAL_OK; i += 4) {
+        word = FWU_FLAG_CLEAR;
+        memcpy(&word, &data[i], (length - i < 4) ? (length - i) : 4);
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + i, word);
+    }
+    HAL_FLASH_Lock();
+    xTaskResumeAll();
+    
+    return status;
+}
+
+static HAL_StatusTypeDef FWU_SetFlag(const volatile uint32_t* flag) {
+    uint32_t set = FWU_FLAG_SET;
+    
+    if(*flag == FWU_FLAG_SET) {
+        return HAL_OK;
+    }
+    return FWU_Program((uint32_t)(uintptr_t)flag, (const uint8_t*)&set, sizeof(set));
+}
+
+/* Erase the slot and write the header, magic last. The core stalls on
+ * instruction fetch for the erase (up to ~2 s); the Pi waits for the
+ * RECEIVING status before it streams, so nothing is lost meanwhile. */
+static HAL_StatusTypeDef FWU_StartSlot(void) {
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t sector_error;
+    uint32_t magic = FWU_MAGIC;
+    HAL_StatusTypeDef status;
+    
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = FWU_SLOT_SECTOR;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    
+    vTaskSuspendAll();
+    HAL_FLASH_Unlock();
+    status = HAL_FLASHEx_Erase(&erase, &sector_error);
+    HAL_FLASH_Lock();
+    xTaskResumeAll();
+    if(status != HAL_OK) {
+        return status;
+    }
+    
+    status = FWU_Program(FWU_SLOT_BASE + offsetof(FWU_Slot_t, session),
+                         (const uint8_t*)fwu_begin, sizeof(fwu_begin));
+    if(status == HAL_OK) {
+        status = FWU_Program(FWU_SLOT_BASE, (const uint8_t*)&magic, sizeof(magic));
+    }
+    return status;
+}
+
+/* ==================== STATUS ==================== */
+
+static uint16_t FWU_FirstMissing(uint16_t count) {
+    uint16_t chunk = 0;
+    
+    while(chunk < count && FWU_SLOT->chunk_done[chunk] == FWU_FLAG_SET) {
+        chunk++;
+    }
+    return chunk;
+}
+
+static void FWU_SendStatus(void) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    uint8_t frame[FWU_STATUS_FRAME_SIZE];
+    FWU_State_t state = FWU_GetState();
+    uint32_t session = 0;
+    uint16_t count = 0;
+    uint16_t base = 0;
+    uint32_t bitmap = 0;
+    uint16_t crc;
+    
+    if(state == FWU_STATE_PREPARING) {
+        session = fwu_begin[0];
+    } else if(state != FWU_STATE_IDLE) {
+        session = slot->session;
+        count = FWU_ChunkCount(slot->image_size);
+        base = FWU_FirstMissing(count);
+        for(uint8_t i = 0; i < 32 && base + i < count; i++) {
+            if(slot->chunk_done[base + i] == FWU_FLAG_SET) {
+                bitmap |= 1u << i;
+            }
+        }
+    }
+    
+    frame[0] = 0xAA;
+    frame[1] = 0x60;
+    frame[2] = (uint8_t)state;
+    frame[3] = fwu_result;
+    memcpy(&frame[4], &session, sizeof(session));
+    memcpy(&frame[8], &count, sizeof(count));
+    memcpy(&frame[10], &base, sizeof(base));
+    memcpy(&frame[12], &bitmap, sizeof(bitmap));
+    crc = CRC16_Calculate(frame, FWU_STATUS_FRAME_SIZE - 2);
+    memcpy(&frame[16], &crc, sizeof(crc));
+    
+    fwu_status_due = (COMM_Transmit(&huart1, frame, sizeof(frame)) != HAL_OK);
+    fwu_since_ack = 0;
+}
+
+/* ==================== OPERATIONS ==================== */
+
+/* The vector table must point into the application sectors and RAM */
+static uint8_t FWU_ImagePlausible(void) {
+    const volatile uint32_t* vectors = (const volatile uint32_t*)(uintptr_t)FWU_SLOT_IMAGE;
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1];
+    
+    return (sp - FWU_RAM_BASE - 1) < FWU_RAM_SIZE &&
+           (reset & 1) != 0 &&
+           ((reset & ~1u) - FWU_APP_BASE) < FWU_SLOT->image_size;
+}
+
+static FWU_Result_t FWU_Begin(const uint8_t* params, uint16_t length) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    FWU_State_t state = FWU_GetState();
+    uint32_t begin[3];
+    
+    if(length < 1 + sizeof(begin)) {
+        return FWU_ERR_SIZE;
+    }
+    memcpy(begin, &params[1], sizeof(begin));
+    
+    if(begin[1] == 0 || begin[1] > FWU_APP_SIZE) {
+        return FWU_ERR_SIZE;
+    }
+    /* A committed or unconfirmed image must be aborted or confirmed first */
+    if(state == FWU_STATE_PENDING || state == FWU_STATE_TRIAL) {
+        return FWU_ERR_STATE;
+    }
+    /* Same upload: resume, the status tells the Pi what is missing */
+    if((state == FWU_STATE_RECEIVING || state == FWU_STATE_COMPLETE) &&
+       slot->session == begin[0] && slot->image_size == begin[1] &&
+       slot->image_crc == begin[2]) {
+        return FWU_OK;
+    }
+    
+    /* New upload: the slot is erased once the history log has moved off it */
+    memcpy(fwu_begin, begin, sizeof(fwu_begin));
+    fwu_preparing = 1;
+    HIST_LendSector();
+    return FWU_OK;
+}
+
+static FWU_Result_t FWU_Commit(void) {
+    if(FWU_GetState() != FWU_STATE_COMPLETE) {
+        return FWU_ERR_STATE;
+    }
+    if(!FWU_ImagePlausible()) {
+        return FWU_ERR_IMAGE;
+    }
+    if(FWU_SetFlag(&FWU_SLOT->pending) != HAL_OK) {
+        return FWU_ERR_FLASH;
+    }
+    return FWU_OK;
+}
+
+static FWU_Result_t FWU_Abort(void) {
+    FWU_State_t state = FWU_GetState();
+    
+    /* Once installed the bootloader owns the slot until it is confirmed */
+    if(state == FWU_STATE_TRIAL) {
+        return FWU_ERR_STATE;
+    }
+    fwu_preparing = 0;
+    if(FWU_SLOT->magic == FWU_MAGIC) {
+        /* Clearing the magic invalidates the slot without an erase */
+        if(FWU_SetFlag(&FWU_SLOT->magic) != HAL_OK) {
+            return FWU_ERR_FLASH;
+        }
+    }
+    HIST_ReturnSector();
+    return FWU_OK;
+}
+
+/* CMD_UPDATE_FIRMWARE, CommTask. Every operation answers with a status. */
+void FWU_HandleCommand(const uint8_t* params, uint16_t length) {
+    uint8_t op = (length >= 1) ? params[0] : FWU_OP_STATUS;
+    
+    switch(op) {
+        case FWU_OP_BEGIN:
+            fwu_result = FWU_Begin(params, length);
+            break;
+        
+        case FWU_OP_STATUS:
+            break;
+        
+        case FWU_OP_COMMIT:
+            fwu_result = FWU_Commit();
+            break;
+        
+        case FWU_OP_ABORT:
+            fwu_result = FWU_Abort();
+            break;
+        
+        default:
+            fwu_result = FWU_ERR_STATE;
+            break;
+    }
+    FWU_SendStatus();
+}
+
+/* All chunks in: check the image as a whole before it can be committed */
+static void FWU_Finish(void) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    
+    if(CRC32_Calculate((const void*)(uintptr_t)FWU_SLOT_IMAGE, slot->image_size) != slot->image_crc) {
+        fwu_result = FWU_ERR_CRC;  /* Chunks were fine - ABORT and upload again */
+    } else if(FWU_SetFlag(&slot->complete) != HAL_OK) {
+        fwu_result = FWU_ERR_FLASH;
+    }
+}
+
+/* SYNC_FIRMWARE chunk, CommTask. The frame is copied first and only the
+ * copy is checked and programmed: if the RX DMA lapped the ring slot
+ * before the copy finished, the chunk is dropped and stays missing. */
+void FWU_HandleChunk(const COMM_Frame_t* frame) {
+    const volatile FWU_Slot_t* slot = FWU_SLOT;
+    const uint8_t* data = &fwu_chunk[sizeof(ChunkHeader_t)];
+    ChunkHeader_t header;
+    uint32_t crc;
+    uint32_t offset;
+    uint16_t count;
+    uint16_t length;
+    
+    DIAG_PROBE_BEGIN();
+    
+    if(FWU_GetState() != FWU_STATE_RECEIVING) {
+        return;  /* Late or stray chunk */
+    }
+    if(frame->length > sizeof(fwu_chunk)) {
+        fwu_result = FWU_ERR_SIZE;
+        return;
+    }
+    memcpy(fwu_chunk, frame->data, frame->length);
+    if(!COMM_FrameValid(frame)) {
+        fwu_result = FWU_ERR_CRC;
+        return;
+    }
+    memcpy(&header, fwu_chunk, sizeof(header));
+    memcpy(&crc, &fwu_chunk[frame->length - 4], sizeof(crc));
+    if(header.file_id != (uint16_t)slot->session) {
+        return;
+    }
+    
+    count = FWU_ChunkCount(slot->image_size);
+    offset = (uint32_t)header.chunk_number * FWU_CHUNK_SIZE;
+    length = (slot->image_size - offset < FWU_CHUNK_SIZE) ? (uint16_t)(slot->image_size - offset)
+                                                           : FWU_CHUNK_SIZE;
+    if(header.chunk_count != count || header.chunk_number >= count ||
+       header.data_length != length) {
+        fwu_result = FWU_ERR_SIZE;
+        return;
+    }
+    if(CRC32_Calculate(fwu_chunk, frame->length - 4) != crc) {
+        fwu_result = FWU_ERR_CRC;
+        return;
+    }
+    
+    if(slot->chunk_done[header.chunk_number] != FWU_FLAG_SET) {
+        /* Compare what landed in flash before marking the chunk */
+        if(FWU_Program(FWU_SLOT_IMAGE + offset, data, length) != HAL_OK ||
+           memcmp((const void*)(uintptr_t)(FWU_SLOT_IMAGE + offset), data, length) != 0 ||
+           FWU_SetFlag(&slot->chunk_done[header.chunk_number]) != HAL_OK) {
+            fwu_result = FWU_ERR_FLASH;
+            return;
+        }
+    }
+    fwu_result = FWU_OK;
+    
+    if(FWU_FirstMissing(count) == count) {
+        FWU_Finish();
+        FWU_SendStatus();
+    } else if(++fwu_since_ack >= FWU_ACK_INTERVAL) {
+        FWU_SendStatus();
+    }
+    
+    DIAG_PROBE_END(DIAG_FW_CHUNK);
+}
+
+/* CommTask: erase the slot once history has let go of it, retry a status
+ * the TX ring had no room for. Returns how long the task may sleep. */
+uint32_t FWU_Service(void) {
+    if(fwu_preparing && HIST_SectorLent()) {
+        fwu_result = (FWU_StartSlot() == HAL_OK) ? FWU_OK : FWU_ERR_FLASH;
+        fwu_preparing = 0;
+        if(fwu_result != FWU_OK) {
+            HIST_ReturnSector();
+        }
+        FWU_SendStatus();
+    } else if(fwu_status_due) {
+        FWU_SendStatus();
+    }
+    
+    return fwu_preparing ? FWU_PREPARE_POLL_MS : osWaitForever;
+}
+
+/* WatchdogTask, once the new image has run healthy for a while. The slot
+ * keeps its record until the history log next needs the sector. */
+void FWU_Confirm(void) {
+    if(FWU_GetState() != FWU_STATE_TRIAL) {
+        return;
+    }
+    if(FWU_SetFlag(&FWU_SLOT->confirmed) == HAL_OK) {
+        HIST_ReturnSector();
+    }
+}
@@ -0,0 +1,596 @@
+/* history.c - Flash Telemetry History
+ *
+ * Every logged snapshot is delta-encoded against the one before it, so a
+ * typical 1 Hz record is ~15 bytes instead of the 90-byte frame. Only
+ * SensorTask appends; readers walk the flash without a lock, taking a
+ * snapshot of the write position first. A sector recycled under a walk
+ * just reads as erased and ends that part of it.
+ */
+#include "history.h"
+#include "crc.h"
+#include "cmsis_os.h"
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+typedef enum {
+    HIST_U8,
+    HIST_U16,
+    HIST_U32,
+    HIST_I32,
+    HIST_F32
+} HIST_Type_t;
+
+typedef struct {
+    uint8_t  offset;
+    uint8_t  type;
+    uint16_t step;       /* Expected increase per record */
+    float    scale;      /* F32 only: stored counts per unit */
+} HIST_Field_t;
+
+#define HIST_FIELD(name, type, step, scale) \
+    { offsetof(TelemetryPacket_t, name), type, step, scale }
+
+/* Ordered by how often they change, the field mask is a varint. Floats
+ * are stored at the resolution of the sensor behind them. */
+static const HIST_Field_t hist_fields[] = {
+    HIST_FIELD(timestamp,       HIST_U32, HIST_PERIOD_MS, 0),
+    HIST_FIELD(mag_x,           HIST_F32, 0, 6250.0f),   /* 0.00016 G LSB */
+    HIST_FIELD(mag_y,           HIST_F32, 0, 6250.0f),
+    HIST_FIELD(mag_z,           HIST_F32, 0, 6250.0f),
+    HIST_FIELD(temperature_bme, HIST_F32, 0, 100.0f),    /* 0.01 degC */
+    HIST_FIELD(pressure,        HIST_F32, 0, 100.0f),    /* 1 Pa */
+    HIST_FIELD(humidity,        HIST_F32, 0, 100.0f),    /* 0.01 %RH */
+    HIST_FIELD(temperature_tmp, HIST_F32, 0, 128.0f),    /* TMP117 LSB */
+    HIST_FIELD(radiation_cps,   HIST_U32, 0, 0),
+    HIST_FIELD(corrosion_raw,   HIST_U16, 0, 0),
+    HIST_FIELD(battery_voltage, HIST_U16, 0, 0),
+    HIST_FIELD(battery_current, HIST_U16, 0, 0),
+    HIST_FIELD(uptime,          HIST_U32, 0, 0),
+    HIST_FIELD(sequence_number, HIST_U16, HIST_LOG_INTERVAL, 0),
+    HIST_FIELD(latitude,        HIST_I32, 0, 0),
+    HIST_FIELD(longitude,       HIST_I32, 0, 0),
+    HIST_FIELD(altitude,        HIST_I32, 0, 0),
+    HIST_FIELD(gps_quality,     HIST_U8,  0, 0),
+    HIST_FIELD(gps_satellites,  HIST_U8,  0, 0),
+    HIST_FIELD(boot_count,      HIST_U8,  0, 0),
+    HIST_FIELD(error_flags,     HIST_U8,  0, 0),
+    HIST_FIELD(system_state,    HIST_U8,  0, 0),
+};
+
+#define HIST_FIELD_COUNT    (sizeof(hist_fields) / sizeof(hist_fields[0]))
+#define HIST_MASK_BINS      0x00000001u              /* Radiation histogram */
+#define HIST_MASK_FIELD(i)  (1u << ((i) + 1))
+#define HIST_MASK_KEYFRAME  (1u << (HIST_FIELD_COUNT + 1))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;  /* Higher is newer */
+} HIST_SectorHeader_t;
+
+static const struct {
+    uint32_t sector;
+    uint32_t base;
+    uint32_t size;
+} hist_sectors[2] = {
+    { HIST_SECTOR_A, HIST_SECTOR_A_BASE, HIST_SECTOR_A_SIZE },
+    { HIST_SECTOR_B, HIST_SECTOR_B_BASE, HIST_SECTOR_B_SIZE },
+};
+
+static uint8_t hist_ready = 0;
+static uint8_t hist_active = 0;         /* Index into hist_sectors */
+static uint32_t hist_generation = 0;
+static uint32_t hist_write = 0;         /* Next free byte in the active sector */
+static uint32_t hist_since_key = 0;
+static uint32_t hist_skip = 0;
+static TelemetryPacket_t hist_prev;     /* Last packet logged */
+
+/* Sector B loan to the firmware update, requested by CommTask and
+ * handed over by SensorTask */
+#define HIST_LEND_NONE      0
+#define HIST_LEND_REQUESTED 1
+#define HIST_LEND_GRANTED   2
+static volatile uint8_t hist_lend = HIST_LEND_NONE;
+
+/* ==================== CODEC ==================== */
+
+static uint8_t* HIST_PutVarint(uint8_t* out, uint32_t value) {
+    while(value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static const uint8_t* HIST_GetVarint(const uint8_t* in, const uint8_t* end, uint32_t* value) {
+    uint32_t result = 0;
+    uint8_t shift = 0;
+    
+    while(in < end && shift < 35) {
+        uint8_t b = *in++;
+        result |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            *value = result;
+            return in;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static uint32_t HIST_Zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t HIST_Unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t HIST_Get(const TelemetryPacket_t* packet, const HIST_Field_t* field) {
+    const uint8_t* src = (const uint8_t*)packet + field->offset;
+    uint16_t u16;
+    uint32_t u32;
+    float f32;
+    
+    switch(field->type) {
+        case HIST_U8:
+            return *src;
+        case HIST_U16:
+            memcpy(&u16, src, sizeof(u16));
+            return u16;
+        case HIST_F32:
+            memcpy(&f32, src, sizeof(f32));
+            f32 *= field->scale;
+            /* NaN and absurd readings are logged as zero */
+            if(!(f32 > -1e9f && f32 < 1e9f)) {
+                return 0;
+            }
+            return (int32_t)lroundf(f32);
+        default:
+            memcpy(&u32, src, sizeof(u32));
+            return (int32_t)u32;
+    }
+}
+
+static void HIST_Set(TelemetryPacket_t* packet, const HIST_Field_t* field, int32_t value) {
+    uint8_t* dst = (uint8_t*)packet + field->offset;
+    uint16_t u16 = (uint16_t)value;
+    uint32_t u32 = (uint32_t)value;
+    float f32 = value / field->scale;
+    
+    switch(field->type) {
+        case HIST_U8:
+            *dst = (uint8_t)value;
+            break;
+        case HIST_U16:
+            memcpy(dst, &u16, sizeof(u16));
+            break;
+        case HIST_F32:
+            memcpy(dst, &f32, sizeof(f32));
+            break;
+        default:
+            memcpy(dst, &u32, sizeof(u32));
+            break;
+    }
+}
+
+/* Histogram bins are Poisson noise, so they are bit-packed at the width
+ * of the largest bin instead of delta-coded: [width][10 x width bits] */
+static uint8_t* HIST_PutBins(uint8_t* out, const uint16_t* bins) {
+    uint16_t max = 0;
+    uint8_t width = 0;
+    uint32_t acc = 0;
+    uint8_t bits = 0;
+    
+    for(uint8_t i = 0; i < TLM_RADIATION_BINS; i++) {
+        max |= bins[i];
+    }
+    while(width < 16 && (max >> width) != 0) {
+        width++;
+    }
+    *out++ = width;
+    
+    for(uint8_t i = 0; i < TLM_RADIATION_BINS; i++) {
+        acc |= (uint32_t)bins[i] << bits;
+        bits += width;
+        while(bits >= 8) {
+            *out++ = (uint8_t)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if(bits > 0) {
+        *out++ = (uint8_t)acc;
+    }
+    return out;
+}
+
+static const uint8_t* HIST_GetBins(const uint8_t* in, const uint8_t* end, uint16_t* bins) {
+    uint8_t width;
+    uint32_t acc = 0;
+    uint8_t bits = 0;
+    
+    if(in >= end || *in > 16) {
+        return NULL;
+    }
+    width = *in++;
+    
+    for(uint8_t i = 0; i < TLM_RADIATION_BINS; i++) {
+        while(bits < width) {
+            if(in >= end) {
+                return NULL;
+            }
+            acc |= (uint32_t)*in++ << bits;
+            bits += 8;
+        }
+        bins[i] = (uint16_t)(acc & ((1u << width) - 1));
+        acc >>= width;
+        bits -= width;
+    }
+    return in;
+}
+
+uint16_t HIST_Encode(const TelemetryPacket_t* packet, const TelemetryPacket_t* prev, uint8_t* out) {
+    uint8_t body[HIST_MAX_PAYLOAD];
+    uint8_t* p = body;
+    uint16_t bins[TLM_RADIATION_BINS];
+    uint32_t mask = (prev == NULL) ? HIST_MASK_KEYFRAME : 0;
+    uint32_t predicted;
+    int32_t residual;
+    uint16_t length;
+    
+    memcpy(bins, packet->radiation_hist, sizeof(bins));
+    for(uint8_t i = 0; i < TLM_RADIATION_BINS; i++) {
+        if(bins[i] != 0) {
+            mask |= HIST_MASK_BINS;
+            p = HIST_PutBins(p, bins);
+            break;
+        }
+    }
+    
+    for(uint8_t i = 0; i < HIST_FIELD_COUNT; i++) {
+        const HIST_Field_t* field = &hist_fields[i];
+        predicted = (prev != NULL) ? (uint32_t)HIST_Get(prev, field) + field->step : 0;
+        residual = (int32_t)((uint32_t)HIST_Get(packet, field) - predicted);
+        if(residual != 0) {
+            mask |= HIST_MASK_FIELD(i);
+            p = HIST_PutVarint(p, HIST_Zigzag(residual));
+        }
+    }
+    
+    length = HIST_PutVarint(out, mask) - out;
+    memcpy(&out[length], body, p - body);
+    return length + (p - body);
+}
+
+HAL_StatusTypeDef HIST_Decode(const uint8_t* in, uint16_t length,
+                              const TelemetryPacket_t* prev, TelemetryPacket_t* packet) {
+    const uint8_t* end = in + length;
+    TelemetryPacket_t out;
+    uint16_t bins[TLM_RADIATION_BINS] = {0};
+    uint32_t mask, value, predicted;
+    uint8_t keyframe;
+    
+    in = HIST_GetVarint(in, end, &mask);
+    if(in == NULL) {
+        return HAL_ERROR;
+    }
+    keyframe = (mask & HIST_MASK_KEYFRAME) != 0;
+    if(!keyframe && prev == NULL) {
+        return HAL_ERROR;  /* Delta with nothing to apply it to */
+    }
+    
+    memset(&out, 0, sizeof(out));
+    if(mask & HIST_MASK_BINS) {
+        in = HIST_GetBins(in, end, bins);
+        if(in == NULL) {
+            return HAL_ERROR;
+        }
+    }
+    memcpy(out.radiation_hist, bins, sizeof(bins));
+    
+    for(uint8_t i = 0; i < HIST_FIELD_COUNT; i++) {
+        const HIST_Field_t* field = &hist_fields[i];
+        predicted = keyframe ? 0 : (uint32_t)HIST_Get(prev, field) + field->step;
+        value = 0;
+        if(mask & HIST_MASK_FIELD(i)) {
+            in = HIST_GetVarint(in, end, &value);
+            if(in == NULL) {
+                return HAL_ERROR;
+            }
+        }
+        HIST_Set(&out, field, (int32_t)(predicted + (uint32_t)HIST_Unzigzag(value)));
+    }
+    if(in != end) {
+        return HAL_ERROR;
+    }
+    
+    out.sync1 = 0xAA;
+    out.sync2 = 0x55;
+    out.packet_type = 0x01;
+    out.checksum = CRC16_Calculate(&out, sizeof(TelemetryPacket_t) - 2);
+    *packet = out;
+    
+    return HAL_OK;
+}
+
+/* ==================== FLASH LOG ==================== */
+
+static const HIST_SectorHeader_t* HIST_Header(uint8_t s) {
+    return (const HIST_SectorHeader_t*)(uintptr_t)hist_sectors[s].base;
+}
+
+static uint8_t HIST_SectorValid(uint8_t s) {
+    return HIST_Header(s)->magic == HIST_MAGIC;
+}
+
+static HAL_StatusTypeDef HIST_Program(uint32_t addr, const void* data, uint16_t length) {
+    const uint8_t* bytes = data;
+    HAL_StatusTypeDef status = HAL_OK;
+    
+    HAL_FLASH_Unlock();
+    for(uint16_t i = 0; i < length && status == HAL_OK; i++) {
+        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, addr + i, bytes[i]);
+    }
+    HAL_FLASH_Lock();
+    
+    return status;
+}
+
+/* Erase a sector and make it the active one. The F401 has a single
+ * bank, so the core stalls on instruction fetch for the whole erase
+ * (up to ~2 s for 128 KB) - well inside the 8 s watchdog, and it only
+ * happens once per sector fill. */
+static HAL_StatusTypeDef HIST_StartSector(uint8_t s, uint32_t generation) {
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t sector_error;
+    uint32_t magic = HIST_MAGIC;
+    HAL_StatusTypeDef status;
+    
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = hist_sectors[s].sector;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    
+    HAL_FLASH_Unlock();
+    status = HAL_FLASHEx_Erase(&erase, &sector_error);
+    HAL_FLASH_Lock();
+    if(status != HAL_OK) {
+        return status;
+    }
+    
+    /* Magic last, so a reset mid-header leaves the sector invalid */
+    status = HIST_Program(hist_sectors[s].base + offsetof(HIST_SectorHeader_t, generation),
+                          &generation, sizeof(generation));
+    if(status == HAL_OK) {
+        status = HIST_Program(hist_sectors[s].base, &magic, sizeof(magic));
+    }
+    
+    taskENTER_CRITICAL();
+    hist_active = s;
+    hist_generation = generation;
+    hist_write = hist_sectors[s].base + sizeof(HIST_SectorHeader_t);
+    taskEXIT_CRITICAL();
+    hist_since_key = HIST_KEYFRAME_INTERVAL;
+    
+    return status;
+}
+
+/* First erased byte after the last record. A torn record still has its
+ * length byte, so the walk steps over it and the CRC rejects it. */
+static uint32_t HIST_ScanEnd(uint8_t s) {
+    uint32_t addr = hist_sectors[s].base + sizeof(HIST_SectorHeader_t);
+    uint32_t end = hist_sectors[s].base + hist_sectors[s].size;
+    uint8_t length;
+    
+    while(addr < end) {
+        length = *(const volatile uint8_t*)(uintptr_t)addr;
+        if(length == 0xFF) {
+            break;
+        }
+        addr += length + HIST_RECORD_OVERHEAD;
+    }
+    return (addr > end) ? end : addr;
+}
+
+/* Move the log off sector B. Its records are given up with it. */
+static void HIST_Handover(void) {
+    if(hist_ready && hist_active == 1) {
+        hist_ready = (HIST_StartSector(0, hist_generation + 1) == HAL_OK);
+    }
+    
+    taskENTER_CRITICAL();
+    if(hist_lend == HIST_LEND_REQUESTED) {
+        hist_lend = HIST_LEND_GRANTED;  /* Unless returned meanwhile */
+    }
+    taskEXIT_CRITICAL();
+}
+
+HAL_StatusTypeDef HIST_Init(void) {
+    uint8_t a_valid = HIST_SectorValid(0);
+    uint8_t b_valid = HIST_SectorValid(1);
+    HAL_StatusTypeDef status = HAL_OK;
+    uint8_t s;
+    
+    if(!a_valid && !b_valid) {
+        status = HIST_StartSector(0, 1);
+    } else {
+        s = (a_valid && (!b_valid || HIST_Header(0)->generation > HIST_Header(1)->generation)) ? 0 : 1;
+        hist_active = s;
+        hist_generation = HIST_Header(s)->generation;
+        hist_write = HIST_ScanEnd(s);
+        hist_since_key = HIST_KEYFRAME_INTERVAL;  /* No previous packet in RAM */
+    }
+    
+    hist_skip = 0;
+    hist_ready = (status == HAL_OK);
+    if(hist_lend == HIST_LEND_REQUESTED) {
+        HIST_Handover();
+    }
+    return status;
+}
+
+/* SensorTask only */
+HAL_StatusTypeDef HIST_Append(const TelemetryPacket_t* packet) {
+    uint8_t record[HIST_MAX_PAYLOAD + HIST_RECORD_OVERHEAD];
+    uint8_t keyframe;
+    uint16_t length;
+    uint16_t crc;
+    HAL_StatusTypeDef status;
+    uint8_t next;
+    
+    if(hist_lend == HIST_LEND_REQUESTED) {
+        HIST_Handover();
+    }
+    if(!hist_ready) {
+        return HAL_ERROR;
+    }
+    if(++hist_skip < HIST_LOG_INTERVAL) {
+        return HAL_OK;
+    }
+    hist_skip = 0;
+    
+    keyframe = (hist_since_key >= HIST_KEYFRAME_INTERVAL);
+    length = HIST_Encode(packet, keyframe ? NULL : &hist_prev, &record[1]);
+    
+    /* Sector full: recycle the older one, or this one while B is lent.
+     * A new sector starts on a keyframe so it decodes on its own. */
+    if(hist_write + length + HIST_RECORD_OVERHEAD >
+       hist_sectors[hist_active].base + hist_sectors[hist_active].size) {
+        next = (hist_lend == HIST_LEND_GRANTED) ? hist_active : (hist_active ^ 1);
+        status = HIST_StartSector(next, hist_generation + 1);
+        if(status != HAL_OK) {
+            return status;
+        }
+        keyframe = 1;
+        length = HIST_Encode(packet, NULL, &record[1]);
+    }
+    
+    record[0] = (uint8_t)length;
+    crc = CRC16_Calculate(record, length + 1);
+    memcpy(&record[length + 1], &crc, sizeof(crc));
+    
+    status = HIST_Program(hist_write, record, length + HIST_RECORD_OVERHEAD);
+    
+    /* Publish only after programming - queries never see a partial record */
+    taskENTER_CRITICAL();
+    hist_write += length + HIST_RECORD_OVERHEAD;
+    taskEXIT_CRITICAL();
+    
+    if(status != HAL_OK) {
+        hist_since_key = HIST_KEYFRAME_INTERVAL;  /* Chain is broken */
+        return status;
+    }
+    
+    hist_prev = *packet;
+    hist_since_key = keyframe ? 1 : hist_since_key + 1;
+    return HAL_OK;
+}
+
+/* ==================== SECTOR LOAN ==================== */
+
+void HIST_LendSector(void) {
+    if(hist_lend == HIST_LEND_NONE) {
+        hist_lend = HIST_LEND_REQUESTED;
+    }
+}
+
+uint8_t HIST_SectorLent(void) {
+    return hist_lend == HIST_LEND_GRANTED;
+}
+
+/* The slot's contents are not valid history, so B is only used again
+ * once A fills and B is erased for it */
+void HIST_ReturnSector(void) {
+    hist_lend = HIST_LEND_NONE;
+}
+
+/* Start a walk over everything logged with first_seq <= sequence_number
+ * <= last_seq (modulo 2^16), oldest first. The end of the log is fixed
+ * here; records appended later are not returned. */
+void HIST_IterBegin(HIST_Iter_t* it, uint16_t first_seq, uint16_t last_seq) {
+    uint8_t active;
+    uint32_t write;
+    
+    it->first_seq = first_seq;
+    it->span = last_seq - first_seq;
+    it->chained = 0;
+    
+    if(!hist_ready) {
+        it->phase = 2;
+        return;
+    }
+    
+    taskENTER_CRITICAL();
+    active = hist_active;
+    write = hist_write;
+    taskEXIT_CRITICAL();
+    
+    it->active_end = write;
+    it->active_generation = HIST_Header(active)->generation;
+    it->sector = active ^ 1;
+    it->generation = HIST_Header(it->sector)->generation;
+    it->phase = 0;
+    
+    if(HIST_SectorValid(it->sector) && it->generation < it->active_generation) {
+        it->addr = hist_sectors[it->sector].base + sizeof(HIST_SectorHeader_t);
+        it->end = hist_sectors[it->sector].base + hist_sectors[it->sector].size;
+    } else {
+        it->addr = 0;
+        it->end = 0;  /* No older sector - straight to the active one */
+    }
+}
+
+/* Next packet in range, 0 when the walk is done. Callers own the
+ * iterator, so several walks can run at once. */
+uint8_t HIST_IterNext(HIST_Iter_t* it, TelemetryPacket_t* packet) {
+    const uint8_t* record;
+    uint16_t crc;
+    uint8_t length;
+    
+    while(it->phase < 2) {
+        if(it->addr >= it->end) {
+            /* Older sector done, move on to the active one */
+            if(it->phase++ == 0) {
+                it->sector ^= 1;
+                it->addr = hist_sectors[it->sector].base + sizeof(HIST_SectorHeader_t);
+                it->end = it->active_end;
+                it->generation = it->active_generation;
+                it->chained = 0;
+            }
+            continue;
+        }
+        
+        /* Recycled (or lent to a firmware update) since the walk began */
+        if(!HIST_SectorValid(it->sector) ||
+           HIST_Header(it->sector)->generation != it->generation) {
+            it->end = it->addr;
+            continue;
+        }
+        
+        record = (const uint8_t*)(uintptr_t)it->addr;
+        length = record[0];
+        if(length == 0xFF || length > HIST_MAX_PAYLOAD ||
+           it->addr + length + HIST_RECORD_OVERHEAD > it->end) {
+            it->end = it->addr;  /* Erased (or recycled) from here on */
+            continue;
+        }
+        it->addr += length + HIST_RECORD_OVERHEAD;
+        
+        memcpy(&crc, &record[length + 1], sizeof(crc));
+        if(crc != CRC16_Calculate(record, length + 1) ||
+           HIST_Decode(&record[1], length, it->chained ? &it->prev : NULL,
+                       packet) != HAL_OK) {
+            it->chained = 0;  /* Skip to the next keyframe */
+            continue;
+        }
+        it->prev = *packet;
+        it->chained = 1;
+        
+        if((uint16_t)(packet->sequence_number - it->first_seq) <= it->span) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+/* i2c_bus.c - Asynchronous I2C Transaction Queue
+ *
+ * Transactions are queued FIFO and run back to back from the HAL
+ * completion interrupts, so a task can submit a whole sensor sweep and
+ * sleep until it is done. Timeouts are enforced by the waiting task: if
+ * the active transaction overruns, I2CBUS_Wait aborts it, resets the
+ * peripheral and moves on to the next one.
+ */
+#include "i2c_bus.h"
+#include "cmsis_os.h"
+
+static I2C_HandleTypeDef* bus = NULL;
+static I2CBUS_Transaction_t* queue[I2CBUS_QUEUE_SIZE];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_tail = 0;
+static I2CBUS_Transaction_t* volatile active = NULL;
+
+HAL_StatusTypeDef I2CBUS_Init(I2C_HandleTypeDef* hi2c) {
+    bus = hi2c;
+    queue_head = 0;
+    queue_tail = 0;
+    active = NULL;
+    return HAL_OK;
+}
+
+/* Report a transaction's result to its owner */
+static void I2CBUS_Finish(I2CBUS_Transaction_t* txn, HAL_StatusTypeDef status) {
+    txn->status = status;
+    if(txn->notify_thread != NULL) {
+        osThreadFlagsSet(txn->notify_thread, I2CBUS_FLAG_DONE);
+    }
+    if(txn->complete != NULL) {
+        txn->complete(txn);
+    }
+}
+
+/* Start the next queued transaction. Caller holds the queue. */
+static void I2CBUS_StartNext(void) {
+    I2CBUS_Transaction_t* txn;
+    HAL_StatusTypeDef status;
+    
+    while(active == NULL && queue_tail != queue_head) {
+        txn = queue[queue_tail];
+        queue_tail = (queue_tail + 1) % I2CBUS_QUEUE_SIZE;
+        
+        txn->start_tick = HAL_GetTick();
+        active = txn;
+        
+        if(!txn->is_read) {
+            status = HAL_I2C_Mem_Write_IT(bus, txn->dev_addr << 1, txn->reg,
+                                          I2C_MEMADD_SIZE_8BIT, txn->data, txn->length);
+        } else if(txn->length >= I2CBUS_DMA_THRESHOLD && bus->hdmarx != NULL) {
+            status = HAL_I2C_Mem_Read_DMA(bus, txn->dev_addr << 1, txn->reg,
+                                          I2C_MEMADD_SIZE_8BIT, txn->data, txn->length);
+        } else {
+            status = HAL_I2C_Mem_Read_IT(bus, txn->dev_addr << 1, txn->reg,
+                                         I2C_MEMADD_SIZE_8BIT, txn->data, txn->length);
+        }
+        
+        if(status != HAL_OK) {
+            /* Could not even start - fail it and try the next one */
+            active = NULL;
+            I2CBUS_Finish(txn, status);
+        }
+    }
+}
+
+/* Finish the active transaction and chain the next (ISR or locked) */
+static void I2CBUS_Complete(HAL_StatusTypeDef status) {
+    I2CBUS_Transaction_t* txn = active;
+    
+    if(txn == NULL) {
+        return;
+    }
+    
+    active = NULL;
+    I2CBUS_Finish(txn, status);
+    
+    I2CBUS_StartNext();
+}
+
+/* Append to the queue and start the bus if idle. Caller holds the queue. */
+static HAL_StatusTypeDef I2CBUS_Enqueue(I2CBUS_Transaction_t* txn) {
+    uint8_t next = (queue_head + 1) % I2CBUS_QUEUE_SIZE;
+    
+    if(next == queue_tail) {
+        txn->status = HAL_ERROR;
+        return HAL_BUSY;
+    }
+    
+    txn->status = HAL_BUSY;
+    queue[queue_head] = txn;
+    queue_head = next;
+    I2CBUS_StartNext();
+    
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef I2CBUS_Submit(I2CBUS_Transaction_t* txn) {
+    HAL_StatusTypeDef status;
+    
+    if(bus == NULL) {
+        return HAL_ERROR;
+    }
+    
+    txn->notify_thread = osThreadGetId();
+    
+    taskENTER_CRITICAL();
+    status = I2CBUS_Enqueue(txn);
+    taskEXIT_CRITICAL();
+    
+    return status;
+}
+
+/* Interrupt-safe submit. Nobody waits on these, so they should carry
+ * a complete callback. */
+HAL_StatusTypeDef I2CBUS_SubmitFromISR(I2CBUS_Transaction_t* txn) {
+    HAL_StatusTypeDef status;
+    UBaseType_t saved;
+    
+    if(bus == NULL) {
+        return HAL_ERROR;
+    }
+    
+    txn->notify_thread = NULL;
+    
+    saved = taskENTER_CRITICAL_FROM_ISR();
+    status = I2CBUS_Enqueue(txn);
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+    
+    return status;
+}
+
+HAL_StatusTypeDef I2CBUS_Wait(I2CBUS_Transaction_t* txn) {
+    uint32_t elapsed;
+    uint32_t remaining;
+    I2CBUS_Transaction_t* current;
+    
+    while(txn->status == HAL_BUSY) {
+        /* Sleep until the transaction at the head of the bus is due */
+        taskENTER_CRITICAL();
+        current = active;
+        remaining = 1;
+        if(current != NULL) {
+            elapsed = HAL_GetTick() - current->start_tick;
+            remaining = (elapsed < current->timeout_ms) ? (current->timeout_ms - elapsed) : 0;
+        }
+        taskEXIT_CRITICAL();
+        
+        if(remaining > 0) {
+            osThreadFlagsWait(I2CBUS_FLAG_DONE, osFlagsWaitAny, remaining);
+            continue;
+        }
+        
+        /* Head transaction overran: a slave is holding the bus. Reset the
+         * peripheral and carry on with the rest of the queue. */
+        taskENTER_CRITICAL();
+        if(active == current) {
+            HAL_I2C_DeInit(bus);
+            HAL_I2C_Init(bus);
+            I2CBUS_Complete(HAL_TIMEOUT);
+        }
+        taskEXIT_CRITICAL();
+    }
+    
+    return txn->status;
+}
+
+/* ==================== HAL CALLBACKS ==================== */
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if(hi2c == bus) {
+        I2CBUS_Complete(HAL_OK);
+    }
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if(hi2c == bus) {
+        I2CBUS_Complete(HAL_OK);
+    }
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    if(hi2c == bus) {
+        /* NACK, arbitration loss or bus error */
+        I2CBUS_Complete(HAL_ERROR);
+    }
+}
@@ -0,0 +1,202 @@
+/* mag_stream.c - LIS3MDL Data-Ready Streaming and Decimation
+ *
+ * Every data-ready edge queues a 6-byte read on the I2C bus from the
+ * EXTI handler; the completion callback pushes the raw sample into a
+ * single-producer/single-consumer ring. SensorTask drains the ring and
+ * runs a CIC decimator plus per-window min/max/variance, so telemetry
+ * sees a low-noise average of every sample rather than one in 155.
+ */
+#include "mag_stream.h"
+#include "sensors.h"
+#include "i2c_bus.h"
+#include "spsc_ring.h"
+
+/* Produced by the I2C completion ISR, consumed by SensorTask */
+SPSC_RING(mag_ring, MAG_Sample_t, MAG_RING_SIZE);
+static volatile uint16_t mag_dropped = 0;          /* This window */
+static volatile uint32_t mag_dropped_total = 0;    /* Since the last diagnostics reset */
+
+static uint8_t mag_raw[6];
+static I2CBUS_Transaction_t mag_txn;
+
+/* CIC state. Unsigned so integrator wrap-around is well defined; the
+ * comb stages undo it as long as the register is wider than
+ * 16 + ORDER * log2(DECIMATION) bits. */
+static uint64_t cic_integrator[3][MAG_CIC_ORDER];
+static uint64_t cic_comb[3][MAG_CIC_ORDER];
+static uint16_t cic_count = 0;
+static uint8_t  cic_warmup = MAG_CIC_ORDER - 1;
+
+/* Window statistics on raw counts */
+static int16_t  win_min[3];
+static int16_t  win_max[3];
+static int64_t  win_sum[3];
+static int64_t  win_sumsq[3];
+
+static void MAG_ReadComplete(I2CBUS_Transaction_t* txn);
+
+/* EXTI and I2C completion context, which share a priority */
+static void MAG_Drop(void) {
+    mag_dropped++;
+    mag_dropped_total++;
+}
+
+HAL_StatusTypeDef MAG_StreamStart(void) {
+    SPSC_RESET(mag_ring);
+    mag_dropped = 0;
+    memset(cic_integrator, 0, sizeof(cic_integrator));
+    memset(cic_comb, 0, sizeof(cic_comb));
+    cic_count = 0;
+    cic_warmup = MAG_CIC_ORDER - 1;
+    
+    mag_txn.dev_addr = LIS3MDL_ADDR;
+    mag_txn.reg = LIS3MDL_OUT_X_L_AI;
+    mag_txn.is_read = 1;
+    mag_txn.data = mag_raw;
+    mag_txn.length = sizeof(mag_raw);
+    mag_txn.timeout_ms = I2C_SENSOR_TIMEOUT_MS;
+    mag_txn.complete = MAG_ReadComplete;
+    mag_txn.status = HAL_OK;
+    
+    MAG_StreamKick();
+    return HAL_OK;
+}
+
+/* DRDY is level-high until the data is read; if it is already set no
+ * edge will come, so fetch the pending sample now. Also used after the
+ * data-ready interrupt was masked (STOP mode). */
+void MAG_StreamKick(void) {
+    if(HAL_GPIO_ReadPin(MAG_DRDY_PORT, MAG_DRDY_PIN) == GPIO_PIN_SET) {
+        MAG_DataReadyCallback();
+    }
+}
+
+/* EXTI context */
+void MAG_DataReadyCallback(void) {
+    if(mag_txn.status == HAL_BUSY) {
+        return;  /* Read in flight, its completion checks DRDY again */
+    }
+    
+    if(I2CBUS_SubmitFromISR(&mag_txn) != HAL_OK) {
+        MAG_Drop();
+    }
+}
+
+/* I2C completion context */
+static void MAG_ReadComplete(I2CBUS_Transaction_t* txn) {
+    MAG_Sample_t* sample;
+    
+    if(txn->status == HAL_OK) {
+        sample = SPSC_CLAIM(mag_ring);
+        if(sample == NULL) {
+            MAG_Drop();
+        } else {
+            sample->x = (int16_t)(mag_raw[1] << 8 | mag_raw[0]);
+            sample->y = (int16_t)(mag_raw[3] << 8 | mag_raw[2]);
+            sample->z = (int16_t)(mag_raw[5] << 8 | mag_raw[4]);
+            SPSC_COMMIT(mag_ring);
+        }
+    } else {
+        MAG_Drop();
+    }
+    
+    /* A sample that landed during the read left DRDY high with no edge */
+    if(HAL_GPIO_ReadPin(MAG_DRDY_PORT, MAG_DRDY_PIN) == GPIO_PIN_SET) {
+        I2CBUS_SubmitFromISR(txn);
+    }
+}
+
+static void MAG_WindowReset(void) {
+    for(uint8_t axis = 0; axis < 3; axis++) {
+        win_min[axis] = INT16_MAX;
+        win_max[axis] = INT16_MIN;
+        win_sum[axis] = 0;
+        win_sumsq[axis] = 0;
+    }
+}
+
+/* Drain the ring through the decimator. Returns 1 and fills stats when
+ * a decimation window completed (the latest one if several did). */
+uint8_t MAG_StreamProcess(MAG_Stats_t* stats) {
+    uint8_t ready = 0;
+    const MAG_Sample_t* s;
+    int16_t value[3];
+    uint64_t in, prev;
+    int64_t n = MAG_CIC_DECIMATION;
+    float scale = LIS3MDL_GAUSS_PER_LSB;
+    
+    /* CIC DC gain is DECIMATION^ORDER */
+    for(uint8_t i = 0; i < MAG_CIC_ORDER; i++) {
+        scale /= (float)MAG_CIC_DECIMATION;
+    }
+    
+    while((s = SPSC_FRONT(mag_ring)) != NULL) {
+        value[0] = s->x;
+        value[1] = s->y;
+        value[2] = s->z;
+        SPSC_RELEASE(mag_ring);
+        
+        if(cic_count == 0) {
+            MAG_WindowReset();
+        }
+        
+        for(uint8_t axis = 0; axis < 3; axis++) {
+            /* Integrators run at the input rate */
+            cic_integrator[axis][0] += (uint64_t)(int64_t)value[axis];
+            for(uint8_t i = 1; i < MAG_CIC_ORDER; i++) {
+                cic_integrator[axis][i] += cic_integrator[axis][i - 1];
+            }
+            
+            if(value[axis] < win_min[axis]) win_min[axis] = value[axis];
+            if(value[axis] > win_max[axis]) win_max[axis] = value[axis];
+            win_sum[axis] += value[axis];
+            win_sumsq[axis] += (int32_t)value[axis] * value[axis];
+        }
+        
+        if(++cic_count < MAG_CIC_DECIMATION) {
+            continue;
+        }
+        cic_count = 0;
+        
+        /* Combs run at the output rate */
+        for(uint8_t axis = 0; axis < 3; axis++) {
+            in = cic_integrator[axis][MAG_CIC_ORDER - 1];
+            for(uint8_t i = 0; i < MAG_CIC_ORDER; i++) {
+                prev = cic_comb[axis][i];
+                cic_comb[axis][i] = in;
+                in = in - prev;
+            }
+            
+            if(!cic_warmup) {
+                stats->mean[axis] = (float)(int64_t)in * scale;
+                stats->min[axis] = win_min[axis] * LIS3MDL_GAUSS_PER_LSB;
+                stats->max[axis] = win_max[axis] * LIS3MDL_GAUSS_PER_LSB;
+                stats->variance[axis] = (float)(n * win_sumsq[axis] - win_sum[axis] * win_sum[axis]) /
+                                        (float)(n * n) * LIS3MDL_GAUSS_PER_LSB * LIS3MDL_GAUSS_PER_LSB;
+            }
+        }
+        
+        /* The first ORDER - 1 outputs are the filter filling up */
+        if(cic_warmup) {
+            cic_warmup--;
+        } else {
+            stats->samples = MAG_CIC_DECIMATION;
+            stats->dropped = mag_dropped;
+            mag_dropped = 0;
+            ready = 1;
+        }
+    }
+    
+    return ready;
+}
+
+/* Samples lost since start or the last reset, for GET_DIAGNOSTICS.
+ * Caller holds off the I2C and EXTI interrupts. */
+uint32_t MAG_DroppedTotal(uint8_t reset) {
+    uint32_t total = mag_dropped_total;
+    
+    if(reset) {
+        mag_dropped_total = 0;
+    }
+    return total;
+}
@@ -3,7 +3,21 @@
 #include "sensors.h"
 #include "communication.h"
 #include "system.h"
+#include "crc.h"
+#include "i2c_bus.h"
+#include "mag_stream.h"
+#include "telemetry.h"
+#include "clock.h"
+#include "radiation.h"
+#include "history.h"
+#include "dump.h"
+#include "diag.h"
+#include "mcp3008.h"
+#include "battery.h"
+#include "fwupdate.h"
+#include "scheduler.h"
 #include "cmsis_os.h"
+#include <math.h>
 
 /* Global Variables */
 UART_HandleTypeDef huart1;  /* Communication with Pi */
@@ -12,48 +26,65 @@ I2C_HandleTypeDef hi2c1;    /* I2C for sensors */
 SPI_HandleTypeDef hspi1;    /* SPI for ADC */
 ADC_HandleTypeDef hadc1;    /* ADC for battery */
 IWDG_HandleTypeDef hiwdg;    /* Independent Watchdog */
+TIM_HandleTypeDef htim2;     /* Geiger pulse counter (ETR) */
+TIM_HandleTypeDef htim3;     /* 100 ms radiation gate */
+CRC_HandleTypeDef hcrc;      /* CRC-32 unit for chunk integrity */
+RTC_HandleTypeDef hrtc;      /* STOP-mode wakeup and sleep timing */
+DMA_HandleTypeDef hdma_i2c1_rx;    /* I2C1 RX for magnetometer and BME280 reads */
+DMA_HandleTypeDef hdma_usart1_rx;  /* USART1 RX circular DMA */
+DMA_HandleTypeDef hdma_usart1_tx;  /* USART1 TX queue DMA */
+DMA_HandleTypeDef hdma_usart2_tx;  /* USART2 TX queue DMA */
+DMA_HandleTypeDef hdma_spi1_rx;    /* SPI1 RX, MCP3008 scan results */
+DMA_HandleTypeDef hdma_spi1_tx;    /* SPI1 TX, MCP3008 scan commands */
+DMA_HandleTypeDef hdma_adc1;       /* ADC1 circular battery samples */
+
+/* Vector table, startup_stm32f401xc.s; placed first in FLASH */
+extern const uint32_t g_pfnVectors[];
 
 /* FreeRTOS Handles */
 osThreadId_t sensorTaskHandle;
 osThreadId_t radiationTaskHandle;
 osThreadId_t commTaskHandle;
+osThreadId_t downlinkTaskHandle;
 osThreadId_t watchdogTaskHandle;
-osMessageQueueId_t telemetryQueueHandle;
-osMessageQueueId_t commandQueueHandle;
 osTimerId_t beaconTimerHandle;
 
+/* Static task and timer memory - nothing is taken from the heap, so
+ * fragmentation cannot fail a create mid-mission. The diagnostics
+ * report identifies tasks by name. */
+#define TASK_ATTRIBUTES(task, stack_words, prio)                             \
+    static StaticTask_t task##_cb;                                           \
+    static StackType_t task##_stack[stack_words];                            \
+    static const osThreadAttr_t task##_attributes = {                        \
+        .name = #task, .cb_mem = &task##_cb, .cb_size = sizeof(task##_cb),   \
+        .stack_mem = task##_stack, .stack_size = sizeof(task##_stack),       \
+        .priority = prio }
+
+TASK_ATTRIBUTES(SensorTask, SENSOR_TASK_STACK_WORDS, SENSOR_TASK_PRIORITY);
+TASK_ATTRIBUTES(RadiationTask, RADIATION_TASK_STACK_WORDS, RADIATION_TASK_PRIORITY);
+TASK_ATTRIBUTES(CommTask, COMM_TASK_STACK_WORDS, COMM_TASK_PRIORITY);
+TASK_ATTRIBUTES(DownlinkTask, DOWNLINK_TASK_STACK_WORDS, DOWNLINK_TASK_PRIORITY);
+TASK_ATTRIBUTES(WatchdogTask, WATCHDOG_TASK_STACK_WORDS, WATCHDOG_TASK_PRIORITY);
+
+static StaticTimer_t beaconTimer_cb;
+static const osTimerAttr_t beaconTimer_attributes = {
+    .name = "Beacon", .cb_mem = &beaconTimer_cb, .cb_size = sizeof(beaconTimer_cb) };
+
 /* System State */
 uint8_t system_state = STATE_BOOT;
 uint32_t boot_count = 0;
 uint32_t system_uptime = 0;
-TelemetryPacket_t current_telemetry;
-volatile uint32_t radiation_pulse_count = 0;
+MAG_Stats_t mag_stats;       /* Last magnetometer decimation window */
+MCP3008_Scan_t adc_scan;     /* Last MCP3008 scan, all channels */
+static uint32_t beacon_interval_ms = COMM_BEACON_INTERVAL_MS;  /* As set */
+static uint32_t beacon_period_ms = COMM_BEACON_INTERVAL_MS;    /* Timer now */
 
 /* ==================== SYSTEM INITIALIZATION ==================== */
 
+/* Bring up the active clock profile - at boot that is full speed, after
+ * STOP it restores whatever profile the state machine had selected */
 void SystemClock_Config(void) {
-    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-    RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
-    /* Configure HSE oscillator */
-    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
-    RCC_OscInitStruct.HSEState = RCC_HSE_ON;
-    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
-    RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
-    RCC_OscInitStruct.PLL.PLLM = 8;
-    RCC_OscInitStruct.PLL.PLLN = 336;
-    RCC_OscInitStruct.PLL.PLLP = RCC_PLLP_DIV2;
-    RCC_OscInitStruct.PLL.PLLQ = 7;
-    HAL_RCC_OscConfig(&RCC_OscInitStruct);
-
-    /* Configure system clocks */
-    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK |
-                                   RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
-    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
-    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV2;
-    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-    HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_2);
+    CLOCK_Configure(CLOCK_GetProfile());
 }
 
 void MX_GPIO_Init(void) {
@@ -71,10 +102,12 @@ void MX_GPIO_Init(void) {
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
     HAL_GPIO_Init(LED_PORT, &GPIO_InitStruct);
 
-    /* Configure radiation input pin with interrupt */
+    /* Radiation input clocks TIM2 through ETR - no per-pulse interrupt */
     GPIO_InitStruct.Pin = RADIATION_PIN;
-    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
     GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = GPIO_AF1_TIM2;
     HAL_GPIO_Init(RADIATION_PORT, &GPIO_InitStruct);
 
     /* Configure Pi wake pin */
@@ -83,15 +116,70 @@ void MX_GPIO_Init(void) {
     GPIO_InitStruct.Pull = GPIO_NOPULL;
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
     HAL_GPIO_Init(PI_WAKE_PORT, &GPIO_InitStruct);
+    
+    /* Battery divider */
+    GPIO_InitStruct.Pin = ADC_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(ADC_PORT, &GPIO_InitStruct);
+    
+    /* MCP3008 chip select, idle high */
+    HAL_GPIO_WritePin(MCP3008_CS_PORT, MCP3008_CS_PIN, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin = MCP3008_CS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(MCP3008_CS_PORT, &GPIO_InitStruct);
 
-    /* Set interrupt priorities */
-    HAL_NVIC_SetPriority(EXTI0_IRQn, 5, 0);
-    HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+    /* EXTI0 only counts radiation pulses during STOP and is enabled
+     * around it by the radiation module */
+    HAL_NVIC_SetPriority(EXTI0_IRQn, IRQ_PRIO_WAKEUP, 0);
+
+    /* Configure magnetometer data-ready input */
+    GPIO_InitStruct.Pin = MAG_DRDY_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(MAG_DRDY_PORT, &GPIO_InitStruct);
+
+    HAL_NVIC_SetPriority(EXTI1_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+}
+
+void MX_DMA_Init(void) {
+    /* Enable DMA controller clocks */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    /* DMA2_Stream2 = USART1_RX */
+    HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, IRQ_PRIO_COMM, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+
+    /* DMA2_Stream7 = USART1_TX */
+    HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, IRQ_PRIO_COMM, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+
+    /* DMA2_Stream0 = SPI1_RX, DMA2_Stream3 = SPI1_TX */
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+    HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
+    
+    /* DMA2_Stream4 = ADC1 */
+    HAL_NVIC_SetPriority(DMA2_Stream4_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream4_IRQn);
+    
+    /* DMA1_Stream0 = I2C1_RX */
+    HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+
+    /* DMA1_Stream6 = USART2_TX */
+    HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, IRQ_PRIO_COMM, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
 }
 
 void MX_I2C1_Init(void) {
     hi2c1.Instance = I2C1;
-    hi2c1.Init.ClockSpeed = 100000;
+    hi2c1.Init.ClockSpeed = I2C1_CLOCK_SPEED;
     hi2c1.Init.DutyCycle = I2C_DUTYCYCLE_2;
     hi2c1.Init.OwnAddress1 = 0;
     hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
@@ -100,6 +188,27 @@ void MX_I2C1_Init(void) {
     hi2c1.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
     hi2c1.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
     HAL_I2C_Init(&hi2c1);
+
+    hdma_i2c1_rx.Instance = DMA1_Stream0;
+    hdma_i2c1_rx.Init.Channel = DMA_CHANNEL_1;
+    hdma_i2c1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_i2c1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_i2c1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_i2c1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_i2c1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_i2c1_rx.Init.Mode = DMA_NORMAL;
+    hdma_i2c1_rx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_i2c1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_i2c1_rx);
+    __HAL_LINKDMA(&hi2c1, hdmarx, hdma_i2c1_rx);
+
+    /* Event/error IRQs drive the transaction queue */
+    HAL_NVIC_SetPriority(I2C1_EV_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_SetPriority(I2C1_ER_IRQn, IRQ_PRIO_SENSOR, 0);
+    HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+
+    I2CBUS_Init(&hi2c1);
 }
 
 void MX_SPI1_Init(void) {
@@ -110,12 +219,42 @@ void MX_SPI1_Init(void) {
     hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
     hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
     hspi1.Init.NSS = SPI_NSS_SOFT;
-    hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_16;
+    hspi1.Init.BaudRatePrescaler = CLOCK_SpiPrescaler(CLOCK_SPI1_MAX_HZ);
     hspi1.Init.FirstBit = SPI_FIRSTBIT_MSB;
     hspi1.Init.TIMode = SPI_TIMODE_DISABLE;
     hspi1.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
     hspi1.Init.CRCPolynomial = 10;
     HAL_SPI_Init(&hspi1);
+    
+    /* Full-duplex DMA for the ADC scan; RX outranks TX so a received
+     * byte is always collected before the next one lands */
+    hdma_spi1_rx.Instance = DMA2_Stream0;
+    hdma_spi1_rx.Init.Channel = DMA_CHANNEL_3;
+    hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_spi1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_spi1_rx);
+    __HAL_LINKDMA(&hspi1, hdmarx, hdma_spi1_rx);
+    
+    hdma_spi1_tx.Instance = DMA2_Stream3;
+    hdma_spi1_tx.Init.Channel = DMA_CHANNEL_3;
+    hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_spi1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_spi1_tx);
+    __HAL_LINKDMA(&hspi1, hdmatx, hdma_spi1_tx);
+    
+    MCP3008_Init(&hspi1);
 }
 
 void MX_USART1_UART_Init(void) {
@@ -128,11 +267,43 @@ void MX_USART1_UART_Init(void) {
     huart1.Init.HwFlowCtl = UART_HWCONTROL_NONE;
     huart1.Init.OverSampling = UART_OVERSAMPLING_16;
     HAL_UART_Init(&huart1);
+
+    /* RX DMA: circular so reception never has to be re-armed */
+    hdma_usart1_rx.Instance = DMA2_Stream2;
+    hdma_usart1_rx.Init.Channel = DMA_CHANNEL_4;
+    hdma_usart1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_usart1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_usart1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_usart1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_usart1_rx);
+    __HAL_LINKDMA(&huart1, hdmarx, hdma_usart1_rx);
+
+    /* TX DMA: one-shot per span, chained from TxCpltCallback */
+    hdma_usart1_tx.Instance = DMA2_Stream7;
+    hdma_usart1_tx.Init.Channel = DMA_CHANNEL_4;
+    hdma_usart1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_usart1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_usart1_tx);
+    __HAL_LINKDMA(&huart1, hdmatx, hdma_usart1_tx);
+
+    /* USART1 IRQ delivers the idle-line event */
+    HAL_NVIC_SetPriority(USART1_IRQn, IRQ_PRIO_COMM, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
 }
 
 void MX_USART2_UART_Init(void) {
     huart2.Instance = USART2;
-    huart2.Init.BaudRate = 115200;
+    huart2.Init.BaudRate = 9600;  /* Radio modem line rate */
     huart2.Init.WordLength = UART_WORDLENGTH_8B;
     huart2.Init.StopBits = UART_STOPBITS_1;
     huart2.Init.Parity = UART_PARITY_NONE;
@@ -140,28 +311,66 @@ void MX_USART2_UART_Init(void) {
     huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
     huart2.Init.OverSampling = UART_OVERSAMPLING_16;
     HAL_UART_Init(&huart2);
+
+    hdma_usart2_tx.Instance = DMA1_Stream6;
+    hdma_usart2_tx.Init.Channel = DMA_CHANNEL_4;
+    hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart2_tx.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_usart2_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_usart2_tx);
+    __HAL_LINKDMA(&huart2, hdmatx, hdma_usart2_tx);
+
+    /* USART2 IRQ delivers the TX complete event */
+    HAL_NVIC_SetPriority(USART2_IRQn, IRQ_PRIO_COMM, 0);
+    HAL_NVIC_EnableIRQ(USART2_IRQn);
 }
 
 void MX_ADC1_Init(void) {
     ADC_ChannelConfTypeDef sConfig = {0};
-
+    
+    /* Battery sequence on every TIM3 update, results by circular DMA */
     hadc1.Instance = ADC1;
     hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
     hadc1.Init.Resolution = ADC_RESOLUTION_12B;
-    hadc1.Init.ScanConvMode = DISABLE;
-    hadc1.Init.ContinuousConvMode = ENABLE;
+    hadc1.Init.ScanConvMode = ENABLE;
+    hadc1.Init.ContinuousConvMode = DISABLE;
     hadc1.Init.DiscontinuousConvMode = DISABLE;
-    hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+    hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T3_TRGO;
+    hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
     hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
-    hadc1.Init.NbrOfConversion = 1;
-    hadc1.Init.DMAContinuousRequests = DISABLE;
-    hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+    hadc1.Init.NbrOfConversion = BATT_SEQ_LENGTH;
+    hadc1.Init.DMAContinuousRequests = ENABLE;
+    hadc1.Init.EOCSelection = ADC_EOC_SEQ_CONV;
     HAL_ADC_Init(&hadc1);
-
-    sConfig.Channel = ADC_CHANNEL_0;
-    sConfig.Rank = 1;
-    sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
-    HAL_ADC_ConfigChannel(&hadc1, &sConfig);
+    
+    /* PB0 = IN8. The long sample time covers the divider's source
+     * impedance and the 10 us VREFINT needs. */
+    sConfig.SamplingTime = ADC_SAMPLETIME_480CYCLES;
+    for(uint8_t rank = 1; rank <= BATT_SEQ_LENGTH; rank++) {
+        sConfig.Channel = (rank <= BATT_VBAT_RANKS) ? ADC_CHANNEL_8 : ADC_CHANNEL_VREFINT;
+        sConfig.Rank = rank;
+        HAL_ADC_ConfigChannel(&hadc1, &sConfig);
+    }
+    
+    hdma_adc1.Instance = DMA2_Stream4;
+    hdma_adc1.Init.Channel = DMA_CHANNEL_0;
+    hdma_adc1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_adc1.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_adc1.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_adc1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_adc1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma_adc1.Init.Mode = DMA_CIRCULAR;
+    hdma_adc1.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_adc1.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(&hdma_adc1);
+    __HAL_LINKDMA(&hadc1, DMA_Handle, hdma_adc1);
+    
+    BATT_Init(&hadc1);
 }
 
 void MX_IWDG_Init(void) {
@@ -171,25 +380,179 @@ void MX_IWDG_Init(void) {
     HAL_IWDG_Init(&hiwdg);
 }
 
+void MX_RTC_Init(void) {
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+
+    /* RTC runs from LSI (already on for the IWDG) so it keeps counting
+     * in STOP */
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_LSI;
+    RCC_OscInitStruct.LSIState = RCC_LSI_ON;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+    HAL_RCC_OscConfig(&RCC_OscInitStruct);
+
+    PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_RTC;
+    PeriphClkInit.RTCClockSelection = RCC_RTCCLKSOURCE_LSI;
+    HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
+    __HAL_RCC_RTC_ENABLE();
+
+    hrtc.Instance = RTC;
+    hrtc.Init.HourFormat = RTC_HOURFORMAT_24;
+    hrtc.Init.AsynchPrediv = POWER_RTC_ASYNC_PREDIV;
+    hrtc.Init.SynchPrediv = POWER_RTC_SYNC_PREDIV;
+    hrtc.Init.OutPut = RTC_OUTPUT_DISABLE;
+    hrtc.Init.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH;
+    hrtc.Init.OutPutType = RTC_OUTPUT_TYPE_OPENDRAIN;
+    HAL_RTC_Init(&hrtc);
+
+    HAL_NVIC_SetPriority(RTC_WKUP_IRQn, IRQ_PRIO_WAKEUP, 0);
+    HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+}
+
+/* Pulse counter: TIM2 clocked by the tube on ETR, free-running 32-bit */
+void MX_TIM2_Init(void) {
+    TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    htim2.Instance = TIM2;
+    htim2.Init.Prescaler = 0;
+    htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim2.Init.Period = 0xFFFFFFFF;
+    htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    HAL_TIM_Base_Init(&htim2);
+
+    sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_ETRMODE2;
+    sClockSourceConfig.ClockPolarity = TIM_CLOCKPOLARITY_NONINVERTED;
+    sClockSourceConfig.ClockPrescaler = TIM_CLOCKPRESCALER_DIV1;
+    sClockSourceConfig.ClockFilter = RAD_ETR_FILTER;
+    HAL_TIM_ConfigClockSource(&htim2, &sClockSourceConfig);
+}
+
+/* Gate: TIM3 at RAD_GATE_TICK_HZ, one update per RAD_BIN_MS */
+void MX_TIM3_Init(void) {
+    TIM_MasterConfigTypeDef sMasterConfig = {0};
+    
+    __HAL_RCC_TIM3_CLK_ENABLE();
+
+    htim3.Instance = TIM3;
+    htim3.Init.Prescaler = RAD_GatePrescaler();
+    htim3.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim3.Init.Period = (RAD_GATE_TICK_HZ / 1000) * RAD_BIN_MS - 1;
+    htim3.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim3.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    HAL_TIM_Base_Init(&htim3);
+    
+    /* Each gate update also triggers the ADC1 battery sequence */
+    sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
+    sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+    HAL_TIMEx_MasterConfigSynchronization(&htim3, &sMasterConfig);
+
+    HAL_NVIC_SetPriority(TIM3_IRQn, IRQ_PRIO_RAD_GATE, 0);
+    HAL_NVIC_EnableIRQ(TIM3_IRQn);
+}
+
 /* ==================== INTERRUPT HANDLERS ==================== */
 
-void EXTI0_IRQHandler(void) {
-    HAL_GPIO_EXTI_IRQHandler(RADIATION_PIN);
+/* Each handler is timed into its diagnostics probe slot */
+
+void RTC_WKUP_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_RTCEx_WakeUpTimerIRQHandler(&hrtc);
+    DIAG_PROBE_END(DIAG_ISR_RTC);
 }
 
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
-    if(GPIO_Pin == RADIATION_PIN) {
-        radiation_pulse_count++;
+void EXTI1_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_GPIO_EXTI_IRQHandler(MAG_DRDY_PIN);
+    DIAG_PROBE_END(DIAG_ISR_MAG_DRDY);
+}
+
+void USART1_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_UART_IRQHandler(&huart1);
+    DIAG_PROBE_END(DIAG_ISR_USART1);
+}
+
+void USART2_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_UART_IRQHandler(&huart2);
+    DIAG_PROBE_END(DIAG_ISR_USART2);
+}
+
+void TIM3_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_TIM_IRQHandler(&htim3);
+    DIAG_PROBE_END(DIAG_ISR_RAD_GATE);
+}
+
+void I2C1_EV_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_I2C_EV_IRQHandler(&hi2c1);
+    DIAG_PROBE_END(DIAG_ISR_I2C);
+}
+
+void I2C1_ER_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_I2C_ER_IRQHandler(&hi2c1);
+    DIAG_PROBE_END(DIAG_ISR_I2C);
+}
+
+void DMA1_Stream0_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_i2c1_rx);
+    DIAG_PROBE_END(DIAG_ISR_I2C);
+}
+
+void DMA2_Stream0_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_spi1_rx);
+    DIAG_PROBE_END(DIAG_ISR_SPI);
+}
+
+void DMA2_Stream3_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_spi1_tx);
+    DIAG_PROBE_END(DIAG_ISR_SPI);
+}
+
+void DMA2_Stream4_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_adc1);
+    DIAG_PROBE_END(DIAG_ISR_ADC);
+}
+
+void DMA2_Stream2_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_usart1_rx);
+    DIAG_PROBE_END(DIAG_ISR_USART1);
+}
+
+void DMA2_Stream7_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_usart1_tx);
+    DIAG_PROBE_END(DIAG_ISR_UART_DMA_TX);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+    DIAG_PROBE_BEGIN();
+    HAL_DMA_IRQHandler(&hdma_usart2_tx);
+    DIAG_PROBE_END(DIAG_ISR_UART_DMA_TX);
+}
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+    if(htim->Instance == TIM3) {
+        RAD_GateElapsed();
     }
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
-    static CommandPacket_t rx_cmd;
-    
-    if(huart->Instance == USART1) {
-        /* Command received from Pi */
-        osMessageQueuePut(commandQueueHandle, &rx_cmd, 0, 0);
-        HAL_UART_Receive_IT(&huart1, (uint8_t*)&rx_cmd, sizeof(CommandPacket_t));
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+    if(GPIO_Pin == MAG_DRDY_PIN) {
+        MAG_DataReadyCallback();
     }
 }
 
@@ -200,29 +563,36 @@ HAL_StatusTypeDef LIS3MDL_Init(void) {
     uint8_t config = 0;
     
     /* Configure control register 1 */
-    config = 0x70;  /* 155Hz, XY ultra-low-power mode */
-    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR, 0x20, I2C_MEMADD_SIZE_8BIT, 
+    config = 0x62;  /* 155Hz (FAST_ODR), XY ultra-high-performance mode */
+    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR << 1, 0x20, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
     /* Configure control register 2 */
     config = 0x00;  /* ±4 gauss */
-    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR, 0x21, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR << 1, 0x21, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
     /* Configure control register 3 */
     config = 0x00;  /* Continuous conversion mode */
-    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR, 0x22, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR << 1, 0x22, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
     /* Configure control register 4 */
     config = 0x08;  /* MSB at lower address */
-    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR, 0x23, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR << 1, 0x23, I2C_MEMADD_SIZE_8BIT, 
+                         &config, 1, HAL_MAX_DELAY) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    
+    /* Configure control register 5 */
+    config = 0x40;  /* Block data update - no torn samples while streaming */
+    if(HAL_I2C_Mem_Write(&hi2c1, LIS3MDL_ADDR << 1, 0x24, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
@@ -232,14 +602,20 @@ HAL_StatusTypeDef LIS3MDL_Init(void) {
 
 HAL_StatusTypeDef LIS3MDL_Read(float* mx, float* my, float* mz) {
     uint8_t data[6];
-    int16_t raw_x, raw_y, raw_z;
     
     /* Read magnetometer data */
-    if(HAL_I2C_Mem_Read(&hi2c1, LIS3MDL_ADDR, 0x28, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Read(&hi2c1, LIS3MDL_ADDR << 1, 0x28, I2C_MEMADD_SIZE_8BIT, 
                          data, 6, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
+    LIS3MDL_Convert(data, mx, my, mz);
+    return HAL_OK;
+}
+
+void LIS3MDL_Convert(const uint8_t* data, float* mx, float* my, float* mz) {
+    int16_t raw_x, raw_y, raw_z;
+    
     /* Convert to 16-bit values (little endian) */
     raw_x = (int16_t)(data[1] << 8 | data[0]);
     raw_y = (int16_t)(data[3] << 8 | data[2]);
@@ -249,8 +625,6 @@ HAL_StatusTypeDef LIS3MDL_Read(float* mx, float* my, float* mz) {
     *mx = raw_x * 0.00016f;
     *my = raw_y * 0.00016f;
     *mz = raw_z * 0.00016f;
-    
-    return HAL_OK;
 }
 
 /* BME280 Environmental Sensor */
@@ -259,72 +633,43 @@ HAL_StatusTypeDef BME280_Init(void) {
     
     /* Reset sensor */
     config = 0xB6;
-    if(HAL_I2C_Mem_Write(&hi2c1, BME280_ADDR, 0xE0, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Write(&hi2c1, BME280_ADDR << 1, 0xE0, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     HAL_Delay(10);
     
-    /* Configure humidity control */
-    config = 0x03;  /* Oversampling x2 */
-    if(HAL_I2C_Mem_Write(&hi2c1, BME280_ADDR, 0xF2, I2C_MEMADD_SIZE_8BIT, 
-                         &config, 1, HAL_MAX_DELAY) != HAL_OK) {
-        return HAL_ERROR;
-    }
-    
-    /* Configure measurement control */
-    config = 0x27;  /* Temp oversampling x2, Pressure oversampling x16, Normal mode */
-    if(HAL_I2C_Mem_Write(&hi2c1, BME280_ADDR, 0xF4, I2C_MEMADD_SIZE_8BIT, 
-                         &config, 1, HAL_MAX_DELAY) != HAL_OK) {
-        return HAL_ERROR;
-    }
-    
-    /* Configure config register */
-    config = 0xA0;  /* Standby 1000ms, filter off */
-    if(HAL_I2C_Mem_Write(&hi2c1, BME280_ADDR, 0xF5, I2C_MEMADD_SIZE_8BIT, 
-                         &config, 1, HAL_MAX_DELAY) != HAL_OK) {
-        return HAL_ERROR;
-    }
-    
+    /* Reset leaves the sensor in sleep mode. SensorTask loads the
+     * acquisition profile for system_state and triggers one forced
+     * conversion per sweep. */
     return HAL_OK;
 }
 
 HAL_StatusTypeDef BME280_Read(float* temp, float* press, float* hum) {
     uint8_t data[8];
-    int32_t raw_temp, raw_press, raw_hum;
     
     /* Read pressure (0xF7) */
-    if(HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR, 0xF7, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR << 1, 0xF7, I2C_MEMADD_SIZE_8BIT, 
                          data, 8, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
+    BME280_Convert(data, temp, press, hum);
+    return HAL_OK;
+}
+
+void BME280_Convert(const uint8_t* data, float* temp, float* press, float* hum) {
+    int32_t raw_temp, raw_press, raw_hum;
+    
     /* Extract 20-bit values */
     raw_press = (data[0] << 12) | (data[1] << 4) | (data[2] >> 4);
     raw_temp = (data[3] << 12) | (data[4] << 4) | (data[5] >> 4);
     raw_hum = (data[6] << 8) | data[7];
     
-    /* Compensate values */
+    /* Compensate values - temperature first, it updates t_fine */
     *temp = BME280_CompensateTemperature(raw_temp);
-    *press = BME280_CompensatePressure(raw_press) / 100.0f;
+    *press = BME280_CompensatePressure(raw_press) / 100.0f;  /* hPa */
     *hum = BME280_CompensateHumidity(raw_hum);
-    
-    return HAL_OK;
-}
-
-float BME280_CompensateTemperature(int32_t raw_temp) {
-    /* Simplified compensation - real code would use calibration data */
-    return raw_temp / 100.0f;
-}
-
-float BME280_CompensatePressure(int32_t raw_press) {
-    /* Simplified compensation */
-    return raw_press / 256.0f;
-}
-
-float BME280_CompensateHumidity(int32_t raw_hum) {
-    /* Simplified compensation */
-    return raw_hum / 1024.0f;
 }
 
 /* TMP117 Precision Temperature */
@@ -332,14 +677,14 @@ HAL_StatusTypeDef TMP117_Init(void) {
     uint8_t config = 0;
     
     /* Read device ID to verify connection */
-    if(HAL_I2C_Mem_Read(&hi2c1, TMP117_ADDR, 0x0F, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Read(&hi2c1, TMP117_ADDR << 1, 0x0F, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
     /* Configure for continuous conversion */
     config = 0x00;
-    if(HAL_I2C_Mem_Write(&hi2c1, TMP117_ADDR, 0x01, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Write(&hi2c1, TMP117_ADDR << 1, 0x01, I2C_MEMADD_SIZE_8BIT, 
                          &config, 1, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
@@ -349,125 +694,212 @@ HAL_StatusTypeDef TMP117_Init(void) {
 
 HAL_StatusTypeDef TMP117_Read(float* temp) {
     uint8_t data[2];
-    int16_t raw_temp;
     
-    if(HAL_I2C_Mem_Read(&hi2c1, TMP117_ADDR, 0x00, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Read(&hi2c1, TMP117_ADDR << 1, 0x00, I2C_MEMADD_SIZE_8BIT, 
                          data, 2, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
     
+    TMP117_Convert(data, temp);
+    return HAL_OK;
+}
+
+void TMP117_Convert(const uint8_t* data, float* temp) {
+    int16_t raw_temp;
+    
     raw_temp = (data[0] << 8) | data[1];
     *temp = raw_temp * 0.0078125f;  /* 7.8125 m°C per LSB */
-    
-    return HAL_OK;
 }
 
-/* MCP3008 ADC */
-uint16_t MCP3008_Read(uint8_t channel) {
-    uint8_t tx_data[3];
-    uint8_t rx_data[3];
+/* Sensor Sweep - queues all three I2C reads at once and sleeps until the
+ * bus has worked through them. A failed or timed-out sensor keeps its
+ * previous value. With MAG_STREAM_ENABLE the magnetometer is skipped,
+ * its samples arrive through the data-ready stream instead. */
+HAL_StatusTypeDef Sensors_ReadSweep(TelemetryPacket_t* tlm) {
+    static uint8_t mag_data[6];
+    static uint8_t bme_data[8];
+    static uint8_t tmp_data[2];
+    static I2CBUS_Transaction_t sweep[] = {
+        { .dev_addr = LIS3MDL_ADDR, .reg = LIS3MDL_OUT_X_L_AI, .is_read = 1, .data = mag_data,
+          .length = sizeof(mag_data), .timeout_ms = I2C_SENSOR_TIMEOUT_MS },
+        { .dev_addr = BME280_ADDR, .reg = 0xF7, .is_read = 1, .data = bme_data,
+          .length = sizeof(bme_data), .timeout_ms = I2C_SENSOR_TIMEOUT_MS },
+        { .dev_addr = TMP117_ADDR, .reg = 0x00, .is_read = 1, .data = tmp_data,
+          .length = sizeof(tmp_data), .timeout_ms = I2C_SENSOR_TIMEOUT_MS },
+    };
+    HAL_StatusTypeDef result = HAL_OK;
+    float x, y, z;
     
-    /* Ensure channel is valid */
-    channel &= 0x07;
+    for(uint8_t i = MAG_STREAM_ENABLE; i < sizeof(sweep) / sizeof(sweep[0]); i++) {
+        I2CBUS_Submit(&sweep[i]);
+    }
     
-    /* Build SPI command */
-    tx_data[0] = 0x01;  /* Start bit */
-    tx_data[1] = (0x80 | (channel << 4));  /* Single-ended + channel */
-    tx_data[2] = 0x00;
+#if !MAG_STREAM_ENABLE
+    if(I2CBUS_Wait(&sweep[0]) == HAL_OK) {
+        LIS3MDL_Convert(mag_data, &x, &y, &z);
+        tlm->mag_x = x;
+        tlm->mag_y = y;
+        tlm->mag_z = z;
+    } else {
+        result = HAL_ERROR;
+    }
+#endif
     
-    /* CS low */
-    HAL_GPIO_WritePin(SPI1_CS_GPIO_Port, SPI1_CS_Pin, GPIO_PIN_RESET);
+    if(I2CBUS_Wait(&sweep[1]) == HAL_OK) {
+        BME280_Convert(bme_data, &x, &y, &z);
+        tlm->temperature_bme = x;
+        tlm->pressure = y;
+        tlm->humidity = z;
+    } else {
+        result = HAL_ERROR;
+    }
     
-    /* SPI transaction */
-    HAL_SPI_TransmitReceive(&hspi1, tx_data, rx_data, 3, HAL_MAX_DELAY);
+    if(I2CBUS_Wait(&sweep[2]) == HAL_OK) {
+        TMP117_Convert(tmp_data, &x);
+        tlm->temperature_tmp = x;
+    } else {
+        result = HAL_ERROR;
+    }
     
-    /* CS high */
-    HAL_GPIO_WritePin(SPI1_CS_GPIO_Port, SPI1_CS_Pin, GPIO_PIN_SET);
+    if(result != HAL_OK) {
+        LogError(ERROR_I2C);
+    }
     
-    /* Extract 10-bit result */
-    return ((rx_data[1] & 0x03) << 8) | rx_data[2];
+    return result;
 }
 
-/* Battery Monitoring */
-uint16_t Read_Battery_Voltage(void) {
-    uint32_t adc_value;
-    uint16_t voltage_mv;
+/* ==================== COMMUNICATION FUNCTIONS ==================== */
+
+uint16_t CalculateChecksum(void* data, uint16_t length) {
+    uint16_t checksum = 0;
+    uint8_t* bytes = (uint8_t*)data;
     
-    HAL_ADC_Start(&hadc1);
-    if(HAL_ADC_PollForConversion(&hadc1, 100) == HAL_OK) {
-        adc_value = HAL_ADC_GetValue(&hadc1);
-        /* Convert ADC (12-bit, 0-4095) to voltage (mV) */
-        /* Voltage divider: 1:2, Vref = 3300mV */
-        voltage_mv = (adc_value * 3300 * 2) / 4096;
-        return voltage_mv;
+    for(uint16_t i = 0; i < length; i++) {
+        checksum += bytes[i];
     }
-    HAL_ADC_Stop(&hadc1);
     
-    return 0;
+    return ~checksum;
 }
 
-uint16_t Read_Battery_Current(void) {
-    /* Would need current sensor - placeholder */
-    return 0;
+/* Snapshots come framed and checksummed from TLM_Publish*, just queue
+ * one. The TX queue copies the frame, so it is safe to re-read the
+ * snapshot afterwards. */
+HAL_StatusTypeDef COMM_SendTelemetry(const TelemetryPacket_t* packet) {
+    return COMM_Transmit(&huart1, (const uint8_t*)packet, sizeof(TelemetryPacket_t));
 }
 
-/* Radiation Counter */
-uint32_t Get_Radiation_Counts(void) {
-    uint32_t counts;
+/* Queue the live snapshot, retrying if it was republished underneath */
+static HAL_StatusTypeDef COMM_SendTelemetrySnapshot(void) {
+    const TelemetryPacket_t* snapshot;
+    HAL_StatusTypeDef status;
+    uint32_t seq;
     
-    taskENTER_CRITICAL();
-    counts = radiation_pulse_count;
-    taskEXIT_CRITICAL();
+    do {
+        snapshot = TLM_Acquire(&seq);
+        status = COMM_SendTelemetry(snapshot);
+    } while(!TLM_Release(seq));
     
-    return counts;
+    return status;
 }
 
-void Reset_Radiation_Counter(void) {
-    taskENTER_CRITICAL();
-    radiation_pulse_count = 0;
-    taskEXIT_CRITICAL();
+/* Saturate v to lo..hi */
+static int32_t BeaconField(int32_t v, int32_t lo, int32_t hi) {
+    return (v < lo) ? lo : (v > hi) ? hi : v;
 }
 
-/* ==================== COMMUNICATION FUNCTIONS ==================== */
-
-uint16_t CalculateChecksum(void* data, uint16_t length) {
-    uint16_t checksum = 0;
-    uint8_t* bytes = (uint8_t*)data;
+void COMM_SendBeacon(void) {
+    const TelemetryPacket_t* tlm;
+    uint8_t beacon[COMM_BEACON_FRAME_SIZE];
+    uint64_t status;
+    int32_t temperature;
+    uint32_t seq;
+    uint16_t crc;
     
-    for(uint16_t i = 0; i < length; i++) {
-        checksum += bytes[i];
+    do {
+        tlm = TLM_Acquire(&seq);
+        temperature = BeaconField(lroundf(tlm->temperature_tmp * 2.0f), -128, 127);
+        status  = (uint64_t)(system_state & 0x07);
+        status |= (uint64_t)BeaconField(((int32_t)tlm->battery_voltage - 2500) / 8, 0, 0xFF) << 3;
+        status |= (uint64_t)(uint8_t)(int8_t)temperature << 11;
+        status |= (uint64_t)tlm->error_flags << 19;
+        status |= (uint64_t)((tlm->radiation_cps > 0xFFF) ? 0xFFF : tlm->radiation_cps) << 27;
+        status |= (uint64_t)(boot_count & 0xFF) << 39;
+        status |= (uint64_t)BeaconField((int32_t)(tlm->uptime / 60), 0, 0x1FFFF) << 47;
+    } while(!TLM_Release(seq));
+    
+    beacon[0] = 0xAA;
+    beacon[1] = 0x5D;
+    memcpy(&beacon[2], &status, sizeof(status));
+    crc = CRC16_Calculate(beacon, COMM_BEACON_FRAME_SIZE - 2);
+    memcpy(&beacon[10], &crc, sizeof(crc));
+    
+    COMM_Transmit(&huart2, beacon, sizeof(beacon));
+}
+
+void COMM_SetBeaconInterval(uint32_t seconds) {
+    if(seconds < COMM_BEACON_MIN_INTERVAL_S) {
+        seconds = COMM_BEACON_MIN_INTERVAL_S;
+    } else if(seconds > COMM_BEACON_MAX_INTERVAL_S) {
+        seconds = COMM_BEACON_MAX_INTERVAL_S;
     }
     
-    return ~checksum;
+    beacon_interval_ms = seconds * 1000;
+    beacon_period_ms = beacon_interval_ms;
+    osTimerStart(beaconTimerHandle, beacon_period_ms);
 }
 
-HAL_StatusTypeDef COMM_SendTelemetry(TelemetryPacket_t* packet) {
-    packet->sync1 = 0xAA;
-    packet->sync2 = 0x55;
-    packet->packet_type = 0x01;
-    packet->timestamp = HAL_GetTick();
-    packet->checksum = CalculateChecksum(packet, sizeof(TelemetryPacket_t) - 2);
+/* Beacon timer for the current state: the set interval, doubling with
+ * every beacon in low power (fewer wakeups from STOP) and snapping back
+ * once power recovers */
+static void BeaconReschedule(uint8_t sent) {
+    uint32_t period = beacon_interval_ms;
+    uint32_t ceiling = (beacon_interval_ms > COMM_BEACON_BACKOFF_MAX_MS) ? beacon_interval_ms
+                                                                        : COMM_BEACON_BACKOFF_MAX_MS;
+    
+    if(system_state == STATE_LOW_POWER) {
+        period = sent ? beacon_period_ms * 2 : beacon_period_ms;
+        if(period > ceiling) {
+            period = ceiling;
+        }
+    }
     
-    return HAL_UART_Transmit(&huart1, (uint8_t*)packet, 
-                             sizeof(TelemetryPacket_t), HAL_MAX_DELAY);
+    if(period != beacon_period_ms) {
+        beacon_period_ms = period;
+        osTimerStart(beaconTimerHandle, beacon_period_ms);
+    }
 }
 
-void COMM_SendBeacon(void) {
-    uint8_t beacon[] = {0xAA, 0x59, system_state, 
-                        (uint8_t)(boot_count & 0xFF), 
-                        (uint8_t)(current_telemetry.battery_voltage >> 8),
-                        (uint8_t)(current_telemetry.battery_voltage & 0xFF)};
+uint16_t CommandFrameLength(const CommandPacket_t* cmd) {
+    if(cmd->sync1 != 0xAA) {
+        return 0;
+    }
+    
+    if(cmd->sync2 == 0x56) {
+        return sizeof(CommandPacket_t);
+    }
     
-    HAL_UART_Transmit(&huart2, beacon, sizeof(beacon), HAL_MAX_DELAY);
+    if(cmd->sync2 == 0x5B && cmd->parameter_length <= CMD_MAX_PARAMETERS) {
+        return CMD_HEADER_SIZE + cmd->parameter_length + 2;
+    }
+    
+    return 0;
 }
 
 void ProcessCommand(CommandPacket_t* cmd) {
-    if(cmd->sync1 != 0xAA || cmd->sync2 != 0x56) {
+    uint16_t frame_length = CommandFrameLength(cmd);
+    uint16_t rx_checksum;
+    
+    if(frame_length == 0) {
         return;  /* Invalid sync */
     }
     
-    uint16_t calc_checksum = CalculateChecksum(cmd, sizeof(CommandPacket_t) - 2);
-    if(calc_checksum != cmd->checksum) {
+    /* Checksum sits right after the parameters that were actually sent */
+    memcpy(&rx_checksum, (uint8_t*)cmd + frame_length - 2, sizeof(rx_checksum));
+    
+    /* v1 keeps the additive sum old ground software sends, v2 is CRC-16 */
+    uint16_t calc_checksum = (cmd->sync2 == 0x5B) ? CRC16_Calculate(cmd, frame_length - 2)
+                                                  : CalculateChecksum(cmd, frame_length - 2);
+    if(calc_checksum != rx_checksum) {
         LogError(ERROR_UART);
         return;  /* Checksum error */
     }
@@ -475,13 +907,14 @@ void ProcessCommand(CommandPacket_t* cmd) {
     switch(cmd->command_id) {
         case CMD_PING:
         {
-            uint8_t response[] = {0xAA, 0x57, 0x01, cmd->sequence_number & 0xFF};
-            HAL_UART_Transmit(&huart1, response, 4, HAL_MAX_DELAY);
+            uint8_t response[] = {0xAA, 0x57, 0x01, cmd->sequence_number & 0xFF,
+                                  CMD_PROTOCOL_VERSION};
+            COMM_Transmit(&huart1, response, sizeof(response));
             break;
         }
         
         case CMD_GET_TELEMETRY:
-            COMM_SendTelemetry(&current_telemetry);
+            COMM_SendTelemetrySnapshot();
             break;
             
         case CMD_CAPTURE_IMAGE:
@@ -503,10 +936,78 @@ void ProcessCommand(CommandPacket_t* cmd) {
             NVIC_SystemReset();
             break;
             
+        case CMD_BEACON:
+            if(cmd->parameter_length >= 2) {
+                uint16_t interval_s = cmd->parameters[0] | (cmd->parameters[1] << 8);
+                COMM_SetBeaconInterval(interval_s);
+            } else {
+                COMM_SendBeacon();
+            }
+            break;
+            
+        case CMD_GET_HISTORY:
+            if(cmd->parameter_length >= 4) {
+                uint16_t first_seq = cmd->parameters[0] | (cmd->parameters[1] << 8);
+                uint16_t last_seq = cmd->parameters[2] | (cmd->parameters[3] << 8);
+                if(DUMP_SendRange(first_seq, last_seq) != HAL_OK) {
+                    LogError(ERROR_UART);  /* Requests not taken up yet */
+                }
+            }
+            break;
+            
+        case CMD_DUMP_HISTORY:
+            if(cmd->parameter_length >= 4) {
+                uint16_t first_seq = cmd->parameters[0] | (cmd->parameters[1] << 8);
+                uint16_t last_seq = cmd->parameters[2] | (cmd->parameters[3] << 8);
+                uint8_t window = (cmd->parameter_length >= 5) ? cmd->parameters[4]
+                                                              : DUMP_DEFAULT_WINDOW;
+                if(DUMP_Start(cmd->sequence_number, first_seq, last_seq, window) != HAL_OK) {
+                    LogError(ERROR_UART);
+                }
+            }
+            break;
+            
+        case CMD_DUMP_ACK:
+            if(cmd->parameter_length >= 8) {
+                uint16_t session, base;
+                uint32_t bitmap;
+                memcpy(&session, &cmd->parameters[0], sizeof(session));
+                memcpy(&base, &cmd->parameters[2], sizeof(base));
+                memcpy(&bitmap, &cmd->parameters[4], sizeof(bitmap));
+                DUMP_HandleAck(session, base, bitmap);
+            }
+            break;
+            
+        case CMD_BRIDGE:
+            if(cmd->parameter_length >= 1 && cmd->parameters[0]) {
+                uint16_t idle_s = 0;
+                if(cmd->parameter_length >= 3) {
+                    memcpy(&idle_s, &cmd->parameters[1], sizeof(idle_s));
+                }
+                COMM_BridgeStart((uint32_t)idle_s * 1000);
+            } else {
+                COMM_BridgeStop();
+            }
+            break;
+            
+        case CMD_GET_DIAGNOSTICS:
+            if(DIAG_SendReport(cmd->parameter_length >= 1 && cmd->parameters[0]) != HAL_OK) {
+                LogError(ERROR_UART);
+            }
+            break;
+            
+        case CMD_UPDATE_FIRMWARE:
+            FWU_HandleCommand(cmd->parameters, cmd->parameter_length);
+            break;
+            
+        case CMD_SET_SCHEDULE:
+            SCHED_HandleCommand(cmd->parameters, cmd->parameter_length);
+            break;
+            
         case CMD_TRANSMIT_FILE:
-            /* Forward to Pi */
-            HAL_UART_Transmit(&huart1, (uint8_t*)cmd, 
-                             sizeof(CommandPacket_t), HAL_MAX_DELAY);
+        case CMD_FILE_ACK:
+            /* Forward to Pi, which runs file transfers */
+            COMM_Transmit(&huart1, (uint8_t*)cmd, frame_length);
             break;
             
         default:
@@ -516,122 +1017,293 @@ void ProcessCommand(CommandPacket_t* cmd) {
 }
 
 void LogError(uint8_t error_code) {
-    current_telemetry.error_flags |= error_code;
+    TLM_LogError(error_code);
 }
 
 /* ==================== FreeRTOS TASKS ==================== */
 
 void SensorTask(void *argument) {
-    TickType_t lastWakeTime = xTaskGetTickCount();
+    TickType_t lastWakeTime;
+    TickType_t lead;
     static uint16_t sequence = 0;
+    static TelemetryPacket_t staged;  /* SensorTask's fields, published at once */
+    static TelemetryPacket_t logged;  /* Snapshot copy for the flash history */
+    uint8_t sensor_state = 0xFF;  /* Forces a profile load on the first pass */
+    uint32_t seq;
+    HAL_StatusTypeDef status;
+    BATT_Status_t battery;
     
     /* Initialize sensors */
     LIS3MDL_Init();
     BME280_Init();
+    if(Sensors_Init() != HAL_OK) {
+        LogError(ERROR_I2C);  /* No calibration, BME280 values invalid */
+    }
+#ifdef BME280_RUN_BENCHMARK
+    /* Datasheet sample values - read the result out with the debugger */
+    static BME280_Benchmark_t bme280_benchmark;
+    BME280_Benchmark(519888, 415148, 30000, &bme280_benchmark);
+#endif
     TMP117_Init();
+    if(HIST_Init() != HAL_OK) {
+        LogError(ERROR_MEMORY);
+    }
+#if MAG_STREAM_ENABLE
+    MAG_StreamStart();
+#endif
+    
+    lastWakeTime = xTaskGetTickCount();
     
     while(1) {
-        /* Read magnetometer */
-        LIS3MDL_Read(&current_telemetry.mag_x, 
-                     &current_telemetry.mag_y, 
-                     &current_telemetry.mag_z);
+        /* Follow system state with the BME280 acquisition profile */
+        if(system_state != sensor_state) {
+            sensor_state = system_state;
+            if(BME280_SetProfile(BME280_ProfileForState(sensor_state)) != HAL_OK) {
+                LogError(ERROR_I2C);
+            }
+        }
         
-        /* Read environmental sensors */
-        BME280_Read(&current_telemetry.temperature_bme,
-                    &current_telemetry.pressure,
-                    &current_telemetry.humidity);
+        /* Trigger the forced conversion so it finishes just as the sweep
+         * reads it - the 1 s period is split around the conversion time */
+        lead = pdMS_TO_TICKS(BME280_MeasureTime());
+        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(1000) - lead);
+        BME280_TriggerMeasurement();
+        vTaskDelayUntil(&lastWakeTime, lead);
+        SYSTEM_Heartbeat(SUPV_TASK_SENSOR);  /* Sample instant, measures jitter */
         
-        TMP117_Read(&current_telemetry.temperature_tmp);
+        /* Magnetometer, environmental and precision temperature in one
+         * asynchronous I2C sweep */
+        DIAG_TIMED(DIAG_SENSOR_SWEEP, Sensors_ReadSweep(&staged));
         
-        /* Read corrosion sensor */
-        current_telemetry.corrosion_raw = MCP3008_Read(0);
+#if MAG_STREAM_ENABLE
+        /* Magnetometer telemetry is the decimated average of the stream */
+        if(MAG_StreamProcess(&mag_stats)) {
+            staged.mag_x = mag_stats.mean[0];
+            staged.mag_y = mag_stats.mean[1];
+            staged.mag_z = mag_stats.mean[2];
+        }
+#endif
+        
+        /* All MCP3008 channels in one DMA scan; corrosion goes out in
+         * telemetry, the rest stay in adc_scan */
+        DIAG_TIMED(DIAG_SENSOR_ADC_SCAN,
+                   status = MCP3008_Scan(MCP3008_SCAN_MASK, MCP3008_SCAN_OVERSAMPLE, &adc_scan));
+        if(status == HAL_OK) {
+            staged.corrosion_raw = MCP3008_Rounded(&adc_scan, MCP3008_CH_CORROSION);
+        } else {
+            LogError(ERROR_SPI);
+        }
         
-        /* Read battery */
-        current_telemetry.battery_voltage = Read_Battery_Voltage();
-        current_telemetry.battery_current = Read_Battery_Current();
+        /* Battery voltage is filtered in the background; the scan's
+         * current channel feeds the coulomb counter */
+        if(status == HAL_OK) {
+            BATT_UpdateCurrent(adc_scan.average[MCP3008_CH_BATT_CURRENT],
+                               xTaskGetTickCount() * portTICK_PERIOD_MS);
+        }
+        BATT_GetStatus(&battery);
+        staged.battery_voltage = battery.voltage_mv;
+        staged.battery_current = (battery.current_ma > 0) ? (uint16_t)battery.current_ma : 0;
         
         /* Update system info */
-        current_telemetry.sequence_number = sequence++;
-        current_telemetry.boot_count = boot_count;
-        current_telemetry.system_state = system_state;
-        current_telemetry.uptime = system_uptime;
+        staged.sequence_number = sequence++;
+        staged.boot_count = boot_count;
+        staged.system_state = system_state;
+        staged.uptime = system_uptime;
         
-        /* Send to queue */
-        osMessageQueuePut(telemetryQueueHandle, &current_telemetry, 0, 0);
+        /* Publish to the telemetry snapshot and wake CommTask */
+        TLM_PublishSensors(&staged);
+        COMM_Notify(COMM_EVT_TELEMETRY);
+        
+        /* Keep the full snapshot, radiation included, for backfill */
+        do {
+            logged = *TLM_Acquire(&seq);
+        } while(!TLM_Release(seq));
+        DIAG_TIMED(DIAG_HIST_APPEND, status = HIST_Append(&logged));
+        if(status != HAL_OK) {
+            LogError(ERROR_MEMORY);
+        }
         
         /* Toggle LED */
         HAL_GPIO_TogglePin(LED_PORT, LED_PIN);
-        
-        /* Wait 1 second */
-        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(1000));
     }
 }
 
 void RadiationTask(void *argument) {
-    uint32_t last_count = 0;
-    uint32_t current_count;
+    RAD_Window_t window;
+    
+    RAD_Start();
     
     while(1) {
-        /* Calculate counts per second */
-        current_count = Get_Radiation_Counts();
-        current_telemetry.radiation_cps = current_count - last_count;
-        last_count = current_count;
+        /* The gate ISR wakes us once per 1 s window; windows stretch
+         * while TIM3 halts in STOP, so beat on a timeout as well */
+        osThreadFlagsWait(RAD_FLAG_WINDOW, osFlagsWaitAny, SUPV_IDLE_BEAT_MS);
+        SYSTEM_Heartbeat(SUPV_TASK_RADIATION);
         
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        while(RAD_GetWindow(&window)) {
+            TLM_PublishRadiation(RAD_CorrectedCps(&window), window.counts);
+        }
     }
 }
 
 void CommTask(void *argument) {
-    TelemetryPacket_t tx_packet;
-    CommandPacket_t cmd;
-    uint32_t last_beacon = 0;
+    COMM_Frame_t cmd_frame;
+    uint32_t events;
+    uint32_t seq;
+    uint32_t last_sent = 0xFFFFFFFF;  /* Sensor sequence number last sent */
+    uint8_t telemetry_pending = 0;
+    uint32_t timeout = SUPV_IDLE_BEAT_MS;
+    uint32_t fw_timeout;
+    uint8_t beacon_sent;
     
-    /* Start UART reception */
-    HAL_UART_Receive_IT(&huart1, (uint8_t*)&cmd, sizeof(CommandPacket_t));
+    /* Start UART reception (circular DMA + idle line); this task
+     * becomes the target of COMM_Notify */
+    COMM_Init();
     
     while(1) {
-        /* Send telemetry to Pi if available */
-        if(osMessageQueueGet(telemetryQueueHandle, &tx_packet, 0, 10) == osOK) {
-            COMM_SendTelemetry(&tx_packet);
+        /* Sleep until something happens - no polling between events,
+         * except while the bridge is open, and the supervisor heartbeat
+         * when idle */
+        events = osThreadFlagsWait(COMM_EVT_ALL, osFlagsWaitAny, timeout);
+        SYSTEM_Heartbeat(SUPV_TASK_COMM);
+        if(events == osFlagsErrorTimeout) {
+            events = 0;
+        } else if(events & osFlagsError) {
+            continue;
+        }
+        
+        /* Process commands and firmware chunks, all that queued up since
+         * the last wake */
+        if(events & COMM_EVT_COMMAND) {
+            while(COMM_NextCommand(&cmd_frame)) {
+                /* Packet is read in place from the RX ring */
+                if(!COMM_FrameValid(&cmd_frame)) {
+                    LogError(ERROR_UART);  /* Overwritten before we got to it */
+                } else if(cmd_frame.sync_word == SYNC_FIRMWARE) {
+                    FWU_HandleChunk(&cmd_frame);
+                } else {
+                    DIAG_TIMED(DIAG_COMMAND,
+                               ProcessCommand((CommandPacket_t*)cmd_frame.data));
+                }
+            }
+        }
+        
+        /* Time-tagged commands, run the same way once due */
+        if(events & COMM_EVT_SCHEDULE) {
+            SCHED_RunDue();
         }
         
-        /* Process commands */
-        if(osMessageQueueGet(commandQueueHandle, &cmd, 0, 10) == osOK) {
-            ProcessCommand(&cmd);
+        /* Send telemetry to Pi once per new sensor sweep; if the TX ring
+         * is full, retry when it drains */
+        if((events & COMM_EVT_TELEMETRY) ||
+           (telemetry_pending && (events & COMM_EVT_TX_DONE))) {
+            const TelemetryPacket_t* snapshot = TLM_Acquire(&seq);
+            if(snapshot->sequence_number != last_sent || telemetry_pending) {
+                if(COMM_SendTelemetrySnapshot() == HAL_OK) {
+                    last_sent = snapshot->sequence_number;
+                    telemetry_pending = 0;
+                } else {
+                    telemetry_pending = 1;
+                }
+            }
         }
         
-        /* Send beacon every 30 seconds */
-        if((HAL_GetTick() - last_beacon) > 30000 && 
-           (system_state == STATE_NOMINAL || system_state == STATE_IDLE)) {
+        /* Beacon on the timer, only in states where the radio is ours -
+         * in bridge mode the Pi owns it */
+        beacon_sent = 0;
+        if((events & COMM_EVT_BEACON) && !COMM_BridgeActive() &&
+           (system_state == STATE_NOMINAL || system_state == STATE_IDLE ||
+            system_state == STATE_LOW_POWER)) {
             COMM_SendBeacon();
-            last_beacon = HAL_GetTick();
+            beacon_sent = 1;
         }
+        BeaconReschedule(beacon_sent);
         
-        osDelay(100);
+        /* History dumps wait on the same TX ring */
+        if(events & COMM_EVT_TX_DONE) {
+            DUMP_Notify();
+        }
+        
+        timeout = COMM_BridgeService();
+        fw_timeout = FWU_Service();
+        if(fw_timeout < timeout) {
+            timeout = fw_timeout;
+        }
+        if(timeout > SUPV_IDLE_BEAT_MS) {
+            timeout = SUPV_IDLE_BEAT_MS;  /* Heartbeat while idle */
+        }
+    }
+}
+
+/* Bulk history downlink, below everything else. Sleeps until CommTask
+ * queues a request or the TX ring drains. */
+void DownlinkTask(void *argument) {
+    uint32_t timeout;
+    
+    DUMP_Init();
+    
+    while(1) {
+        timeout = DUMP_Service();
+#ifdef DOWNLINK_LOAD_BENCHMARK
+        /* Keep USART1 saturated with the whole history; GET_DIAGNOSTICS
+         * then shows the worst sensor jitter under full downlink load */
+        if(timeout == osWaitForever) {
+            DUMP_SendRange(0, 0xFFFF);
+            continue;
+        }
+#endif
+        if(timeout > SUPV_IDLE_BEAT_MS) {
+            timeout = SUPV_IDLE_BEAT_MS;
+        }
+        osThreadFlagsWait(DUMP_FLAG_WAKE, osFlagsWaitAny, timeout);
+        SYSTEM_Heartbeat(SUPV_TASK_DOWNLINK);
     }
 }
 
+void BeaconTimerCallback(void *argument) {
+    COMM_Notify(COMM_EVT_BEACON);
+}
+
 void WatchdogTask(void *argument) {
+    const TelemetryPacket_t* tlm;
+    uint32_t seq;
+    BATT_Status_t battery;
+    float temperature_bme;
+    
     while(1) {
-        /* Check system health */
-        if(current_telemetry.battery_voltage < BATTERY_CRITICAL) {
+        /* Check system health against a consistent snapshot */
+        do {
+            tlm = TLM_Acquire(&seq);
+            temperature_bme = tlm->temperature_bme;
+        } while(!TLM_Release(seq));
+        
+        /* Battery from the filtered ADC average, once it has one */
+        BATT_GetStatus(&battery);
+        if(battery.blocks > 0 && battery.voltage_mv < BATTERY_CRITICAL) {
             system_state = STATE_LOW_POWER;
             ShutdownPayload();
         }
         
-        if(current_telemetry.temperature_bme > 70.0f || 
-           current_telemetry.temperature_bme < -20.0f) {
+        if(temperature_bme > 70.0f || 
+           temperature_bme < -20.0f) {
             system_state = STATE_SAFE;
             LogError(ERROR_TEMPERATURE);
         }
         
-        /* Refresh watchdog */
-        HAL_IWDG_Refresh(&hiwdg);
+        /* Trade MIPS for power to match the state; retried next pass if
+         * a transfer kept the buses busy */
+        CLOCK_SetProfile(CLOCK_ProfileForState(system_state));
+        
+        /* Feed the watchdog only if every task is keeping its deadline;
+         * a new firmware image that gets this far for long enough is
+         * kept, otherwise the bootloader rolls it back */
+        if(SYSTEM_RefreshWatchdog() && system_uptime >= FWU_CONFIRM_UPTIME_S) {
+            FWU_Confirm();
+        }
         
         /* Increment uptime (every 5 seconds) */
-        system_uptime += 5;
+        system_uptime += SUPV_CHECK_PERIOD_MS / 1000;
         
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        vTaskDelay(pdMS_TO_TICKS(SUPV_CHECK_PERIOD_MS));
     }
 }
 
@@ -639,14 +1311,17 @@ void ShutdownPayload(void) {
     /* Put Pi to sleep */
     HAL_GPIO_WritePin(PI_WAKE_PORT, PI_WAKE_PIN, GPIO_PIN_RESET);
     
-    /* Disable non-essential peripherals */
-    __HAL_RCC_I2C1_CLK_DISABLE();
-    __HAL_RCC_SPI1_CLK_DISABLE();
+    /* Sensor peripherals stay up for 1 Hz sampling; the tickless idle
+     * hook gates their clocks around each STOP instead */
 }
 
 /* ==================== MAIN ==================== */
 
 int main(void) {
+    /* Linked behind the bootloader (STM32F401CCUX_FLASH.ld); the
+     * bootloader jumps here with its own vector table still live */
+    SCB->VTOR = (uint32_t)(uintptr_t)g_pfnVectors;
+    
     /* HAL Init */
     HAL_Init();
     
@@ -655,25 +1330,35 @@ int main(void) {
     
     /* Initialize peripherals */
     MX_GPIO_Init();
+    MX_DMA_Init();
     MX_I2C1_Init();
     MX_SPI1_Init();
     MX_USART1_UART_Init();
     MX_USART2_UART_Init();
     MX_ADC1_Init();
     MX_IWDG_Init();
+    MX_RTC_Init();
+    MX_TIM2_Init();
+    MX_TIM3_Init();
+    CRC32_Init();
+    DIAG_Init();
+    FWU_Init();  /* Before SensorTask opens the history log */
     
     /* Initialize kernel */
     osKernelInitialize();
     
-    /* Create queues */
-    telemetryQueueHandle = osMessageQueueNew(10, sizeof(TelemetryPacket_t), NULL);
-    commandQueueHandle = osMessageQueueNew(5, sizeof(CommandPacket_t), NULL);
-    
     /* Create tasks */
-    osThreadNew(SensorTask, NULL, NULL);
-    osThreadNew(RadiationTask, NULL, NULL);
-    osThreadNew(CommTask, NULL, NULL);
-    osThreadNew(WatchdogTask, NULL, NULL);
+    sensorTaskHandle = osThreadNew(SensorTask, NULL, &SensorTask_attributes);
+    radiationTaskHandle = osThreadNew(RadiationTask, NULL, &RadiationTask_attributes);
+    commTaskHandle = osThreadNew(CommTask, NULL, &CommTask_attributes);
+    downlinkTaskHandle = osThreadNew(DownlinkTask, NULL, &DownlinkTask_attributes);
+    watchdogTaskHandle = osThreadNew(WatchdogTask, NULL, &WatchdogTask_attributes);
+    
+    /* Create beacon timer - it only posts an event to CommTask */
+    beaconTimerHandle = osTimerNew(BeaconTimerCallback, osTimerPeriodic, NULL,
+                                   &beaconTimer_attributes);
+    osTimerStart(beaconTimerHandle, COMM_BEACON_INTERVAL_MS);
+    SCHED_Init();
     
     /* Start scheduler */
     osKernelStart();
@@ -0,0 +1,187 @@
+/* mcp3008.c - MCP3008 Multi-Channel ADC Scan
+ *
+ * A scan converts every requested channel, oversampled, as one run of
+ * chained SPI DMA transfers. The MCP3008 needs CS to go high between
+ * conversions and SPI1 has no NSS pulse mode, so each conversion is its
+ * own 3-byte transfer and the completion interrupt toggles CS and starts
+ * the next. The calling task sleeps until the whole scan is done, then
+ * the results are unpacked from the receive buffer in one pass.
+ */
+#include "mcp3008.h"
+#include "diag.h"
+#include "cmsis_os.h"
+#include <string.h>
+
+static SPI_HandleTypeDef* spi = NULL;
+
+/* Command and response bytes for every conversion of the scan */
+static uint8_t scan_tx[MCP3008_MAX_CONVERSIONS * MCP3008_CONVERSION_BYTES];
+static uint8_t scan_rx[MCP3008_MAX_CONVERSIONS * MCP3008_CONVERSION_BYTES];
+static volatile uint8_t scan_count = 0;
+static volatile uint8_t scan_next = 0;
+static volatile HAL_StatusTypeDef scan_status = HAL_OK;  /* HAL_BUSY mid-scan */
+static void* volatile scan_thread = NULL;
+static uint32_t cs_high_cycles = 0;
+
+HAL_StatusTypeDef MCP3008_Init(SPI_HandleTypeDef* hspi) {
+    spi = hspi;
+    scan_status = HAL_OK;
+    
+    /* CS idles high; tCSH is timed on the cycle counter */
+    HAL_GPIO_WritePin(MCP3008_CS_PORT, MCP3008_CS_PIN, GPIO_PIN_SET);
+    DIAG_Init();
+    
+    return HAL_OK;
+}
+
+/* End the scan and wake the task waiting on it (ISR or locked) */
+static void MCP3008_Finish(HAL_StatusTypeDef status) {
+    HAL_GPIO_WritePin(MCP3008_CS_PORT, MCP3008_CS_PIN, GPIO_PIN_SET);
+    scan_status = status;
+    if(scan_thread != NULL) {
+        osThreadFlagsSet(scan_thread, MCP3008_FLAG_DONE);
+    }
+}
+
+/* Select the chip and clock out the next conversion (ISR or locked) */
+static void MCP3008_StartConversion(void) {
+    uint16_t offset = scan_next * MCP3008_CONVERSION_BYTES;
+    HAL_StatusTypeDef status;
+    
+    HAL_GPIO_WritePin(MCP3008_CS_PORT, MCP3008_CS_PIN, GPIO_PIN_RESET);
+    status = HAL_SPI_TransmitReceive_DMA(spi, &scan_tx[offset], &scan_rx[offset],
+                                         MCP3008_CONVERSION_BYTES);
+    if(status != HAL_OK) {
+        MCP3008_Finish(status);
+    }
+}
+
+/* Scan the channels in mask, oversample conversions each, into result.
+ * Passes are interleaved (0..7, 0..7, ...) so the oversamples of a
+ * channel are spread over the scan rather than taken back to back.
+ * Channels outside mask keep their previous values. Task context. */
+HAL_StatusTypeDef MCP3008_Scan(uint8_t mask, uint8_t oversample, MCP3008_Scan_t* result) {
+    uint32_t sum[MCP3008_CHANNELS];
+    uint16_t value;
+    uint8_t* cmd;
+    uint8_t count = 0;
+    uint8_t channel;
+    
+    if(spi == NULL || mask == 0 || oversample == 0 || oversample > MCP3008_MAX_OVERSAMPLE) {
+        return HAL_ERROR;
+    }
+    if(scan_status == HAL_BUSY) {
+        return HAL_BUSY;
+    }
+    
+    for(uint8_t pass = 0; pass < oversample; pass++) {
+        for(channel = 0; channel < MCP3008_CHANNELS; channel++) {
+            if(mask & (1u << channel)) {
+                cmd = &scan_tx[count * MCP3008_CONVERSION_BYTES];
+                cmd[0] = 0x01;                    /* Start bit */
+                cmd[1] = 0x80 | (channel << 4);   /* Single-ended + channel */
+                cmd[2] = 0x00;
+                count++;
+            }
+        }
+    }
+    
+    /* Core clock can change between scans with the clock profile */
+    cs_high_cycles = (SystemCoreClock / 1000000) * MCP3008_CS_HIGH_NS / 1000 + 1;
+    
+    osThreadFlagsClear(MCP3008_FLAG_DONE);
+    scan_thread = osThreadGetId();
+    scan_count = count;
+    scan_next = 0;
+    scan_status = HAL_BUSY;
+    
+    taskENTER_CRITICAL();
+    MCP3008_StartConversion();
+    taskEXIT_CRITICAL();
+    
+    osThreadFlagsWait(MCP3008_FLAG_DONE, osFlagsWaitAny, MCP3008_SCAN_TIMEOUT_MS);
+    
+    taskENTER_CRITICAL();
+    if(scan_status == HAL_BUSY) {
+        /* Lost a completion interrupt - stop the DMA and free the bus */
+        HAL_SPI_Abort(spi);
+        MCP3008_Finish(HAL_TIMEOUT);
+    }
+    taskEXIT_CRITICAL();
+    
+    if(scan_status != HAL_OK) {
+        return scan_status;
+    }
+    
+    memset(sum, 0, sizeof(sum));
+    for(uint8_t i = 0; i < count; i++) {
+        cmd = &scan_tx[i * MCP3008_CONVERSION_BYTES];
+        channel = (cmd[1] >> 4) & 0x07;
+        value = ((scan_rx[i * MCP3008_CONVERSION_BYTES + 1] & 0x03) << 8) |
+                scan_rx[i * MCP3008_CONVERSION_BYTES + 2];
+        sum[channel] += value;
+        result->raw[channel] = value;
+    }
+    
+    for(channel = 0; channel < MCP3008_CHANNELS; channel++) {
+        if(mask & (1u << channel)) {
+            result->average[channel] = (uint16_t)(((sum[channel] << MCP3008_AVERAGE_SHIFT) +
+                                                   oversample / 2) / oversample);
+        }
+    }
+    result->mask = mask;
+    result->oversample = oversample;
+    result->tick = HAL_GetTick();
+    
+    return HAL_OK;
+}
+
+/* Single conversion, 0 if the scan failed */
+uint16_t MCP3008_Read(uint8_t channel) {
+    MCP3008_Scan_t scan;
+    
+    channel &= 0x07;
+    if(MCP3008_Scan(1u << channel, 1, &scan) != HAL_OK) {
+        return 0;
+    }
+    return scan.raw[channel];
+}
+
+/* Channel average rounded back to a 10-bit code */
+uint16_t MCP3008_Rounded(const MCP3008_Scan_t* scan, uint8_t channel) {
+    uint16_t half = 1u << (MCP3008_AVERAGE_SHIFT - 1);
+    
+    return (scan->average[channel & 0x07] + half) >> MCP3008_AVERAGE_SHIFT;
+}
+
+/* ==================== HAL CALLBACKS ==================== */
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    uint32_t start;
+    
+    if(hspi != spi || scan_status != HAL_BUSY) {
+        return;
+    }
+    
+    HAL_GPIO_WritePin(MCP3008_CS_PORT, MCP3008_CS_PIN, GPIO_PIN_SET);
+    
+    scan_next++;
+    if(scan_next >= scan_count) {
+        MCP3008_Finish(HAL_OK);
+        return;
+    }
+    
+    /* Hold CS high for tCSH before the next conversion */
+    start = DWT->CYCCNT;
+    while((DWT->CYCCNT - start) < cs_high_cycles) {
+    }
+    
+    MCP3008_StartConversion();
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+    if(hspi == spi && scan_status == HAL_BUSY) {
+        /* Overrun or DMA transfer error */
+        MCP3008_Finish(HAL_ERROR);
+    }
+}
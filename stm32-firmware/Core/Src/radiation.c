@@ -0,0 +1,190 @@
+/* radiation.c - Gated Radiation Counter
+ *
+ * TIM2 runs in external clock mode 2 with PA0 on its ETR input, so the
+ * tube pulses are counted in hardware whatever the flux. TIM3 raises an
+ * update every RAD_BIN_MS; its ISR latches the TIM2 count into the
+ * current histogram bin. Bin lengths come from the RTOS tick, so a bin
+ * stretched by a late interrupt or a STOP period is still converted to
+ * a correct rate.
+ */
+#include "radiation.h"
+#include "sensors.h"
+#include "spsc_ring.h"
+#include "cmsis_os.h"
+#include <string.h>
+
+static osThreadId_t rad_thread = NULL;
+
+static volatile uint32_t rad_last_cnt = 0;     /* TIM2 at the last bin edge */
+static volatile uint32_t rad_stop_pulses = 0;  /* Counted by EXTI0 in STOP */
+static volatile uint32_t rad_total = 0;        /* Closed bins since reset */
+static uint32_t rad_bin_tick = 0;
+static uint8_t rad_bin = 0;
+
+static RAD_Window_t rad_live;                  /* Bins being filled */
+
+/* Completed windows, gate ISR to RadiationTask */
+SPSC_RING(rad_windows, RAD_Window_t, RAD_WINDOW_RING_SIZE);
+
+/* APB1 timers run at twice PCLK1 whenever APB1 is divided */
+static uint32_t RAD_Apb1TimerClock(void) {
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+    
+    return (pclk1 == HAL_RCC_GetHCLKFreq()) ? pclk1 : pclk1 * 2;
+}
+
+uint32_t RAD_GatePrescaler(void) {
+    return (RAD_Apb1TimerClock() / RAD_GATE_TICK_HZ) - 1;
+}
+
+/* Called after a clock profile switch. PSC is preloaded, so the bin in
+ * progress finishes at the old rate and the next one uses the new. */
+void RAD_GateRetune(void) {
+    htim3.Init.Prescaler = RAD_GatePrescaler();
+    __HAL_TIM_SET_PRESCALER(&htim3, htim3.Init.Prescaler);
+}
+
+/* Called from RadiationTask, which receives RAD_FLAG_WINDOW */
+HAL_StatusTypeDef RAD_Start(void) {
+    rad_thread = osThreadGetId();
+    
+    taskENTER_CRITICAL();
+    memset(&rad_live, 0, sizeof(rad_live));
+    rad_bin = 0;
+    SPSC_RESET(rad_windows);
+    rad_stop_pulses = 0;
+    rad_last_cnt = htim2.Instance->CNT;
+    rad_bin_tick = xTaskGetTickCount();
+    taskEXIT_CRITICAL();
+    
+    if(HAL_TIM_Base_Start(&htim2) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return HAL_TIM_Base_Start_IT(&htim3);
+}
+
+void RAD_GateElapsed(void) {
+    uint32_t cnt = htim2.Instance->CNT;
+    uint32_t now = xTaskGetTickCountFromISR();
+    uint32_t pulses = (cnt - rad_last_cnt) + rad_stop_pulses;  /* Wraps cleanly */
+    uint32_t bin_ms = (now - rad_bin_tick) * portTICK_PERIOD_MS;
+    RAD_Window_t* done;
+    
+    rad_last_cnt = cnt;
+    rad_stop_pulses = 0;
+    rad_bin_tick = now;
+    rad_total += pulses;
+    
+    rad_live.counts[rad_bin] = (pulses > 0xFFFF) ? 0xFFFF : pulses;
+    rad_live.bin_ms[rad_bin] = (bin_ms > 0xFFFF) ? 0xFFFF : bin_ms;
+    rad_live.window_ms += bin_ms;
+    
+    if(++rad_bin >= RAD_GATE_BINS) {
+        /* If RadiationTask is this far behind the window is dropped;
+         * the pulses are still in the running total */
+        done = SPSC_CLAIM(rad_windows);
+        if(done != NULL) {
+            *done = rad_live;
+            SPSC_COMMIT(rad_windows);
+        }
+        memset(&rad_live, 0, sizeof(rad_live));
+        rad_bin = 0;
+        
+        if(rad_thread != NULL) {
+            osThreadFlagsSet(rad_thread, RAD_FLAG_WINDOW);
+        }
+    }
+}
+
+/* Take the oldest complete window. 0 when none is waiting. */
+uint8_t RAD_GetWindow(RAD_Window_t* window) {
+    const RAD_Window_t* done = SPSC_FRONT(rad_windows);
+    
+    if(done == NULL) {
+        return 0;
+    }
+    *window = *done;
+    SPSC_RELEASE(rad_windows);
+    
+    return 1;
+}
+
+/* Dead-time corrected rate over a window. The non-paralyzable model
+ * gives true = measured / (1 - measured * tau), applied per bin so a
+ * short burst is not averaged away before it is corrected. */
+uint32_t RAD_CorrectedCps(const RAD_Window_t* window) {
+    float total = 0.0f;
+    float rate, loss;
+    uint8_t i;
+    
+    if(window->window_ms == 0) {
+        return 0;
+    }
+    
+    for(i = 0; i < RAD_GATE_BINS; i++) {
+        if(window->bin_ms[i] == 0) {
+            continue;
+        }
+        rate = (window->counts[i] * 1000.0f) / window->bin_ms[i];
+        loss = rate * (RAD_DEAD_TIME_US * 1e-6f);
+        if(loss > RAD_MAX_LOSS) {
+            loss = RAD_MAX_LOSS;
+        }
+        total += window->counts[i] / (1.0f - loss);
+    }
+    
+    return (uint32_t)((total * 1000.0f) / window->window_ms + 0.5f);
+}
+
+/* ==================== STOP MODE ==================== */
+
+/* EXTICR1 resets to port A, so line 0 is already PA0 */
+void RAD_EnterStop(void) {
+    EXTI->PR = RADIATION_PIN;
+    EXTI->RTSR |= RADIATION_PIN;
+    EXTI->IMR |= RADIATION_PIN;
+    HAL_NVIC_ClearPendingIRQ(EXTI0_IRQn);
+    HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+}
+
+/* Count a pulse that ended STOP. With interrupts masked the EXTI0
+ * handler never runs, so its pending bits are cleared here. */
+uint8_t RAD_StopWakeup(void) {
+    if(!__HAL_GPIO_EXTI_GET_IT(RADIATION_PIN)) {
+        return 0;
+    }
+    
+    __HAL_GPIO_EXTI_CLEAR_IT(RADIATION_PIN);
+    HAL_NVIC_ClearPendingIRQ(EXTI0_IRQn);
+    rad_stop_pulses++;
+    
+    return 1;
+}
+
+void RAD_ExitStop(void) {
+    EXTI->IMR &= ~RADIATION_PIN;
+    HAL_NVIC_DisableIRQ(EXTI0_IRQn);
+    
+    /* A pulse may have landed after the last wakeup */
+    (void)RAD_StopWakeup();
+}
+
+/* ==================== LEGACY COUNTER API ==================== */
+
+/* Running total since the last reset, including the open bin */
+uint32_t Get_Radiation_Counts(void) {
+    uint32_t counts;
+    
+    taskENTER_CRITICAL();
+    counts = rad_total + (htim2.Instance->CNT - rad_last_cnt) + rad_stop_pulses;
+    taskEXIT_CRITICAL();
+    
+    return counts;
+}
+
+void Reset_Radiation_Counter(void) {
+    /* Offset the pulses in the open bin - they still go in the histogram */
+    taskENTER_CRITICAL();
+    rad_total = 0 - ((htim2.Instance->CNT - rad_last_cnt) + rad_stop_pulses);
+    taskEXIT_CRITICAL();
+}
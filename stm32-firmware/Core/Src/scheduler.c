@@ -0,0 +1,281 @@
+/* scheduler.c - Time-Tagged Command Scheduler
+ *
+ * The ground uploads a pass worth of commands - captures, downlinks,
+ * mode changes - each tagged with the mission time it should run at.
+ * Entries sit in a fixed pool; a binary min-heap of pool indices keeps
+ * them ordered by time, then by upload order, so adding or running one
+ * is O(log n). A single one-shot software timer is kept armed for the
+ * head of the heap and only wakes CommTask, which runs the due frames
+ * through ProcessCommand exactly as if they had just arrived, checksum
+ * check included. Since everything here runs in CommTask, nothing needs
+ * a lock, and between entries the MCU is free to sleep: the Pi is woken
+ * only by the commands scheduled for it.
+ */
+#include "scheduler.h"
+#include "communication.h"
+#include "crc.h"
+#include "diag.h"
+#include "cmsis_os.h"
+#include <string.h>
+#include <stddef.h>
+
+typedef struct {
+    uint32_t time_ms;
+    uint32_t order;           /* Upload count, breaks ties */
+    uint8_t  length;
+    uint8_t  frame[SCHED_MAX_FRAME];
+} SCHED_Entry_t;
+
+/* CommTask only */
+static SCHED_Entry_t sched_pool[SCHED_MAX_ENTRIES];
+static uint8_t sched_heap[SCHED_MAX_ENTRIES];   /* Pool indices, earliest first */
+static uint8_t sched_free[SCHED_MAX_ENTRIES];   /* Unused pool indices, a stack */
+static uint8_t sched_count = 0;
+static uint32_t sched_order = 0;
+static CommandPacket_t sched_run;               /* Due frame, off the task stack */
+
+static osTimerId_t sched_timer = NULL;
+static StaticTimer_t sched_timer_cb;
+static const osTimerAttr_t sched_timer_attributes = {
+    .name = "Schedule", .cb_mem = &sched_timer_cb, .cb_size = sizeof(sched_timer_cb) };
+
+uint32_t SCHED_Now(void) {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/* ==================== HEAP ==================== */
+
+/* Times compare modulo 2^32 - every entry lies within 2^31 ms of now */
+static uint8_t SCHED_Before(uint8_t a, uint8_t b) {
+    int32_t dt = (int32_t)(sched_pool[a].time_ms - sched_pool[b].time_ms);
+    
+    return dt < 0 || (dt == 0 && (int32_t)(sched_pool[a].order - sched_pool[b].order) < 0);
+}
+
+static void SCHED_SiftUp(uint8_t i) {
+    uint8_t slot = sched_heap[i];
+    uint8_t parent;
+    
+    while(i > 0) {
+        parent = (i - 1) / 2;
+        if(!SCHED_Before(slot, sched_heap[parent])) {
+            break;
+        }
+        sched_heap[i] = sched_heap[parent];
+        i = parent;
+    }
+    sched_heap[i] = slot;
+}
+
+static void SCHED_SiftDown(uint8_t i) {
+    uint8_t slot = sched_heap[i];
+    uint8_t child;
+    
+    while((child = 2 * i + 1) < sched_count) {
+        if(child + 1 < sched_count && SCHED_Before(sched_heap[child + 1], sched_heap[child])) {
+            child++;
+        }
+        if(!SCHED_Before(sched_heap[child], slot)) {
+            break;
+        }
+        sched_heap[i] = sched_heap[child];
+        i = child;
+    }
+    sched_heap[i] = slot;
+}
+
+/* Take heap position i out and put its pool slot back */
+static void SCHED_Remove(uint8_t i) {
+    sched_count--;
+    sched_free[SCHED_MAX_ENTRIES - 1 - sched_count] = sched_heap[i];
+    
+    if(i < sched_count) {
+        sched_heap[i] = sched_heap[sched_count];
+        SCHED_SiftDown(i);
+        SCHED_SiftUp(i);
+    }
+}
+
+static uint16_t SCHED_Sequence(uint8_t slot) {
+    uint16_t seq;
+    
+    memcpy(&seq, &sched_pool[slot].frame[offsetof(CommandPacket_t, sequence_number)], sizeof(seq));
+    return seq;
+}
+
+/* ==================== TIMER ==================== */
+
+static void SCHED_TimerCallback(void *argument) {
+    COMM_Notify(COMM_EVT_SCHEDULE);
+}
+
+/* Arm the timer for the earliest entry; an early expiry (tick rounding)
+ * just finds nothing due and arms again */
+static void SCHED_Rearm(void) {
+    int32_t delay;
+    
+    if(sched_count == 0) {
+        osTimerStop(sched_timer);
+        return;
+    }
+    
+    delay = (int32_t)(sched_pool[sched_heap[0]].time_ms - SCHED_Now()) / (int32_t)portTICK_PERIOD_MS;
+    osTimerStart(sched_timer, (delay > 0) ? (uint32_t)delay : 1);
+}
+
+static void SCHED_Clear(void) {
+    for(uint8_t i = 0; i < SCHED_MAX_ENTRIES; i++) {
+        sched_free[i] = i;
+    }
+    sched_count = 0;
+}
+
+void SCHED_Init(void) {
+    SCHED_Clear();
+    sched_timer = osTimerNew(SCHED_TimerCallback, osTimerOnce, NULL, &sched_timer_attributes);
+}
+
+/* ==================== OPERATIONS ==================== */
+
+static SCHED_Result_t SCHED_Add(const uint8_t* params, uint16_t length) {
+    const CommandPacket_t* cmd = (const CommandPacket_t*)&params[5];
+    uint16_t frame_length = length - 5;
+    uint16_t rx_crc;
+    uint32_t time_ms;
+    uint32_t now = SCHED_Now();
+    SCHED_Entry_t* entry;
+    uint8_t slot;
+    
+    /* Only v2 frames fit; ProcessCommand checks them again when they run,
+     * this is so the ground hears about a bad one now */
+    if(length < 5 + CMD_HEADER_SIZE + 2 || frame_length > SCHED_MAX_FRAME ||
+       cmd->sync2 != 0x5B || CommandFrameLength(cmd) != frame_length) {
+        return SCHED_ERR_FRAME;
+    }
+    memcpy(&rx_crc, &params[length - 2], sizeof(rx_crc));
+    if(CRC16_Calculate(cmd, frame_length - 2) != rx_crc ||
+       cmd->command_id == CMD_SET_SCHEDULE) {
+        return SCHED_ERR_FRAME;
+    }
+    
+    if(sched_count >= SCHED_MAX_ENTRIES) {
+        return SCHED_ERR_FULL;
+    }
+    
+    /* A time that has passed runs at once */
+    memcpy(&time_ms, &params[1], sizeof(time_ms));
+    if((int32_t)(time_ms - now) < 0) {
+        time_ms = now;
+    }
+    
+    slot = sched_free[SCHED_MAX_ENTRIES - 1 - sched_count];
+    entry = &sched_pool[slot];
+    entry->time_ms = time_ms;
+    entry->order = sched_order++;
+    entry->length = (uint8_t)frame_length;
+    memcpy(entry->frame, cmd, frame_length);
+    
+    sched_heap[sched_count] = slot;
+    sched_count++;
+    SCHED_SiftUp(sched_count - 1);
+    return SCHED_OK;
+}
+
+/* Every entry carrying this sequence number */
+static SCHED_Result_t SCHED_Cancel(uint16_t seq) {
+    SCHED_Result_t result = SCHED_ERR_NOT_FOUND;
+    uint8_t i = 0;
+    
+    while(i < sched_count) {
+        if(SCHED_Sequence(sched_heap[i]) == seq) {
+            SCHED_Remove(i);
+            result = SCHED_OK;
+            i = 0;  /* Removal reorders the heap */
+        } else {
+            i++;
+        }
+    }
+    return result;
+}
+
+static void SCHED_SendStatus(uint8_t result) {
+    uint8_t frame[SCHED_STATUS_FRAME_SIZE];
+    uint32_t now = SCHED_Now();
+    uint32_t next = 0xFFFFFFFF;
+    uint16_t next_seq = 0xFFFF;
+    uint16_t crc;
+    
+    if(sched_count > 0) {
+        next = sched_pool[sched_heap[0]].time_ms;
+        next_seq = SCHED_Sequence(sched_heap[0]);
+    }
+    
+    frame[0] = 0xAA;
+    frame[1] = 0x61;
+    frame[2] = result;
+    frame[3] = sched_count;
+    memcpy(&frame[4], &now, sizeof(now));
+    memcpy(&frame[8], &next, sizeof(next));
+    memcpy(&frame[12], &next_seq, sizeof(next_seq));
+    crc = CRC16_Calculate(frame, SCHED_STATUS_FRAME_SIZE - 2);
+    memcpy(&frame[14], &crc, sizeof(crc));
+    
+    if(COMM_Transmit(&huart1, frame, sizeof(frame)) != HAL_OK) {
+        LogError(ERROR_UART);
+    }
+}
+
+/* CMD_SET_SCHEDULE, from ProcessCommand in CommTask */
+void SCHED_HandleCommand(const uint8_t* params, uint16_t length) {
+    SCHED_Result_t result = SCHED_OK;
+    uint16_t seq;
+    uint8_t op = (length >= 1) ? params[0] : SCHED_OP_STATUS;
+    
+    switch(op) {
+        case SCHED_OP_ADD:
+            result = SCHED_Add(params, length);
+            break;
+        
+        case SCHED_OP_CANCEL:
+            if(length < 3) {
+                result = SCHED_ERR_FRAME;
+                break;
+            }
+            memcpy(&seq, &params[1], sizeof(seq));
+            result = SCHED_Cancel(seq);
+            break;
+        
+        case SCHED_OP_CLEAR:
+            SCHED_Clear();
+            break;
+        
+        case SCHED_OP_STATUS:
+            break;
+        
+        default:
+            result = SCHED_ERR_OP;
+            break;
+    }
+    
+    SCHED_Rearm();
+    SCHED_SendStatus(result);
+}
+
+/* CommTask, on COMM_EVT_SCHEDULE */
+void SCHED_RunDue(void) {
+    SCHED_Entry_t* entry;
+    
+    while(sched_count > 0) {
+        entry = &sched_pool[sched_heap[0]];
+        if((int32_t)(entry->time_ms - SCHED_Now()) > 0) {
+            break;
+        }
+        
+        /* Copied out first - removing frees the slot */
+        memcpy(&sched_run, entry->frame, entry->length);
+        SCHED_Remove(0);
+        DIAG_TIMED(DIAG_COMMAND, ProcessCommand(&sched_run));
+    }
+    
+    SCHED_Rearm();
+}
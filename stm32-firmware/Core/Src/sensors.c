@@ -1,5 +1,6 @@
 /* sensors.c - Sensor Implementation */
 #include "sensors.h"
+#include "i2c_bus.h"
 
 /* BME280 Calibration Data */
 static struct {
@@ -23,11 +24,25 @@ static struct {
     int8_t   dig_H6;
 } bme280_cal;
 
+/* Fine temperature shared by the pressure and humidity compensation.
+ * Updated by every temperature compensation, so temperature must be
+ * compensated first from the same burst read. */
+static int32_t bme280_t_fine = 0;
+
+/* BME280 Acquisition Profiles */
+static const BME280_Profile_t bme280_profiles[BME280_PROFILE_COUNT] = {
+    /* STANDARD  */ { 0x01, (0x02 << 5) | (0x03 << 2), 0x00 },
+    /* LOW_POWER */ { 0x01, (0x01 << 5) | (0x01 << 2), 0x00 },
+    /* HIGH_RES  */ { 0x01, (0x02 << 5) | (0x05 << 2), (0x02 << 2) },
+};
+
+static uint8_t bme280_profile = BME280_PROFILE_STANDARD;
+
 HAL_StatusTypeDef Sensors_Init(void) {
     /* Read BME280 calibration data */
     uint8_t cal_data[32];
     
-    if(HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR, 0x88, I2C_MEMADD_SIZE_8BIT, 
+    if(HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR << 1, 0x88, I2C_MEMADD_SIZE_8BIT, 
                          cal_data, 24, HAL_MAX_DELAY) != HAL_OK) {
         return HAL_ERROR;
     }
@@ -48,17 +63,266 @@ HAL_StatusTypeDef Sensors_Init(void) {
     bme280_cal.dig_P9 = (int16_t)(cal_data[23] << 8 | cal_data[22]);
     
     /* Read humidity calibration */
-    HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR, 0xA1, I2C_MEMADD_SIZE_8BIT, 
+    HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR << 1, 0xA1, I2C_MEMADD_SIZE_8BIT, 
                      &bme280_cal.dig_H1, 1, HAL_MAX_DELAY);
     
-    HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR, 0xE1, I2C_MEMADD_SIZE_8BIT, 
+    HAL_I2C_Mem_Read(&hi2c1, BME280_ADDR << 1, 0xE1, I2C_MEMADD_SIZE_8BIT, 
                      cal_data, 7, HAL_MAX_DELAY);
     
     bme280_cal.dig_H2 = (int16_t)(cal_data[1] << 8 | cal_data[0]);
     bme280_cal.dig_H3 = cal_data[2];
-    bme280_cal.dig_H4 = (int16_t)((cal_data[3] << 4) | (cal_data[4] & 0x0F));
-    bme280_cal.dig_H5 = (int16_t)((cal_data[5] << 4) | (cal_data[4] >> 4));
+    /* H4/H5 are signed 12-bit values sharing the nibbles of 0xE5 */
+    bme280_cal.dig_H4 = (int16_t)(((int8_t)cal_data[3] * 16) | (cal_data[4] & 0x0F));
+    bme280_cal.dig_H5 = (int16_t)(((int8_t)cal_data[5] * 16) | (cal_data[4] >> 4));
     bme280_cal.dig_H6 = (int8_t)cal_data[6];
     
     return HAL_OK;
-}
\ No newline at end of file
+}
+
+/* ==================== BME280 ACQUISITION ==================== */
+
+static HAL_StatusTypeDef BME280_WriteReg(uint8_t reg, uint8_t value) {
+    I2CBUS_Transaction_t txn = {
+        .dev_addr = BME280_ADDR, .reg = reg, .is_read = 0, .data = &value,
+        .length = 1, .timeout_ms = I2C_SENSOR_TIMEOUT_MS
+    };
+    
+    if(I2CBUS_Submit(&txn) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return I2CBUS_Wait(&txn);
+}
+
+/* Load a profile while the sensor sleeps. ctrl_hum only latches on the
+ * next ctrl_meas write, which is the trigger. */
+HAL_StatusTypeDef BME280_SetProfile(uint8_t profile) {
+    const BME280_Profile_t* p;
+    
+    if(profile >= BME280_PROFILE_COUNT) {
+        return HAL_ERROR;
+    }
+    
+    p = &bme280_profiles[profile];
+    if(BME280_WriteReg(0xF2, p->ctrl_hum) != HAL_OK ||
+       BME280_WriteReg(0xF5, p->config) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    
+    bme280_profile = profile;
+    return HAL_OK;
+}
+
+uint8_t BME280_ProfileForState(uint8_t state) {
+    switch(state) {
+        case STATE_LOW_POWER:
+        case STATE_EMERGENCY:
+            return BME280_PROFILE_LOW_POWER;
+            
+        case STATE_SAFE:
+            return BME280_PROFILE_HIGH_RES;  /* Thermal watch while payload is off */
+            
+        default:
+            return BME280_PROFILE_STANDARD;
+    }
+}
+
+/* Oversampling register code to sample count: 0 = skipped, 1..5 = x1..x16 */
+static uint32_t BME280_Oversampling(uint8_t code) {
+    return (code == 0) ? 0 : (1u << (code - 1));
+}
+
+/* Maximum forced conversion time of the active profile in ms, rounded
+ * up (datasheet section 9.1) */
+uint32_t BME280_MeasureTime(void) {
+    const BME280_Profile_t* p = &bme280_profiles[bme280_profile];
+    uint32_t osrs_t = BME280_Oversampling((p->ctrl_meas >> 5) & 0x07);
+    uint32_t osrs_p = BME280_Oversampling((p->ctrl_meas >> 2) & 0x07);
+    uint32_t osrs_h = BME280_Oversampling(p->ctrl_hum & 0x07);
+    uint32_t us = 1250 + 2300 * osrs_t;
+    
+    if(osrs_p) {
+        us += 2300 * osrs_p + 575;
+    }
+    if(osrs_h) {
+        us += 2300 * osrs_h + 575;
+    }
+    
+    return (us + 999) / 1000;
+}
+
+/* Start one forced-mode conversion; the sensor returns to sleep after */
+HAL_StatusTypeDef BME280_TriggerMeasurement(void) {
+    return BME280_WriteReg(0xF4, bme280_profiles[bme280_profile].ctrl_meas | 0x01);
+}
+
+/* ==================== BME280 COMPENSATION ==================== */
+/* Bosch BME280 datasheet section 4.2.3 / 8.2. */
+
+/* Returns temperature in 0.01 degC, e.g. 5123 = 51.23 degC */
+int32_t BME280_CompensateTemperatureFixed(int32_t raw_temp) {
+    int32_t var1, var2;
+    
+    var1 = ((((raw_temp >> 3) - ((int32_t)bme280_cal.dig_T1 << 1))) *
+            ((int32_t)bme280_cal.dig_T2)) >> 11;
+    var2 = (((((raw_temp >> 4) - ((int32_t)bme280_cal.dig_T1)) *
+              ((raw_temp >> 4) - ((int32_t)bme280_cal.dig_T1))) >> 12) *
+            ((int32_t)bme280_cal.dig_T3)) >> 14;
+    bme280_t_fine = var1 + var2;
+    
+    return (bme280_t_fine * 5 + 128) >> 8;
+}
+
+/* Returns pressure in Pa as Q24.8, e.g. 24674867 = 96386.2 Pa */
+uint32_t BME280_CompensatePressureFixed(int32_t raw_press) {
+    int64_t var1, var2, p;
+    
+    var1 = ((int64_t)bme280_t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t)bme280_cal.dig_P6;
+    var2 = var2 + ((var1 * (int64_t)bme280_cal.dig_P5) << 17);
+    var2 = var2 + (((int64_t)bme280_cal.dig_P4) << 35);
+    var1 = ((var1 * var1 * (int64_t)bme280_cal.dig_P3) >> 8) +
+           ((var1 * (int64_t)bme280_cal.dig_P2) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)bme280_cal.dig_P1) >> 33;
+    
+    if(var1 == 0) {
+        return 0;  /* Avoid division by zero (no calibration) */
+    }
+    
+    p = 1048576 - raw_press;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)bme280_cal.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)bme280_cal.dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)bme280_cal.dig_P7) << 4);
+    
+    return (uint32_t)p;
+}
+
+/* Returns humidity in %RH as Q22.10, e.g. 47445 = 46.333 %RH */
+uint32_t BME280_CompensateHumidityFixed(int32_t raw_hum) {
+    int32_t v;
+    
+    v = bme280_t_fine - ((int32_t)76800);
+    v = (((((raw_hum << 14) - (((int32_t)bme280_cal.dig_H4) << 20) -
+            (((int32_t)bme280_cal.dig_H5) * v)) + ((int32_t)16384)) >> 15) *
+         (((((((v * ((int32_t)bme280_cal.dig_H6)) >> 10) *
+              (((v * ((int32_t)bme280_cal.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+            ((int32_t)2097152)) * ((int32_t)bme280_cal.dig_H2) + 8192) >> 14));
+    v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)bme280_cal.dig_H1)) >> 4));
+    v = (v < 0) ? 0 : v;
+    v = (v > 419430400) ? 419430400 : v;
+    
+    return (uint32_t)(v >> 12);
+}
+
+/* Floating-point reference path, returns degC */
+float BME280_CompensateTemperatureFloat(int32_t raw_temp) {
+    float var1, var2;
+    
+    var1 = ((float)raw_temp / 16384.0f - (float)bme280_cal.dig_T1 / 1024.0f) *
+           (float)bme280_cal.dig_T2;
+    var2 = ((float)raw_temp / 131072.0f - (float)bme280_cal.dig_T1 / 8192.0f);
+    var2 = var2 * var2 * (float)bme280_cal.dig_T3;
+    bme280_t_fine = (int32_t)(var1 + var2);
+    
+    return (var1 + var2) / 5120.0f;
+}
+
+/* Floating-point reference path, returns Pa */
+float BME280_CompensatePressureFloat(int32_t raw_press) {
+    float var1, var2, p;
+    
+    var1 = ((float)bme280_t_fine / 2.0f) - 64000.0f;
+    var2 = var1 * var1 * (float)bme280_cal.dig_P6 / 32768.0f;
+    var2 = var2 + var1 * (float)bme280_cal.dig_P5 * 2.0f;
+    var2 = (var2 / 4.0f) + ((float)bme280_cal.dig_P4 * 65536.0f);
+    var1 = ((float)bme280_cal.dig_P3 * var1 * var1 / 524288.0f +
+            (float)bme280_cal.dig_P2 * var1) / 524288.0f;
+    var1 = (1.0f + var1 / 32768.0f) * (float)bme280_cal.dig_P1;
+    
+    if(var1 == 0.0f) {
+        return 0.0f;
+    }
+    
+    p = 1048576.0f - (float)raw_press;
+    p = (p - (var2 / 4096.0f)) * 6250.0f / var1;
+    var1 = (float)bme280_cal.dig_P9 * p * p / 2147483648.0f;
+    var2 = p * (float)bme280_cal.dig_P8 / 32768.0f;
+    
+    return p + (var1 + var2 + (float)bme280_cal.dig_P7) / 16.0f;
+}
+
+/* Floating-point reference path, returns %RH */
+float BME280_CompensateHumidityFloat(int32_t raw_hum) {
+    float h;
+    
+    h = (float)bme280_t_fine - 76800.0f;
+    h = ((float)raw_hum - ((float)bme280_cal.dig_H4 * 64.0f +
+                           (float)bme280_cal.dig_H5 / 16384.0f * h)) *
+        ((float)bme280_cal.dig_H2 / 65536.0f *
+         (1.0f + (float)bme280_cal.dig_H6 / 67108864.0f * h *
+                 (1.0f + (float)bme280_cal.dig_H3 / 67108864.0f * h)));
+    h = h * (1.0f - (float)bme280_cal.dig_H1 * h / 524288.0f);
+    
+    if(h > 100.0f) {
+        h = 100.0f;
+    } else if(h < 0.0f) {
+        h = 0.0f;
+    }
+    
+    return h;
+}
+
+/* Unit-level API used by the sensor task: degC, Pa, %RH */
+float BME280_CompensateTemperature(int32_t raw_temp) {
+#if BME280_USE_FIXED_POINT
+    return BME280_CompensateTemperatureFixed(raw_temp) / 100.0f;
+#else
+    return BME280_CompensateTemperatureFloat(raw_temp);
+#endif
+}
+
+float BME280_CompensatePressure(int32_t raw_press) {
+#if BME280_USE_FIXED_POINT
+    return BME280_CompensatePressureFixed(raw_press) / 256.0f;
+#else
+    return BME280_CompensatePressureFloat(raw_press);
+#endif
+}
+
+float BME280_CompensateHumidity(int32_t raw_hum) {
+#if BME280_USE_FIXED_POINT
+    return BME280_CompensateHumidityFixed(raw_hum) / 1024.0f;
+#else
+    return BME280_CompensateHumidityFloat(raw_hum);
+#endif
+}
+
+/* Microbenchmark - average DWT cycles for one full T/P/H conversion on
+ * each path, using the given raw sample and the loaded calibration. */
+void BME280_Benchmark(int32_t raw_temp, int32_t raw_press, int32_t raw_hum,
+                      BME280_Benchmark_t* result) {
+    volatile float sink = 0.0f;
+    uint32_t start;
+    uint32_t i;
+    
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    
+    start = DWT->CYCCNT;
+    for(i = 0; i < BME280_BENCHMARK_ITERATIONS; i++) {
+        sink = BME280_CompensateTemperatureFixed(raw_temp);
+        sink = BME280_CompensatePressureFixed(raw_press);
+        sink = BME280_CompensateHumidityFixed(raw_hum);
+    }
+    result->fixed_cycles = (DWT->CYCCNT - start) / BME280_BENCHMARK_ITERATIONS;
+    
+    start = DWT->CYCCNT;
+    for(i = 0; i < BME280_BENCHMARK_ITERATIONS; i++) {
+        sink = BME280_CompensateTemperatureFloat(raw_temp);
+        sink = BME280_CompensatePressureFloat(raw_press);
+        sink = BME280_CompensateHumidityFloat(raw_hum);
+    }
+    result->float_cycles = (DWT->CYCCNT - start) / BME280_BENCHMARK_ITERATIONS;
+    
+    (void)sink;
+}
@@ -1,8 +1,27 @@
 /* system.c - System Management Implementation */
 #include "system.h"
+#include "mag_stream.h"
+#include "radiation.h"
+#include "battery.h"
+#include "cmsis_os.h"
 
-static uint32_t last_health_check = 0;
-static uint8_t task_health[4] = {0};
+extern uint32_t boot_count;
+
+typedef struct {
+    uint32_t period_ms;        /* 0 = event driven, no jitter */
+    uint32_t deadline_ms;
+    uint32_t last_tick;        /* ms */
+    uint32_t last_us;
+    uint8_t  late;             /* Missed deadline already counted */
+    SUPV_Stats_t stats;
+} SUPV_Task_t;
+
+static SUPV_Task_t supv_tasks[SUPV_TASK_COUNT] = {
+    [SUPV_TASK_SENSOR]    = { SUPV_SENSOR_PERIOD_MS, SUPV_SENSOR_DEADLINE_MS },
+    [SUPV_TASK_RADIATION] = { 0, SUPV_EVENT_DEADLINE_MS },
+    [SUPV_TASK_COMM]      = { 0, SUPV_EVENT_DEADLINE_MS },
+    [SUPV_TASK_DOWNLINK]  = { 0, SUPV_EVENT_DEADLINE_MS },
+};
 
 void SYSTEM_Init(void) {
     boot_count++;
@@ -11,26 +30,259 @@ void SYSTEM_Init(void) {
     /* Increment boot counter */
 }
 
-void SYSTEM_CheckHealth(void) {
-    uint32_t current_time = HAL_GetTick();
+/* ==================== TASK SUPERVISION ==================== */
+
+static uint32_t SUPV_Now(void) {
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+/* Microseconds from the tick count plus the SysTick phase. Wraps after
+ * 71 minutes, which differences survive. Task context only - the tick
+ * interrupt has to be able to run between the two count reads. */
+static uint32_t SUPV_Micros(void) {
+    uint32_t ticks;
+    uint32_t phase;
+    uint32_t reload;
+    
+    do {
+        ticks = xTaskGetTickCount();
+        phase = SysTick->LOAD - SysTick->VAL;
+    } while(ticks != xTaskGetTickCount());
     
-    if((current_time - last_health_check) > 60000) {  /* Check every minute */
-        /* Check if tasks are responding */
-        task_health[0] = (osThreadGetState(sensorTaskHandle) == osThreadRunning);
-        task_health[1] = (osThreadGetState(radiationTaskHandle) == osThreadRunning);
-        task_health[2] = (osThreadGetState(commTaskHandle) == osThreadRunning);
-        task_health[3] = (osThreadGetState(watchdogTaskHandle) == osThreadRunning);
-        
-        last_health_check = current_time;
+    reload = SysTick->LOAD + 1;
+    return ticks * (portTICK_PERIOD_MS * 1000) + (phase * (portTICK_PERIOD_MS * 1000)) / reload;
+}
+
+void SYSTEM_Heartbeat(SUPV_TaskId_t task) {
+    SUPV_Task_t* t = &supv_tasks[task];
+    uint32_t now = SUPV_Now();
+    uint32_t now_us = SUPV_Micros();
+    uint32_t interval;
+    uint32_t jitter;
+    
+    taskENTER_CRITICAL();
+    if(t->stats.beats > 0) {
+        interval = now - t->last_tick;
+        if(interval > t->stats.max_interval_ms) {
+            t->stats.max_interval_ms = interval;
+        }
+        if(t->period_ms) {
+            jitter = now_us - t->last_us;
+            jitter = (jitter > t->period_ms * 1000) ? jitter - t->period_ms * 1000
+                                                    : t->period_ms * 1000 - jitter;
+            if(jitter > t->stats.max_jitter_us) {
+                t->stats.max_jitter_us = jitter;
+            }
+        }
+        if(interval > t->deadline_ms && !t->late) {
+            t->stats.missed++;
+        }
     }
+    t->last_tick = now;
+    t->last_us = now_us;
+    t->late = 0;
+    t->stats.beats++;
+    taskEXIT_CRITICAL();
 }
 
+/* A task that has not beaten yet is given the startup grace instead of
+ * its deadline */
 uint8_t SYSTEM_CheckTaskHealth(void) {
-    return (task_health[0] && task_health[1] && 
-            task_health[2] && task_health[3]);
+    uint32_t now = SUPV_Now();
+    uint8_t healthy = 1;
+    
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < SUPV_TASK_COUNT; i++) {
+        SUPV_Task_t* t = &supv_tasks[i];
+        uint8_t on_time = (t->stats.beats > 0) ? (now - t->last_tick) <= t->deadline_ms
+                                               : now <= SUPV_STARTUP_GRACE_MS;
+        if(!on_time) {
+            if(!t->late) {
+                t->late = 1;
+                t->stats.missed++;
+            }
+            healthy = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+    
+    return healthy;
+}
+
+/* The only place the IWDG is fed once the scheduler runs */
+uint8_t SYSTEM_RefreshWatchdog(void) {
+    if(SYSTEM_CheckTaskHealth()) {
+        HAL_IWDG_Refresh(&hiwdg);
+        return 1;
+    }
+    LogError(ERROR_TASK_HANG);
+    return 0;
+}
+
+void SYSTEM_GetTaskStats(SUPV_Stats_t* stats, uint8_t reset) {
+    taskENTER_CRITICAL();
+    for(uint8_t i = 0; i < SUPV_TASK_COUNT; i++) {
+        stats[i] = supv_tasks[i].stats;
+        if(reset) {
+            /* Keep beats so the next interval is still measured */
+            supv_tasks[i].stats.max_interval_ms = 0;
+            supv_tasks[i].stats.max_jitter_us = 0;
+            supv_tasks[i].stats.missed = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
 }
 
 void SYSTEM_ResetSystem(void) {
     HAL_Delay(100);
     NVIC_SystemReset();
-}
\ No newline at end of file
+}
+
+/* ==================== POWER MANAGEMENT ==================== */
+
+#if (configUSE_TICKLESS_IDLE != 2)
+#error "STOP-mode idle needs configUSE_TICKLESS_IDLE 2 in FreeRTOSConfig.h"
+#endif
+
+/* Written by the idle task with interrupts masked */
+static uint32_t power_stop_entries = 0;
+static uint32_t power_stop_ms = 0;
+
+/* Gate what is idle while the core is stopped. Register contents
+ * survive clock gating, so restarting needs no re-init. */
+void SYSTEM_ShutdownPeripherals(void) {
+    /* Magnetometer data-ready would wake STOP at 155 Hz */
+    HAL_NVIC_DisableIRQ(EXTI1_IRQn);
+    
+    __HAL_RCC_I2C1_CLK_DISABLE();
+    __HAL_RCC_SPI1_CLK_DISABLE();
+    __HAL_RCC_ADC1_CLK_DISABLE();
+    
+    /* TIM2 halts in STOP - count the tube on EXTI0 instead */
+    RAD_EnterStop();
+}
+
+void SYSTEM_RestartPeripherals(void) {
+    RAD_ExitStop();
+    
+    __HAL_RCC_I2C1_CLK_ENABLE();
+    __HAL_RCC_SPI1_CLK_ENABLE();
+    __HAL_RCC_ADC1_CLK_ENABLE();
+    
+    HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+    MAG_StreamKick();  /* DRDY may have risen while masked */
+}
+
+/* Enter STOP with the low-power regulator. Returns after wakeup with
+ * the core still on HSI - call SYSTEM_ExitLowPower next. */
+void SYSTEM_EnterLowPower(void) {
+    SYSTEM_ShutdownPeripherals();
+    HAL_SuspendTick();
+    HAL_PWREx_EnableFlashPowerDown();
+    
+    /* A Geiger pulse only needs counting: go straight back down on HSI
+     * unless the RTC deadline fired too */
+    do {
+        HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+    } while(RAD_StopWakeup() && !__HAL_RTC_WAKEUPTIMER_EXTI_GET_FLAG());
+}
+
+void SYSTEM_ExitLowPower(void) {
+    /* STOP drops back to HSI - bring HSE and the PLL back */
+    SystemClock_Config();
+    HAL_PWREx_DisableFlashPowerDown();
+    HAL_ResumeTick();
+    SYSTEM_RestartPeripherals();
+}
+
+/* RTC time of day in ms. The RTC keeps running in STOP, so the
+ * difference across a sleep is how long we were really asleep. */
+static uint32_t SYSTEM_RtcMillis(void) {
+    uint32_t ssr = hrtc.Instance->SSR;
+    uint32_t tr = hrtc.Instance->TR;   /* Reading SSR froze TR/DR... */
+    uint32_t dr = hrtc.Instance->DR;   /* ...until DR is read */
+    uint32_t hours, minutes, seconds;
+    
+    (void)dr;
+    hours   = ((tr >> 20) & 0x3) * 10 + ((tr >> 16) & 0xF);
+    minutes = ((tr >> 12) & 0x7) * 10 + ((tr >> 8) & 0xF);
+    seconds = ((tr >> 4) & 0x7) * 10 + (tr & 0xF);
+    
+    return ((hours * 60 + minutes) * 60 + seconds) * 1000 +
+           ((POWER_RTC_SYNC_PREDIV - ssr) * 1000) / (POWER_RTC_SYNC_PREDIV + 1);
+}
+
+/* FreeRTOS tickless idle hook: called from the idle task when every task
+ * is blocked for at least configEXPECTED_IDLE_TIME_BEFORE_SLEEP ticks. */
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime) {
+    uint32_t sleep_ms = xExpectedIdleTime * portTICK_PERIOD_MS;
+    uint32_t start, slept;
+    
+    /* STOP only when battery-starved and nothing is mid-transfer: DMA
+     * and the I2C/SPI/ADC kernels halt with the core. Otherwise sleep until
+     * the next tick as before. */
+    if(system_state != STATE_LOW_POWER || sleep_ms < POWER_MIN_STOP_MS ||
+       hi2c1.State != HAL_I2C_STATE_READY ||
+       hspi1.State != HAL_SPI_STATE_READY || !BATT_SequenceIdle() ||
+       huart1.gState != HAL_UART_STATE_READY ||
+       huart2.gState != HAL_UART_STATE_READY) {
+        __DSB();
+        __WFI();
+        return;
+    }
+    
+    __disable_irq();
+    __DSB();
+    __ISB();
+    
+    if(eTaskConfirmSleepModeStatus() == eAbortSleep) {
+        __enable_irq();
+        return;
+    }
+    
+    /* Wake just ahead of the deadline so the clock is back up in time;
+     * the 16-bit counter caps one STOP at ~32 s */
+    sleep_ms -= POWER_STOP_WAKE_MARGIN_MS;
+    if(sleep_ms > (0xFFFFu * 1000u) / POWER_RTC_WAKEUP_HZ) {
+        sleep_ms = (0xFFFFu * 1000u) / POWER_RTC_WAKEUP_HZ;
+    }
+    
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    start = SYSTEM_RtcMillis();
+    HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, (sleep_ms * POWER_RTC_WAKEUP_HZ) / 1000 - 1,
+                                RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+    
+    SYSTEM_EnterLowPower();
+    SYSTEM_ExitLowPower();
+    
+    HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
+    
+    /* Shadow registers are stale after STOP until the next RTC sync */
+    HAL_RTC_WaitForSynchro(&hrtc);
+    slept = (SYSTEM_RtcMillis() + 86400000u - start) % 86400000u;
+    if(slept > xExpectedIdleTime * portTICK_PERIOD_MS) {
+        slept = xExpectedIdleTime * portTICK_PERIOD_MS;
+    }
+    
+    /* Account for the sleep and restart the tick */
+    vTaskStepTick(slept / portTICK_PERIOD_MS);
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    power_stop_entries++;
+    power_stop_ms += slept;
+    
+    /* Let the wakeup interrupt (or any EXTI) run */
+    __enable_irq();
+}
+
+/* STOP entries and ms spent in STOP since start or the last reset */
+void SYSTEM_GetStopStats(uint32_t* entries, uint32_t* stop_ms, uint8_t reset) {
+    taskENTER_CRITICAL();
+    *entries = power_stop_entries;
+    *stop_ms = power_stop_ms;
+    if(reset) {
+        power_stop_entries = 0;
+        power_stop_ms = 0;
+    }
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,86 @@
+/* telemetry.c - Telemetry Snapshot */
+#include "telemetry.h"
+#include "crc.h"
+#include "cmsis_os.h"
+#include <string.h>
+
+static TelemetryPacket_t tlm_buffer[2];
+
+/* Odd while a publish is in progress. The live buffer is
+ * tlm_buffer[(tlm_seq >> 1) & 1]; a publish writes the other one. */
+static volatile uint32_t tlm_seq = 0;
+
+/* Writer side - takes the lock and returns the spare buffer, already
+ * holding a copy of the live snapshot. Usable from ISRs. */
+static TelemetryPacket_t* TLM_WriteBegin(UBaseType_t* lock) {
+    TelemetryPacket_t* spare;
+    
+    *lock = taskENTER_CRITICAL_FROM_ISR();
+    spare = &tlm_buffer[((tlm_seq >> 1) + 1) & 1];
+    tlm_seq++;
+    *spare = tlm_buffer[(tlm_seq >> 1) & 1];
+    
+    return spare;
+}
+
+static void TLM_WriteEnd(TelemetryPacket_t* spare, UBaseType_t lock) {
+    spare->sync1 = 0xAA;
+    spare->sync2 = 0x55;
+    spare->packet_type = 0x01;
+    spare->timestamp = HAL_GetTick();
+    spare->checksum = CRC16_Calculate(spare, sizeof(TelemetryPacket_t) - 2);
+    
+    tlm_seq++;  /* Even again, spare is now live */
+    taskEXIT_CRITICAL_FROM_ISR(lock);
+}
+
+void TLM_PublishSensors(const TelemetryPacket_t* staged) {
+    UBaseType_t lock;
+    TelemetryPacket_t* p = TLM_WriteBegin(&lock);
+    
+    p->sequence_number = staged->sequence_number;
+    p->mag_x = staged->mag_x;
+    p->mag_y = staged->mag_y;
+    p->mag_z = staged->mag_z;
+    p->corrosion_raw = staged->corrosion_raw;
+    p->temperature_bme = staged->temperature_bme;
+    p->pressure = staged->pressure;
+    p->humidity = staged->humidity;
+    p->temperature_tmp = staged->temperature_tmp;
+    p->battery_voltage = staged->battery_voltage;
+    p->battery_current = staged->battery_current;
+    p->boot_count = staged->boot_count;
+    p->system_state = staged->system_state;
+    p->uptime = staged->uptime;
+    
+    TLM_WriteEnd(p, lock);
+}
+
+void TLM_PublishRadiation(uint32_t cps, const uint16_t* hist) {
+    UBaseType_t lock;
+    TelemetryPacket_t* p = TLM_WriteBegin(&lock);
+    
+    p->radiation_cps = cps;
+    memcpy(p->radiation_hist, hist, sizeof(p->radiation_hist));
+    
+    TLM_WriteEnd(p, lock);
+}
+
+void TLM_LogError(uint8_t error_code) {
+    UBaseType_t lock;
+    TelemetryPacket_t* p = TLM_WriteBegin(&lock);
+    
+    p->error_flags |= error_code;
+    
+    TLM_WriteEnd(p, lock);
+}
+
+const TelemetryPacket_t* TLM_Acquire(uint32_t* seq) {
+    *seq = tlm_seq & ~1u;
+    return &tlm_buffer[(*seq >> 1) & 1];
+}
+
+uint8_t TLM_Release(uint32_t seq) {
+    /* One publish only writes the other buffer; a second starts on ours */
+    return (tlm_seq - seq) <= 2;
+}
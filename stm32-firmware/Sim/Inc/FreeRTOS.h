@@ -0,0 +1,22 @@
+/* FreeRTOS.h - Host Simulation FreeRTOS Types */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+#include <stdint.h>
+#include <stddef.h>
+#include "FreeRTOSConfig.h"
+typedef uint32_t TickType_t; typedef long BaseType_t; typedef unsigned long UBaseType_t; typedef uint32_t StackType_t;
+typedef struct { void *dummy[24]; } StaticTask_t; typedef struct { void *dummy[20]; } StaticQueue_t; typedef struct { void *dummy[11]; } StaticTimer_t;
+typedef StaticQueue_t StaticSemaphore_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
+#define portTICK_PERIOD_MS 1
+#define configASSERT(x) ((void)(x))
+void vPortEnterCritical(void); void vPortExitCritical(void);
+#define portYIELD_FROM_ISR(x) ((void)(x))
+#define portSUPPRESS_TICKS_AND_SLEEP(x) vPortSuppressTicksAndSleep(x)
+void vPortSuppressTicksAndSleep(TickType_t);
+size_t xPortGetFreeHeapSize(void); size_t xPortGetMinimumEverFreeHeapSize(void);
+#endif
@@ -0,0 +1,14 @@
+/* FreeRTOSConfig.h - Host Simulation Kernel Configuration
+ *
+ * Only the values the firmware sources read, matching the target. */
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY (5 << 4)
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY 15
+#define configTICK_RATE_HZ 1000
+#define configUSE_TICKLESS_IDLE 2
+#define configMAX_PRIORITIES 56
+#define configMINIMAL_STACK_SIZE 128
+#define configTOTAL_HEAP_SIZE 15360
+#endif
@@ -0,0 +1,47 @@
+/* cmsis_os.h - Host Simulation CMSIS-RTOS2 API
+ *
+ * The subset of the CMSIS-RTOS2 interface the firmware calls. There is
+ * no scheduler: hal_sim.c runs everything on the calling thread, thread
+ * flags just accumulate and software timers fire from SIM_AdvanceTick.
+ */
+#ifndef CMSIS_OS_H_
+#define CMSIS_OS_H_
+#include <stdint.h>
+#include <stddef.h>
+#include "FreeRTOS.h"
+#include "task.h"
+typedef void *osThreadId_t; typedef void *osMessageQueueId_t; typedef void *osTimerId_t; typedef void *osSemaphoreId_t; typedef void *osMutexId_t; typedef void *osEventFlagsId_t;
+typedef void (*osThreadFunc_t)(void*); typedef void (*osTimerFunc_t)(void*);
+typedef enum { osOK=0, osError=-1, osErrorTimeout=-2, osErrorResource=-3, osErrorParameter=-4 } osStatus_t;
+typedef enum { osThreadInactive=0, osThreadReady=1, osThreadRunning=2, osThreadBlocked=3, osThreadTerminated=4, osThreadError=-1 } osThreadState_t;
+typedef enum { osPriorityNone=0, osPriorityIdle=1, osPriorityLow=8, osPriorityBelowNormal=16, osPriorityNormal=24, osPriorityAboveNormal=32, osPriorityHigh=40, osPriorityRealtime=48 } osPriority_t;
+typedef enum { osTimerOnce=0, osTimerPeriodic=1 } osTimerType_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; void *stack_mem; uint32_t stack_size; osPriority_t priority; uint32_t tz_module; uint32_t reserved; } osThreadAttr_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; void *mq_mem; uint32_t mq_size; } osMessageQueueAttr_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; } osTimerAttr_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; } osSemaphoreAttr_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; } osMutexAttr_t;
+typedef struct { const char *name; uint32_t attr_bits; void *cb_mem; uint32_t cb_size; } osEventFlagsAttr_t;
+#define osWaitForever 0xFFFFFFFFU
+#define osFlagsWaitAny 0u
+#define osFlagsWaitAll 1u
+#define osFlagsNoClear 2u
+#define osFlagsError 0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+osStatus_t osKernelInitialize(void); osStatus_t osKernelStart(void); uint32_t osKernelGetTickCount(void); uint32_t osKernelGetTickFreq(void);
+osThreadId_t osThreadNew(osThreadFunc_t, void*, const osThreadAttr_t*);
+osThreadState_t osThreadGetState(osThreadId_t); osThreadId_t osThreadGetId(void);
+uint32_t osThreadGetStackSpace(osThreadId_t); const char *osThreadGetName(osThreadId_t);
+uint32_t osThreadFlagsSet(osThreadId_t, uint32_t); uint32_t osThreadFlagsWait(uint32_t, uint32_t, uint32_t); uint32_t osThreadFlagsClear(uint32_t);
+osStatus_t osDelay(uint32_t); osStatus_t osDelayUntil(uint32_t);
+osMessageQueueId_t osMessageQueueNew(uint32_t, uint32_t, const osMessageQueueAttr_t*);
+osStatus_t osMessageQueuePut(osMessageQueueId_t, const void*, uint8_t, uint32_t);
+osStatus_t osMessageQueueGet(osMessageQueueId_t, void*, uint8_t*, uint32_t);
+uint32_t osMessageQueueGetCount(osMessageQueueId_t); uint32_t osMessageQueueGetSpace(osMessageQueueId_t);
+osTimerId_t osTimerNew(osTimerFunc_t, osTimerType_t, void*, const osTimerAttr_t*);
+osStatus_t osTimerStart(osTimerId_t, uint32_t); osStatus_t osTimerStop(osTimerId_t); uint32_t osTimerIsRunning(osTimerId_t);
+osSemaphoreId_t osSemaphoreNew(uint32_t, uint32_t, const osSemaphoreAttr_t*);
+osStatus_t osSemaphoreAcquire(osSemaphoreId_t, uint32_t); osStatus_t osSemaphoreRelease(osSemaphoreId_t);
+osMutexId_t osMutexNew(const osMutexAttr_t*); osStatus_t osMutexAcquire(osMutexId_t, uint32_t); osStatus_t osMutexRelease(osMutexId_t);
+osEventFlagsId_t osEventFlagsNew(const osEventFlagsAttr_t*); uint32_t osEventFlagsSet(osEventFlagsId_t, uint32_t); uint32_t osEventFlagsWait(osEventFlagsId_t, uint32_t, uint32_t, uint32_t);
+#endif
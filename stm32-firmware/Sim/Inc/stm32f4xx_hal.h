@@ -0,0 +1,495 @@
+/* stm32f4xx_hal.h - Host Simulation HAL
+ *
+ * Stands in for the STM32F4 HAL and CMSIS device headers in the host
+ * build (Sim/Makefile): the same types, handles and constants the
+ * firmware uses, with the functions implemented by hal_sim.c. Register
+ * blocks are plain structs in host RAM, so register-level code compiles
+ * and runs but drives nothing. The target build never sees this file.
+ */
+#ifndef __STM32F4XX_HAL_H
+#define __STM32F4XX_HAL_H
+#include <stdint.h>
+#include <stddef.h>
+#define __IO volatile
+typedef enum { HAL_OK=0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { RESET=0, SET=1 } FlagStatus;
+typedef enum { GPIO_PIN_RESET=0, GPIO_PIN_SET } GPIO_PinState;
+typedef struct { __IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2]; } GPIO_TypeDef;
+typedef struct { __IO uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, OAR1, OAR2, DR, SR1, SR2, CCR, TRISE, FLTR; } I2C_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SR, DR; } SPI_TypeDef;
+typedef struct { __IO uint32_t SR, CR1, CR2, SMPR1, SMPR2, DR; } ADC_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4; } TIM_TypeDef;
+typedef struct { __IO uint32_t DR, IDR, CR; } CRC_TypeDef;
+typedef struct { __IO uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR; } DMA_Stream_TypeDef;
+typedef struct { __IO uint32_t KR, PR, RLR, SR; } IWDG_TypeDef;
+typedef struct { __IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, OPTCR; } FLASH_TypeDef;
+typedef struct { __IO uint32_t CTRL, CYCCNT, CPICNT, EXCCNT, SLEEPCNT, LSUCNT, FOLDCNT, PCSR; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+typedef struct { __IO uint32_t CPUID, ICSR, VTOR, AIRCR, SCR, CCR; } SCB_Type;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL, CALIB; } SysTick_Type;
+typedef struct { __IO uint32_t TR, DR, CR, ISR, PRER, WUTR, SSR; } RTC_TypeDef;
+typedef struct { __IO uint32_t CR, CSR; } PWR_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+extern GPIO_TypeDef *GPIOA, *GPIOB, *GPIOC;
+extern USART_TypeDef *USART1, *USART2;
+extern I2C_TypeDef *I2C1; extern SPI_TypeDef *SPI1; extern ADC_TypeDef *ADC1;
+extern TIM_TypeDef *TIM1, *TIM2, *TIM3, *TIM4, *TIM5, *TIM9, *TIM10, *TIM11;
+extern CRC_TypeDef *CRC; extern IWDG_TypeDef *IWDG; extern FLASH_TypeDef *FLASH;
+extern DWT_Type *DWT; extern CoreDebug_Type *CoreDebug; extern SCB_Type *SCB; extern SysTick_Type *SysTick;
+extern RTC_TypeDef *RTC; extern PWR_TypeDef *PWR; extern EXTI_TypeDef *EXTI;
+extern DMA_Stream_TypeDef *DMA1_Stream5, *DMA1_Stream6, *DMA2_Stream0, *DMA2_Stream2, *DMA2_Stream7, *DMA2_Stream3, *DMA2_Stream4, *DMA2_Stream1, *DMA1_Stream0;
+extern uint32_t SystemCoreClock;
+#define DWT_CTRL_CYCCNTENA_Msk 1u
+#define CoreDebug_DEMCR_TRCENA_Msk (1u<<24)
+#define SCB_SCR_SLEEPDEEP_Msk (1u<<2)
+#define SCB_SCR_SLEEPONEXIT_Msk (1u<<1)
+typedef enum { NonMaskableInt_IRQn=-14, SysTick_IRQn=-1, EXTI0_IRQn=6, EXTI1_IRQn=7, DMA1_Stream0_IRQn=11, DMA1_Stream5_IRQn=16, DMA1_Stream6_IRQn=17, ADC_IRQn=18, EXTI9_5_IRQn=23, TIM1_BRK_TIM9_IRQn=24, TIM2_IRQn=28, TIM3_IRQn=29, TIM4_IRQn=30, I2C1_EV_IRQn=31, I2C1_ER_IRQn=32, SPI1_IRQn=35, USART1_IRQn=37, USART2_IRQn=38, RTC_WKUP_IRQn=3, TIM5_IRQn=50, DMA2_Stream0_IRQn=56, DMA2_Stream1_IRQn=57, DMA2_Stream2_IRQn=58, DMA2_Stream3_IRQn=59, DMA2_Stream4_IRQn=60, DMA2_Stream7_IRQn=70, FLASH_IRQn=4 } IRQn_Type;
+static inline uint32_t __REV(uint32_t x) { return __builtin_bswap32(x); }
+#define __DMB() __asm volatile("" ::: "memory")
+#define __DSB() __asm volatile("" ::: "memory")
+#define __ISB() __asm volatile("" ::: "memory")
+#define __WFI() ((void)0)
+#define __NOP() ((void)0)
+#define __disable_irq() ((void)0)
+#define __enable_irq() ((void)0)
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t x) { (void)x; }
+static inline uint32_t __get_IPSR(void) { return 0; }
+static inline void __set_MSP(uint32_t x) { (void)x; }
+#define UNUSED(x) ((void)(x))
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+#define ENABLE 1
+#define DISABLE 0
+typedef enum { HAL_UNLOCKED=0, HAL_LOCKED } HAL_LockTypeDef;
+/* GPIO */
+typedef struct { uint32_t Pin, Mode, Pull, Speed, Alternate; } GPIO_InitTypeDef;
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_MODE_INPUT 0u
+#define GPIO_MODE_OUTPUT_PP 1u
+#define GPIO_MODE_AF_PP 2u
+#define GPIO_MODE_AF_OD 0x12u
+#define GPIO_MODE_ANALOG 3u
+#define GPIO_MODE_IT_RISING 0x10110000u
+#define GPIO_MODE_IT_FALLING 0x10210000u
+#define GPIO_NOPULL 0u
+#define GPIO_PULLUP 1u
+#define GPIO_PULLDOWN 2u
+#define GPIO_SPEED_FREQ_LOW 0u
+#define GPIO_SPEED_FREQ_HIGH 2u
+#define GPIO_SPEED_FREQ_VERY_HIGH 3u
+#define GPIO_AF1_TIM2 1u
+#define GPIO_AF2_TIM3 2u
+#define GPIO_AF4_I2C1 4u
+#define GPIO_AF5_SPI1 5u
+#define GPIO_AF7_USART1 7u
+#define GPIO_AF7_USART2 7u
+void HAL_GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*);
+void HAL_GPIO_DeInit(GPIO_TypeDef*, uint32_t);
+void HAL_GPIO_WritePin(GPIO_TypeDef*, uint16_t, GPIO_PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef*, uint16_t);
+void HAL_GPIO_TogglePin(GPIO_TypeDef*, uint16_t);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t);
+void HAL_GPIO_EXTI_Callback(uint16_t);
+#define __HAL_GPIO_EXTI_CLEAR_IT(x) ((void)(x))
+/* DMA */
+typedef struct { uint32_t Channel, Direction, PeriphInc, MemInc, PeriphDataAlignment, MemDataAlignment, Mode, Priority, FIFOMode, FIFOThreshold, MemBurst, PeriphBurst; } DMA_InitTypeDef;
+typedef struct __DMA_HandleTypeDef { DMA_Stream_TypeDef *Instance; DMA_InitTypeDef Init; void *Parent; uint32_t ErrorCode; } DMA_HandleTypeDef;
+#define DMA_CHANNEL_0 0u
+#define DMA_CHANNEL_3 0x06000000u
+#define DMA_CHANNEL_4 0x08000000u
+#define DMA_CHANNEL_1 0x02000000u
+#define DMA_PERIPH_TO_MEMORY 0u
+#define DMA_MEMORY_TO_PERIPH 0x40u
+#define DMA_PINC_DISABLE 0u
+#define DMA_PINC_ENABLE 0x200u
+#define DMA_MINC_ENABLE 0x400u
+#define DMA_MINC_DISABLE 0u
+#define DMA_PDATAALIGN_BYTE 0u
+#define DMA_PDATAALIGN_HALFWORD 0x800u
+#define DMA_PDATAALIGN_WORD 0x1000u
+#define DMA_MDATAALIGN_BYTE 0u
+#define DMA_MDATAALIGN_HALFWORD 0x2000u
+#define DMA_MDATAALIGN_WORD 0x4000u
+#define DMA_NORMAL 0u
+#define DMA_CIRCULAR 0x100u
+#define DMA_PRIORITY_LOW 0u
+#define DMA_PRIORITY_MEDIUM 0x10000u
+#define DMA_PRIORITY_HIGH 0x20000u
+#define DMA_PRIORITY_VERY_HIGH 0x30000u
+#define DMA_FIFOMODE_DISABLE 0u
+#define DMA_IT_HT 0x08u
+#define DMA_IT_TC 0x10u
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef*);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef*);
+#define __HAL_DMA_DISABLE_IT(h, it) ((void)(h),(void)(it))
+#define __HAL_DMA_GET_COUNTER(h) ((h)->Instance->NDTR)
+#define __HAL_LINKDMA(h, field, dma) do { (h)->field = &(dma); (dma).Parent = (h); } while(0)
+#define __HAL_RCC_DMA1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_DMA2_CLK_ENABLE() ((void)0)
+/* UART */
+typedef struct { uint32_t BaudRate, WordLength, StopBits, Parity, Mode, HwFlowCtl, OverSampling; } UART_InitTypeDef;
+typedef struct __UART_HandleTypeDef { USART_TypeDef *Instance; UART_InitTypeDef Init; uint8_t *pTxBuffPtr; uint16_t TxXferSize; __IO uint16_t TxXferCount; uint8_t *pRxBuffPtr; uint16_t RxXferSize; __IO uint16_t RxXferCount; DMA_HandleTypeDef *hdmatx; DMA_HandleTypeDef *hdmarx; HAL_LockTypeDef Lock; __IO uint32_t gState, RxState; __IO uint32_t ErrorCode; } UART_HandleTypeDef;
+#define UART_WORDLENGTH_8B 0u
+#define UART_STOPBITS_1 0u
+#define UART_PARITY_NONE 0u
+#define UART_MODE_TX_RX 0xCu
+#define UART_MODE_TX 0x8u
+#define UART_HWCONTROL_NONE 0u
+#define UART_HWCONTROL_RTS 0x100u
+#define UART_HWCONTROL_CTS 0x200u
+#define UART_HWCONTROL_RTS_CTS 0x300u
+#define UART_OVERSAMPLING_16 0u
+#define HAL_UART_STATE_READY 0x20u
+#define HAL_UART_STATE_BUSY_TX 0x21u
+#define UART_IT_IDLE 0x10u
+#define UART_IT_RXNE 0x20u
+#define UART_FLAG_IDLE 0x10u
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef*, const uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef*, const uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef*, const uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef*, uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef*, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef*, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_UART_DMAStop(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_DMAPause(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_DMAResume(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef*);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef*, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_IT(UART_HandleTypeDef*, uint8_t*, uint16_t);
+void HAL_UART_IRQHandler(UART_HandleTypeDef*);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef*);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef*);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef*);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef*, uint16_t);
+#define __HAL_UART_ENABLE_IT(h, it) ((void)(h),(void)(it))
+#define __HAL_UART_DISABLE_IT(h, it) ((void)(h),(void)(it))
+#define __HAL_UART_CLEAR_IDLEFLAG(h) ((void)(h))
+#define __HAL_UART_GET_FLAG(h, f) ((void)(h),0)
+#define __HAL_RCC_USART1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_USART2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_USART1_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_USART2_CLK_DISABLE() ((void)0)
+/* I2C */
+typedef struct { uint32_t ClockSpeed, DutyCycle, OwnAddress1, AddressingMode, DualAddressMode, OwnAddress2, GeneralCallMode, NoStretchMode; } I2C_InitTypeDef;
+typedef struct __I2C_HandleTypeDef { I2C_TypeDef *Instance; I2C_InitTypeDef Init; uint8_t *pBuffPtr; uint16_t XferSize; __IO uint16_t XferCount; DMA_HandleTypeDef *hdmatx; DMA_HandleTypeDef *hdmarx; HAL_LockTypeDef Lock; __IO uint32_t State; __IO uint32_t ErrorCode; } I2C_HandleTypeDef;
+#define HAL_I2C_STATE_READY 0x20u
+#define I2C_DUTYCYCLE_2 0u
+#define I2C_DUTYCYCLE_16_9 0x4000u
+#define I2C_ADDRESSINGMODE_7BIT 0x4000u
+#define I2C_DUALADDRESS_DISABLE 0u
+#define I2C_GENERALCALL_DISABLE 0u
+#define I2C_NOSTRETCH_DISABLE 0u
+#define I2C_MEMADD_SIZE_8BIT 1u
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef*);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef*);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef*, uint16_t, uint16_t, uint16_t, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef*, uint16_t);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef*, uint16_t, uint32_t, uint32_t);
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef*);
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef*);
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef*);
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef*);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef*);
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef*);
+#define __HAL_RCC_I2C1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_I2C1_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_I2C1_FORCE_RESET() ((void)0)
+#define __HAL_RCC_I2C1_RELEASE_RESET() ((void)0)
+/* SPI */
+typedef struct { uint32_t Mode, Direction, DataSize, CLKPolarity, CLKPhase, NSS, BaudRatePrescaler, FirstBit, TIMode, CRCCalculation, CRCPolynomial; } SPI_InitTypeDef;
+typedef struct __SPI_HandleTypeDef { SPI_TypeDef *Instance; SPI_InitTypeDef Init; uint8_t *pTxBuffPtr; uint16_t TxXferSize; __IO uint16_t TxXferCount; uint8_t *pRxBuffPtr; uint16_t RxXferSize; __IO uint16_t RxXferCount; DMA_HandleTypeDef *hdmatx; DMA_HandleTypeDef *hdmarx; HAL_LockTypeDef Lock; __IO uint32_t State; __IO uint32_t ErrorCode; } SPI_HandleTypeDef;
+#define SPI_MODE_MASTER 0x104u
+#define SPI_DIRECTION_2LINES 0u
+#define SPI_DATASIZE_8BIT 0u
+#define SPI_POLARITY_LOW 0u
+#define SPI_PHASE_1EDGE 0u
+#define SPI_NSS_SOFT 0x200u
+#define SPI_BAUDRATEPRESCALER_2 0u
+#define SPI_BAUDRATEPRESCALER_4 0x8u
+#define SPI_BAUDRATEPRESCALER_8 0x10u
+#define SPI_BAUDRATEPRESCALER_16 0x18u
+#define SPI_BAUDRATEPRESCALER_32 0x20u
+#define SPI_BAUDRATEPRESCALER_64 0x28u
+#define SPI_BAUDRATEPRESCALER_128 0x30u
+#define SPI_BAUDRATEPRESCALER_256 0x38u
+#define SPI_FIRSTBIT_MSB 0u
+#define SPI_TIMODE_DISABLE 0u
+#define SPI_CRCCALCULATION_DISABLE 0u
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef*);
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef*);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef*, const uint8_t*, uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef*, const uint8_t*, uint8_t*, uint16_t);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef*, const uint8_t*, uint16_t, uint32_t);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef*, uint8_t*, uint16_t, uint32_t);
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef*);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef*);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef*);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef*);
+#define __HAL_RCC_SPI1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_SPI1_CLK_DISABLE() ((void)0)
+/* ADC */
+typedef struct { uint32_t ClockPrescaler, Resolution, DataAlign, ScanConvMode, EOCSelection, ContinuousConvMode, NbrOfConversion, DiscontinuousConvMode, NbrOfDiscConversion, ExternalTrigConv, ExternalTrigConvEdge, DMAContinuousRequests; } ADC_InitTypeDef;
+typedef struct __ADC_HandleTypeDef { ADC_TypeDef *Instance; ADC_InitTypeDef Init; DMA_HandleTypeDef *DMA_Handle; HAL_LockTypeDef Lock; __IO uint32_t State; __IO uint32_t ErrorCode; } ADC_HandleTypeDef;
+typedef struct { uint32_t Channel, Rank, SamplingTime, Offset; } ADC_ChannelConfTypeDef;
+#define ADC_CLOCK_SYNC_PCLK_DIV4 0x10000u
+#define ADC_CLOCK_SYNC_PCLK_DIV8 0x30000u
+#define ADC_RESOLUTION_12B 0u
+#define ADC_DATAALIGN_RIGHT 0u
+#define ADC_EOC_SINGLE_CONV 1u
+#define ADC_EOC_SEQ_CONV 0u
+#define ADC_EXTERNALTRIGCONVEDGE_NONE 0u
+#define ADC_EXTERNALTRIGCONVEDGE_RISING 0x10000000u
+#define ADC_EXTERNALTRIGCONV_T3_TRGO 0x08000000u
+#define ADC_EXTERNALTRIGCONV_T2_TRGO 0x06000000u
+#define ADC_SOFTWARE_START 0x0F000001u
+#define ADC_CHANNEL_0 0u
+#define ADC_CHANNEL_1 1u
+#define ADC_CHANNEL_8 8u
+#define ADC_CHANNEL_9 9u
+#define ADC_CHANNEL_VREFINT 17u
+#define ADC_SAMPLETIME_3CYCLES 0u
+#define ADC_SAMPLETIME_84CYCLES 4u
+#define ADC_SAMPLETIME_144CYCLES 5u
+#define ADC_SAMPLETIME_480CYCLES 7u
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef*);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef*, ADC_ChannelConfTypeDef*);
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef*);
+HAL_StatusTypeDef HAL_ADC_Stop(ADC_HandleTypeDef*);
+HAL_StatusTypeDef HAL_ADC_PollForConversion(ADC_HandleTypeDef*, uint32_t);
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef*);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef*, uint32_t*, uint32_t);
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef*);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef*);
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef*);
+#define __HAL_RCC_ADC1_CLK_ENABLE() ((void)0)
+/* TIM */
+typedef struct { uint32_t Prescaler, CounterMode, Period, ClockDivision, RepetitionCounter, AutoReloadPreload; } TIM_Base_InitTypeDef;
+typedef struct { TIM_TypeDef *Instance; TIM_Base_InitTypeDef Init; uint32_t Channel; DMA_HandleTypeDef *hdma[7]; HAL_LockTypeDef Lock; __IO uint32_t State; } TIM_HandleTypeDef;
+typedef struct { uint32_t ClockSource, ClockPolarity, ClockPrescaler, ClockFilter; } TIM_ClockConfigTypeDef;
+typedef struct { uint32_t MasterOutputTrigger, MasterSlaveMode; } TIM_MasterConfigTypeDef;
+typedef struct { uint32_t SlaveMode, InputTrigger, TriggerPolarity, TriggerPrescaler, TriggerFilter; } TIM_SlaveConfigTypeDef;
+typedef struct { uint32_t ICPolarity, ICSelection, ICPrescaler, ICFilter; } TIM_IC_InitTypeDef;
+#define TIM_COUNTERMODE_UP 0u
+#define TIM_CLOCKDIVISION_DIV1 0u
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0u
+#define TIM_CLOCKSOURCE_INTERNAL 0x1000u
+#define TIM_CLOCKSOURCE_ETRMODE2 0x2000u
+#define TIM_CLOCKSOURCE_TI1 0x50u
+#define TIM_CLOCKSOURCE_TI1ED 0x40u
+#define TIM_CLOCKPOLARITY_RISING 0u
+#define TIM_CLOCKPRESCALER_DIV1 0u
+#define TIM_TRGO_RESET 0u
+#define TIM_TRGO_UPDATE 0x20u
+#define TIM_MASTERSLAVEMODE_DISABLE 0u
+#define TIM_ICPOLARITY_RISING 0u
+#define TIM_ICSELECTION_DIRECTTI 1u
+#define TIM_ICPSC_DIV1 0u
+#define TIM_CHANNEL_1 0u
+#define TIM_CHANNEL_2 4u
+#define TIM_IT_UPDATE 1u
+#define TIM_IT_CC1 2u
+#define TIM_FLAG_UPDATE 1u
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_Base_Stop(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef*, TIM_ClockConfigTypeDef*);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef*, TIM_MasterConfigTypeDef*);
+HAL_StatusTypeDef HAL_TIM_SlaveConfigSynchro(TIM_HandleTypeDef*, TIM_SlaveConfigTypeDef*);
+HAL_StatusTypeDef HAL_TIM_IC_Init(TIM_HandleTypeDef*);
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef*, TIM_IC_InitTypeDef*, uint32_t);
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef*, uint32_t);
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef*);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef*);
+void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef*);
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_SET_COUNTER(h, v) ((h)->Instance->CNT = (v))
+#define __HAL_TIM_SET_AUTORELOAD(h, v) ((h)->Instance->ARR = (v))
+#define __HAL_TIM_SET_PRESCALER(h, v) ((h)->Instance->PSC = (v))
+#define __HAL_TIM_CLEAR_FLAG(h, f) ((void)(h),(void)(f))
+#define HAL_TIM_ReadCapturedValue(h, c) ((h)->Instance->CCR1)
+#define __HAL_RCC_TIM2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_TIM3_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_TIM4_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_TIM5_CLK_ENABLE() ((void)0)
+/* CRC */
+typedef struct { CRC_TypeDef *Instance; HAL_LockTypeDef Lock; __IO uint32_t State; } CRC_HandleTypeDef;
+HAL_StatusTypeDef HAL_CRC_Init(CRC_HandleTypeDef*);
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef*, uint32_t*, uint32_t);
+uint32_t HAL_CRC_Accumulate(CRC_HandleTypeDef*, uint32_t*, uint32_t);
+#define __HAL_RCC_CRC_CLK_ENABLE() ((void)0)
+#define __HAL_CRC_DR_RESET(h) ((h)->Instance->CR = 1u)
+/* IWDG */
+typedef struct { uint32_t Prescaler, Reload; } IWDG_InitTypeDef;
+typedef struct { IWDG_TypeDef *Instance; IWDG_InitTypeDef Init; } IWDG_HandleTypeDef;
+#define IWDG_PRESCALER_64 4u
+HAL_StatusTypeDef HAL_IWDG_Init(IWDG_HandleTypeDef*);
+HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef*);
+/* FLASH */
+typedef struct { uint32_t TypeErase, Banks, Sector, NbSectors, VoltageRange; } FLASH_EraseInitTypeDef;
+#define FLASH_TYPEERASE_SECTORS 0u
+#define FLASH_VOLTAGE_RANGE_3 2u
+#define FLASH_TYPEPROGRAM_BYTE 0u
+#define FLASH_TYPEPROGRAM_HALFWORD 1u
+#define FLASH_TYPEPROGRAM_WORD 2u
+#define FLASH_SECTOR_0 0u
+#define FLASH_SECTOR_1 1u
+#define FLASH_SECTOR_2 2u
+#define FLASH_SECTOR_3 3u
+#define FLASH_SECTOR_4 4u
+#define FLASH_SECTOR_5 5u
+#define FLASH_LATENCY_0 0u
+#define FLASH_LATENCY_1 1u
+#define FLASH_LATENCY_2 2u
+#define FLASH_LATENCY_3 3u
+#define FLASH_LATENCY_5 5u
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t, uint32_t, uint64_t);
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t, uint32_t, uint64_t);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef*, uint32_t*);
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef*);
+void HAL_FLASH_IRQHandler(void);
+void HAL_FLASH_EndOfOperationCallback(uint32_t);
+void HAL_FLASH_OperationErrorCallback(uint32_t);
+#define __HAL_FLASH_CLEAR_FLAG(f) ((void)(f))
+#define FLASH_FLAG_EOP 1u
+#define FLASH_FLAG_OPERR 2u
+#define FLASH_FLAG_WRPERR 0x10u
+#define FLASH_FLAG_PGAERR 0x20u
+#define FLASH_FLAG_PGPERR 0x40u
+#define FLASH_FLAG_PGSERR 0x80u
+/* RCC / PWR / RTC */
+typedef struct { uint32_t PLLState, PLLSource, PLLM, PLLN, PLLP, PLLQ; } RCC_PLLInitTypeDef;
+typedef struct { uint32_t OscillatorType, HSEState, LSEState, HSIState, HSICalibrationValue, LSIState; RCC_PLLInitTypeDef PLL; } RCC_OscInitTypeDef;
+typedef struct { uint32_t ClockType, SYSCLKSource, AHBCLKDivider, APB1CLKDivider, APB2CLKDivider; } RCC_ClkInitTypeDef;
+#define RCC_OSCILLATORTYPE_NONE 0u
+#define RCC_OSCILLATORTYPE_HSE 1u
+#define RCC_OSCILLATORTYPE_HSI 2u
+#define RCC_OSCILLATORTYPE_LSI 8u
+#define RCC_OSCILLATORTYPE_LSE 4u
+#define RCC_HSE_ON 1u
+#define RCC_HSE_OFF 0u
+#define RCC_HSI_ON 1u
+#define RCC_LSI_ON 1u
+#define RCC_HSICALIBRATION_DEFAULT 0x10u
+#define RCC_PLL_NONE 0u
+#define RCC_PLL_ON 2u
+#define RCC_PLL_OFF 1u
+#define RCC_PLLSOURCE_HSE 0x400000u
+#define RCC_PLLSOURCE_HSI 0u
+#define RCC_PLLP_DIV2 2u
+#define RCC_PLLP_DIV4 4u
+#define RCC_CLOCKTYPE_SYSCLK 1u
+#define RCC_CLOCKTYPE_HCLK 2u
+#define RCC_CLOCKTYPE_PCLK1 4u
+#define RCC_CLOCKTYPE_PCLK2 8u
+#define RCC_SYSCLKSOURCE_HSI 0u
+#define RCC_SYSCLKSOURCE_HSE 1u
+#define RCC_SYSCLKSOURCE_PLLCLK 2u
+#define RCC_SYSCLK_DIV1 0u
+#define RCC_SYSCLK_DIV2 0x80u
+#define RCC_SYSCLK_DIV4 0x90u
+#define RCC_HCLK_DIV1 0u
+#define RCC_HCLK_DIV2 0x1000u
+#define RCC_HCLK_DIV4 0x1400u
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef*);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef*, uint32_t);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+uint32_t HAL_RCC_GetSysClockFreq(void);
+#define __HAL_RCC_GPIOA_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_PWR_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_RTC_ENABLE() ((void)0)
+#define PWR_MAINREGULATOR_ON 0u
+#define PWR_LOWPOWERREGULATOR_ON 1u
+#define PWR_STOPENTRY_WFI 1u
+#define PWR_SLEEPENTRY_WFI 1u
+#define PWR_REGULATOR_VOLTAGE_SCALE1 0xC000u
+#define PWR_REGULATOR_VOLTAGE_SCALE2 0x8000u
+#define __HAL_PWR_VOLTAGESCALING_CONFIG(x) ((void)(x))
+void HAL_PWR_EnterSTOPMode(uint32_t, uint8_t);
+void HAL_PWR_EnterSLEEPMode(uint32_t, uint8_t);
+void HAL_PWREx_EnableFlashPowerDown(void);
+void HAL_PWREx_DisableFlashPowerDown(void);
+typedef struct { uint32_t HourFormat, AsynchPrediv, SynchPrediv, OutPut, OutPutPolarity, OutPutType; } RTC_InitTypeDef;
+typedef struct { RTC_TypeDef *Instance; RTC_InitTypeDef Init; HAL_LockTypeDef Lock; __IO uint32_t State; } RTC_HandleTypeDef;
+#define RTC_HOURFORMAT_24 0u
+#define RTC_OUTPUT_DISABLE 0u
+#define RTC_OUTPUT_POLARITY_HIGH 0u
+#define RTC_OUTPUT_TYPE_OPENDRAIN 0u
+#define RTC_WAKEUPCLOCK_RTCCLK_DIV16 0u
+#define RTC_WAKEUPCLOCK_CK_SPRE_16BITS 4u
+HAL_StatusTypeDef HAL_RTC_Init(RTC_HandleTypeDef*);
+HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT(RTC_HandleTypeDef*, uint32_t, uint32_t);
+HAL_StatusTypeDef HAL_RTCEx_DeactivateWakeUpTimer(RTC_HandleTypeDef*);
+void HAL_RTCEx_WakeUpTimerIRQHandler(RTC_HandleTypeDef*);
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef*);
+uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef*, uint32_t);
+void HAL_RTCEx_BKUPWrite(RTC_HandleTypeDef*, uint32_t, uint32_t);
+#define RTC_BKP_DR0 0u
+#define RTC_BKP_DR1 1u
+#define RTC_BKP_DR2 2u
+#define RTC_BKP_DR3 3u
+void HAL_PWR_EnableBkUpAccess(void);
+/* Core */
+HAL_StatusTypeDef HAL_Init(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t);
+void HAL_IncTick(void);
+void HAL_SuspendTick(void);
+void HAL_ResumeTick(void);
+HAL_StatusTypeDef HAL_InitTick(uint32_t);
+void HAL_NVIC_SetPriority(IRQn_Type, uint32_t, uint32_t);
+void HAL_NVIC_EnableIRQ(IRQn_Type);
+void HAL_NVIC_DisableIRQ(IRQn_Type);
+void HAL_NVIC_SetPriorityGrouping(uint32_t);
+#define NVIC_PRIORITYGROUP_4 3u
+void NVIC_SystemReset(void);
+void NVIC_SetPriority(IRQn_Type, uint32_t);
+void HAL_SYSTICK_Config(uint32_t);
+
+typedef struct { uint32_t PeriphClockSelection, RTCClockSelection; } RCC_PeriphCLKInitTypeDef;
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef*);
+#define RCC_PERIPHCLK_RTC 2u
+#define RCC_RTCCLKSOURCE_LSI 0x200u
+#define RCC_RTCCLKSOURCE_LSE 0x100u
+#define SysTick_CTRL_ENABLE_Msk 1u
+#define SysTick_CTRL_TICKINT_Msk 2u
+HAL_StatusTypeDef HAL_RTC_WaitForSynchro(RTC_HandleTypeDef*);
+#define __HAL_RCC_ADC1_CLK_DISABLE() ((void)0)
+#define UART_BRR_SAMPLING16(pclk, baud) ((uint32_t)(((pclk) + ((baud) / 2U)) / (baud)))
+#define UART_FLAG_TC 0x40u
+#define PWR_REGULATOR_VOLTAGE_SCALE3 0x4000u
+#define HAL_SPI_STATE_READY 0x01u
+#define TIM_CLOCKPOLARITY_NONINVERTED 0u
+#define __HAL_GPIO_EXTI_GET_IT(x) (EXTI->PR & (x))
+#define RTC_EXTI_LINE_WAKEUPTIMER_EVENT ((uint32_t)0x00400000U)
+#define __HAL_RTC_WAKEUPTIMER_EXTI_GET_FLAG() (EXTI->PR & RTC_EXTI_LINE_WAKEUPTIMER_EVENT)
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type);
+
+#endif /* __STM32F4XX_HAL_H */
@@ -0,0 +1,27 @@
+/* task.h - Host Simulation FreeRTOS Task API */
+#ifndef INC_TASK_H
+#define INC_TASK_H
+#include "FreeRTOS.h"
+typedef void *TaskHandle_t;
+typedef enum { eNoAction=0, eSetBits, eIncrement, eSetValueWithOverwrite } eNotifyAction;
+typedef enum { eAbortSleep=0, eStandardSleep, eNoTasksWaitingTimeout } eSleepModeStatus;
+typedef struct { TaskHandle_t xHandle; const char *pcTaskName; UBaseType_t xTaskNumber; int eCurrentState; UBaseType_t uxCurrentPriority; UBaseType_t uxBasePriority; uint32_t ulRunTimeCounter; StackType_t *pxStackBase; uint16_t usStackHighWaterMark; } TaskStatus_t;
+#define taskENTER_CRITICAL() vPortEnterCritical()
+#define taskEXIT_CRITICAL() vPortExitCritical()
+UBaseType_t taskENTER_CRITICAL_FROM_ISR_fn(void);
+#define taskENTER_CRITICAL_FROM_ISR() taskENTER_CRITICAL_FROM_ISR_fn()
+#define taskEXIT_CRITICAL_FROM_ISR(x) ((void)(x))
+TickType_t xTaskGetTickCount(void); TickType_t xTaskGetTickCountFromISR(void);
+void vTaskDelay(TickType_t); void vTaskDelayUntil(TickType_t*, TickType_t); BaseType_t xTaskDelayUntil(TickType_t*, TickType_t);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t); void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+BaseType_t xTaskNotify(TaskHandle_t, uint32_t, eNotifyAction); BaseType_t xTaskNotifyFromISR(TaskHandle_t, uint32_t, eNotifyAction, BaseType_t*);
+BaseType_t xTaskNotifyWait(uint32_t, uint32_t, uint32_t*, TickType_t);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t*, UBaseType_t, uint32_t*);
+UBaseType_t uxTaskGetNumberOfTasks(void);
+void vTaskStepTick(TickType_t); eSleepModeStatus eTaskConfirmSleepModeStatus(void);
+void vTaskSuspendAll(void); BaseType_t xTaskResumeAll(void);
+void vTaskSetTimeOutState(void*);
+#endif
@@ -0,0 +1,510 @@
+/* bench.c - Host Firmware Benchmark
+ *
+ * Runs the firmware's framer, checksums, command dispatch and sensor
+ * conversions on the simulated HAL (hal_sim.c) and reports host time per
+ * operation. Every case is checked for the right answer first, so a
+ * change that is fast because it is wrong fails too. Host nanoseconds
+ * only track on-target cycles loosely - they are for catching
+ * regressions between builds, GET_DIAGNOSTICS measures the real thing.
+ *
+ *   bench [STREAM] [--save FILE] [--baseline FILE [--tolerance PCT]]
+ *
+ * STREAM is a capture of raw bytes arriving on the Pi link, replayed
+ * through COMM_ProcessReceivedData in DMA-sized pieces. Any file will do:
+ * bytes between frames are line noise to the framer. Exit status is 1
+ * if a check fails or a case is slower than the baseline by more than
+ * the tolerance (default 25%).
+ */
+#include "sim.h"
+#include "communication.h"
+#include "crc.h"
+#include "diag.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define BENCH_FEED_SIZE     64      /* Bytes per simulated idle-line event */
+#define BENCH_MIN_NS        100000000ull
+#define BENCH_RUNS          5
+#define BENCH_MAX_CASES     16
+#define BENCH_CHUNK_DATA    200
+
+/* main.c */
+void MX_USART1_UART_Init(void);
+void MX_USART2_UART_Init(void);
+
+typedef struct {
+    const char* name;
+    double ns_per_op;
+    double bytes_per_op;
+} BENCH_Result_t;
+
+static BENCH_Result_t bench_results[BENCH_MAX_CASES];
+static uint8_t bench_count = 0;
+static uint8_t bench_failed = 0;
+
+/* What went out on each link, and what CommTask saw */
+static uint32_t bench_tx_pi = 0;
+static uint32_t bench_tx_radio = 0;
+static uint32_t bench_commands = 0;
+
+static uint8_t* bench_stream = NULL;
+static uint32_t bench_stream_length = 0;
+
+/* ==================== HARNESS ==================== */
+
+static uint64_t BENCH_Now(void) {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void BENCH_Check(const char* what, int ok) {
+    if(!ok) {
+        printf("FAIL  %s\n", what);
+        bench_failed = 1;
+    }
+}
+
+/* Best of BENCH_RUNS batches, each long enough to swamp timer overhead */
+static void BENCH_Run(const char* name, void (*op)(void), double bytes_per_op) {
+    uint64_t batch = 1;
+    uint64_t start;
+    uint64_t elapsed;
+    double best = 0;
+    
+    while(1) {
+        start = BENCH_Now();
+        for(uint64_t i = 0; i < batch; i++) {
+            op();
+        }
+        elapsed = BENCH_Now() - start;
+        if(elapsed >= BENCH_MIN_NS / 8) {
+            break;
+        }
+        batch *= 2;
+    }
+    batch = batch * BENCH_MIN_NS / (elapsed ? elapsed : 1) + 1;
+    
+    for(uint8_t run = 0; run < BENCH_RUNS; run++) {
+        start = BENCH_Now();
+        for(uint64_t i = 0; i < batch; i++) {
+            op();
+        }
+        elapsed = BENCH_Now() - start;
+        if(run == 0 || (double)elapsed / batch < best) {
+            best = (double)elapsed / batch;
+        }
+    }
+    
+    if(bench_count < BENCH_MAX_CASES) {
+        bench_results[bench_count].name = name;
+        bench_results[bench_count].ns_per_op = best;
+        bench_results[bench_count].bytes_per_op = bytes_per_op;
+        bench_count++;
+    }
+    if(bytes_per_op > 0) {
+        printf("%-24s %12.1f ns/op %10.1f MB/s\n", name, best, bytes_per_op * 1000.0 / best);
+    } else {
+        printf("%-24s %12.1f ns/op\n", name, best);
+    }
+}
+
+/* Keeps results live so the compiler cannot drop the work */
+static volatile uint32_t bench_sink;
+
+/* ==================== LINK ==================== */
+
+static void BENCH_UartSink(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t length) {
+    if(huart == &huart1) {
+        bench_tx_pi += length;
+    } else {
+        bench_tx_radio += length;
+    }
+}
+
+/* The CommTask command loop, without the scheduling */
+static void BENCH_CommService(void) {
+    COMM_Frame_t frame;
+    
+    SIM_TakeFlags();
+    while(COMM_NextCommand(&frame)) {
+        if(!COMM_FrameValid(&frame)) {
+            LogError(ERROR_UART);
+        } else if(frame.sync_word != SYNC_FIRMWARE) {
+            bench_commands++;
+            DIAG_TIMED(DIAG_COMMAND, ProcessCommand((CommandPacket_t*)frame.data));
+        }
+    }
+    SIM_UartDrain(&huart1);
+    SIM_UartDrain(&huart2);
+}
+
+/* Bytes in as the DMA would deliver them, an idle-line event at a time:
+ * the DMA counter has moved before the event is handled */
+static void BENCH_Feed(uint8_t* data, uint32_t length) {
+    uint16_t span;
+    
+    while(length > 0) {
+        span = (length > BENCH_FEED_SIZE) ? BENCH_FEED_SIZE : (uint16_t)length;
+        SIM_UartRxAdvance(&huart1, span);
+        COMM_ProcessReceivedData(data, span);
+        BENCH_CommService();
+        data += span;
+        length -= span;
+    }
+}
+
+/* ==================== STREAMS ==================== */
+
+static uint8_t bench_frames[16384];
+static uint32_t bench_frames_length = 0;
+static uint32_t bench_frames_commands = 0;
+static uint32_t bench_frames_pings = 0;
+static uint32_t bench_frames_relayed = 0;
+
+static void BENCH_Put(const void* data, uint32_t length) {
+    memcpy(&bench_frames[bench_frames_length], data, length);
+    bench_frames_length += length;
+}
+
+static void BENCH_PutPing(uint8_t version, uint16_t seq) {
+    CommandPacket_t cmd;
+    uint16_t length;
+    uint16_t checksum;
+    
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.sync1 = 0xAA;
+    cmd.sync2 = (version == 2) ? 0x5B : 0x56;
+    cmd.command_id = CMD_PING;
+    cmd.sequence_number = seq;
+    cmd.parameter_length = 0;
+    length = CommandFrameLength(&cmd);
+    checksum = (version == 2) ? CRC16_Calculate(&cmd, length - 2)
+                              : CalculateChecksum(&cmd, length - 2);
+    memcpy((uint8_t*)&cmd + length - 2, &checksum, sizeof(checksum));
+    
+    BENCH_Put(&cmd, length);
+    bench_frames_commands++;
+    bench_frames_pings++;
+}
+
+static void BENCH_PutChunk(uint16_t chunk) {
+    uint8_t frame[sizeof(ChunkHeader_t) + BENCH_CHUNK_DATA + 4];
+    ChunkHeader_t header = { 0xAA, 0x58, 7, chunk, 1000, BENCH_CHUNK_DATA };
+    uint32_t crc;
+    
+    memcpy(frame, &header, sizeof(header));
+    for(uint16_t i = 0; i < BENCH_CHUNK_DATA; i++) {
+        frame[sizeof(header) + i] = (uint8_t)(i * 7 + chunk);
+    }
+    crc = CRC32_Calculate(frame, sizeof(header) + BENCH_CHUNK_DATA);
+    memcpy(&frame[sizeof(header) + BENCH_CHUNK_DATA], &crc, sizeof(crc));
+    
+    BENCH_Put(frame, sizeof(frame));
+    bench_frames_relayed += sizeof(frame);
+}
+
+/* Never 0xAA, so noise cannot start a frame that swallows real ones */
+static void BENCH_PutNoise(uint32_t* seed, uint16_t length) {
+    uint8_t byte;
+    
+    for(uint16_t i = 0; i < length; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        byte = (uint8_t)(*seed >> 16);
+        bench_frames[bench_frames_length++] = (byte == 0xAA) ? 0xAB : byte;
+    }
+}
+
+/* What the Pi link carries on a busy pass */
+static void BENCH_BuildFrames(void) {
+    TelemetryPacket_t echo;
+    uint32_t seed = 1;
+    uint16_t seq = 0;
+    
+    memset(&echo, 0, sizeof(echo));
+    echo.sync1 = 0xAA;
+    echo.sync2 = 0x55;
+    
+    while(bench_frames_length + 1024 < sizeof(bench_frames)) {
+        BENCH_PutPing(2, seq++);
+        BENCH_PutPing(2, seq++);
+        BENCH_PutPing(1, seq++);
+        BENCH_PutNoise(&seed, 13);
+        BENCH_Put(&echo, sizeof(echo));
+        BENCH_PutChunk(seq);
+        BENCH_PutNoise(&seed, 40);
+    }
+}
+
+static void BENCH_ReplayFrames(void) {
+    BENCH_Feed(bench_frames, bench_frames_length);
+}
+
+static void BENCH_ReplayStream(void) {
+    BENCH_Feed(bench_stream, bench_stream_length);
+}
+
+static uint8_t BENCH_LoadStream(const char* path) {
+    FILE* f = fopen(path, "rb");
+    long size;
+    
+    if(f == NULL) {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bench_stream = malloc(size > 0 ? (size_t)size : 1);
+    bench_stream_length = (bench_stream != NULL) ? (uint32_t)fread(bench_stream, 1, size, f) : 0;
+    fclose(f);
+    return bench_stream_length > 0;
+}
+
+/* ==================== CHECKSUMS ==================== */
+
+static uint8_t bench_block[256];
+
+static void BENCH_Checksum(void) {
+    bench_sink += CalculateChecksum(bench_block, 73);
+}
+
+static void BENCH_Crc16(void) {
+    bench_sink += CRC16_Calculate(bench_block, 73);
+}
+
+static void BENCH_Crc32(void) {
+    bench_sink += CRC32_Calculate(bench_block, sizeof(bench_block));
+}
+
+/* ==================== COMMANDS ==================== */
+
+static CommandPacket_t bench_ping;
+
+static void BENCH_ProcessCommand(void) {
+    ProcessCommand(&bench_ping);
+    SIM_UartDrain(&huart1);
+}
+
+/* ==================== SENSORS ==================== */
+
+/* Bosch datasheet example: 25.08 degC, 100653 Pa */
+#define BENCH_RAW_TEMP      519888
+#define BENCH_RAW_PRESS     415148
+#define BENCH_RAW_HUM       30000
+
+static const uint8_t bench_bme280_raw[8] = {
+    BENCH_RAW_PRESS >> 12, (BENCH_RAW_PRESS >> 4) & 0xFF, (BENCH_RAW_PRESS & 0x0F) << 4,
+    BENCH_RAW_TEMP >> 12, (BENCH_RAW_TEMP >> 4) & 0xFF, (BENCH_RAW_TEMP & 0x0F) << 4,
+    BENCH_RAW_HUM >> 8, BENCH_RAW_HUM & 0xFF
+};
+static const uint8_t bench_lis3mdl_raw[6] = { 0x10, 0x02, 0xF0, 0xFD, 0x00, 0x10 };
+static const uint8_t bench_tmp117_raw[2] = { 0x0C, 0x80 };
+
+static void BENCH_LoadCalibration(void) {
+    /* dig_T1..dig_P9, little-endian from 0x88 */
+    static const int32_t tp[12] = {
+        27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000
+    };
+    /* 0xE1..0xE7: H2 = 362, H3 = 0, H4 = 313, H5 = 50, H6 = 30 */
+    static const uint8_t h[7] = { 0x6A, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1E };
+    static const uint8_t h1 = 75;
+    uint8_t cal[24];
+    
+    for(uint8_t i = 0; i < 12; i++) {
+        cal[2 * i] = (uint8_t)tp[i];
+        cal[2 * i + 1] = (uint8_t)((uint32_t)tp[i] >> 8);
+    }
+    SIM_I2CLoad(BME280_ADDR, 0x88, cal, sizeof(cal));
+    SIM_I2CLoad(BME280_ADDR, 0xA1, &h1, 1);
+    SIM_I2CLoad(BME280_ADDR, 0xE1, h, sizeof(h));
+}
+
+static void BENCH_Bme280Fixed(void) {
+    bench_sink += BME280_CompensateTemperatureFixed(BENCH_RAW_TEMP);
+    bench_sink += BME280_CompensatePressureFixed(BENCH_RAW_PRESS);
+    bench_sink += BME280_CompensateHumidityFixed(BENCH_RAW_HUM);
+}
+
+static void BENCH_Bme280Float(void) {
+    float t = BME280_CompensateTemperatureFloat(BENCH_RAW_TEMP);
+    float p = BME280_CompensatePressureFloat(BENCH_RAW_PRESS);
+    float hum = BME280_CompensateHumidityFloat(BENCH_RAW_HUM);
+    
+    bench_sink += (uint32_t)(t + p + hum);
+}
+
+static void BENCH_Bme280Convert(void) {
+    float t, p, hum;
+    
+    BME280_Convert(bench_bme280_raw, &t, &p, &hum);
+    bench_sink += (uint32_t)(t + p + hum);
+}
+
+static void BENCH_Lis3mdl(void) {
+    float x, y, z;
+    
+    LIS3MDL_Convert(bench_lis3mdl_raw, &x, &y, &z);
+    bench_sink += (uint32_t)(x + y + z);
+}
+
+static void BENCH_Tmp117(void) {
+    float t;
+    
+    TMP117_Convert(bench_tmp117_raw, &t);
+    bench_sink += (uint32_t)t;
+}
+
+/* ==================== CHECKS ==================== */
+
+static void BENCH_Verify(void) {
+    static const char check[] = "123456789";
+    float t, p, hum;
+    uint32_t commands, pi, radio;
+    
+    BENCH_Check("CRC-16/CCITT-FALSE check value", CRC16_Calculate(check, 9) == 0x29B1);
+    BENCH_Check("CRC-32/MPEG-2 check value", CRC32_Calculate(check, 9) == 0x0376E6E7);
+    
+    BENCH_Check("BME280 fixed temperature", BME280_CompensateTemperatureFixed(BENCH_RAW_TEMP) == 2508);
+    BENCH_Check("BME280 fixed pressure",
+                labs((long)(BME280_CompensatePressureFixed(BENCH_RAW_PRESS) / 256) - 100653) <= 1);
+    BME280_Convert(bench_bme280_raw, &t, &p, &hum);
+    BENCH_Check("BME280 convert", fabsf(t - 25.08f) < 0.01f && fabsf(p - 1006.53f) < 0.02f &&
+                                  hum >= 0.0f && hum <= 100.0f);
+    BENCH_Check("BME280 float path",
+                fabsf(BME280_CompensateTemperatureFloat(BENCH_RAW_TEMP) - 25.08f) < 0.01f &&
+                fabsf(BME280_CompensatePressureFloat(BENCH_RAW_PRESS) - 100653.0f) < 2.0f);
+    
+    /* Every command answered, every chunk relayed, nothing from noise */
+    commands = bench_commands;
+    pi = bench_tx_pi;
+    radio = bench_tx_radio;
+    BENCH_ReplayFrames();
+    BENCH_Check("framer: commands found", bench_commands - commands == bench_frames_commands);
+    BENCH_Check("framer: ping replies", bench_tx_pi - pi == bench_frames_pings * 5);
+    BENCH_Check("framer: chunks relayed", bench_tx_radio - radio == bench_frames_relayed);
+}
+
+/* ==================== BASELINE ==================== */
+
+static void BENCH_Save(const char* path) {
+    FILE* f = fopen(path, "w");
+    
+    if(f == NULL) {
+        printf("FAIL  cannot write %s\n", path);
+        bench_failed = 1;
+        return;
+    }
+    for(uint8_t i = 0; i < bench_count; i++) {
+        fprintf(f, "%s %.1f\n", bench_results[i].name, bench_results[i].ns_per_op);
+    }
+    fclose(f);
+}
+
+static void BENCH_Compare(const char* path, double tolerance) {
+    FILE* f = fopen(path, "r");
+    char name[64];
+    double ns;
+    
+    if(f == NULL) {
+        printf("FAIL  cannot read %s\n", path);
+        bench_failed = 1;
+        return;
+    }
+    while(fscanf(f, "%63s %lf", name, &ns) == 2) {
+        for(uint8_t i = 0; i < bench_count; i++) {
+            if(strcmp(name, bench_results[i].name) == 0 &&
+               bench_results[i].ns_per_op > ns * (1.0 + tolerance / 100.0)) {
+                printf("SLOW  %s %.1f ns/op, baseline %.1f\n", name, bench_results[i].ns_per_op, ns);
+                bench_failed = 1;
+            }
+        }
+    }
+    fclose(f);
+}
+
+/* ==================== MAIN ==================== */
+
+int main(int argc, char** argv) {
+    const char* stream_path = NULL;
+    const char* save_path = NULL;
+    const char* baseline_path = NULL;
+    double tolerance = 25.0;
+    uint16_t length;
+    
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if(argv[i][0] != '-') {
+            stream_path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [STREAM] [--save FILE] [--baseline FILE [--tolerance PCT]]\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    /* The parts of main() the benchmarked code depends on */
+    SIM_Init();
+    SIM_UartSetSink(BENCH_UartSink);
+    MX_USART1_UART_Init();
+    MX_USART2_UART_Init();
+    CRC32_Init();
+    DIAG_Init();
+    COMM_Init();
+    SCHED_Init();
+    
+    BENCH_LoadCalibration();
+    BENCH_Check("Sensors_Init", Sensors_Init() == HAL_OK);
+    
+    for(uint16_t i = 0; i < sizeof(bench_block); i++) {
+        bench_block[i] = (uint8_t)(i * 31 + 5);
+    }
+    memset(&bench_ping, 0, sizeof(bench_ping));
+    bench_ping.sync1 = 0xAA;
+    bench_ping.sync2 = 0x5B;
+    bench_ping.command_id = CMD_PING;
+    length = CommandFrameLength(&bench_ping);
+    bench_ping.parameters[0] = (uint8_t)CRC16_Calculate(&bench_ping, length - 2);
+    bench_ping.parameters[1] = (uint8_t)(CRC16_Calculate(&bench_ping, length - 2) >> 8);
+    
+    BENCH_BuildFrames();
+    BENCH_Verify();
+    
+    BENCH_Run("framer_frames", BENCH_ReplayFrames, bench_frames_length);
+    if(stream_path != NULL) {
+        if(BENCH_LoadStream(stream_path)) {
+            BENCH_Run("framer_stream", BENCH_ReplayStream, bench_stream_length);
+        } else {
+            printf("FAIL  cannot read %s\n", stream_path);
+            bench_failed = 1;
+        }
+    }
+    BENCH_Run("checksum_sum_73", BENCH_Checksum, 73);
+    BENCH_Run("crc16_73", BENCH_Crc16, 73);
+    BENCH_Run("crc32_sw_256", BENCH_Crc32, sizeof(bench_block));
+    BENCH_Run("process_command_ping", BENCH_ProcessCommand, 0);
+    BENCH_Run("bme280_fixed_tph", BENCH_Bme280Fixed, 0);
+    BENCH_Run("bme280_float_tph", BENCH_Bme280Float, 0);
+    BENCH_Run("bme280_convert", BENCH_Bme280Convert, 0);
+    BENCH_Run("lis3mdl_convert", BENCH_Lis3mdl, 0);
+    BENCH_Run("tmp117_convert", BENCH_Tmp117, 0);
+    
+    if(save_path != NULL) {
+        BENCH_Save(save_path);
+    }
+    if(baseline_path != NULL) {
+        BENCH_Compare(baseline_path, tolerance);
+    }
+    
+    printf("%s\n", bench_failed ? "FAILED" : "OK");
+    return bench_failed ? 1 : 0;
+}
@@ -0,0 +1,672 @@
+/* hal_sim.c - Host Simulation HAL and RTOS
+ *
+ * Just enough of the STM32F4 HAL, CMSIS-RTOS2 and FreeRTOS for the
+ * firmware modules to link and run on a PC, single-threaded. Peripheral
+ * register blocks are zeroed host structs. Flash is an anonymous mapping
+ * at 0x08000000, so code that reads it by address works unchanged, and
+ * it programs like the real part: bits only clear, erase sets a sector
+ * back to 0xFF. Calls the firmware makes from a task return at once;
+ * anything that completes in an interrupt on the target is held until
+ * the harness lets time pass or drains the bus (sim.h).
+ */
+#include "sim.h"
+#include "cmsis_os.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0   /* Address is then only a hint, checked below */
+#endif
+
+/* ==================== PERIPHERALS ==================== */
+
+#define SIM_PERIPH(type, name) static type sim_##name; type *name = &sim_##name
+
+SIM_PERIPH(GPIO_TypeDef, GPIOA);
+SIM_PERIPH(GPIO_TypeDef, GPIOB);
+SIM_PERIPH(GPIO_TypeDef, GPIOC);
+SIM_PERIPH(USART_TypeDef, USART1);
+SIM_PERIPH(USART_TypeDef, USART2);
+SIM_PERIPH(I2C_TypeDef, I2C1);
+SIM_PERIPH(SPI_TypeDef, SPI1);
+SIM_PERIPH(ADC_TypeDef, ADC1);
+SIM_PERIPH(TIM_TypeDef, TIM1);
+SIM_PERIPH(TIM_TypeDef, TIM2);
+SIM_PERIPH(TIM_TypeDef, TIM3);
+SIM_PERIPH(TIM_TypeDef, TIM4);
+SIM_PERIPH(TIM_TypeDef, TIM5);
+SIM_PERIPH(TIM_TypeDef, TIM9);
+SIM_PERIPH(TIM_TypeDef, TIM10);
+SIM_PERIPH(TIM_TypeDef, TIM11);
+SIM_PERIPH(CRC_TypeDef, CRC);
+SIM_PERIPH(IWDG_TypeDef, IWDG);
+SIM_PERIPH(FLASH_TypeDef, FLASH);
+SIM_PERIPH(DWT_Type, DWT);
+SIM_PERIPH(CoreDebug_Type, CoreDebug);
+SIM_PERIPH(SCB_Type, SCB);
+SIM_PERIPH(SysTick_Type, SysTick);
+SIM_PERIPH(RTC_TypeDef, RTC);
+SIM_PERIPH(PWR_TypeDef, PWR);
+SIM_PERIPH(EXTI_TypeDef, EXTI);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA1_Stream0);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA1_Stream5);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA1_Stream6);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream0);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream1);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream2);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream3);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream4);
+SIM_PERIPH(DMA_Stream_TypeDef, DMA2_Stream7);
+
+uint32_t SystemCoreClock = 84000000;
+const uint32_t g_pfnVectors[2];  /* Startup file symbol, for SCB->VTOR */
+
+/* ==================== TIME ==================== */
+
+#define SIM_MAX_TIMERS 8
+
+typedef struct {
+    osTimerFunc_t func;
+    void* argument;
+    osTimerType_t type;
+    uint32_t period;
+    uint32_t expiry;
+    uint8_t running;
+} SIM_Timer_t;
+
+static uint32_t sim_tick = 0;
+static SIM_Timer_t sim_timers[SIM_MAX_TIMERS];
+static uint8_t sim_timer_count = 0;
+static uint32_t sim_flags = 0;
+static uint32_t sim_resets = 0;
+static uint8_t sim_sleep_allowed = 0;
+static uint32_t sim_stops = 0;
+static uint32_t sim_wakeup_counter = 0;
+static uint32_t sim_rtc_ms = 0;
+
+uint32_t SIM_Tick(void) {
+    return sim_tick;
+}
+
+/* Step to each timer expiry in turn, so callbacks see the right time */
+void SIM_AdvanceTick(uint32_t ms) {
+    uint32_t target = sim_tick + ms;
+    SIM_Timer_t* next;
+    
+    while(1) {
+        SIM_Poll();
+        
+        next = NULL;
+        for(uint8_t i = 0; i < sim_timer_count; i++) {
+            SIM_Timer_t* t = &sim_timers[i];
+            if(t->running && (int32_t)(t->expiry - target) <= 0 &&
+               (next == NULL || (int32_t)(t->expiry - next->expiry) < 0)) {
+                next = t;
+            }
+        }
+        if(next == NULL) {
+            break;
+        }
+        
+        sim_tick = next->expiry;
+        if(next->type == osTimerPeriodic) {
+            next->expiry += next->period;
+        } else {
+            next->running = 0;
+        }
+        next->func(next->argument);
+    }
+    sim_tick = target;
+}
+
+uint32_t SIM_TakeFlags(void) {
+    uint32_t flags = sim_flags;
+    
+    sim_flags = 0;
+    return flags;
+}
+
+uint32_t SIM_ResetCount(void) {
+    return sim_resets;
+}
+
+void SIM_AllowSleep(uint8_t allow) {
+    sim_sleep_allowed = allow;
+}
+
+uint32_t SIM_StopCount(void) {
+    return sim_stops;
+}
+
+/* Calendar registers for the time of day in ms, as the RTC would show
+ * them with the 1 Hz calendar */
+static void SIM_RtcSet(uint32_t ms) {
+    uint32_t s = (ms / 1000) % 86400;
+    uint32_t h = s / 3600, m = (s / 60) % 60;
+    
+    s %= 60;
+    RTC->TR = ((h / 10) << 20) | ((h % 10) << 16) | ((m / 10) << 12) |
+              ((m % 10) << 8) | ((s / 10) << 4) | (s % 10);
+    RTC->SSR = 999 - (ms % 1000);
+}
+
+HAL_StatusTypeDef HAL_Init(void) { return HAL_OK; }
+HAL_StatusTypeDef HAL_InitTick(uint32_t priority) { return HAL_OK; }
+uint32_t HAL_GetTick(void) { return sim_tick; }
+void HAL_IncTick(void) { sim_tick++; }
+void HAL_Delay(uint32_t ms) { SIM_AdvanceTick(ms); }
+void HAL_SuspendTick(void) {}
+void HAL_ResumeTick(void) {}
+
+/* ==================== FLASH ==================== */
+
+#define SIM_FLASH_BASE  0x08000000u
+#define SIM_FLASH_SIZE  0x00040000u     /* STM32F401CC, 256 KB */
+
+static const uint32_t sim_sector_base[] = {
+    0x08000000, 0x08004000, 0x08008000, 0x0800C000, 0x08010000, 0x08020000, 0x08040000
+};
+#define SIM_FLASH_SECTORS (sizeof(sim_sector_base) / sizeof(sim_sector_base[0]) - 1)
+
+static uint8_t* sim_flash = NULL;
+static uint8_t sim_flash_locked = 1;
+
+static void SIM_FlashMap(void) {
+    void* p;
+    
+    if(sim_flash != NULL) {
+        return;
+    }
+    p = mmap((void*)(uintptr_t)SIM_FLASH_BASE, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if(p == MAP_FAILED || p != (void*)(uintptr_t)SIM_FLASH_BASE) {
+        if(p != MAP_FAILED) {
+            munmap(p, SIM_FLASH_SIZE);
+        }
+        fprintf(stderr, "sim: cannot map flash at 0x%08X, flash access will fault\n",
+                (unsigned)SIM_FLASH_BASE);
+        return;
+    }
+    sim_flash = p;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { sim_flash_locked = 0; return HAL_OK; }
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { sim_flash_locked = 1; return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+    uint32_t size = 1u << TypeProgram;  /* BYTE, HALFWORD, WORD, DOUBLEWORD */
+    
+    if(sim_flash == NULL || sim_flash_locked || Address < SIM_FLASH_BASE ||
+       Address + size > SIM_FLASH_BASE + SIM_FLASH_SIZE || (Address & (size - 1))) {
+        return HAL_ERROR;
+    }
+    for(uint32_t i = 0; i < size; i++) {
+        sim_flash[Address - SIM_FLASH_BASE + i] &= (uint8_t)(Data >> (8 * i));
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+    return HAL_FLASH_Program(TypeProgram, Address, Data);
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* init, uint32_t* SectorError) {
+    *SectorError = 0xFFFFFFFF;
+    if(sim_flash == NULL || sim_flash_locked ||
+       init->Sector + init->NbSectors > SIM_FLASH_SECTORS) {
+        *SectorError = init->Sector;
+        return HAL_ERROR;
+    }
+    for(uint32_t s = init->Sector; s < init->Sector + init->NbSectors; s++) {
+        memset(&sim_flash[sim_sector_base[s] - SIM_FLASH_BASE], 0xFF,
+               sim_sector_base[s + 1] - sim_sector_base[s]);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef* init) {
+    uint32_t error;
+    
+    return HAL_FLASHEx_Erase(init, &error);
+}
+
+void HAL_FLASH_IRQHandler(void) {}
+
+/* ==================== UART ==================== */
+
+typedef struct {
+    UART_HandleTypeDef* huart;
+    const uint8_t* tx_data;
+    uint16_t tx_length;
+    uint8_t tx_busy;
+    uint16_t rx_size;
+} SIM_Uart_t;
+
+static SIM_Uart_t sim_uarts[4];
+static SIM_UartSink_t sim_uart_sink = NULL;
+
+static SIM_Uart_t* SIM_FindUart(UART_HandleTypeDef* huart) {
+    for(uint8_t i = 0; i < sizeof(sim_uarts) / sizeof(sim_uarts[0]); i++) {
+        if(sim_uarts[i].huart == huart || sim_uarts[i].huart == NULL) {
+            sim_uarts[i].huart = huart;
+            return &sim_uarts[i];
+        }
+    }
+    return NULL;
+}
+
+void SIM_UartSetSink(SIM_UartSink_t sink) {
+    sim_uart_sink = sink;
+}
+
+uint32_t SIM_UartDrain(UART_HandleTypeDef* huart) {
+    SIM_Uart_t* u = SIM_FindUart(huart);
+    uint32_t total = 0;
+    
+    /* The callback usually chains the next span straight away */
+    while(u != NULL && u->tx_busy) {
+        if(sim_uart_sink != NULL) {
+            sim_uart_sink(huart, u->tx_data, u->tx_length);
+        }
+        total += u->tx_length;
+        u->tx_busy = 0;
+        huart->gState = HAL_UART_STATE_READY;
+        HAL_UART_TxCpltCallback(huart);
+    }
+    return total;
+}
+
+void SIM_UartRxAdvance(UART_HandleTypeDef* huart, uint16_t length) {
+    SIM_Uart_t* u = SIM_FindUart(huart);
+    uint32_t pos;
+    
+    if(u == NULL || u->rx_size == 0 || huart->hdmarx == NULL) {
+        return;
+    }
+    pos = (u->rx_size - huart->hdmarx->Instance->NDTR + length) % u->rx_size;
+    huart->hdmarx->Instance->NDTR = u->rx_size - pos;
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart) {
+    huart->gState = HAL_UART_STATE_READY;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef* huart) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size) {
+    SIM_Uart_t* u = SIM_FindUart(huart);
+    
+    if(u == NULL || u->tx_busy) {
+        return HAL_BUSY;
+    }
+    u->tx_data = pData;
+    u->tx_length = Size;
+    u->tx_busy = 1;
+    huart->gState = HAL_UART_STATE_READY | 0x01;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+    if(sim_uart_sink != NULL) {
+        sim_uart_sink(huart, pData, Size);
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+    SIM_Uart_t* u = SIM_FindUart(huart);
+    
+    if(u == NULL) {
+        return HAL_ERROR;
+    }
+    u->rx_size = Size;
+    if(huart->hdmarx != NULL) {
+        huart->hdmarx->Instance->NDTR = Size;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DMAStop(UART_HandleTypeDef* huart) { return HAL_OK; }
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef* huart) { return HAL_OK; }
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef* huart) { return HAL_OK; }
+void HAL_UART_IRQHandler(UART_HandleTypeDef* huart) {}
+
+/* ==================== I2C ==================== */
+
+typedef struct {
+    I2C_HandleTypeDef* hi2c;
+    uint8_t rx;
+} SIM_I2CEvent_t;
+
+static uint8_t sim_i2c_regs[128][256];
+static SIM_I2CEvent_t sim_i2c_pending[8];
+static uint8_t sim_i2c_pending_count = 0;
+
+void SIM_I2CLoad(uint8_t addr, uint8_t reg, const uint8_t* data, uint16_t length) {
+    for(uint16_t i = 0; i < length; i++) {
+        sim_i2c_regs[addr & 0x7F][(uint8_t)(reg + i)] = data[i];
+    }
+}
+
+/* Register auto-increment, as on every sensor here */
+static void SIM_I2CTransfer(uint16_t DevAddress, uint16_t MemAddress, uint8_t* pData, uint16_t Size, uint8_t rx) {
+    uint8_t* regs = sim_i2c_regs[(DevAddress >> 1) & 0x7F];
+    
+    for(uint16_t i = 0; i < Size; i++) {
+        if(rx) {
+            pData[i] = regs[(uint8_t)(MemAddress + i)];
+        } else {
+            regs[(uint8_t)(MemAddress + i)] = pData[i];
+        }
+    }
+}
+
+static HAL_StatusTypeDef SIM_I2CDefer(I2C_HandleTypeDef* hi2c, uint8_t rx) {
+    if(sim_i2c_pending_count >= sizeof(sim_i2c_pending) / sizeof(sim_i2c_pending[0])) {
+        return HAL_BUSY;
+    }
+    sim_i2c_pending[sim_i2c_pending_count].hi2c = hi2c;
+    sim_i2c_pending[sim_i2c_pending_count].rx = rx;
+    sim_i2c_pending_count++;
+    return HAL_OK;
+}
+
+void SIM_Poll(void) {
+    SIM_I2CEvent_t event;
+    
+    /* A completion may start the next transfer, which queues again */
+    while(sim_i2c_pending_count > 0) {
+        event = sim_i2c_pending[0];
+        memmove(sim_i2c_pending, &sim_i2c_pending[1], --sim_i2c_pending_count * sizeof(event));
+        if(event.rx) {
+            HAL_I2C_MemRxCpltCallback(event.hi2c);
+        } else {
+            HAL_I2C_MemTxCpltCallback(event.hi2c);
+        }
+    }
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef* hi2c) { return HAL_OK; }
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef* hi2c) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+    SIM_I2CTransfer(DevAddress, MemAddress, pData, Size, 1);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t* pData, uint16_t Size, uint32_t Timeout) {
+    SIM_I2CTransfer(DevAddress, MemAddress, pData, Size, 0);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                      uint16_t MemAddSize, uint8_t* pData, uint16_t Size) {
+    SIM_I2CTransfer(DevAddress, MemAddress, pData, Size, 1);
+    return SIM_I2CDefer(hi2c, 1);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                       uint16_t MemAddSize, uint8_t* pData, uint16_t Size) {
+    SIM_I2CTransfer(DevAddress, MemAddress, pData, Size, 1);
+    return SIM_I2CDefer(hi2c, 1);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                       uint16_t MemAddSize, uint8_t* pData, uint16_t Size) {
+    SIM_I2CTransfer(DevAddress, MemAddress, pData, Size, 0);
+    return SIM_I2CDefer(hi2c, 0);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress,
+                                        uint16_t MemAddSize, uint8_t* pData, uint16_t Size) {
+    return HAL_I2C_Mem_Write_IT(hi2c, DevAddress, MemAddress, MemAddSize, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout) {
+    return HAL_OK;
+}
+
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef* hi2c) {}
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef* hi2c) {}
+
+/* ==================== OTHER PERIPHERALS ==================== */
+
+/* Accepted and never completed - the harness drives these modules'
+ * conversion code directly */
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* init) {}
+void HAL_GPIO_DeInit(GPIO_TypeDef* GPIOx, uint32_t pin) {}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t pin, GPIO_PinState state) {
+    if(state == GPIO_PIN_SET) {
+        GPIOx->ODR |= pin;
+    } else {
+        GPIOx->ODR &= ~(uint32_t)pin;
+    }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t pin) {
+    return (GPIOx->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t pin) { GPIOx->ODR ^= pin; }
+void HAL_GPIO_EXTI_IRQHandler(uint16_t pin) {}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma) { return HAL_OK; }
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef* hdma) {}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi) { return HAL_OK; }
+HAL_StatusTypeDef HAL_SPI_DeInit(SPI_HandleTypeDef* hspi) { return HAL_OK; }
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi) { return HAL_OK; }
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef* hspi, const uint8_t* pTxData,
+                                              uint8_t* pRxData, uint16_t Size) { return HAL_OK; }
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef* hspi) {}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* config) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length) { return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef* hadc) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef* htim, TIM_ClockConfigTypeDef* config) { return HAL_OK; }
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* config) { return HAL_OK; }
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef* htim) {}
+
+HAL_StatusTypeDef HAL_IWDG_Init(IWDG_HandleTypeDef* hiwdg) { return HAL_OK; }
+HAL_StatusTypeDef HAL_IWDG_Refresh(IWDG_HandleTypeDef* hiwdg) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_RTC_Init(RTC_HandleTypeDef* hrtc) { return HAL_OK; }
+HAL_StatusTypeDef HAL_RTC_WaitForSynchro(RTC_HandleTypeDef* hrtc) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT(RTC_HandleTypeDef* hrtc, uint32_t counter, uint32_t clock) {
+    sim_wakeup_counter = counter;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTCEx_DeactivateWakeUpTimer(RTC_HandleTypeDef* hrtc) {
+    EXTI->PR &= ~RTC_EXTI_LINE_WAKEUPTIMER_EVENT;
+    return HAL_OK;
+}
+
+void HAL_RTCEx_WakeUpTimerIRQHandler(RTC_HandleTypeDef* hrtc) {}
+
+void HAL_PWR_EnableBkUpAccess(void) {}
+
+/* Sleep until the wakeup timer fires: the RTC moves on, the tick does
+ * not (the tickless hook steps it) */
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry) {
+    sim_stops++;
+    sim_rtc_ms += ((sim_wakeup_counter + 1) * 1000) / 2000;  /* RTCCLK / 16 */
+    SIM_RtcSet(sim_rtc_ms);
+    EXTI->PR |= RTC_EXTI_LINE_WAKEUPTIMER_EVENT;
+}
+
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry) {}
+void HAL_PWREx_EnableFlashPowerDown(void) {}
+void HAL_PWREx_DisableFlashPowerDown(void) {}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef* init) { return HAL_OK; }
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef* init, uint32_t latency) { return HAL_OK; }
+HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef* init) { return HAL_OK; }
+uint32_t HAL_RCC_GetHCLKFreq(void) { return SystemCoreClock; }
+uint32_t HAL_RCC_GetPCLK1Freq(void) { return SystemCoreClock / 2; }
+uint32_t HAL_RCC_GetPCLK2Freq(void) { return SystemCoreClock; }
+uint32_t HAL_RCC_GetSysClockFreq(void) { return SystemCoreClock; }
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {}
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {}
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {}
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type IRQn) {}
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup) {}
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {}
+
+/* The target never returns from here; the harness carries on and counts */
+void NVIC_SystemReset(void) {
+    sim_resets++;
+}
+
+/* ==================== RTOS ==================== */
+
+static uint32_t sim_thread_count = 0;
+
+osStatus_t osKernelInitialize(void) { return osOK; }
+osStatus_t osKernelStart(void) { return osOK; }
+uint32_t osKernelGetTickCount(void) { return sim_tick; }
+uint32_t osKernelGetTickFreq(void) { return configTICK_RATE_HZ; }
+
+/* Threads are never run; the harness calls task bodies' pieces itself */
+osThreadId_t osThreadNew(osThreadFunc_t func, void* argument, const osThreadAttr_t* attr) {
+    return (osThreadId_t)(uintptr_t)++sim_thread_count;
+}
+
+osThreadId_t osThreadGetId(void) { return (osThreadId_t)(uintptr_t)0x51u; }
+
+uint32_t osThreadFlagsSet(osThreadId_t thread_id, uint32_t flags) {
+    sim_flags |= flags;
+    return sim_flags;
+}
+
+uint32_t osThreadFlagsClear(uint32_t flags) {
+    uint32_t old = sim_flags;
+    
+    sim_flags &= ~flags;
+    return old;
+}
+
+uint32_t osThreadFlagsWait(uint32_t flags, uint32_t options, uint32_t timeout) {
+    uint32_t got = sim_flags & flags;
+    
+    if(got == 0 || ((options & osFlagsWaitAll) && got != flags)) {
+        if(timeout != osWaitForever) {
+            SIM_AdvanceTick(timeout);
+        }
+        return osFlagsErrorTimeout;
+    }
+    if(!(options & osFlagsNoClear)) {
+        sim_flags &= ~got;
+    }
+    return got;
+}
+
+osStatus_t osDelay(uint32_t ticks) {
+    SIM_AdvanceTick(ticks);
+    return osOK;
+}
+
+osTimerId_t osTimerNew(osTimerFunc_t func, osTimerType_t type, void* argument, const osTimerAttr_t* attr) {
+    SIM_Timer_t* t;
+    
+    if(sim_timer_count >= SIM_MAX_TIMERS) {
+        return NULL;
+    }
+    t = &sim_timers[sim_timer_count++];
+    t->func = func;
+    t->argument = argument;
+    t->type = type;
+    t->running = 0;
+    return t;
+}
+
+osStatus_t osTimerStart(osTimerId_t timer_id, uint32_t ticks) {
+    SIM_Timer_t* t = timer_id;
+    
+    if(t == NULL || ticks == 0) {
+        return osErrorParameter;
+    }
+    t->period = ticks;
+    t->expiry = sim_tick + ticks;
+    t->running = 1;
+    return osOK;
+}
+
+osStatus_t osTimerStop(osTimerId_t timer_id) {
+    SIM_Timer_t* t = timer_id;
+    
+    if(t == NULL || !t->running) {
+        return osErrorResource;
+    }
+    t->running = 0;
+    return osOK;
+}
+
+uint32_t osTimerIsRunning(osTimerId_t timer_id) {
+    SIM_Timer_t* t = timer_id;
+    
+    return t != NULL && t->running;
+}
+
+TickType_t xTaskGetTickCount(void) { return sim_tick; }
+TickType_t xTaskGetTickCountFromISR(void) { return sim_tick; }
+void vTaskDelay(TickType_t ticks) { SIM_AdvanceTick(ticks); }
+
+void vTaskDelayUntil(TickType_t* previous, TickType_t increment) {
+    *previous += increment;
+    if((int32_t)(*previous - sim_tick) > 0) {
+        SIM_AdvanceTick(*previous - sim_tick);
+    }
+}
+
+void vTaskStepTick(TickType_t ticks) { sim_tick += ticks; }
+eSleepModeStatus eTaskConfirmSleepModeStatus(void) { return sim_sleep_allowed ? eStandardSleep : eAbortSleep; }
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* status, UBaseType_t size, uint32_t* total) {
+    if(total != NULL) {
+        *total = 0;
+    }
+    return 0;
+}
+
+/* One thread, no preemption: nothing to lock against */
+void vPortEnterCritical(void) {}
+void vPortExitCritical(void) {}
+UBaseType_t taskENTER_CRITICAL_FROM_ISR_fn(void) { return 0; }
+void vTaskSuspendAll(void) {}
+BaseType_t xTaskResumeAll(void) { return pdFALSE; }
+
+/* ==================== SETUP ==================== */
+
+void SIM_Init(void) {
+    SIM_FlashMap();
+    if(sim_flash != NULL) {
+        memset(sim_flash, 0xFF, SIM_FLASH_SIZE);
+    }
+    sim_flash_locked = 1;
+    
+    sim_tick = 0;
+    sim_flags = 0;
+    sim_resets = 0;
+    sim_sleep_allowed = 0;
+    sim_stops = 0;
+    sim_rtc_ms = 0;
+    SIM_RtcSet(0);
+    sim_timer_count = 0;
+    sim_i2c_pending_count = 0;
+    memset(sim_uarts, 0, sizeof(sim_uarts));
+    memset(sim_i2c_regs, 0, sizeof(sim_i2c_regs));
+}
@@ -0,0 +1,43 @@
+/* sim.h - Host Simulation Controls
+ *
+ * What the host harness uses to stand in for the hardware around the
+ * firmware modules: time, interrupts and the far ends of the buses.
+ */
+#ifndef __SIM_H
+#define __SIM_H
+
+#include "main.h"
+
+void SIM_Init(void);                    /* Tick 0, flash erased, buses idle */
+
+/* Time only moves when the harness moves it. Software timers and
+ * deferred bus completions fire from here, as interrupts would. */
+uint32_t SIM_Tick(void);
+void SIM_AdvanceTick(uint32_t ms);
+void SIM_Poll(void);                    /* Deliver pending I2C completions */
+
+/* Thread flags posted by any context since the last call */
+uint32_t SIM_TakeFlags(void);
+
+/* I2C devices are register files, by 7-bit address */
+void SIM_I2CLoad(uint8_t addr, uint8_t reg, const uint8_t* data, uint16_t length);
+
+/* UART TX: a started DMA transfer stays in flight until drained, which
+ * hands its bytes to the sink and runs the TX complete callback */
+typedef void (*SIM_UartSink_t)(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t length);
+void SIM_UartSetSink(SIM_UartSink_t sink);
+uint32_t SIM_UartDrain(UART_HandleTypeDef* huart);
+
+/* UART RX: move the circular DMA counter over bytes about to be written
+ * into the ring by software (COMM_ProcessReceivedData) - the DMA is
+ * always ahead of the idle-line event that reports it */
+void SIM_UartRxAdvance(UART_HandleTypeDef* huart, uint16_t length);
+
+uint32_t SIM_ResetCount(void);          /* NVIC_SystemReset calls */
+
+/* Tickless idle: the kernel refuses to sleep unless allowed; STOP lasts
+ * until the RTC wakeup timer fires, moving the RTC but not the tick */
+void SIM_AllowSleep(uint8_t allow);
+uint32_t SIM_StopCount(void);           /* HAL_PWR_EnterSTOPMode calls */
+
+#endif /* __SIM_H */
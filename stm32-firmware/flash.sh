@@ -0,0 +1,27 @@
+#!/bin/sh
+# Flash the CubeSat STM32 over ST-Link.
+#
+#   ./flash.sh boot BIN   bootloader, linked with Bootloader/STM32F401CCUX_BOOT.ld
+#   ./flash.sh app BIN    application, linked with STM32F401CCUX_FLASH.ld
+#
+# The addresses are FWU_APP_BASE and the start of flash in
+# Core/Inc/fwslot.h; both linker scripts fail the link when an image
+# outgrows its sectors. A board without the bootloader does not start the
+# application.
+set -e
+
+BOOT_BASE=0x08000000
+APP_BASE=0x08004000
+
+case "$1" in
+    boot) addr=$BOOT_BASE ;;
+    app)  addr=$APP_BASE ;;
+    *)    echo "usage: $0 boot|app image.bin" >&2; exit 2 ;;
+esac
+
+if [ ! -f "$2" ]; then
+    echo "$0: no image $2" >&2
+    exit 2
+fi
+
+st-flash --reset write "$2" "$addr"
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""
+SRAM budget report for the STM32 firmware
+Sums .data and .bss per object file (or per symbol for a linked ELF),
+lists the task stacks and the largest buffers, and checks the total
+against the STM32F401CC's 64 KB. Run after the build:
+
+    python3 ram_budget.py build/*.o
+    python3 ram_budget.py build/CubeSat.elf
+
+Exits with status 1 if the budget is exceeded, so it can gate the build.
+"""
+import os
+import sys
+import argparse
+import subprocess
+from collections import defaultdict
+
+RAM_SIZE = 64 * 1024
+MSP_STACK = 0x400       # _Min_Stack_Size in the linker script, ISRs run here
+HEAP_RESERVE = 0x200    # _Min_Heap_Size, newlib only - FreeRTOS allocates statically
+
+
+def read_symbols(path, nm):
+    """(name, size) of every .data/.bss symbol in the file"""
+    out = subprocess.run([nm, '-S', '--size-sort', path],
+                         capture_output=True, text=True, check=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 4 and parts[2] in 'bBdD':
+            symbols.append((parts[3], int(parts[1], 16)))
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description='STM32 SRAM budget report')
+    parser.add_argument('files', nargs='+', help='object files or linked ELF')
+    parser.add_argument('--nm', default='arm-none-eabi-nm')
+    parser.add_argument('--top', type=int, default=12, help='largest symbols to list')
+    args = parser.parse_args()
+
+    modules = defaultdict(int)
+    symbols = []
+    for path in args.files:
+        module = os.path.splitext(os.path.basename(path))[0]
+        for name, size in read_symbols(path, args.nm):
+            modules[module] += size
+            symbols.append((name, size, module))
+
+    used = sum(modules.values())
+    reserved = MSP_STACK + HEAP_RESERVE
+    free = RAM_SIZE - used - reserved
+
+    print(f"{'Module':<24}{'Bytes':>8}")
+    for module, size in sorted(modules.items(), key=lambda m: -m[1]):
+        print(f"{module:<24}{size:>8}")
+
+    stacks = [s for s in symbols if s[0].endswith('_stack')]
+    if stacks:
+        print(f"\n{'Task stack':<24}{'Bytes':>8}")
+        for name, size, _ in sorted(stacks):
+            print(f"{name:<24}{size:>8}")
+
+    print(f"\n{'Largest':<32}{'Bytes':>8}  Module")
+    for name, size, module in sorted(symbols, key=lambda s: -s[1])[:args.top]:
+        print(f"{name:<32}{size:>8}  {module}")
+
+    print(f"\nStatic data    {used:>6} B")
+    print(f"MSP + heap     {reserved:>6} B")
+    print(f"Free           {free:>6} B of {RAM_SIZE} ({100 * free / RAM_SIZE:.1f}%)")
+
+    if free < 0:
+        print("RAM budget exceeded", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""
+Telemetry schema generator
+Reads the TelemetryPacket_t layout from Core/Inc/main.h and writes
+telemetry_schema.py for the Pi and the ground station, so neither keeps
+its own copy of the offsets. Run it after changing the struct:
+
+    python3 tlm_schema.py
+    python3 tlm_schema.py --check
+
+--check only compares, and exits with status 1 if a generated file is
+out of date, so it can gate the build.
+"""
+import os
+import re
+import sys
+import struct
+import argparse
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+HEADER = os.path.join(HERE, 'Core', 'Inc', 'main.h')
+OUTPUTS = [
+    os.path.join(HERE, '..', 'raspberry-pi-code', 'telemetry_schema.py'),
+    os.path.join(HERE, '..', 'ground-station', 'telemetry_schema.py'),
+]
+
+# C type -> struct format character; all little-endian, packed
+TYPES = {
+    'uint8_t': 'B', 'int8_t': 'b',
+    'uint16_t': 'H', 'int16_t': 'h',
+    'uint32_t': 'I', 'int32_t': 'i',
+    'float': 'f',
+}
+
+FIELD_RE = re.compile(r'^\s*(\w+)\s+(\w+)\s*(?:\[\s*(\w+)\s*\])?\s*;\s*(?:/\*\s*(.*?)\s*\*/)?')
+
+
+def read_layout(path):
+    """[(name, format char, count, comment)] of TelemetryPacket_t"""
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+
+    defines = {name: int(value, 0) for name, value in
+               re.findall(r'^#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)\b', text, re.M)}
+
+    body = re.search(r'typedef struct __attribute__\(\(packed\)\) \{(.*?)\}\s*TelemetryPacket_t;',
+                     text, re.S)
+    if not body:
+        sys.exit(f'{path}: TelemetryPacket_t not found')
+
+    fields = []
+    for line in body.group(1).splitlines():
+        m = FIELD_RE.match(line)
+        if not m:
+            continue
+        ctype, name, dim, comment = m.groups()
+        if ctype not in TYPES:
+            sys.exit(f'{path}: {name}: unsupported type {ctype}')
+        count = 1
+        if dim:
+            count = int(dim, 0) if dim[0].isdigit() else defines.get(dim)
+            if count is None:
+                sys.exit(f'{path}: {name}: unknown array size {dim}')
+        fields.append((name, TYPES[ctype], count, comment or ''))
+
+    if fields[-1][0] != 'checksum' or fields[0][0] != 'sync1':
+        sys.exit(f'{path}: TelemetryPacket_t must start with sync1 and end with checksum')
+    return fields
+
+
+def layout_format(fields):
+    return '<' + ''.join(f'{n}{c}' if n > 1 else c for _, c, n, _ in fields)
+
+
+def render(fields):
+    fmt = layout_format(fields)
+    size = struct.calcsize(fmt)
+
+    out = []
+    w = out.append
+    w('"""')
+    w('Telemetry packet schema - TelemetryPacket_t from stm32-firmware/Core/Inc/main.h')
+    w('')
+    w('GENERATED by stm32-firmware/tlm_schema.py, do not edit. decode() reads one')
+    w('frame with a single precompiled unpack.')
+    w('"""')
+    w('import struct')
+    w('')
+    w('SYNC = 0xAA55')
+    w(f'FRAME_SIZE = {size}')
+    w('')
+    w('# (name, struct format, count, unit / meaning) in wire order')
+    w('FIELDS = (')
+    for name, c, n, comment in fields:
+        w(f'    ({name!r}, {c!r}, {n}, {comment!r}),')
+    w(')')
+    w('')
+    w(f'FORMAT = {fmt!r}')
+    w('STRUCT = struct.Struct(FORMAT)')
+    w('assert STRUCT.size == FRAME_SIZE')
+    w('')
+    w('')
+    w('def _crc16_table():')
+    w('    table = []')
+    w('    for i in range(256):')
+    w('        crc = i << 8')
+    w('        for _ in range(8):')
+    w('            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)')
+    w('        table.append(crc & 0xFFFF)')
+    w('    return table')
+    w('')
+    w('_CRC16_TABLE = _crc16_table()')
+    w('')
+    w('')
+    w('def crc16(data):')
+    w('    """CRC-16/CCITT-FALSE, as CRC16_Calculate in the firmware"""')
+    w('    crc = 0xFFFF')
+    w('    for b in data:')
+    w('        crc = ((crc << 8) & 0xFFFF) ^ _CRC16_TABLE[((crc >> 8) ^ b) & 0xFF]')
+    w('    return crc')
+    w('')
+    w('')
+    w('def decode(frame, check=True):')
+    w('    """One frame -> dict of fields by C name, None if sync, length or CRC is wrong"""')
+    w('    if len(frame) < FRAME_SIZE or frame[0] != 0xAA or frame[1] != 0x55:')
+    w('        return None')
+    w('    values = STRUCT.unpack_from(frame)')
+    w('    if check and values[-1] != crc16(frame[:FRAME_SIZE - 2]):')
+    w('        return None')
+    w('    fields = {}')
+    w('    i = 0')
+    w('    for name, _, count, _ in FIELDS:')
+    w('        fields[name] = values[i] if count == 1 else list(values[i:i + count])')
+    w('        i += count')
+    w('    return fields')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate telemetry_schema.py from main.h')
+    parser.add_argument('--check', action='store_true', help='fail if a generated file is stale')
+    args = parser.parse_args()
+
+    fields = read_layout(HEADER)
+    text = render(fields)
+
+    stale = []
+    for path in OUTPUTS:
+        path = os.path.normpath(path)
+        current = open(path, encoding='utf-8').read() if os.path.exists(path) else None
+        if current == text:
+            continue
+        if args.check:
+            stale.append(path)
+        else:
+            with open(path, 'w', encoding='utf-8') as f:
+                f.write(text)
+            print(f'wrote {path}')
+
+    print(f'TelemetryPacket_t: {len(fields)} fields, {struct.calcsize(layout_format(fields))} bytes')
+    if stale:
+        for path in stale:
+            print(f'out of date: {path}')
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
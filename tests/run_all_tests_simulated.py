@@ -20,6 +20,26 @@ TESTS = [
         'path': 'tests/test_communication_simulated.py',
         'timeout': 15
     },
+    {
+        'name': 'Telemetry Schema Test',
+        'path': 'tests/test_telemetry_schema.py',
+        'timeout': 30
+    },
+    {
+        'name': 'History Decode Test',
+        'path': 'tests/test_history_decode.py',
+        'timeout': 60
+    },
+    {
+        'name': 'Beacon Decode Test',
+        'path': 'tests/test_beacon_decode.py',
+        'timeout': 60
+    },
+    {
+        'name': 'Tickless STOP Test',
+        'path': 'tests/test_tickless_stop.py',
+        'timeout': 60
+    },
     {
         'name': 'Telemetry Database Test',
         'code': '''
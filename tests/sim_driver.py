@@ -0,0 +1,82 @@
+"""Host drivers linked against the Sim build of the STM32 firmware
+
+A test hands build_sim_driver() the C source of a small main(); it gets
+the Sim objects built, compiles and links the driver the way the Sim
+Makefile builds the firmware, and returns the executable. Every driver
+starts with PRELUDE: the firmware headers, and a UART sink capturing
+what the firmware transmits on SIM_TX_UART (huart1, the Pi link, unless
+the test defines another) into tx[] for PrintTx() to answer in hex.
+Needs a C compiler and make; build_sim_driver() returns None without
+them and the test skips itself with skip().
+"""
+import os
+import shutil
+import subprocess
+from pathlib import Path
+
+ROOT = Path(__file__).parent.parent
+SIM = ROOT / 'stm32-firmware' / 'Sim'
+
+PRELUDE = r'''
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "cmsis_os.h"
+#include "sim.h"
+
+#ifndef SIM_TX_UART
+#define SIM_TX_UART huart1
+#endif
+#ifndef SIM_TX_SIZE
+#define SIM_TX_SIZE 1024
+#endif
+
+static uint8_t tx[SIM_TX_SIZE];
+static uint32_t tx_length;
+
+static void Sink(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t length) {
+    if(huart == &SIM_TX_UART && tx_length + length <= sizeof(tx)) {
+        memcpy(&tx[tx_length], data, length);
+        tx_length += length;
+    }
+}
+
+static void PrintTx(void) {
+    for(uint32_t i = 0; i < tx_length; i++) {
+        printf("%02x", tx[i]);
+    }
+}
+#line 1 "driver.c"
+'''
+
+
+def build_sim_driver(source, tmp, defines=None):
+    """Driver executable in tmp, None without a toolchain. defines are
+    passed as -D flags (name: value, or name: None for a bare -D)"""
+    cc = shutil.which(os.environ.get('CC', 'cc'))
+    if cc is None or shutil.which('make') is None:
+        return None
+    subprocess.run(['make', '-C', str(SIM)], check=True, stdout=subprocess.DEVNULL)
+
+    src = os.path.join(tmp, 'driver.c')
+    exe = os.path.join(tmp, 'driver')
+    with open(src, 'w') as f:
+        f.write(PRELUDE + source)
+    flags = [f'-D{name}' if value is None else f'-D{name}={value}'
+             for name, value in (defines or {}).items()]
+    objects = [str(p) for p in sorted((SIM / 'build' / 'fw').glob('*.o'))]
+    subprocess.run([cc, '-std=gnu11', '-DSTM32F401xE', '-DCRC32_USE_HARDWARE=0', *flags,
+                    f'-I{SIM / "Inc"}', f'-I{SIM}', f'-I{ROOT / "stm32-firmware" / "Core" / "Inc"}',
+                    src, *objects, str(SIM / 'build' / 'hal_sim.o'), '-lm', '-o', exe], check=True)
+    return exe
+
+
+def run_cases(exe, cases):
+    """One case per stdin line, its values space separated -> the
+    driver's output lines"""
+    lines = ''.join(' '.join(str(v) for v in case) + '\n' for case in cases)
+    return subprocess.run([exe], input=lines, check=True, stdout=subprocess.PIPE, text=True).stdout.split('\n')
+
+
+def skip(name):
+    print(f"- {name} skipped, no C compiler")
@@ -0,0 +1,103 @@
+"""Decode beacons from the firmware's COMM_SendBeacon on the ground
+
+A host driver, linked against the Sim build of the firmware, publishes a
+snapshot per case and sends a beacon for it; ground-station/beacon_decoder.py
+has to read back every field at the beacon's resolution, saturated
+values included. Needs a C compiler and make; skipped without them.
+"""
+import sys
+import tempfile
+
+from sim_driver import ROOT, build_sim_driver, run_cases, skip
+
+sys.path.insert(0, str(ROOT / 'ground-station'))
+import beacon_decoder
+
+DRIVER = r'''
+#include "crc.h"
+#include "telemetry.h"
+#include "communication.h"
+
+void MX_USART2_UART_Init(void);
+extern uint32_t boot_count;
+
+/* One case per stdin line: state mV temperature errors cps boots uptime;
+ * answers the beacon in hex */
+int main(void) {
+    TelemetryPacket_t staged;
+    unsigned state, mv, errors, cps, boots, uptime;
+    float temperature;
+    uint16_t hist[TLM_RADIATION_BINS] = {0};
+
+    SIM_Init();
+    SIM_UartSetSink(Sink);
+    MX_USART2_UART_Init();
+    COMM_Init();
+
+    memset(&staged, 0, sizeof(staged));
+    while(scanf("%u %u %f %u %u %u %u", &state, &mv, &temperature, &errors, &cps, &boots, &uptime) == 7) {
+        system_state = (uint8_t)state;
+        boot_count = boots;
+        staged.battery_voltage = (uint16_t)mv;
+        staged.temperature_tmp = temperature;
+        staged.uptime = uptime;
+        TLM_PublishSensors(&staged);
+        TLM_PublishRadiation(cps, hist);
+        TLM_LogError((uint8_t)errors);
+
+        tx_length = 0;
+        COMM_SendBeacon();
+        SIM_UartDrain(&huart2);
+        PrintTx();
+        printf("\n");
+    }
+    return 0;
+}
+'''
+
+# state, mV, degC, error flags (accumulate), cps, boots, uptime s
+CASES = [
+    (2, 3712, 21.37, 0x00, 57, 3, 7260),
+    (3, 2000, -70.0, 0x04, 5000, 300, 0),           # Battery and temperature floor, cps ceiling
+    (4, 5000, 80.0, 0x10, 4095, 255, 0x1FFFF * 60 + 59),
+    (5, 3400, -0.26, 0x01, 0, 256, 10 * 0x1FFFF * 60),  # Uptime ceiling, boot count wraps
+]
+
+
+def expected(case, flags):
+    state, mv, temperature, _, cps, boots, uptime = case
+    clamp = lambda v, lo, hi: max(lo, min(hi, v))
+    half_degrees = int(abs(temperature) * 2 + 0.5) * (1 if temperature >= 0 else -1)  # lroundf
+    return {
+        'system_state': state,
+        'battery_voltage': clamp(int((mv - 2500) / 8), 0, 0xFF) * 8 + 2500,
+        'temperature_tmp': clamp(half_degrees, -128, 127) / 2.0,
+        'error_flags': flags,
+        'radiation_cps': min(cps, 0xFFF),
+        'boot_count': boots & 0xFF,
+        'uptime': clamp(uptime // 60, 0, 0x1FFFF) * 60,
+    }
+
+
+def main():
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = build_sim_driver(DRIVER, tmp, {'SIM_TX_UART': 'huart2', 'SIM_TX_SIZE': 64})
+        if exe is None:
+            skip("Beacon decode test")
+            return
+        out = run_cases(exe, CASES)[:len(CASES)]
+
+    flags = 0
+    for case, line in zip(CASES, out):
+        frame = bytes.fromhex(line)
+        assert len(frame) == beacon_decoder.FRAME_SIZE, len(frame)
+        flags |= case[3]
+        assert beacon_decoder.decode(frame) == expected(case, flags), (case, beacon_decoder.decode(frame))
+        assert beacon_decoder.decode(frame[:5] + bytes([frame[5] ^ 0x40]) + frame[6:]) is None
+    assert all(out), out
+    print(f"✓ {len(CASES)} beacons decoded")
+    print("✓ Beacon decode test passed")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,261 @@
+"""Decode a flash history backfill on the ground, against the firmware's own decoder
+
+A host driver, linked against the Sim build of the firmware, logs a few
+hundred varied snapshots with HIST_Append, serves them with
+DUMP_SendRange as the STM32 would and records the history frames it puts
+on the Pi UART. It also decodes those frames with HIST_Decode, so
+ground-station/history_decoder.py has to rebuild every TelemetryPacket_t
+bit for bit. Then the same log goes out as a windowed DUMP_HISTORY over
+a lossy link, acknowledged by the ground's DumpReceiver, and has to
+arrive whole with no record saved twice. Needs a C compiler and make;
+skipped without them.
+"""
+import os
+import sys
+import tempfile
+import subprocess
+from collections import deque
+
+from sim_driver import ROOT, build_sim_driver, skip
+
+COUNT = 300
+SESSION = 0x1234
+
+sys.path.insert(0, str(ROOT / 'ground-station'))
+import telemetry_schema
+from history_decoder import HistoryDecoder, DumpReceiver
+
+DRIVER = r'''
+#include <math.h>
+#include "crc.h"
+#include "history.h"
+#include "dump.h"
+#include "communication.h"
+
+void MX_USART1_UART_Init(void);
+
+/* Run DownlinkTask until the TX ring stops moving */
+static uint32_t Service(void) {
+    uint32_t timeout, guard = 0;
+
+    do {
+        timeout = DUMP_Service();
+    } while(SIM_UartDrain(&huart1) != 0 && ++guard < 100000);
+    return timeout;
+}
+
+/* Dump mode: one line per step on stdin, "A session base bitmap" (an
+ * ACK) or "T ms" (time passes); answers "<idle> <TX bytes in hex>" */
+static int Dump(void) {
+    char line[64];
+    unsigned session, base, bitmap, ms;
+    uint32_t timeout;
+
+    DUMP_Start(SESSION, 0, 0xFFFF, DUMP_DEFAULT_WINDOW);
+    while(fgets(line, sizeof(line), stdin) != NULL) {
+        if(sscanf(line, "A %u %u %u", &session, &base, &bitmap) == 3) {
+            DUMP_HandleAck((uint16_t)session, (uint16_t)base, bitmap);
+        } else if(sscanf(line, "T %u", &ms) == 1) {
+            SIM_AdvanceTick(ms);
+        }
+        tx_length = 0;
+        timeout = Service();
+        printf("%d ", timeout == osWaitForever);
+        PrintTx();
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static void Fill(TelemetryPacket_t* p, uint32_t i) {
+    p->sequence_number = (uint16_t)(i + (i > 150 ? 3 : 0));  /* A gap */
+    p->timestamp = 1000 * i + ((i % 7 == 0) ? 13 : 0);
+    p->mag_x = 0.2113f + 0.00131f * (float)(i % 17);
+    p->mag_y = -0.4471f + 0.0007f * (float)(i % 5);
+    p->mag_z = 0.0f - 0.0291f * (float)(i % 3);
+    p->temperature_bme = 21.37f - 0.013f * (float)i;
+    p->pressure = 1013.25f - 0.37f * (float)i;
+    p->humidity = (i == 40) ? NAN : 41.5f + 0.07f * (float)(i % 11);
+    p->temperature_tmp = 20.0f + (float)i / 128.0f;
+    p->radiation_cps = (i * 7) % 23;
+    for(uint8_t k = 0; k < TLM_RADIATION_BINS; k++) {
+        p->radiation_hist[k] = (i % 5 == 0) ? 0 : (uint16_t)((i * (k + 1)) % ((i % 9 == 0) ? 4000 : 9));
+    }
+    p->corrosion_raw = (uint16_t)(512 + (i % 4));
+    p->battery_voltage = (uint16_t)(3700 - i / 3);
+    p->battery_current = (uint16_t)(120 + (i % 13));
+    p->uptime = 86400 + i;
+    p->latitude = -337000000 + (int32_t)i * 13;
+    p->longitude = 1511000000 - (int32_t)i * 29;
+    p->altitude = -2000 + (int32_t)(i % 50) * 1000;
+    p->gps_quality = (uint8_t)((i / 40) % 3);
+    p->gps_satellites = (uint8_t)(4 + i % 8);
+    p->boot_count = 7;
+    p->error_flags = (i % 31 == 0) ? 0x04 : 0;
+    p->system_state = (i < 100) ? 2 : 3;
+}
+
+int main(int argc, char** argv) {
+    TelemetryPacket_t packet, prev;
+    uint32_t pos, end;
+    uint16_t used, crc;
+    FILE* frames_out;
+    FILE* expected;
+
+    SIM_Init();
+    SIM_UartSetSink(Sink);
+    MX_USART1_UART_Init();
+    CRC32_Init();
+    COMM_Init();
+    DUMP_Init();
+    if(HIST_Init() != HAL_OK) {
+        return 1;
+    }
+
+    memset(&packet, 0, sizeof(packet));
+    for(uint32_t i = 0; i < COUNT; i++) {
+        Fill(&packet, i);
+        if(HIST_Append(&packet) != HAL_OK) {
+            return 1;
+        }
+    }
+    if(strcmp(argv[1], "dump") == 0) {
+        return Dump();
+    }
+
+    DUMP_SendRange(0, 0xFFFF);
+    Service();
+    frames_out = fopen(argv[1], "wb");
+    fwrite(tx, 1, tx_length, frames_out);
+    fclose(frames_out);
+
+    /* The firmware's reading of the same frames */
+    expected = fopen(argv[2], "wb");
+    for(pos = 0; pos + DUMP_HEADER_SIZE <= tx_length; pos = end + 2) {
+        memcpy(&used, &tx[pos + 7], sizeof(used));
+        end = pos + DUMP_HEADER_SIZE + used;
+        memcpy(&crc, &tx[end], sizeof(crc));
+        if(tx[pos] != 0xAA || tx[pos + 1] != 0x62 || crc != CRC16_Calculate(&tx[pos], end - pos)) {
+            return 1;
+        }
+        for(uint32_t r = pos + DUMP_HEADER_SIZE, first = 1; r < end; r += tx[r] + HIST_RECORD_OVERHEAD, first = 0) {
+            if(HIST_Decode(&tx[r + 1], tx[r], first ? NULL : &prev, &packet) != HAL_OK) {
+                return 1;
+            }
+            fwrite(&packet, sizeof(packet), 1, expected);
+            prev = packet;
+        }
+    }
+    fclose(expected);
+    return 0;
+}
+'''
+
+
+def split_frames(stream):
+    frames = []
+    pos = 0
+    while pos + HistoryDecoder.HEADER_SIZE <= len(stream):
+        length = int.from_bytes(stream[pos + 7:pos + 9], 'little')
+        end = pos + HistoryDecoder.HEADER_SIZE + length + 2
+        frames.append(stream[pos:end])
+        pos = end
+    return frames
+
+
+def lossy_dump(exe):
+    """DUMP_HISTORY with a quarter of the frames and a fifth of the ACKs
+    lost -> {frame number: records} of the frames passed on as new"""
+    proc = subprocess.Popen([exe, 'dump'], stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True)
+
+    def step(line):
+        proc.stdin.write(line + '\n')
+        proc.stdin.flush()
+        reply = proc.stdout.readline().split()
+        return reply[0] == '1', bytes.fromhex(reply[1]) if len(reply) > 1 else b''
+
+    decoder = HistoryDecoder()
+    receiver = DumpReceiver()
+    receiver.start(SESSION)
+    saved = {}
+    sent = acks = 0
+    replies = deque([step('T 0')])
+
+    for _ in range(1000):
+        if not replies:
+            if receiver.complete and idle:
+                break
+            replies.append(step('T 1000'))  # Let the RTO run
+        idle, stream = replies.popleft()
+        for frame in split_frames(stream):
+            sent += 1
+            if sent % 4 == 1:
+                continue
+            session, number, flags, packets = decoder.decode(frame)
+            is_new, ack = receiver.add(session, number, flags)
+            if is_new:
+                assert number not in saved
+                saved[number] = packets
+            acks += 1
+            if acks % 5 != 0:
+                replies.append(step('A %d %d %d' % DumpReceiver.ACK.unpack(ack)))
+    proc.stdin.close()
+    proc.wait()
+
+    assert receiver.complete and idle, "dump did not finish"
+    print(f"✓ Windowed dump over a lossy link: {len(saved)} frames in {sent} sends")
+    return saved
+
+
+def main():
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = build_sim_driver(DRIVER, tmp, {'COUNT': COUNT, 'SESSION': SESSION, 'SIM_TX_SIZE': 1 << 16})
+        if exe is None:
+            skip("History decode test")
+            return
+        frames_path = os.path.join(tmp, 'frames.bin')
+        expected_path = os.path.join(tmp, 'expected.bin')
+        subprocess.run([exe, frames_path, expected_path], check=True)
+        stream = open(frames_path, 'rb').read()
+        expected = open(expected_path, 'rb').read()
+        dumped = lossy_dump(exe)
+
+    size = telemetry_schema.FRAME_SIZE
+    expected = [expected[i:i + size] for i in range(0, len(expected), size)]
+    assert len(expected) == COUNT, len(expected)
+
+    frames = split_frames(stream)
+    decoder = HistoryDecoder()
+    decoded = []
+    for number, frame in enumerate(frames):
+        session, frame_number, flags, packets = decoder.decode(frame)
+        assert (session, frame_number) == (0, number)
+        assert bool(flags & HistoryDecoder.FLAG_LAST) == (number == len(frames) - 1)
+        decoded.extend(packets)
+    print(f"✓ {len(frames)} history frames decoded, {len(decoded)} records")
+
+    for i, (ours, theirs) in enumerate(zip(decoded, expected)):
+        assert ours == theirs, (i, telemetry_schema.decode(ours), telemetry_schema.decode(theirs))
+    assert len(decoded) == len(expected)
+    print("✓ Every record matches HIST_Decode bit for bit")
+
+    fields = telemetry_schema.decode(decoded[151])
+    assert fields['sequence_number'] == 154 and fields['timestamp'] == 151000
+    assert fields['latitude'] == -337000000 + 151 * 13
+
+    # Frames decode on their own, in any order; a corrupt one is dropped whole
+    again = [decoder.decode(frame)[3] for frame in reversed(frames)]
+    assert sum(reversed(again), []) == decoded
+    bad = bytearray(frames[1])
+    bad[12] ^= 0x01
+    assert decoder.decode(bytes(bad)) is None and decoder.crc_errors == 1
+
+    assert sorted(dumped) == list(range(len(frames)))
+    assert sum((dumped[n] for n in sorted(dumped)), []) == decoded
+    print("✓ Dumped records match the one-shot backfill, none saved twice")
+    print("✓ History decode test passed")
+
+
+if __name__ == '__main__':
+    main()
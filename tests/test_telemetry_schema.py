@@ -0,0 +1,116 @@
+"""Round-trip a TelemetryPacket_t through both generated telemetry_schema.py copies
+
+The frame is built by the host C compiler from Core/Inc/main.h when one is
+available (struct.pack from the header layout otherwise), so a schema that
+drifts from the packed struct fails here.
+"""
+import os
+import sys
+import struct
+import shutil
+import tempfile
+import subprocess
+import importlib.util
+from pathlib import Path
+
+ROOT = Path(__file__).parent.parent
+FIRMWARE = ROOT / 'stm32-firmware'
+COPIES = [ROOT / 'raspberry-pi-code' / 'telemetry_schema.py',
+          ROOT / 'ground-station' / 'telemetry_schema.py']
+
+sys.path.insert(0, str(FIRMWARE))
+import tlm_schema
+
+
+def load(path, name):
+    spec = importlib.util.spec_from_file_location(name, path)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def test_values(fields):
+    """A distinct value per field element, in its C type's range"""
+    values = {}
+    for i, (name, fmt, count, _) in enumerate(fields):
+        if name == 'sync1':
+            items = [0xAA]
+        elif name == 'sync2':
+            items = [0x55]
+        elif name == 'checksum':
+            items = [0]
+        elif fmt == 'f':
+            items = [i + 0.25 * (k + 1) for k in range(count)]  # Exact in float32
+        elif fmt in 'bhi':
+            items = [-(i + k + 1) for k in range(count)]
+        else:
+            mask = (1 << (8 * struct.calcsize(fmt))) - 1
+            items = [(0x5A + i * 37 + k) & mask for k in range(count)]
+        values[name] = items[0] if count == 1 else items
+    return values
+
+
+def c_frame(fields, values):
+    """The packed struct as the firmware lays it out, None without a compiler"""
+    cc = shutil.which(os.environ.get('CC', 'cc'))
+    if cc is None:
+        return None
+
+    lines = ['#include <stdio.h>', '#include "main.h"', 'int main(void) {',
+             '    TelemetryPacket_t p = {0};']
+    for name, fmt, count, _ in fields:
+        items = values[name] if count > 1 else [values[name]]
+        for k, v in enumerate(items):
+            index = f'[{k}]' if count > 1 else ''
+            lines.append(f'    p.{name}{index} = {v!r}{"f" if fmt == "f" else ""};')
+    lines += ['    fwrite(&p, sizeof(p), 1, stdout);', '    return 0;', '}']
+
+    with tempfile.TemporaryDirectory() as tmp:
+        src = os.path.join(tmp, 'pack.c')
+        exe = os.path.join(tmp, 'pack')
+        with open(src, 'w') as f:
+            f.write('\n'.join(lines) + '\n')
+        subprocess.run([cc, '-DSTM32F401xE', f'-I{FIRMWARE / "Sim" / "Inc"}',
+                        f'-I{FIRMWARE / "Core" / "Inc"}', src, '-o', exe], check=True)
+        return subprocess.run([exe], check=True, stdout=subprocess.PIPE).stdout
+
+
+def py_frame(fields, values):
+    flat = []
+    for name, _, count, _ in fields:
+        flat.extend(values[name] if count > 1 else [values[name]])
+    return struct.pack(tlm_schema.layout_format(fields), *flat)
+
+
+def main():
+    fields = tlm_schema.read_layout(tlm_schema.HEADER)
+    values = test_values(fields)
+
+    frame = c_frame(fields, values)
+    source = 'C compiler'
+    if frame is None:
+        frame = py_frame(fields, values)
+        source = 'struct.pack (no C compiler)'
+    print(f"✓ Packed TelemetryPacket_t with {source}: {len(frame)} bytes")
+
+    for index, path in enumerate(COPIES):
+        schema = load(path, f'telemetry_schema_{index}')
+        assert len(frame) == schema.FRAME_SIZE, (path, len(frame), schema.FRAME_SIZE)
+
+        crc = schema.crc16(frame[:-2])
+        frame = frame[:-2] + struct.pack('<H', crc)
+        expected = dict(values, checksum=crc)
+
+        # Sync word as the Pi and the ground station read it
+        assert struct.unpack('>H', frame[0:2])[0] == schema.SYNC
+
+        decoded = schema.decode(frame)
+        assert decoded == expected, (path, decoded)
+        assert schema.decode(frame[:-1] + bytes([frame[-1] ^ 1])) is None
+        print(f"✓ decode() round trip: {path.relative_to(ROOT)}")
+
+    print("✓ Telemetry schema test passed")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,110 @@
+"""Check that the tickless idle hook enters STOP only when it should
+
+A host driver, linked against the Sim build of the firmware, calls
+vPortSuppressTicksAndSleep as the FreeRTOS idle task would, in and out
+of STATE_LOW_POWER, for short idles, with the kernel refusing to sleep
+and with a UART transfer in flight. STOP has to be entered exactly in
+the low-power case, the tick stepped over the time the RTC says passed,
+and GET_DIAGNOSTICS has to report the entries and the time in STOP.
+Needs a C compiler and make; skipped without them.
+"""
+import sys
+import struct
+import tempfile
+
+from sim_driver import ROOT, build_sim_driver, run_cases, skip
+
+sys.path.insert(0, str(ROOT / 'ground-station'))
+import telemetry_schema
+
+DRIVER = r'''
+#include "system.h"
+#include "diag.h"
+#include "communication.h"
+
+void MX_USART1_UART_Init(void);
+void MX_USART2_UART_Init(void);
+void MX_RTC_Init(void);
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime);
+
+/* One case per stdin line: state idle_ms allow_sleep uart_busy;
+ * answers "<STOP calls> <ticks slept>", then the diag report in hex */
+int main(void) {
+    unsigned state, idle, allow, busy;
+    uint32_t start;
+
+    SIM_Init();
+    SIM_UartSetSink(Sink);
+    MX_USART1_UART_Init();
+    MX_USART2_UART_Init();
+    MX_RTC_Init();
+    COMM_Init();
+    hi2c1.State = HAL_I2C_STATE_READY;
+    hspi1.State = HAL_SPI_STATE_READY;
+
+    while(scanf("%u %u %u %u", &state, &idle, &allow, &busy) == 4) {
+        system_state = (uint8_t)state;
+        SIM_AllowSleep((uint8_t)allow);
+        huart2.gState = busy ? HAL_UART_STATE_BUSY_TX : HAL_UART_STATE_READY;
+        start = SIM_Tick();
+        uint32_t stops = SIM_StopCount();
+        vPortSuppressTicksAndSleep(idle);
+        printf("%u %u\n", SIM_StopCount() - stops, SIM_Tick() - start);
+    }
+    huart2.gState = HAL_UART_STATE_READY;
+
+    tx_length = 0;
+    DIAG_SendReport(1);
+    SIM_UartDrain(&huart1);
+    PrintTx();
+    printf("\n");
+    return 0;
+}
+'''
+
+NOMINAL, LOW_POWER = 0x02, 0x04
+
+# state, idle ms, kernel lets it sleep, UART TX in flight -> STOP entered
+CASES = [
+    ((NOMINAL, 100, 1, 0), False),
+    ((LOW_POWER, 3, 1, 0), False),      # Under POWER_MIN_STOP_MS: WFI
+    ((LOW_POWER, 100, 0, 0), False),    # A task woke while masking
+    ((LOW_POWER, 100, 1, 1), False),    # DMA would halt mid-transfer
+    ((LOW_POWER, 100, 1, 0), True),
+    ((LOW_POWER, 40000, 1, 0), True),   # Capped at the 16-bit wakeup counter
+]
+WAKE_MARGIN_MS = 2                      # POWER_STOP_WAKE_MARGIN_MS
+MAX_STOP_MS = 0xFFFF * 1000 // 2000     # Wakeup counter at RTCCLK / 16
+
+
+def main():
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = build_sim_driver(DRIVER, tmp)
+        if exe is None:
+            skip("Tickless STOP test")
+            return
+        out = run_cases(exe, [case for case, _ in CASES])
+
+    entries = stop_ms = 0
+    for (case, stops), line in zip(CASES, out):
+        calls, slept = map(int, line.split())
+        assert calls == int(stops), (case, calls)
+        if stops:
+            expected = min(case[1] - WAKE_MARGIN_MS, MAX_STOP_MS)
+            assert slept == expected, (case, slept, expected)
+            entries += 1
+            stop_ms += slept
+        else:
+            assert slept == 0, (case, slept)
+    print(f"✓ STOP entered in {entries} of {len(CASES)} idles, only in STATE_LOW_POWER")
+
+    report = bytes.fromhex(out[len(CASES)])
+    assert report[:2] == b'\xaa\x5e'
+    assert struct.unpack_from('<H', report, len(report) - 2)[0] == telemetry_schema.crc16(report[:-2])
+    assert struct.unpack_from('<II', report, len(report) - 10) == (entries, stop_ms)
+    print(f"✓ GET_DIAGNOSTICS reports {entries} STOP entries, {stop_ms} ms in STOP")
+    print("✓ Tickless STOP test passed")
+
+
+if __name__ == '__main__':
+    main()